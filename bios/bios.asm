@@ -53,11 +53,7 @@
 
 %define COM1_IOBASE 0x3F8
 %define COM2_IOBASE 0x2F8
-%define COM3_IOBASE 0x3E8
-%define COM4_IOBASE 0x2E8
-%define LPT1_IOBASE 0x3BC
-%define LPT2_IOBASE 0x378
-%define LPT3_IOBASE 0x278
+%define LPT1_IOBASE 0x378
 
 %macro stub 1
     push    ax
@@ -496,11 +492,11 @@ _bios_init_data:
 
     mov     [BDA_COM1_IOBASE], word COM1_IOBASE
     mov     [BDA_COM2_IOBASE], word COM2_IOBASE
-    mov     [BDA_COM3_IOBASE], word COM3_IOBASE
-    mov     [BDA_COM4_IOBASE], word COM4_IOBASE
+    mov     [BDA_COM3_IOBASE], word 0
+    mov     [BDA_COM4_IOBASE], word 0
     mov     [BDA_LPT1_IOBASE], word LPT1_IOBASE
-    mov     [BDA_LPT2_IOBASE], word LPT2_IOBASE
-    mov     [BDA_LPT3_IOBASE], word LPT3_IOBASE
+    mov     [BDA_LPT2_IOBASE], word 0
+    mov     [BDA_LPT3_IOBASE], word 0
 
     call    check_for_8086
     je      .print8086
@@ -556,7 +552,7 @@ _bios_init_data:
 ;   mov     word [0x0410], 0000000100100000b
 ;                                  xx     x   floppies
     mov     cx, 0000000100100000b
-    mov     cx, 0000000100100101b
+    mov     cx, 0100010100100101b   ; one printer, two serial ports
     ; No DMA
     ; 80x25 color
 ; ------------------------------------------------------
@@ -1085,27 +1081,18 @@ _bios_interrupt16:
     iret
 
 _bios_interrupt17:
-    or      ah, 0x00
-    jz      .printChar              ; echo $c > prn (!)
-    cmp     ah, 0x01
-    je      .fn0x01
     cmp     ah, 0x02
-    je      .fn0x02
-    stub    0x17
-    jmp     .end
-.printChar:
-    push    cx
+    ja      .unsupported
+    push    cx                      ; 1700 print, 1701 init, 1702 status
     mov     cl, al
-    mov     ax, 0x1700
+    mov     al, ah
+    mov     ah, 0x17
     out     LEGACY_VM_CALL, al
+    mov     al, cl
     pop     cx
-    jmp     .end
-.fn0x01:
-    mov     ah, 0x00
-    jmp     .end
-.fn0x02:
-    mov     ah, 0x00                ; Zeroes. No fucking printer here, dude.
-.end:
+    iret
+.unsupported:
+    stub    0x17
     iret
 
 _bios_interrupt1a:
@@ -45,10 +45,18 @@ HEADERS += gui/machinewidget.h \
            gui/screen.h \
            gui/worker.h \
            gui/Renderer.h \
+           gui/RenderThread.h \
+           gui/FrameCapture.h \
+           hw/FrameSnapshot.h \
+           hw/BlockCache.h \
+           hw/DiskImage.h \
+           hw/GuestMemory.h \
            hw/MemoryProvider.h \
            hw/ROM.h \
            hw/SimpleMemoryProvider.h \
            hw/DiskDrive.h \
+           hw/OverlayDiskImage.h \
+           hw/dma.h \
            hw/fdc.h \
            hw/ide.h \
            hw/iodevice.h \
@@ -58,10 +66,15 @@ HEADERS += gui/machinewidget.h \
            hw/pic.h \
            hw/pit.h \
            hw/vga.h \
+           hw/vbe.h \
            hw/PS2.h \
            hw/busmouse.h \
+           hw/InputQueue.h \
            hw/MouseObserver.h \
-           hw/ThreadedTimer.h \
+           hw/TimerService.h \
+           hw/SerialBackend.h \
+           hw/SerialPort.h \
+           hw/ParallelPort.h \
            include/debugger.h \
            include/types.h \
            include/debug.h \
@@ -70,6 +83,8 @@ HEADERS += gui/machinewidget.h \
            include/templates.h \
            include/Common.h \
            include/OwnPtr.h \
+           include/TripleBuffer.h \
+           include/SPSCQueue.h \
            x86/CPU.h \
            x86/Descriptor.h \
            x86/Instruction.h \
@@ -106,20 +121,32 @@ SOURCES += debug.cpp \
            gui/screen.cpp \
            gui/worker.cpp \
            gui/Renderer.cpp \
+           gui/RenderThread.cpp \
+           gui/FrameCapture.cpp \
            hw/busmouse.cpp \
+           hw/dma.cpp \
            hw/fdc.cpp \
            hw/ide.cpp \
            hw/keyboard.cpp \
            hw/pic.cpp \
            hw/pit.cpp \
            hw/vga.cpp \
+           hw/vbe.cpp \
            hw/vomctl.cpp \
            hw/iodevice.cpp \
            hw/cmos.cpp \
            hw/PS2.cpp \
+           hw/GuestMemory.cpp \
            hw/MemoryProvider.cpp \
            hw/ROM.cpp \
            hw/SimpleMemoryProvider.cpp \
            hw/DiskDrive.cpp \
+           hw/BlockCache.cpp \
+           hw/DiskImage.cpp \
+           hw/OverlayDiskImage.cpp \
+           hw/InputQueue.cpp \
            hw/MouseObserver.cpp \
-           hw/ThreadedTimer.cpp
+           hw/TimerService.cpp \
+           hw/SerialBackend.cpp \
+           hw/SerialPort.cpp \
+           hw/ParallelPort.cpp
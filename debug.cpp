@@ -64,6 +64,8 @@ void vlog(VLogChannel channel, const char* format, ...)
     case LogScreen: prefix = "screen"; break;
     case LogFPU: prefix = "fpu"; break;
     case LogTimer: prefix = "timer"; break;
+    case LogDMA: prefix = "dma"; break;
+    case LogSerial: prefix = "serial"; break;
 #ifdef DEBUG_SERENITY
     case LogSerenity: prefix = "serenity"; break;
 #endif
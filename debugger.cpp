@@ -30,6 +30,10 @@
 #include "machine.h"
 #include "pic.h"
 #include "vga.h"
+#include "InputQueue.h"
+#include "TimerService.h"
+#include "SerialPort.h"
+#include "ParallelPort.h"
 #include <QDebug>
 #include <QStringBuilder>
 #include <QStringList>
@@ -180,6 +184,65 @@ void Debugger::handleCommand(const QString& rawCommand)
         return;
     }
 
+    if (lowerCommand == "vm86") {
+        cpu().dumpVM86Statistics();
+        return;
+    }
+
+    if (lowerCommand == "input") {
+        cpu().machine().inputQueue().dumpStatistics();
+        return;
+    }
+
+    if (lowerCommand == "serial") {
+        cpu().machine().serialPort(0).dumpStatistics();
+        cpu().machine().serialPort(1).dumpStatistics();
+        return;
+    }
+
+    if (lowerCommand == "parallel") {
+        cpu().machine().parallelPort().dumpStatistics();
+        return;
+    }
+
+    if (lowerCommand == "checkpoint" || lowerCommand == "restore") {
+        auto& memory = cpu().guestMemory();
+        if (!memory.canCheckpoint()) {
+            vlog(LogDump, "Guest RAM backing doesn't support checkpoints");
+            return;
+        }
+        if (lowerCommand == "restore") {
+            memory.restoreCheckpoint();
+            vlog(LogDump, "Guest RAM restored to the last checkpoint");
+        } else {
+            unsigned pages = memory.dirtyPageCount();
+            if (memory.checkpoint())
+                vlog(LogDump, "Guest RAM checkpointed (%u dirty pages)", pages);
+        }
+        return;
+    }
+
+    if (lowerCommand == "fork") {
+        if (cpu().forkGuestMemory())
+            vlog(LogDump, "Running on a fork of the last guest RAM checkpoint");
+        else
+            vlog(LogDump, "Can't fork guest RAM");
+        return;
+    }
+
+    if (lowerCommand == "join") {
+        if (cpu().joinGuestMemoryFork())
+            vlog(LogDump, "Guest RAM fork discarded");
+        else
+            vlog(LogDump, "Guest RAM isn't forked");
+        return;
+    }
+
+    if (lowerCommand == "timers") {
+        cpu().machine().timerService().dumpStatistics();
+        return;
+    }
+
     if (lowerCommand == "sti") {
         vlog(LogDump, "IF <- 1");
         cpu().setIF(1);
@@ -0,0 +1,149 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "FrameCapture.h"
+#include "CPU.h"
+#include "FrameSnapshot.h"
+#include "machine.h"
+#include "vbe.h"
+#include "vga.h"
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <algorithm>
+#include <stdlib.h>
+
+FrameCapture::FrameCapture(Machine& machine)
+    : m_machine(machine)
+    , m_cycles(options.captureCycles)
+{
+    std::sort(m_cycles.begin(), m_cycles.end());
+    QDir().mkpath(options.captureDirectory);
+    scheduleNext();
+}
+
+FrameCapture::~FrameCapture()
+{
+}
+
+void FrameCapture::scheduleNext()
+{
+    if (m_nextIndex < m_cycles.size())
+        m_machine.cpu().setNextFrameCaptureCycle(m_cycles[m_nextIndex++]);
+}
+
+QString FrameCapture::fileNameFor(QWORD cycle, const QImage& image) const
+{
+    if (options.captureFormat == "raw")
+        return QString("frame-%1-%2x%3.raw").arg(cycle).arg(image.width()).arg(image.height());
+    return QString("frame-%1.png").arg(cycle);
+}
+
+void FrameCapture::capture()
+{
+    // Frames are named after the requested cycle, so reference file names don't depend on
+    // how far past it the instruction boundary fell.
+    QWORD cycle = m_cycles[m_nextIndex - 1];
+
+    FrameSnapshot snapshot;
+    m_machine.vga().captureFrame(snapshot);
+    m_machine.vbe().captureFrame(snapshot);
+
+    QElapsedTimer timer;
+    timer.start();
+    QImage image;
+    m_renderers.rendererFor(snapshot).render(snapshot, image);
+    qint64 renderTime = timer.nsecsElapsed();
+
+    image = image.convertToFormat(QImage::Format_RGB32);
+    QString fileName = fileNameFor(cycle, image);
+    QString path = QDir(options.captureDirectory).filePath(fileName);
+
+    bool saved;
+    if (options.captureFormat == "raw") {
+        QFile file(path);
+        saved = file.open(QIODevice::WriteOnly) && file.write(reinterpret_cast<const char*>(image.constBits()), image.width() * image.height() * 4) == image.width() * image.height() * 4;
+    } else {
+        saved = image.save(path, "PNG");
+    }
+    if (!saved)
+        vlog(LogScreen, "Failed to write frame capture %s", qPrintable(path));
+
+    if (options.benchmark)
+        printf("%s: rendered in %lld us\n", qPrintable(fileName), (long long)(renderTime / 1000));
+
+    if (!options.captureReference.isEmpty() && !compareWithReference(fileName, image))
+        hard_exit(1);
+
+    scheduleNext();
+}
+
+bool FrameCapture::compareWithReference(const QString& fileName, const QImage& image)
+{
+    QString path = QDir(options.captureReference).filePath(fileName);
+    if (!QFile::exists(path)) {
+        printf("FAIL: %s (no reference frame)\n", qPrintable(fileName));
+        return false;
+    }
+
+    QImage reference;
+    if (options.captureFormat == "raw") {
+        QFile file(path);
+        if (file.open(QIODevice::ReadOnly)) {
+            QByteArray data = file.readAll();
+            if (data.size() == image.width() * image.height() * 4)
+                reference = QImage(reinterpret_cast<const uchar*>(data.constData()), image.width(), image.height(), QImage::Format_RGB32).copy();
+        }
+    } else {
+        reference = QImage(path).convertToFormat(QImage::Format_RGB32);
+    }
+
+    if (reference.size() != image.size()) {
+        printf("FAIL: %s (size %dx%d, expected %dx%d)\n", qPrintable(fileName), image.width(), image.height(), reference.width(), reference.height());
+        return false;
+    }
+
+    // A pixel differs if any of its channels is off by more than the tolerance.
+    int tolerance = options.captureTolerance;
+    int differingPixels = 0;
+    for (int y = 0; y < image.height(); ++y) {
+        auto* actual = reinterpret_cast<const DWORD*>(image.constScanLine(y));
+        auto* expected = reinterpret_cast<const DWORD*>(reference.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            for (int shift = 0; shift < 24; shift += 8) {
+                if (abs((int)((actual[x] >> shift) & 0xff) - (int)((expected[x] >> shift) & 0xff)) > tolerance) {
+                    ++differingPixels;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (differingPixels) {
+        printf("FAIL: %s (%d pixels differ by more than %d)\n", qPrintable(fileName), differingPixels, tolerance);
+        return false;
+    }
+    printf("PASS: %s\n", qPrintable(fileName));
+    return true;
+}
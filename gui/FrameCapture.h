@@ -24,46 +24,31 @@
 
 #pragma once
 
+#include "Renderer.h"
 #include "types.h"
-#include <QThread>
+#include <QtCore/QString>
+#include <vector>
 
-class ThreadedTimerHelper;
+class Machine;
 
-class ThreadedTimer final : public QThread {
-    Q_OBJECT
+// Renders frames at given virtual times (instruction counts) without any GUI, saves them
+// as PNG or raw RGB32 files, and optionally compares them against reference images.
+// Driven by the --capture-* options, used for headless renderer tests and benchmarks.
+class FrameCapture {
 public:
-    class Listener {
-    public:
-        virtual ~Listener();
-        virtual void threadedTimerFired(Badge<ThreadedTimer>) = 0;
-    };
+    explicit FrameCapture(Machine&);
+    ~FrameCapture();
 
-    explicit ThreadedTimer(Listener&, int ms);
-    virtual ~ThreadedTimer();
+    // Called by the CPU once the cycle passed to CPU::setNextFrameCaptureCycle() is reached.
+    void capture();
 
 private:
-    friend class ThreadedTimerHelper;
-    virtual void run() override;
-    void helperTimerFired();
-    Listener& m_listener;
-    int m_ms { 0 };
+    QString fileNameFor(QWORD cycle, const QImage&) const;
+    bool compareWithReference(const QString& fileName, const QImage&);
+    void scheduleNext();
+
+    Machine& m_machine;
+    RendererSet m_renderers;
+    std::vector<QWORD> m_cycles;
+    size_t m_nextIndex { 0 };
 };
-
-class ThreadedTimerHelper : public QObject {
-    Q_OBJECT
-public:
-    explicit ThreadedTimerHelper(ThreadedTimer& threadedTimer, int ms)
-        : m_threadedTimer(threadedTimer)
-    {
-        startTimer(ms);
-    }
-
-    virtual void timerEvent(QTimerEvent*) override
-    {
-        m_threadedTimer.helperTimerFired();
-    }
-
-private:
-    ThreadedTimer& m_threadedTimer;
-};
-
@@ -0,0 +1,107 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "RenderThread.h"
+#include "Common.h"
+#include "FrameSnapshot.h"
+#include "debug.h"
+#include "machine.h"
+#include <QtCore/QMutexLocker>
+#include <chrono>
+
+static const QWORD framesPerStatistics = 300;
+
+RenderThread::RenderThread(Machine& machine, QObject& receiver)
+    : QThread(nullptr)
+    , m_machine(machine)
+    , m_receiver(receiver)
+{
+    start();
+}
+
+RenderThread::~RenderThread()
+{
+    shutdown();
+}
+
+void RenderThread::frameAvailable()
+{
+    QMutexLocker locker(&m_mutex);
+    m_frameAvailable = true;
+    m_condition.wakeOne();
+}
+
+void RenderThread::shutdown()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_shouldExit = true;
+        m_condition.wakeOne();
+    }
+    wait();
+}
+
+void RenderThread::run()
+{
+    forever {
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_frameAvailable && !m_shouldExit)
+                m_condition.wait(&m_mutex);
+            if (m_shouldExit)
+                return;
+            m_frameAvailable = false;
+        }
+
+        if (!m_machine.frames().take())
+            continue;
+
+        const auto& snapshot = m_machine.frames().front();
+        auto& renderer = m_renderers.rendererFor(snapshot);
+        auto& frame = m_renderedFrames.back();
+        renderer.render(snapshot, frame.image);
+        frame.scale = renderer.scale();
+        frame.serial = snapshot.serial;
+        m_renderedFrames.publish();
+
+        QMetaObject::invokeMethod(&m_receiver, "frameReady", Qt::QueuedConnection);
+
+        didRenderFrame(snapshot);
+    }
+}
+
+void RenderThread::didRenderFrame(const FrameSnapshot& snapshot)
+{
+    QWORD now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    QWORD latency = now - snapshot.timestamp;
+    m_totalLatency += latency;
+    m_worstLatency = std::max(m_worstLatency, latency);
+
+    if (++m_frameCount % framesPerStatistics)
+        return;
+    if (options.vgadebug)
+        vlog(LogScreen, "Frame latency over %llu frames: %llu us average, %llu us worst", (unsigned long long)framesPerStatistics, (unsigned long long)(m_totalLatency / framesPerStatistics / 1000), (unsigned long long)(m_worstLatency / 1000));
+    m_totalLatency = 0;
+    m_worstLatency = 0;
+}
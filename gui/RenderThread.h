@@ -0,0 +1,80 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "Renderer.h"
+#include "TripleBuffer.h"
+#include "types.h"
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QImage>
+
+class Machine;
+class QObject;
+
+struct RenderedFrame {
+    QImage image;
+    int scale { 1 };
+    QWORD serial { 0 };
+};
+
+// Turns the FrameSnapshots published by the machine into images, away from both the
+// emulation and GUI threads. Finished frames are handed over through renderedFrames(),
+// and announced by queueing a call to the receiver's frameReady() slot.
+class RenderThread final : public QThread {
+    Q_OBJECT
+public:
+    RenderThread(Machine&, QObject& receiver);
+    virtual ~RenderThread() override;
+
+    // Called on the emulation thread after a snapshot has been published.
+    void frameAvailable();
+
+    void shutdown();
+
+    TripleBuffer<RenderedFrame>& renderedFrames() { return m_renderedFrames; }
+
+private:
+    virtual void run() override;
+    void didRenderFrame(const FrameSnapshot&);
+
+    Machine& m_machine;
+    QObject& m_receiver;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    bool m_frameAvailable { false };
+    bool m_shouldExit { false };
+
+    TripleBuffer<RenderedFrame> m_renderedFrames;
+
+    RendererSet m_renderers;
+
+    // Time from capture to finished image, in nanoseconds.
+    QWORD m_frameCount { 0 };
+    QWORD m_totalLatency { 0 };
+    QWORD m_worstLatency { 0 };
+};
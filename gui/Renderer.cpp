@@ -24,59 +24,86 @@
 
 #include "Common.h"
 #include "Renderer.h"
-#include "CPU.h"
-#include "machine.h"
-#include "screen.h"
-#include "vga.h"
-#include <QPainter>
+#include "FrameSnapshot.h"
+#include <string.h>
 
-struct fontcharbitmap_t {
-    BYTE data[16];
-};
+void Renderer::prepareImage(QImage& image, int width, int height, QImage::Format format)
+{
+    if (image.width() != width || image.height() != height || image.format() != format)
+        image = QImage(width, height, format);
+}
 
-const Screen& Renderer::screen() const
+BufferedRenderer::BufferedRenderer(int width, int height, int scale)
+    : m_width(width)
+    , m_height(height)
+    , m_scale(scale)
 {
-    return m_screen;
 }
 
-const VGA& Renderer::vga() const
+void BufferedRenderer::prepareImage(QImage& image, const DWORD* colors, int colorCount)
 {
-    return m_screen.machine().vga();
+    Renderer::prepareImage(image, m_width, m_height, QImage::Format_Indexed8);
+    image.setColorCount(colorCount);
+    for (int i = 0; i < colorCount; ++i)
+        image.setColor(i, colors[i]);
 }
 
-BufferedRenderer::BufferedRenderer(Screen& screen, int width, int height, int scale)
-    : Renderer(screen)
-    , m_buffer(width, height, QImage::Format_Indexed8)
-    , m_scale(scale)
+void DummyRenderer::render(const FrameSnapshot&, QImage& image)
 {
-    m_buffer.fill(0);
+    prepareImage(image, 640, 400, QImage::Format_RGB32);
+    image.fill(0);
 }
 
-Mode04Renderer::Mode04Renderer(Screen& screen)
-    : BufferedRenderer(screen, 320, 200, 2)
+void TextRenderer::putCharacter(QImage& image, const FrameSnapshot& frame, int row, int column, BYTE color, BYTE character)
 {
-    m_buffer.setColor(0, QColor(Qt::black).rgb());
-    m_buffer.setColor(1, QColor(Qt::cyan).rgb());
-    m_buffer.setColor(2, QColor(Qt::magenta).rgb());
-    m_buffer.setColor(3, QColor(Qt::white).rgb());
+    DWORD foreground = frame.paletteColor[color & 0xf];
+    DWORD background = frame.paletteColor[color >> 4];
+    const BYTE* glyph = &frame.font[character * 16];
+
+    for (int y = 0; y < m_characterHeight; ++y) {
+        auto* px = reinterpret_cast<DWORD*>(image.scanLine(row * m_characterHeight + y)) + column * m_characterWidth;
+        BYTE bits = glyph[y];
+        for (int x = 0; x < m_characterWidth; ++x)
+            *(px++) = (bits & (0x80 >> x)) ? foreground : background;
+    }
 }
 
-void TextRenderer::putCharacter(QPainter& p, int row, int column, BYTE color, BYTE character)
+void TextRenderer::render(const FrameSnapshot& frame, QImage& image)
 {
-    int x = column * m_characterWidth;
-    int y = row * m_characterHeight;
+    prepareImage(image, m_characterWidth * m_columns, m_characterHeight * m_rows, QImage::Format_RGB32);
+
+    const BYTE* text_ptr = frame.vgaMemory.data() + frame.startAddress * 2;
 
-    p.setBackground(m_brush[color >> 4]);
-    p.eraseRect(x, y, m_characterWidth, m_characterHeight);
-    p.setPen(m_color[color & 0xf]);
-    p.drawPixmap(x, y, m_character[character]);
+    for (int y = 0; y < m_rows; ++y) {
+        for (int x = 0; x < m_columns; ++x) {
+            putCharacter(image, frame, y, x, text_ptr[1], text_ptr[0]);
+            text_ptr += 2;
+        }
+    }
+
+    if (frame.cursorEnabled) {
+        WORD raw_cursor = frame.cursorLocation - frame.startAddress;
+        WORD screen_columns = frame.columns;
+        int row = screen_columns ? (raw_cursor / screen_columns) : 0;
+        int column = screen_columns ? (raw_cursor % screen_columns) : 0;
+        if (row >= m_rows || column >= m_columns)
+            return;
+        for (int y = frame.cursorStartScanline; y < frame.cursorEndScanline && y < m_characterHeight; ++y) {
+            auto* px = reinterpret_cast<DWORD*>(image.scanLine(row * m_characterHeight + y)) + column * m_characterWidth;
+            for (int x = 0; x < m_characterWidth; ++x)
+                *(px++) = frame.paletteColor[14];
+        }
+    }
 }
 
-void Mode04Renderer::render()
+void Mode04Renderer::render(const FrameSnapshot& frame, QImage& image)
 {
-    const BYTE* video_memory = vga().text_memory() + vga().start_address();
+    static const DWORD colors[4] = { 0xff000000, 0xff00ffff, 0xffff00ff, 0xffffffff };
+    prepareImage(image, colors, 4);
+
+    const BYTE* video_memory = frame.vgaMemory.data() + frame.startAddress;
     for (unsigned scanLine = 0; scanLine < 200; ++scanLine) {
-        BYTE* out = m_buffer.scanLine(scanLine);
+        BYTE* out = image.scanLine(scanLine);
         const BYTE* in = video_memory;
         if ((scanLine & 1))
             in += 0x2000;
@@ -90,18 +117,19 @@ void Mode04Renderer::render()
     }
 }
 
-void Mode12Renderer::render()
+void Mode12Renderer::render(const FrameSnapshot& frame, QImage& image)
 {
-    const BYTE *p0 = vga().plane(0);
-    const BYTE *p1 = vga().plane(1);
-    const BYTE *p2 = vga().plane(2);
-    const BYTE *p3 = vga().plane(3);
+    prepareImage(image, frame.paletteColor, 16);
+
+    const BYTE *p0 = frame.plane(0);
+    const BYTE *p1 = frame.plane(1);
+    const BYTE *p2 = frame.plane(2);
+    const BYTE *p3 = frame.plane(3);
 
     int offset = 0;
 
-    BYTE* bits = bufferBits();
     for (int y = 0; y < 480; ++y) {
-        BYTE* px = &bits[y*640];
+        BYTE* px = image.scanLine(y);
 
         for (int x = 0; x < 640; x += 8, ++offset) {
 #define D(i) ((p0[offset]>>i) & 1) | (((p1[offset]>>i) & 1)<<1) | (((p2[offset]>>i) & 1)<<2) | (((p3[offset]>>i) & 1)<<3)
@@ -117,25 +145,25 @@ void Mode12Renderer::render()
     }
 }
 
-void Mode0DRenderer::render()
+void Mode0DRenderer::render(const FrameSnapshot& frame, QImage& image)
 {
-    const BYTE *p0 = vga().plane(0);
-    const BYTE *p1 = vga().plane(1);
-    const BYTE *p2 = vga().plane(2);
-    const BYTE *p3 = vga().plane(3);
+    prepareImage(image, frame.paletteColor, 16);
 
-    WORD start_address = vga().start_address();
+    const BYTE *p0 = frame.plane(0);
+    const BYTE *p1 = frame.plane(1);
+    const BYTE *p2 = frame.plane(2);
+    const BYTE *p3 = frame.plane(3);
+
+    WORD start_address = frame.startAddress;
     p0 += start_address;
     p1 += start_address;
     p2 += start_address;
     p3 += start_address;
 
-    BYTE* bits = bufferBits();
     int offset = 0;
 
     for (int y = 0; y < 200; ++y) {
-        BYTE* px = &bits[y*320];
-#define A0D(i) ((p0[offset]>>i) & 1) | (((p1[offset]>>i) & 1)<<1) | (((p2[offset]>>i) & 1)<<2) | (((p3[offset]>>i) & 1)<<3)
+        BYTE* px = image.scanLine(y);
         for (int x = 0; x < 320; x += 8, ++offset) {
             *(px++) = D(7);
             *(px++) = D(6);
@@ -149,45 +177,19 @@ void Mode0DRenderer::render()
     }
 }
 
-void BufferedRenderer::willBecomeActive()
-{
-    const_cast<Screen&>(screen()).setScreenSize(m_buffer.width() * m_scale, m_buffer.height() * m_scale);
-}
-
-void BufferedRenderer::paint(QPainter& p)
-{
-    p.drawImage(QRect(0, 0, m_buffer.width() * m_scale, m_buffer.height() * m_scale), m_buffer);
-}
-
-void Mode0DRenderer::synchronizeColors()
-{
-    for (unsigned i = 0; i < 16; ++i)
-        m_buffer.setColor(i, vga().paletteColor(i).rgb());
-}
-
-void Mode12Renderer::synchronizeColors()
+void Mode13Renderer::render(const FrameSnapshot& frame, QImage& image)
 {
-    for (unsigned i = 0; i < 16; ++i)
-        m_buffer.setColor(i, vga().paletteColor(i).rgb());
-}
+    prepareImage(image, frame.color, 256);
 
-void Mode13Renderer::synchronizeColors()
-{
-    for (unsigned i = 0; i < 256; ++i)
-        m_buffer.setColor(i, vga().color(i).rgb());
-}
-
-void Mode13Renderer::render()
-{
-    const BYTE* videoMemory = vga().plane(0) + vga().start_address();
+    const BYTE* videoMemory = frame.plane(0) + frame.startAddress;
 
     ValueSize mode;
-    DWORD lineOffset = vga().readRegister(0x13);
+    DWORD lineOffset = frame.crtc[0x13];
 
-    if (vga().readRegister(0x14) & 0x40) {
+    if (frame.crtc[0x14] & 0x40) {
         mode = DWordSize;
         lineOffset <<= 3;
-    } else if (vga().readRegister(0x17) & 0x40) {
+    } else if (frame.crtc[0x17] & 0x40) {
         mode = ByteSize;
         lineOffset <<= 1;
     } else {
@@ -195,86 +197,89 @@ void Mode13Renderer::render()
         lineOffset <<= 2;
     }
 
-    auto* bits = bufferBits();
-    auto* bit = bits;
-
-    if (mode == ByteSize) {
-        for (unsigned y = 0; y < 200; ++y) {
-            for (unsigned x = 0; x < 320; ++x) {
-                BYTE plane = x % 4;
-                DWORD byteOffset = (plane * 65536) + (y * lineOffset) + (x >> 2);
-                *(bit++) = videoMemory[byteOffset];
-            }
-        }
-    } else if (mode == WordSize) {
-        for (unsigned y = 0; y < 200; ++y) {
-            for (unsigned x = 0; x < 320; ++x) {
-                BYTE plane = x % 4;
-                DWORD byteOffset = (plane * 65536) + (y * lineOffset) + ((x >> 1) & ~1);
-                *(bit++) = videoMemory[byteOffset];
-            }
-        }
-    } else if (mode == DWordSize) {
-        for (unsigned y = 0; y < 200; ++y) {
-            for (unsigned x = 0; x < 320; ++x) {
-                BYTE plane = x % 4;
-                DWORD byteOffset = (plane * 65536) + (y * lineOffset) + (x & ~3);
-                *(bit++) = videoMemory[byteOffset];
-            }
+    for (unsigned y = 0; y < 200; ++y) {
+        BYTE* bit = image.scanLine(y);
+        for (unsigned x = 0; x < 320; ++x) {
+            BYTE plane = x % 4;
+            DWORD byteOffset = (plane * 65536) + (y * lineOffset);
+            if (mode == ByteSize)
+                byteOffset += x >> 2;
+            else if (mode == WordSize)
+                byteOffset += (x >> 1) & ~1;
+            else
+                byteOffset += x & ~3;
+            // The start address can push the last lines past the end of VGA memory.
+            *(bit++) = byteOffset + frame.startAddress < 0x40000 ? videoMemory[byteOffset] : 0;
         }
     }
 }
 
-void TextRenderer::willBecomeActive()
+void VBERenderer::render(const FrameSnapshot& frame, QImage& image)
 {
-    const_cast<Screen&>(screen()).setScreenSize(m_characterWidth * m_columns, m_characterHeight * m_rows);
-}
+    auto& vbe = frame.vbe;
+
+    QImage::Format format;
+    switch (vbe.bitsPerPixel) {
+    case 8:
+        format = QImage::Format_Indexed8;
+        break;
+    case 15:
+        format = QImage::Format_RGB555;
+        break;
+    case 16:
+        format = QImage::Format_RGB16;
+        break;
+    default:
+        format = QImage::Format_RGB32;
+        break;
+    }
 
-void TextRenderer::paint(QPainter& p)
-{
-    auto* text_ptr = vga().text_memory() + vga().start_address() * 2;
+    prepareImage(image, vbe.width, vbe.height, format);
+    if (format == QImage::Format_Indexed8) {
+        image.setColorCount(256);
+        for (int i = 0; i < 256; ++i)
+            image.setColor(i, frame.color[i]);
+    }
 
-    // Repaint everything
-    for (int y = 0; y < m_rows; ++y) {
-        for (int x = 0; x < m_columns; ++x) {
-            putCharacter(p, y, x, text_ptr[1], text_ptr[0]);
-            text_ptr += 2;
+    DWORD bytesPerPixel = (vbe.bitsPerPixel + 7) / 8;
+    DWORD length = vbe.width * bytesPerPixel;
+
+    for (int y = 0; y < vbe.height; ++y) {
+        DWORD offset = y * vbe.bytesPerLine;
+        if (offset + length > vbe.memory.size())
+            break;
+
+        const BYTE* in = vbe.memory.data() + offset;
+        BYTE* out = image.scanLine(y);
+
+        if (vbe.bitsPerPixel != 24) {
+            memcpy(out, in, length);
+            continue;
         }
-    }
 
-    if (vga().cursor_enabled()) {
-        WORD raw_cursor = vga().cursor_location() - vga().start_address();
-        WORD screen_columns = screen().currentColumnCount();
-        WORD row = screen_columns ? (raw_cursor / screen_columns) : 0;
-        WORD column = screen_columns ? (raw_cursor % screen_columns) : 0;
-        BYTE cursor_start = vga().cursor_start_scanline();
-        BYTE cursor_end = vga().cursor_end_scanline();
-
-        p.fillRect(
-            column * m_characterWidth,
-            row * m_characterHeight + cursor_start,
-            m_characterWidth,
-            cursor_end - cursor_start,
-            m_brush[14]
-        );
+        auto* pixel = reinterpret_cast<DWORD*>(out);
+        for (int x = 0; x < vbe.width; ++x, in += 3)
+            *(pixel++) = 0xff000000 | (in[2] << 16) | (in[1] << 8) | in[0];
     }
 }
 
-void TextRenderer::synchronizeColors()
+Renderer& RendererSet::rendererFor(const FrameSnapshot& frame)
 {
-    for (int i = 0; i < 16; ++i) {
-        m_color[i] = vga().paletteColor(i);
-        m_brush[i] = QBrush(m_color[i]);
+    if (frame.vbe.enabled)
+        return m_vbeRenderer;
+
+    switch (frame.videoMode) {
+    case 0x03:
+        return m_textRenderer;
+    case 0x04:
+        return m_mode04Renderer;
+    case 0x0D:
+        return m_mode0DRenderer;
+    case 0x12:
+        return m_mode12Renderer;
+    case 0x13:
+        return m_mode13Renderer;
+    default:
+        return m_dummyRenderer;
     }
 }
-
-void TextRenderer::synchronizeFont()
-{
-    auto vector = screen().machine().cpu().getRealModeInterruptVector(0x43);
-    auto physicalAddress = PhysicalAddress::fromRealMode(vector);
-    auto* fbmp = (const fontcharbitmap_t *)(screen().machine().cpu().pointerToPhysicalMemory(physicalAddress));
-
-    for (int i = 0; i < 256; ++i)
-        m_character[i] = QBitmap::fromData(QSize(m_characterWidth, m_characterHeight), fbmp[i].data, QImage::Format_Mono);
-}
-
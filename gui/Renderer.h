@@ -25,110 +25,102 @@
 #pragma once
 
 #include "types.h"
-#include <QBitmap>
-#include <QBrush>
 #include <QImage>
 
-class Screen;
-class VGA;
+struct FrameSnapshot;
 
+// Turns a FrameSnapshot into pixels. Renderers run on the render thread and
+// never look at live machine state.
 class Renderer {
 public:
-    const Screen& screen() const;
-    const VGA& vga() const;
+    virtual ~Renderer() { }
 
-    virtual void synchronizeFont() = 0;
-    virtual void synchronizeColors() = 0;
-    virtual void willBecomeActive() = 0;
-    virtual void render() = 0;
-    virtual void paint(QPainter&) = 0;
+    // Draws the whole frame into target, reallocating it if the size or format doesn't match.
+    virtual void render(const FrameSnapshot&, QImage& target) = 0;
 
-protected:
-    explicit Renderer(Screen& screen) : m_screen(screen) { }
+    // How many screen pixels each image pixel covers, in both directions.
+    virtual int scale() const { return 1; }
 
-private:
-    Screen& m_screen;
+protected:
+    Renderer() { }
+    static void prepareImage(QImage&, int width, int height, QImage::Format);
 };
 
 class TextRenderer final : public Renderer {
 public:
-    explicit TextRenderer(Screen& screen) : Renderer(screen) { }
-
-    virtual void synchronizeFont() override;
-    virtual void synchronizeColors() override;
-    virtual void willBecomeActive() override;
-    virtual void render() override { }
-    virtual void paint(QPainter&) override;
+    virtual void render(const FrameSnapshot&, QImage&) override;
 
 private:
-    void putCharacter(QPainter&, int row, int column, BYTE color, BYTE character);
+    void putCharacter(QImage&, const FrameSnapshot&, int row, int column, BYTE color, BYTE character);
 
     int m_rows { 25 };
     int m_columns { 80 };
     int m_characterWidth { 8 };
     int m_characterHeight { 16 };
-
-    QBitmap m_character[256];
-    QBrush m_brush[16];
-    QColor m_color[16];
 };
 
 class DummyRenderer final : public Renderer {
 public:
-    explicit DummyRenderer(Screen& screen) : Renderer(screen) { }
-
-    virtual void synchronizeFont() override { }
-    virtual void synchronizeColors() override { }
-    virtual void willBecomeActive() override { }
-    virtual void render() override { }
-    virtual void paint(QPainter&) override { }
+    virtual void render(const FrameSnapshot&, QImage&) override;
 };
 
 class BufferedRenderer : public Renderer {
 public:
-    virtual void paint(QPainter&) override;
-    virtual void willBecomeActive() override;
+    virtual int scale() const override { return m_scale; }
 
 protected:
-    explicit BufferedRenderer(Screen&, int width, int height, int scale = 1);
-    BYTE* bufferBits() { return m_buffer.bits(); }
+    BufferedRenderer(int width, int height, int scale = 1);
+    void prepareImage(QImage&, const DWORD* colors, int colorCount);
 
-    QImage m_buffer;
+    int m_width { 0 };
+    int m_height { 0 };
     int m_scale { 1 };
 };
 
 class Mode04Renderer final : public BufferedRenderer {
 public:
-    explicit Mode04Renderer(Screen&);
+    Mode04Renderer() : BufferedRenderer(320, 200, 2) { }
 
-    virtual void synchronizeFont() override { }
-    virtual void synchronizeColors() override { }
-    virtual void render() override;
+    virtual void render(const FrameSnapshot&, QImage&) override;
 };
 
 class Mode0DRenderer final : public BufferedRenderer {
 public:
-    explicit Mode0DRenderer(Screen& screen) : BufferedRenderer(screen, 320, 200, 2) { }
+    Mode0DRenderer() : BufferedRenderer(320, 200, 2) { }
 
-    virtual void synchronizeFont() override { }
-    virtual void synchronizeColors() override;
-    virtual void render() override;
+    virtual void render(const FrameSnapshot&, QImage&) override;
 };
 
 class Mode12Renderer final : public BufferedRenderer {
 public:
-    explicit Mode12Renderer(Screen& screen) : BufferedRenderer(screen, 640, 480) { }
+    Mode12Renderer() : BufferedRenderer(640, 480) { }
 
-    virtual void synchronizeFont() override { }
-    virtual void synchronizeColors() override;
-    virtual void render() override;
+    virtual void render(const FrameSnapshot&, QImage&) override;
 };
 
 class Mode13Renderer final : public BufferedRenderer {
 public:
-    explicit Mode13Renderer(Screen& screen) : BufferedRenderer(screen, 320, 200, 2) { }
+    Mode13Renderer() : BufferedRenderer(320, 200, 2) { }
+
+    virtual void render(const FrameSnapshot&, QImage&) override;
+};
+
+class VBERenderer final : public Renderer {
+public:
+    virtual void render(const FrameSnapshot&, QImage&) override;
+};
 
-    virtual void synchronizeFont() override { }
-    virtual void synchronizeColors() override;
-    virtual void render() override;
+// One of each renderer, and the logic for picking the right one for a frame.
+class RendererSet {
+public:
+    Renderer& rendererFor(const FrameSnapshot&);
+
+private:
+    TextRenderer m_textRenderer;
+    Mode04Renderer m_mode04Renderer;
+    Mode0DRenderer m_mode0DRenderer;
+    Mode12Renderer m_mode12Renderer;
+    Mode13Renderer m_mode13Renderer;
+    VBERenderer m_vbeRenderer;
+    DummyRenderer m_dummyRenderer;
 };
@@ -30,7 +30,6 @@
 #include "screen.h"
 #include "DiskDrive.h"
 #include <QtCore/QCoreApplication>
-#include <QtCore/QTimer>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QToolBar>
@@ -45,7 +44,6 @@ struct MachineWidget::Private
     QAction* stopMachine;
     QAction* rebootMachine;
 
-    QTimer syncTimer;
 };
 
 MachineWidget::MachineWidget(Machine& m)
@@ -110,9 +108,6 @@ MachineWidget::MachineWidget(Machine& m)
     connect(d->startMachine, SIGNAL(triggered(bool)), SLOT(onStartTriggered()));
     connect(d->stopMachine, SIGNAL(triggered(bool)), SLOT(onStopTriggered()));
 
-    QObject::connect(&d->syncTimer, SIGNAL(timeout()), &screen(), SLOT(flushKeyBuffer()));
-    d->syncTimer.start(10);
-
     QObject::connect(qApp, SIGNAL(aboutToQuit()), &machine(), SLOT(stop()));
 }
 
@@ -32,9 +32,13 @@
 #include "machine.h"
 #include "iodevice.h"
 #include "settings.h"
+#include "OverlayDiskImage.h"
 #include <signal.h>
 
 static void parseArguments(const QStringList& arguments);
+static int runOverlayTool(int argc, char** argv);
+static bool readDiskImage(const QString& path, QWORD offset, size_t length);
+static bool writeDiskImage(const QString& path, QWORD offset, const QString& dataPath);
 
 RuntimeOptions options;
 
@@ -46,6 +50,10 @@ static void sigint_handler(int)
 
 void hard_exit(int exitCode)
 {
+    if (g_cpu) {
+        g_cpu->machine().flushDisks();
+        g_cpu->machine().flushOutputPorts();
+    }
     exit(exitCode);
 }
 
@@ -53,6 +61,9 @@ int main(int argc, char** argv)
 {
     OwnPtr<QCoreApplication> app;
 
+    if (argc >= 2 && !strncmp(argv[1], "--overlay-", 10))
+        return runOverlayTool(argc, argv);
+
     for (int i = 1; i < argc; ++i) {
         if (QString::fromLatin1(argv[i]) == "--no-gui") {
             app = make<QCoreApplication>(argc, argv);
@@ -91,10 +102,9 @@ int main(int argc, char** argv)
         vlog(LogInit, "%s present", device.name());
     });
 
-    if (machine->settings().isForAutotest()) {
-        machine->cpu().mainLoop();
-        return 0;
-    }
+    // The worker thread is already running the CPU.
+    if (machine->settings().isForAutotest() || options.headless)
+        return app->exec();
 
     MainWindow mainWindow;
     mainWindow.addMachine(machine.ptr());
@@ -104,6 +114,55 @@ int main(int argc, char** argv)
     return app->exec();
 }
 
+int runOverlayTool(int argc, char** argv)
+{
+    QString command = QString::fromLocal8Bit(argv[1]);
+    if (command == "--overlay-create" && (argc == 4 || argc == 5)) {
+        DWORD clusterSize = argc == 5 ? atoi(argv[4]) * 1024 : OverlayDiskImage::defaultClusterSize;
+        return OverlayDiskImage::create(QString::fromLocal8Bit(argv[2]), QString::fromLocal8Bit(argv[3]), clusterSize) ? 0 : 1;
+    }
+    if (command == "--overlay-merge" && argc == 3)
+        return OverlayDiskImage::merge(QString::fromLocal8Bit(argv[2])) ? 0 : 1;
+    if (command == "--overlay-compact" && argc == 3)
+        return OverlayDiskImage::compact(QString::fromLocal8Bit(argv[2])) ? 0 : 1;
+    if (command == "--overlay-read" && argc == 5)
+        return readDiskImage(QString::fromLocal8Bit(argv[2]), strtoull(argv[3], nullptr, 0), strtoull(argv[4], nullptr, 0)) ? 0 : 1;
+    if (command == "--overlay-write" && argc == 5)
+        return writeDiskImage(QString::fromLocal8Bit(argv[2]), strtoull(argv[3], nullptr, 0), QString::fromLocal8Bit(argv[4])) ? 0 : 1;
+
+    fprintf(stderr, "usage: computron --overlay-create [overlay] [base image] [cluster size in KiB]\n");
+    fprintf(stderr, "       computron --overlay-merge [overlay]\n");
+    fprintf(stderr, "       computron --overlay-compact [overlay]\n");
+    fprintf(stderr, "       computron --overlay-read [image] [offset] [length]\n");
+    fprintf(stderr, "       computron --overlay-write [image] [offset] [file]\n");
+    return 1;
+}
+
+bool readDiskImage(const QString& path, QWORD offset, size_t length)
+{
+    auto image = DiskImage::open(path, true);
+    if (!image)
+        return false;
+    QByteArray data(length, Qt::Uninitialized);
+    if (!image->read(offset, length, reinterpret_cast<BYTE*>(data.data())))
+        return false;
+    return fwrite(data.constData(), 1, data.size(), stdout) == (size_t)data.size();
+}
+
+bool writeDiskImage(const QString& path, QWORD offset, const QString& dataPath)
+{
+    QFile file(dataPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Failed to open %s\n", qPrintable(dataPath));
+        return false;
+    }
+    QByteArray data = file.readAll();
+    auto image = DiskImage::open(path);
+    if (!image)
+        return false;
+    return image->write(offset, data.size(), reinterpret_cast<const BYTE*>(data.constData()));
+}
+
 void parseArguments(const QStringList& arguments)
 {
     for (auto it = arguments.begin(); it != arguments.end(); ) {
@@ -140,6 +199,120 @@ void parseArguments(const QStringList& arguments)
             options.novlog = true;
         else if (argument == "--no-log-exceptions")
             options.log_exceptions = false;
+        else if (argument == "--bench")
+            options.benchmark = true;
+        else if (argument == "--no-fusion")
+            options.fusion = false;
+        else if (argument == "--no-pacing")
+            options.pacing = false;
+        else if (argument == "--rtc-host-sync")
+            options.rtcHostSync = true;
+        else if (argument == "--no-gui")
+            options.headless = true;
+        else if (argument == "--capture-at") {
+            ++it;
+            bool ok = it != arguments.end();
+            if (ok) {
+                for (const auto& cycle : (*it).split(',')) {
+                    options.captureCycles.push_back(cycle.toULongLong(&ok));
+                    if (!ok)
+                        break;
+                }
+            }
+            if (!ok) {
+                fprintf(stderr, "usage: computron --capture-at [cycle,cycle,...]\n");
+                hard_exit(1);
+            }
+            continue;
+        }
+        else if (argument == "--capture-dir") {
+            ++it;
+            if (it == arguments.end()) {
+                fprintf(stderr, "usage: computron --capture-dir [directory]\n");
+                hard_exit(1);
+            }
+            options.captureDirectory = (*it);
+            continue;
+        }
+        else if (argument == "--capture-format") {
+            ++it;
+            if (it == arguments.end() || (*it != "png" && *it != "raw")) {
+                fprintf(stderr, "usage: computron --capture-format [png|raw]\n");
+                hard_exit(1);
+            }
+            options.captureFormat = (*it);
+            continue;
+        }
+        else if (argument == "--capture-reference") {
+            ++it;
+            if (it == arguments.end()) {
+                fprintf(stderr, "usage: computron --capture-reference [directory]\n");
+                hard_exit(1);
+            }
+            options.captureReference = (*it);
+            continue;
+        }
+        else if (argument == "--capture-tolerance") {
+            ++it;
+            bool ok = it != arguments.end();
+            if (ok)
+                options.captureTolerance = (*it).toInt(&ok);
+            if (!ok) {
+                fprintf(stderr, "usage: computron --capture-tolerance [0-255]\n");
+                hard_exit(1);
+            }
+            continue;
+        }
+        else if (argument == "--memory-size") {
+            ++it;
+            bool ok = it != arguments.end();
+            if (ok)
+                options.memorySize = (*it).toUInt(&ok);
+            if (!ok || !options.memorySize) {
+                fprintf(stderr, "usage: computron --memory-size [KiB]\n");
+                hard_exit(1);
+            }
+            continue;
+        }
+        else if (argument == "--memory-backing") {
+            ++it;
+            GuestMemory::Configuration configuration;
+            if (it == arguments.end() || !Settings::parseMemoryBacking((*it).split(','), configuration)) {
+                fprintf(stderr, "usage: computron --memory-backing [hugepages|hugetlbfs,prefault,lock,node=N]\n");
+                hard_exit(1);
+            }
+            options.memoryBacking = (*it);
+            continue;
+        }
+        else if (argument == "--rtc-offset") {
+            ++it;
+            bool ok = it != arguments.end();
+            if (ok)
+                options.rtcOffset = (*it).toLongLong(&ok);
+            if (!ok) {
+                fprintf(stderr, "usage: computron --rtc-offset [seconds]\n");
+                hard_exit(1);
+            }
+            continue;
+        }
+        else if (argument == "--serial") {
+            ++it;
+            if (it == arguments.end()) {
+                fprintf(stderr, "usage: computron --serial [file:path|pipe:path|pty|unix:path|stdio]\n");
+                hard_exit(1);
+            }
+            options.serialPort = (*it);
+            continue;
+        }
+        else if (argument == "--parallel") {
+            ++it;
+            if (it == arguments.end()) {
+                fprintf(stderr, "usage: computron --parallel [file:path|append:path|pipe:path|pty|unix:path|stdio]\n");
+                hard_exit(1);
+            }
+            options.parallelPort = (*it);
+            continue;
+        }
         else if (argument == "--config") {
             ++it;
             if (it == arguments.end()) {
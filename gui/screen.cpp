@@ -28,17 +28,13 @@
 #include "machine.h"
 #include "debug.h"
 #include "vga.h"
-#include "busmouse.h"
-#include "keyboard.h"
+#include "InputQueue.h"
 #include "settings.h"
-#include "Renderer.h"
+#include "RenderThread.h"
 #include <QtGui/QPainter>
 #include <QtGui/QPaintEvent>
 #include <QtGui/QBitmap>
-#include <QtCore/QMutex>
-#include <QtCore/QQueue>
 #include <QtCore/QDebug>
-#include <QtCore/QTimer>
 
 struct fontcharbitmap_t {
     BYTE data[16];
@@ -48,20 +44,7 @@ static Screen *s_self = 0L;
 
 struct Screen::Private
 {
-    QMutex keyQueueLock;
-
-    QQueue<WORD> keyQueue;
-    QQueue<BYTE> rawQueue;
-
-    QTimer refreshTimer;
-    QTimer periodicRefreshTimer;
-
-    OwnPtr<TextRenderer> textRenderer;
-    OwnPtr<Mode04Renderer> mode04Renderer;
-    OwnPtr<Mode0DRenderer> mode0DRenderer;
-    OwnPtr<Mode12Renderer> mode12Renderer;
-    OwnPtr<Mode13Renderer> mode13Renderer;
-    OwnPtr<DummyRenderer> dummyRenderer;
+    OwnPtr<RenderThread> renderThread;
 };
 
 Screen::Screen(Machine& m)
@@ -71,122 +54,39 @@ Screen::Screen(Machine& m)
 {
     s_self = this;
 
-    d->textRenderer = make<TextRenderer>(*this);
-    d->mode04Renderer = make<Mode04Renderer>(*this);
-    d->mode0DRenderer = make<Mode0DRenderer>(*this);
-    d->mode12Renderer = make<Mode12Renderer>(*this);
-    d->mode13Renderer = make<Mode13Renderer>(*this);
-    d->dummyRenderer = make<DummyRenderer>(*this);
+    d->renderThread = make<RenderThread>(m, *this);
 
     init();
 
     setFocusPolicy(Qt::ClickFocus);
 
     setMouseTracking(true);
-
-    // This timer is kicked whenever screen memory is modified.
-    d->refreshTimer.setSingleShot(true);
-    d->refreshTimer.setInterval(50);
-    connect(&d->refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
-
-    // This timer does a forced refresh() every second, in case we miss anything.
-    // FIXME: This would not be needed if we had perfect invalidation + scanline timing.
-    d->periodicRefreshTimer.setInterval(1000);
-    d->periodicRefreshTimer.start();
-    connect(&d->periodicRefreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
-
-#if 0
-    // HACK 2000: Type w<ENTER> at boot for Windows ;-)
-    d->keyQueue.enqueue(0x1177);
-    d->keyQueue.enqueue(0x1C0D);
-#endif
 }
 
 Screen::~Screen()
 {
 }
 
-MouseObserver& Screen::mouseObserver()
+InputQueue& Screen::inputQueue()
 {
-    return machine().busMouse();
+    return machine().inputQueue();
 }
 
-void Screen::scheduleRefresh()
+void Screen::frameAvailable()
 {
-    if (!d->refreshTimer.isActive())
-        d->refreshTimer.start();
+    d->renderThread->frameAvailable();
 }
 
-void Screen::notify()
+void Screen::frameReady()
 {
-    if (d->refreshTimer.isActive())
+    auto& frames = d->renderThread->renderedFrames();
+    if (!frames.take())
         return;
-    QMetaObject::invokeMethod(this, "scheduleRefresh", Qt::QueuedConnection);
-}
-
-class RefreshGuard {
-public:
-    RefreshGuard(Machine& machine) : m_machine(machine) { m_machine.vga().willRefreshScreen(); }
-    ~RefreshGuard() { m_machine.vga().didRefreshScreen(); }
-
-private:
-    Machine& m_machine;
-};
-
-inline bool isVideoModeUsingVGAMemory(BYTE videoMode)
-{
-    return videoMode == 0x0D || videoMode == 0x12 || videoMode == 0x13;
-}
-
-void Screen::refresh()
-{
-    RefreshGuard guard(machine());
-
-    BYTE videoMode = currentVideoMode();
-    bool videoModeChanged = false;
-
-    if (m_videoModeInLastRefresh != videoMode) {
-        vlog(LogScreen, "Video mode changed to %02X", videoMode);
-        m_videoModeInLastRefresh = videoMode;
-        videoModeChanged = true;
-    }
-
-    if (videoModeChanged) {
-        renderer().willBecomeActive();
-    }
-
-    if (isVideoModeUsingVGAMemory(videoMode)) {
-        if (machine().vga().isPaletteDirty()) {
-            renderer().synchronizeColors();
-            machine().vga().setPaletteDirty(false);
-        }
-    }
-
-    renderer().synchronizeFont();
-    renderer().synchronizeColors();
-    renderer().render();
-
+    auto& frame = frames.front();
+    setScreenSize(frame.image.width() * frame.scale, frame.image.height() * frame.scale);
     update();
 }
 
-Renderer& Screen::renderer()
-{
-    switch (currentVideoMode()) {
-    case 0x03:
-        return *d->textRenderer;
-    case 0x04:
-        return *d->mode04Renderer;
-    case 0x0D:
-        return *d->mode0DRenderer;
-    case 0x12:
-        return *d->mode12Renderer;
-    case 0x13:
-        return *d->mode13Renderer;
-    default:
-        return *d->dummyRenderer;
-    }
-}
-
 void Screen::setScreenSize(int width, int height)
 {
     if (m_width == width && m_height == height)
@@ -209,7 +109,8 @@ void Screen::resizeEvent(QResizeEvent* e)
 void Screen::paintEvent(QPaintEvent*)
 {
     QPainter p(this);
-    renderer().paint(p);
+    auto& frame = d->renderThread->renderedFrames().front();
+    p.drawImage(QRect(0, 0, frame.image.width() * frame.scale, frame.image.height() * frame.scale), frame.image);
 }
 
 BYTE Screen::currentVideoMode() const
@@ -232,7 +133,7 @@ BYTE Screen::currentColumnCount() const
 void Screen::mouseMoveEvent(QMouseEvent* e)
 {
     QOpenGLWidget::mouseMoveEvent(e);
-    mouseObserver().moveEvent(e->x(), e->y());
+    inputQueue().postMouseMove(e->x(), e->y());
 }
 
 void Screen::mousePressEvent(QMouseEvent* e)
@@ -240,10 +141,10 @@ void Screen::mousePressEvent(QMouseEvent* e)
     QOpenGLWidget::mousePressEvent(e);
     switch (e->button()) {
     case Qt::LeftButton:
-        mouseObserver().buttonPressEvent(e->x(), e->y(), MouseButton::Left);
+        inputQueue().postMouseButton(e->x(), e->y(), MouseButton::Left, true);
         break;
     case Qt::RightButton:
-        mouseObserver().buttonPressEvent(e->x(), e->y(), MouseButton::Right);
+        inputQueue().postMouseButton(e->x(), e->y(), MouseButton::Right, true);
         break;
     default:
         break;
@@ -255,10 +156,10 @@ void Screen::mouseReleaseEvent(QMouseEvent *e)
     QOpenGLWidget::mouseReleaseEvent(e);
     switch (e->button()) {
     case Qt::LeftButton:
-        mouseObserver().buttonReleaseEvent(e->x(), e->y(), MouseButton::Left);
+        inputQueue().postMouseButton(e->x(), e->y(), MouseButton::Left, false);
         break;
     case Qt::RightButton:
-        mouseObserver().buttonReleaseEvent(e->x(), e->y(), MouseButton::Right);
+        inputQueue().postMouseButton(e->x(), e->y(), MouseButton::Right, false);
         break;
     default:
         break;
@@ -505,11 +406,6 @@ void Screen::keyPressEvent(QKeyEvent* event)
 
     WORD scancode = scanCodeFromKeyEvent(event);
 
-    if (!machine().keyboard().isEnabled()) {
-        vlog(LogScreen, "KeyPress event while keyboard disabled");
-        return;
-    }
-
     //qDebug() << "KeyPress:" << nativeKeyFromKeyEvent(event) << "mapped to" << keyName << "modifiers" << event->modifiers() << "scancode:" << scancode;
 
     if (keyName == "F11")
@@ -517,19 +413,7 @@ void Screen::keyPressEvent(QKeyEvent* event)
     else if (keyName == "F12")
         releaseMouse();
 
-    QMutexLocker locker(&d->keyQueueLock);
-
-    if (scancode != 0) {
-        d->keyQueue.enqueue(scancode);
-        //printf("Queued %04X (%s)\n", scancode, qPrintable(keyName));
-    }
-
-    if (extended[keyName])
-        d->rawQueue.enqueue(0xE0);
-
-    d->rawQueue.enqueue(makeCode[keyName]);
-
-    machine().keyboard().didEnqueueData();
+    inputQueue().postKeyPress(scancode, makeCode[keyName], extended[keyName]);
 }
 
 void Screen::keyReleaseEvent(QKeyEvent* event)
@@ -540,92 +424,7 @@ void Screen::keyReleaseEvent(QKeyEvent* event)
         return;
     }
 
-    if (!machine().keyboard().isEnabled()) {
-        vlog(LogScreen, "KeyRelease event while keyboard disabled");
-        return;
-    }
-
-    QMutexLocker l(&d->keyQueueLock);
     QString keyName = keyNameFromKeyEvent(event);
-
-    if (extended[keyName])
-        d->rawQueue.enqueue(0xE0);
-
-    d->rawQueue.enqueue(breakCode[keyName]);
-    machine().keyboard().didEnqueueData();
+    inputQueue().postKeyRelease(breakCode[keyName], extended[keyName]);
     event->ignore();
 }
-
-WORD Screen::nextKey()
-{
-    QMutexLocker l(&d->keyQueueLock);
-
-    d->rawQueue.clear();
-    if (!d->keyQueue.isEmpty())
-        return d->keyQueue.dequeue();
-
-    return 0;
-}
-
-WORD Screen::peekKey()
-{
-    QMutexLocker l(&d->keyQueueLock);
-
-    d->rawQueue.clear();
-    if (!d->keyQueue.isEmpty())
-        return d->keyQueue.head();
-
-    return 0;
-}
-
-BYTE Screen::popKeyData()
-{
-    QMutexLocker l(&d->keyQueueLock);
-
-    BYTE key = 0;
-    if (!d->rawQueue.isEmpty())
-        key = d->rawQueue.dequeue();
-    return key;
-}
-
-bool Screen::hasRawKey()
-{
-    QMutexLocker l(&d->keyQueueLock);
-    return !d->rawQueue.isEmpty();
-}
-
-void Screen::flushKeyBuffer()
-{
-    QMutexLocker l(&d->keyQueueLock);
-
-    if (!d->rawQueue.isEmpty() && machine().cpu().getIF())
-        machine().keyboard().didEnqueueData();
-}
-
-bool kbd_has_data()
-{
-    if (!s_self)
-        return false;
-    return s_self->hasRawKey();
-}
-
-WORD kbd_getc()
-{
-    if (!s_self)
-        return 0x0000;
-    return s_self->nextKey();
-}
-
-WORD kbd_hit()
-{
-    if (!s_self)
-        return 0x0000;
-    return s_self->peekKey();
-}
-
-BYTE kbd_pop_raw()
-{
-    if (!s_self)
-        return 0x00;
-    return s_self->popKeyData();
-}
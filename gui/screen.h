@@ -31,8 +31,8 @@
 #include <QOpenGLWidget>
 
 class Machine;
-class MouseObserver;
-class Renderer;
+class InputQueue;
+class RenderThread;
 
 class Screen final : public QOpenGLWidget {
     Q_OBJECT
@@ -40,7 +40,8 @@ public:
     explicit Screen(Machine&);
     virtual ~Screen();
 
-    void notify();
+    // Called on the emulation thread when a new FrameSnapshot has been published.
+    void frameAvailable();
 
     Machine& machine() const { return m_machine; }
 
@@ -49,11 +50,6 @@ public:
     BYTE currentRowCount() const;
     BYTE currentColumnCount() const;
 
-    WORD nextKey();
-    WORD peekKey();
-    BYTE popKeyData();
-    bool hasRawKey();
-
     void setScreenSize( int width, int height );
 
 protected:
@@ -64,21 +60,17 @@ protected:
     void mouseReleaseEvent(QMouseEvent*) override;
 
 public slots:
-    void refresh();
     bool loadKeymap(const QString& filename);
 
 private slots:
-    void flushKeyBuffer();
-    void scheduleRefresh();
+    void frameReady();
 
 private:
     void paintEvent(QPaintEvent*) override;
     void resizeEvent(QResizeEvent*) override;
     void init();
 
-    MouseObserver& mouseObserver();
-
-    Renderer& renderer();
+    InputQueue& inputQueue();
 
     int m_width { 0 };
     int m_height { 0 };
@@ -93,6 +85,5 @@ private:
     struct Private;
     OwnPtr<Private> d;
 
-    BYTE m_videoModeInLastRefresh { 0xFF };
     Machine& m_machine;
 };
@@ -0,0 +1,231 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "BlockCache.h"
+#include "DiskImage.h"
+#include "debug.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+BlockCache::BlockCache(size_t capacity)
+    : m_capacityInChunks(capacity / chunkSize)
+{
+}
+
+BlockCache::~BlockCache()
+{
+    // Every DiskDrive forgets its image before it goes away.
+    ASSERT(m_chunks.empty());
+}
+
+BlockCache::Chunk* BlockCache::find(DiskImage& image, QWORD index)
+{
+    auto it = m_index.find({ &image, index });
+    if (it == m_index.end())
+        return nullptr;
+    m_chunks.splice(m_chunks.begin(), m_chunks, it->second);
+    return &*it->second;
+}
+
+void BlockCache::evictIfFull()
+{
+    while (m_chunks.size() >= m_capacityInChunks) {
+        auto& victim = m_chunks.back();
+        if (victim.isDirty() && !writeBack(victim))
+            vlog(LogDisk, "Dropping unwritten chunk %llu of %s", (unsigned long long)victim.index, qPrintable(victim.image->path()));
+        m_index.erase({ victim.image, victim.index });
+        m_chunks.pop_back();
+        ++m_statistics.evictions;
+    }
+}
+
+BlockCache::Chunk& BlockCache::insert(DiskImage& image, QWORD index)
+{
+    evictIfFull();
+    m_chunks.emplace_front();
+    auto& chunk = m_chunks.front();
+    chunk.image = &image;
+    chunk.index = index;
+    chunk.data.resize(chunkSize);
+    m_index[{ &image, index }] = m_chunks.begin();
+    return chunk;
+}
+
+BlockCache::Chunk* BlockCache::load(DiskImage& image, QWORD index, unsigned readAheadChunks)
+{
+    QWORD imageChunks = (image.size() + chunkSize - 1) / chunkSize;
+    unsigned count = 1;
+    while (count <= readAheadChunks && index + count < imageChunks && !m_index.count({ &image, index + count }))
+        ++count;
+
+    std::vector<BYTE> buffer(count * chunkSize);
+    if (!image.read(index * chunkSize, buffer.size(), buffer.data()))
+        return nullptr;
+
+    // Read-ahead chunks go in first, so the one asked for ends up most recently used.
+    for (unsigned i = count; i-- > 0;) {
+        auto& chunk = insert(image, index + i);
+        memcpy(chunk.data.data(), buffer.data() + i * chunkSize, chunkSize);
+        chunk.readAhead = i != 0;
+    }
+    m_statistics.readAheadChunks += count - 1;
+    return &m_chunks.front();
+}
+
+bool BlockCache::read(DiskImage& image, QWORD offset, size_t length, BYTE* buffer)
+{
+    if (!m_capacityInChunks)
+        return image.read(offset, length, buffer);
+
+    auto& stream = m_streams[&image];
+    if (offset == stream.nextOffset)
+        stream.readAheadChunks = std::min(std::max(stream.readAheadChunks * 2, 1u), maximumReadAheadChunks);
+    else
+        stream.readAheadChunks = 0;
+    stream.nextOffset = offset + length;
+
+    while (length) {
+        QWORD index = offset / chunkSize;
+        size_t offsetInChunk = offset % chunkSize;
+        size_t chunkLength = std::min(length, chunkSize - offsetInChunk);
+
+        auto* chunk = find(image, index);
+        if (chunk) {
+            ++m_statistics.hits;
+            if (chunk->readAhead) {
+                ++m_statistics.readAheadHits;
+                chunk->readAhead = false;
+            }
+        } else {
+            ++m_statistics.misses;
+            chunk = load(image, index, stream.readAheadChunks);
+            if (!chunk)
+                return false;
+        }
+
+        memcpy(buffer, chunk->data.data() + offsetInChunk, chunkLength);
+        offset += chunkLength;
+        buffer += chunkLength;
+        length -= chunkLength;
+    }
+    return true;
+}
+
+bool BlockCache::write(DiskImage& image, QWORD offset, size_t length, const BYTE* data)
+{
+    if (!m_capacityInChunks)
+        return image.write(offset, length, data);
+
+    if (image.isReadOnly()) {
+        vlog(LogDisk, "Write to read-only image %s", qPrintable(image.path()));
+        return false;
+    }
+
+    while (length) {
+        QWORD index = offset / chunkSize;
+        size_t offsetInChunk = offset % chunkSize;
+        size_t chunkLength = std::min(length, chunkSize - offsetInChunk);
+
+        auto* chunk = find(image, index);
+        if (chunk)
+            ++m_statistics.hits;
+        else {
+            ++m_statistics.misses;
+            if (chunkLength == chunkSize)
+                chunk = &insert(image, index);
+            else
+                chunk = load(image, index, 0);
+            if (!chunk)
+                return false;
+        }
+
+        memcpy(chunk->data.data() + offsetInChunk, data, chunkLength);
+        chunk->readAhead = false;
+        if (chunk->isDirty()) {
+            chunk->dirtyStart = std::min(chunk->dirtyStart, offsetInChunk);
+            chunk->dirtyEnd = std::max(chunk->dirtyEnd, offsetInChunk + chunkLength);
+        } else {
+            chunk->dirtyStart = offsetInChunk;
+            chunk->dirtyEnd = offsetInChunk + chunkLength;
+        }
+
+        offset += chunkLength;
+        data += chunkLength;
+        length -= chunkLength;
+    }
+    return true;
+}
+
+bool BlockCache::writeBack(Chunk& chunk)
+{
+    if (!chunk.image->write(chunk.index * chunkSize + chunk.dirtyStart, chunk.dirtyEnd - chunk.dirtyStart, chunk.data.data() + chunk.dirtyStart))
+        return false;
+    chunk.dirtyStart = 0;
+    chunk.dirtyEnd = 0;
+    ++m_statistics.writeBacks;
+    return true;
+}
+
+bool BlockCache::flush(DiskImage& image)
+{
+    std::vector<Chunk*> dirtyChunks;
+    for (auto& chunk : m_chunks) {
+        if (chunk.image == &image && chunk.isDirty())
+            dirtyChunks.push_back(&chunk);
+    }
+    std::sort(dirtyChunks.begin(), dirtyChunks.end(), [] (Chunk* a, Chunk* b) { return a->index < b->index; });
+
+    bool success = true;
+    for (auto* chunk : dirtyChunks)
+        success &= writeBack(*chunk);
+    return success;
+}
+
+void BlockCache::forget(DiskImage& image)
+{
+    if (!flush(image))
+        vlog(LogDisk, "Some writes to %s were lost", qPrintable(image.path()));
+    for (auto it = m_chunks.begin(); it != m_chunks.end();) {
+        if (it->image != &image) {
+            ++it;
+            continue;
+        }
+        m_index.erase({ &image, it->index });
+        it = m_chunks.erase(it);
+    }
+    m_streams.erase(&image);
+}
+
+void BlockCache::dumpStatistics() const
+{
+    QWORD accesses = m_statistics.hits + m_statistics.misses;
+    printf("disk cache: %llu hits, %llu misses (%.1f%% hit rate), %llu of %llu read-ahead chunks used, %llu write-backs, %llu evictions\n",
+        (unsigned long long)m_statistics.hits,
+        (unsigned long long)m_statistics.misses,
+        accesses ? 100.0 * m_statistics.hits / accesses : 0.0,
+        (unsigned long long)m_statistics.readAheadHits,
+        (unsigned long long)m_statistics.readAheadChunks,
+        (unsigned long long)m_statistics.writeBacks,
+        (unsigned long long)m_statistics.evictions);
+}
@@ -0,0 +1,113 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include "types.h"
+#include <QtCore/QMutex>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+class DiskImage;
+
+// An LRU cache of fixed-size chunks, shared by every DiskDrive of a machine.
+//
+// Reads that continue where the previous read of the same image ended grow a
+// read-ahead window, so sequential loads turn into a few large host reads.
+// Writes stay in the cache until flush(), eviction or forget().
+class BlockCache {
+public:
+    static constexpr size_t chunkSize = 64 * 1024;
+    static constexpr unsigned maximumReadAheadChunks = 16;
+
+    struct Statistics {
+        QWORD hits { 0 };
+        QWORD misses { 0 };
+        QWORD readAheadChunks { 0 };
+        QWORD readAheadHits { 0 };
+        QWORD writeBacks { 0 };
+        QWORD evictions { 0 };
+    };
+
+    // A capacity of zero passes every access straight through to the image.
+    explicit BlockCache(size_t capacity);
+    ~BlockCache();
+
+    bool read(DiskImage&, QWORD offset, size_t length, BYTE* buffer);
+    bool write(DiskImage&, QWORD offset, size_t length, const BYTE* data);
+
+    bool flush(DiskImage&);
+    // Flushes and drops everything cached for an image that is about to go away.
+    void forget(DiskImage&);
+
+    const Statistics& statistics() const { return m_statistics; }
+    void dumpStatistics() const;
+
+    // DiskDrives hold this around everything that touches the cache or their image,
+    // so the GUI thread can swap images and exit paths can flush while the CPU runs.
+    QMutex& mutex() { return m_mutex; }
+
+private:
+    struct Chunk {
+        DiskImage* image { nullptr };
+        QWORD index { 0 };
+        std::vector<BYTE> data;
+        // Only the written range goes back to the image, so a write-back never grows it past what the guest wrote.
+        size_t dirtyStart { 0 };
+        size_t dirtyEnd { 0 };
+        bool readAhead { false };
+
+        bool isDirty() const { return dirtyEnd > dirtyStart; }
+    };
+
+    struct Key {
+        DiskImage* image;
+        QWORD index;
+        bool operator==(const Key& other) const { return image == other.image && index == other.index; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return std::hash<DiskImage*>()(key.image) ^ std::hash<QWORD>()(key.index * 0x9E3779B97F4A7C15ull); }
+    };
+
+    struct Stream {
+        QWORD nextOffset { 0 };
+        unsigned readAheadChunks { 0 };
+    };
+
+    Chunk* find(DiskImage&, QWORD index);
+    Chunk* load(DiskImage&, QWORD index, unsigned readAheadChunks);
+    Chunk& insert(DiskImage&, QWORD index);
+    bool writeBack(Chunk&);
+    void evictIfFull();
+
+    size_t m_capacityInChunks { 0 };
+    std::list<Chunk> m_chunks;
+    std::unordered_map<Key, std::list<Chunk>::iterator, KeyHash> m_index;
+    std::unordered_map<DiskImage*, Stream> m_streams;
+    Statistics m_statistics;
+    QMutex m_mutex;
+};
@@ -23,24 +23,112 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "DiskDrive.h"
+#include "BlockCache.h"
+#include "DiskImage.h"
+#include "OverlayDiskImage.h"
+#include "debug.h"
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
 
-DiskDrive::DiskDrive(const QString& name)
-    : m_name(name)
+static bool isSameFile(const QString& a, const QString& b)
+{
+    QString canonicalA = QFileInfo(a).canonicalFilePath();
+    return !canonicalA.isEmpty() && canonicalA == QFileInfo(b).canonicalFilePath();
+}
+
+DiskDrive::DiskDrive(const QString& name, BlockCache& cache)
+    : m_cache(cache)
+    , m_name(name)
 {
 }
 
 DiskDrive::~DiskDrive()
 {
+    QMutexLocker locker(&m_cache.mutex());
+    closeImage();
+}
+
+void DiskDrive::closeImage()
+{
+    if (!m_image)
+        return;
+    m_cache.forget(*m_image);
+    m_image.clear();
 }
 
 void DiskDrive::setConfiguration(Configuration config)
 {
+    QMutexLocker locker(&m_cache.mutex());
     m_config = std::move(config);
     m_present = !m_config.imagePath.isEmpty();
+    closeImage();
 }
 
 void DiskDrive::setImagePath(const QString& path)
 {
+    QMutexLocker locker(&m_cache.mutex());
+    // The configured overlay belongs to the old image.
     m_config.imagePath = path;
+    m_config.overlayPath = QString();
     m_present = !m_config.imagePath.isEmpty();
+    closeImage();
+}
+
+QString DiskDrive::imagePath() const
+{
+    QMutexLocker locker(&m_cache.mutex());
+    return m_config.imagePath;
+}
+
+bool DiskDrive::present() const
+{
+    QMutexLocker locker(&m_cache.mutex());
+    return m_present;
+}
+
+DiskImage* DiskDrive::image()
+{
+    if (m_image || !m_present)
+        return m_image.ptr();
+
+    if (!m_config.overlayPath.isEmpty()) {
+        if (m_config.discardOverlay || !QFile::exists(m_config.overlayPath)) {
+            if (!OverlayDiskImage::create(m_config.overlayPath, m_config.imagePath))
+                return nullptr;
+        }
+        m_image = DiskImage::open(m_config.overlayPath);
+        if (m_image && !m_image->isOverlay()) {
+            vlog(LogDisk, "%s: %s is not an overlay image", qPrintable(m_name), qPrintable(m_config.overlayPath));
+            m_image.clear();
+        } else if (m_image && !isSameFile(static_cast<OverlayDiskImage&>(*m_image).basePath(), m_config.imagePath)) {
+            // Its clusters only make sense on top of the image it was made for. Discarded overlays are always fresh.
+            vlog(LogDisk, "%s: overlay %s is on top of %s, not %s", qPrintable(m_name), qPrintable(m_config.overlayPath),
+                qPrintable(static_cast<OverlayDiskImage&>(*m_image).basePath()), qPrintable(m_config.imagePath));
+            m_image.clear();
+        }
+    } else
+        m_image = DiskImage::open(m_config.imagePath);
+
+    return m_image.ptr();
+}
+
+bool DiskDrive::readSectors(DWORD lba, unsigned count, BYTE* buffer)
+{
+    QMutexLocker locker(&m_cache.mutex());
+    auto* image = this->image();
+    return image && m_cache.read(*image, (QWORD)lba * bytesPerSector(), (size_t)count * bytesPerSector(), buffer);
+}
+
+bool DiskDrive::writeSectors(DWORD lba, unsigned count, const BYTE* data)
+{
+    QMutexLocker locker(&m_cache.mutex());
+    auto* image = this->image();
+    return image && m_cache.write(*image, (QWORD)lba * bytesPerSector(), (size_t)count * bytesPerSector(), data);
+}
+
+bool DiskDrive::flush()
+{
+    QMutexLocker locker(&m_cache.mutex());
+    return !m_image || m_cache.flush(*m_image);
 }
@@ -26,6 +26,10 @@
 
 #include <QString>
 #include "types.h"
+#include "OwnPtr.h"
+
+class BlockCache;
+class DiskImage;
 
 class DiskDrive {
 public:
@@ -36,16 +40,22 @@ public:
         unsigned sectors { 0 };
         unsigned bytesPerSector { 0 };
         BYTE floppyTypeForCMOS { 0 };
+
+        // Writes go to this overlay instead of the image, which is then only read.
+        QString overlayPath;
+        // Start every run from an empty overlay.
+        bool discardOverlay { false };
     };
 
-    explicit DiskDrive(const QString& name);
+    DiskDrive(const QString& name, BlockCache&);
     ~DiskDrive();
 
     QString name() const { return m_name; }
     void setConfiguration(Configuration);
 
+    // Safe to call from the GUI thread; the next access opens the new image.
     void setImagePath(const QString&);
-    QString imagePath() const { return m_config.imagePath; }
+    QString imagePath() const;
 
     DWORD toLBA(WORD cylinder, BYTE head, WORD sector)
     {
@@ -54,7 +64,7 @@ public:
                (cylinder * sectorsPerTrack() * heads());
     }
 
-    bool present() const { return m_present; }
+    bool present() const;
     unsigned cylinders() const { return (m_config.sectors / m_config.sectorsPerTrack / m_config.heads) - 2;}
     unsigned heads() const { return m_config.heads; }
     unsigned sectors() const { return m_config.sectors; }
@@ -62,7 +72,17 @@ public:
     unsigned bytesPerSector() const { return m_config.bytesPerSector; }
     BYTE floppyTypeForCMOS() const { return m_config.floppyTypeForCMOS; }
 
+    bool readSectors(DWORD lba, unsigned count, BYTE* buffer);
+    bool writeSectors(DWORD lba, unsigned count, const BYTE* data);
+    // Writes back everything the block cache holds for this drive.
+    bool flush();
+
 //private:
+    DiskImage* image();
+    void closeImage();
+
+    BlockCache& m_cache;
+    OwnPtr<DiskImage> m_image;
     Configuration m_config;
     QString m_name;
     bool m_present { false };
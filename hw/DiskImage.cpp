@@ -0,0 +1,102 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "DiskImage.h"
+#include "OverlayDiskImage.h"
+#include "debug.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+OwnPtr<DiskImage> DiskImage::open(const QString& path, bool readOnly)
+{
+    int fd = ::open(qPrintable(path), (readOnly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+    if (fd < 0 && !readOnly && (errno == EACCES || errno == EROFS)) {
+        readOnly = true;
+        fd = ::open(qPrintable(path), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        vlog(LogDisk, "Failed to open disk image %s: %s", qPrintable(path), strerror(errno));
+        return nullptr;
+    }
+
+    if (OverlayDiskImage::hasOverlayHeader(fd))
+        return OverlayDiskImage::open(path, fd, readOnly);
+    return make<RawDiskImage>(path, fd, readOnly);
+}
+
+RawDiskImage::RawDiskImage(const QString& path, int fd, bool readOnly)
+    : DiskImage(path, readOnly)
+    , m_fd(fd)
+{
+}
+
+RawDiskImage::~RawDiskImage()
+{
+    close(m_fd);
+}
+
+QWORD RawDiskImage::size() const
+{
+    struct stat st;
+    if (fstat(m_fd, &st) < 0)
+        return 0;
+    return st.st_size;
+}
+
+bool RawDiskImage::read(QWORD offset, size_t length, BYTE* buffer)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t nread = pread(m_fd, buffer + done, length - done, offset + done);
+        if (nread < 0) {
+            vlog(LogDisk, "Read from %s failed: %s", qPrintable(path()), strerror(errno));
+            return false;
+        }
+        if (!nread)
+            break;
+        done += nread;
+    }
+    memset(buffer + done, 0, length - done);
+    return true;
+}
+
+bool RawDiskImage::write(QWORD offset, size_t length, const BYTE* data)
+{
+    if (isReadOnly()) {
+        vlog(LogDisk, "Write to read-only image %s", qPrintable(path()));
+        return false;
+    }
+    size_t done = 0;
+    while (done < length) {
+        ssize_t nwritten = pwrite(m_fd, data + done, length - done, offset + done);
+        if (nwritten <= 0) {
+            vlog(LogDisk, "Write to %s failed: %s", qPrintable(path()), strerror(errno));
+            return false;
+        }
+        done += nwritten;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include "types.h"
+#include "OwnPtr.h"
+#include <QtCore/QString>
+
+// Byte-addressed storage behind a DiskDrive: either a raw image file, or an overlay on top of one.
+class DiskImage {
+public:
+    // Overlays are recognized by their header, so any path that a raw image can go in also takes an overlay.
+    static OwnPtr<DiskImage> open(const QString& path, bool readOnly = false);
+
+    virtual ~DiskImage() { }
+
+    QString path() const { return m_path; }
+    bool isReadOnly() const { return m_readOnly; }
+
+    virtual bool isOverlay() const { return false; }
+    virtual QWORD size() const = 0;
+
+    // Reads past the end of the image come back as zeroes.
+    virtual bool read(QWORD offset, size_t length, BYTE* buffer) = 0;
+    virtual bool write(QWORD offset, size_t length, const BYTE* data) = 0;
+
+protected:
+    DiskImage(const QString& path, bool readOnly) : m_path(path), m_readOnly(readOnly) { }
+
+private:
+    QString m_path;
+    bool m_readOnly { false };
+};
+
+class RawDiskImage final : public DiskImage {
+public:
+    RawDiskImage(const QString& path, int fd, bool readOnly);
+    virtual ~RawDiskImage() override;
+
+    virtual QWORD size() const override;
+    virtual bool read(QWORD offset, size_t length, BYTE* buffer) override;
+    virtual bool write(QWORD offset, size_t length, const BYTE* data) override;
+
+private:
+    int m_fd { -1 };
+};
@@ -0,0 +1,69 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "types.h"
+#include <vector>
+
+// Everything needed to draw one frame, copied out of the display hardware at vertical retrace.
+// Renderers only ever look at a snapshot, never at live device state.
+struct FrameSnapshot {
+    QWORD serial { 0 };
+    // Host monotonic time of the capture, in nanoseconds.
+    QWORD timestamp { 0 };
+
+    BYTE videoMode { 0 };
+    BYTE rows { 25 };
+    BYTE columns { 80 };
+    WORD startAddress { 0 };
+    WORD cursorLocation { 0 };
+    BYTE cursorStartScanline { 0 };
+    BYTE cursorEndScanline { 0 };
+    bool cursorEnabled { false };
+    BYTE crtc[0x19];
+
+    // 0xAARRGGBB, straight from the DAC, and through the attribute controller's palette.
+    DWORD color[256];
+    DWORD paletteColor[16];
+
+    // The four 64K planes, back to back.
+    std::vector<BYTE> vgaMemory;
+    const BYTE* plane(int index) const { return vgaMemory.data() + index * 65536; }
+
+    // Text mode font, 16 bytes per character.
+    BYTE font[256 * 16];
+
+    struct {
+        bool enabled { false };
+        WORD width { 0 };
+        WORD height { 0 };
+        WORD bitsPerPixel { 0 };
+        DWORD bytesPerLine { 0 };
+        DWORD modeGeneration { 0 };
+        QWORD serial { 0 };
+        // The visible part of video memory, starting at the display start address.
+        std::vector<BYTE> memory;
+    } vbe;
+};
@@ -0,0 +1,556 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "GuestMemory.h"
+#include "debug.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct GuestMemory::Backing {
+    enum Kind { PrivateFile, Anonymous, SharedHugeTLB };
+
+    Backing(Kind kind, int fd, const QString& name, bool writable = true) : kind(kind), fd(fd), name(name), writable(writable) { }
+    ~Backing()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    Kind kind { PrivateFile };
+    int fd { -1 };
+    QString name;
+    // The user's RAM image is only ever read; checkpoints go to a private copy.
+    bool writable { true };
+};
+
+static size_t roundUpToHugePage(size_t size)
+{
+    return (size + GuestMemory::hugePageSize - 1) & ~(GuestMemory::hugePageSize - 1);
+}
+
+static int createBackingFile(size_t size)
+{
+#ifdef __linux__
+    int fd = memfd_create("computron-ram", MFD_CLOEXEC);
+#else
+    char path[] = "/tmp/computron-ram.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+        unlink(path);
+#endif
+    if (fd < 0) {
+        vlog(LogInit, "Failed to create guest RAM backing file: %s", strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        vlog(LogInit, "Failed to size guest RAM backing file: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The image must already exist and cover all of guest RAM; a typo shouldn't create or grow a file.
+static int openImageFile(const QString& path, size_t size, int flags)
+{
+    int fd = open(qPrintable(path), flags | O_CLOEXEC);
+    if (fd < 0) {
+        vlog(LogInit, "Failed to open guest RAM image %s: %s", qPrintable(path), strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        vlog(LogInit, "Failed to stat guest RAM image %s: %s", qPrintable(path), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < size) {
+        vlog(LogInit, "Guest RAM image %s is %llu KiB, smaller than the %zu KiB of guest RAM", qPrintable(path), (unsigned long long)st.st_size / 1024, size / 1024);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::shared_ptr<GuestMemory::Backing> GuestMemory::createBacking(size_t size, const Configuration& configuration)
+{
+    if (configuration.hugePages == HugePages::HugeTLB) {
+#ifdef MFD_HUGETLB
+        int fd = memfd_create("computron-ram", MFD_CLOEXEC | MFD_HUGETLB);
+        if (fd >= 0 && ftruncate(fd, roundUpToHugePage(size)) == 0)
+            return std::make_shared<Backing>(Backing::SharedHugeTLB, fd, "hugetlbfs");
+        vlog(LogInit, "No hugetlbfs for guest RAM (%s), trying transparent huge pages", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+#endif
+        return std::make_shared<Backing>(Backing::Anonymous, -1, "anonymous memory");
+    }
+
+    if (configuration.hugePages == HugePages::Transparent)
+        return std::make_shared<Backing>(Backing::Anonymous, -1, "anonymous memory");
+
+    if (!configuration.imagePath.isEmpty()) {
+        int fd = openImageFile(configuration.imagePath, size, O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        return std::make_shared<Backing>(Backing::PrivateFile, fd, configuration.imagePath, false);
+    }
+
+    int fd = createBackingFile(size);
+    if (fd < 0)
+        return nullptr;
+    return std::make_shared<Backing>(Backing::PrivateFile, fd, "memfd");
+}
+
+OwnPtr<GuestMemory> GuestMemory::create(size_t size, const Configuration& configuration)
+{
+    auto backing = createBacking(size, configuration);
+    if (!backing)
+        return nullptr;
+    OwnPtr<GuestMemory> memory(new GuestMemory(std::move(backing), size, configuration));
+    if (!memory->map())
+        return nullptr;
+    if (memory->m_backing->kind != Backing::PrivateFile && !configuration.imagePath.isEmpty() && !memory->loadImage(configuration.imagePath))
+        return nullptr;
+    vlog(LogInit, "Guest RAM: %s", qPrintable(memory->backingReport()));
+    return memory;
+}
+
+GuestMemory::GuestMemory(std::shared_ptr<Backing> backing, size_t size, const Configuration& configuration)
+    : m_backing(std::move(backing))
+    , m_configuration(configuration)
+    , m_size(size)
+{
+    // One spare page, since writePhysicalMemory() only checks the first byte against the size.
+    size_t pageCount = (size + pageSize - 1) / pageSize + 1;
+    m_pendingDirtyPages.resize((pageCount + 63) / 64);
+    m_dirtyLogs.resize(1);
+    m_dirtyLogs[checkpointLog].pages.resize(m_pendingDirtyPages.size());
+    m_dirtyLogs[checkpointLog].armed = true;
+}
+
+GuestMemory::~GuestMemory()
+{
+    if (m_data)
+        munmap(m_data, m_mappedSize);
+}
+
+// THP needs 2 MiB aligned virtual addresses, which a plain mmap() doesn't promise.
+static BYTE* mapAnonymousAligned(size_t length)
+{
+    void* address = mmap(nullptr, length + GuestMemory::hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (address == MAP_FAILED)
+        return nullptr;
+    uintptr_t start = roundUpToHugePage(reinterpret_cast<uintptr_t>(address));
+    size_t head = start - reinterpret_cast<uintptr_t>(address);
+    if (head)
+        munmap(address, head);
+    munmap(reinterpret_cast<BYTE*>(start) + length, GuestMemory::hugePageSize - head);
+    return reinterpret_cast<BYTE*>(start);
+}
+
+bool GuestMemory::map()
+{
+    if (m_backing->kind == Backing::SharedHugeTLB) {
+        m_mappedSize = roundUpToHugePage(m_size);
+        void* address = mmap(nullptr, m_mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_backing->fd, 0);
+        if (address != MAP_FAILED) {
+            m_data = static_cast<BYTE*>(address);
+            applyPlacement();
+            return true;
+        }
+        // The hugetlbfs pool is reserved at mmap() time, so this is where an empty pool shows.
+        vlog(LogInit, "Not enough hugetlbfs pages for guest RAM (%s), trying transparent huge pages", strerror(errno));
+        m_backing = std::make_shared<Backing>(Backing::Anonymous, -1, "anonymous memory");
+    }
+
+    if (m_backing->kind == Backing::Anonymous) {
+        m_mappedSize = roundUpToHugePage(m_size);
+        m_data = mapAnonymousAligned(m_mappedSize);
+        if (!m_data) {
+            vlog(LogInit, "Failed to map guest RAM: %s", strerror(errno));
+            return false;
+        }
+        applyPlacement();
+        return true;
+    }
+
+    m_mappedSize = m_size;
+    void* address = mmap(m_data, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | (m_data ? MAP_FIXED : 0), m_backing->fd, 0);
+    if (address == MAP_FAILED) {
+        vlog(LogInit, "Failed to map guest RAM: %s", strerror(errno));
+        return false;
+    }
+    m_data = static_cast<BYTE*>(address);
+    applyPlacement();
+    return true;
+}
+
+void GuestMemory::applyPlacement()
+{
+#ifdef MADV_HUGEPAGE
+    if (m_backing->kind == Backing::Anonymous && madvise(m_data, m_mappedSize, MADV_HUGEPAGE) < 0)
+        vlog(LogInit, "Failed to enable transparent huge pages for guest RAM: %s", strerror(errno));
+#endif
+
+#if defined(__linux__) && defined(SYS_mbind)
+    // MPOL_BIND, spelled out to avoid depending on libnuma for <numaif.h>.
+    static const int bindPolicy = 2;
+    if (m_configuration.numaNode >= 0) {
+        unsigned long nodeMask = 1UL << m_configuration.numaNode;
+        if (syscall(SYS_mbind, m_data, m_mappedSize, bindPolicy, &nodeMask, sizeof(nodeMask) * 8 + 1, 0) < 0)
+            vlog(LogInit, "Failed to bind guest RAM to NUMA node %d: %s", m_configuration.numaNode, strerror(errno));
+    }
+#endif
+
+    if (m_configuration.prefault)
+        prefault();
+
+    if (m_configuration.lock && mlock(m_data, m_mappedSize) < 0)
+        vlog(LogInit, "Failed to lock guest RAM: %s", strerror(errno));
+}
+
+void GuestMemory::prefault()
+{
+    // Writing to a private file mapping would give every page a private copy, so only fault in the file there.
+    bool forWrite = m_backing->kind != Backing::PrivateFile;
+#if defined(MADV_POPULATE_READ) && defined(MADV_POPULATE_WRITE)
+    if (!madvise(m_data, m_mappedSize, forWrite ? MADV_POPULATE_WRITE : MADV_POPULATE_READ))
+        return;
+#endif
+    volatile BYTE* data = m_data;
+    for (size_t offset = 0; offset < m_mappedSize; offset += pageSize) {
+        BYTE value = data[offset];
+        if (forWrite)
+            data[offset] = value;
+    }
+}
+
+bool GuestMemory::loadImage(const QString& path)
+{
+    int fd = openImageFile(path, m_size, O_RDONLY);
+    if (fd < 0)
+        return false;
+    size_t offset = 0;
+    while (offset < m_size) {
+        ssize_t nread = pread(fd, m_data + offset, m_size - offset, offset);
+        if (nread <= 0)
+            break;
+        offset += nread;
+    }
+    close(fd);
+    vlog(LogInit, "Copied %zu KiB of guest RAM from %s", offset / 1024, qPrintable(path));
+    return true;
+}
+
+QString GuestMemory::backingReport() const
+{
+    const char* mapping = "private copy-on-write mapping of";
+    if (m_backing->kind == Backing::Anonymous)
+        mapping = "transparent huge page mapping of";
+    else if (m_backing->kind == Backing::SharedHugeTLB)
+        mapping = "shared mapping of";
+    QString report = QString::asprintf("%zu KiB, %s %s", m_size / 1024, mapping, qPrintable(m_backing->name));
+
+#ifdef __linux__
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps)
+        return report;
+    auto begin = reinterpret_cast<unsigned long long>(m_data);
+    auto end = begin + m_mappedSize;
+    unsigned long long resident = 0;
+    unsigned long long huge = 0;
+    unsigned long long locked = 0;
+    bool inside = false;
+    char line[256];
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long long start, stop, value;
+        if (sscanf(line, "%llx-%llx ", &start, &stop) == 2) {
+            inside = start >= begin && stop <= end;
+            continue;
+        }
+        if (!inside)
+            continue;
+        if (sscanf(line, "Rss: %llu", &value) == 1)
+            resident += value;
+        else if (sscanf(line, "AnonHugePages: %llu", &value) == 1 || sscanf(line, "ShmemPmdMapped: %llu", &value) == 1)
+            huge += value;
+        else if (sscanf(line, "Shared_Hugetlb: %llu", &value) == 1 || sscanf(line, "Private_Hugetlb: %llu", &value) == 1) {
+            resident += value;
+            huge += value;
+        } else if (sscanf(line, "Locked: %llu", &value) == 1)
+            locked += value;
+    }
+    fclose(smaps);
+    report += QString::asprintf("; %llu KiB resident, %llu KiB in huge pages, %llu KiB locked", resident, huge, locked);
+#endif
+    return report;
+}
+
+void GuestMemory::markRangeDirty(DWORD address, size_t length)
+{
+    if (!length)
+        return;
+    DWORD lastPage = std::min<size_t>(address + length - 1, m_size) / pageSize;
+    for (DWORD page = address / pageSize; page <= lastPage; ++page)
+        markPageDirty(page);
+}
+
+void GuestMemory::foldPendingDirtyPages()
+{
+    for (size_t i = 0; i < m_pendingDirtyPages.size(); ++i) {
+        QWORD bits = m_pendingDirtyPages[i];
+        if (!bits)
+            continue;
+        for (auto& log : m_dirtyLogs) {
+            if (log.armed)
+                log.pages[i] |= bits;
+        }
+        m_pendingDirtyPages[i] = 0;
+    }
+}
+
+template<typename Callback>
+void GuestMemory::forEachDirtyRun(DirtyLogID id, Callback callback)
+{
+    foldPendingDirtyPages();
+    auto& dirtyPages = m_dirtyLogs[id].pages;
+    size_t pageCount = (m_size + pageSize - 1) / pageSize;
+    size_t runStart = 0;
+    size_t runLength = 0;
+    for (size_t i = 0; i < dirtyPages.size(); ++i) {
+        QWORD bits = dirtyPages[i];
+        if (!bits && !runLength)
+            continue;
+        for (size_t bit = 0; bit < 64; ++bit) {
+            size_t page = i * 64 + bit;
+            if (page < pageCount && (bits & ((QWORD)1 << bit))) {
+                if (!runLength)
+                    runStart = page;
+                ++runLength;
+                continue;
+            }
+            if (runLength) {
+                callback(runStart * pageSize, std::min(runLength * pageSize, m_size - runStart * pageSize));
+                runLength = 0;
+            }
+            if (!bits)
+                break;
+        }
+        dirtyPages[i] = 0;
+    }
+    if (runLength)
+        callback(runStart * pageSize, std::min(runLength * pageSize, m_size - runStart * pageSize));
+}
+
+unsigned GuestMemory::dirtyPageCount()
+{
+    foldPendingDirtyPages();
+    unsigned count = 0;
+    for (QWORD bits : m_dirtyLogs[checkpointLog].pages)
+        count += __builtin_popcountll(bits);
+    return count;
+}
+
+GuestMemory::DirtyLogID GuestMemory::armDirtyLog()
+{
+    // Pages written before arming belong to the logs that were already around.
+    foldPendingDirtyPages();
+    DirtyLogID id = 0;
+    while (id < m_dirtyLogs.size() && m_dirtyLogs[id].armed)
+        ++id;
+    if (id == m_dirtyLogs.size())
+        m_dirtyLogs.emplace_back();
+    auto& log = m_dirtyLogs[id];
+    log.pages.assign(m_pendingDirtyPages.size(), 0);
+    log.armed = true;
+    return id;
+}
+
+void GuestMemory::disarmDirtyLog(DirtyLogID id)
+{
+    ASSERT(id != checkpointLog);
+    foldPendingDirtyPages();
+    auto& log = m_dirtyLogs[id];
+    log.armed = false;
+    log.pages.clear();
+    log.pages.shrink_to_fit();
+}
+
+DWORD GuestMemory::harvestDirtyLog(DirtyLogID id, QVector<DWORD>& pages)
+{
+    ASSERT(m_dirtyLogs[id].armed);
+    foldPendingDirtyPages();
+    auto& log = m_dirtyLogs[id];
+    for (size_t i = 0; i < log.pages.size(); ++i) {
+        QWORD bits = log.pages[i];
+        while (bits) {
+            pages.append(i * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+        log.pages[i] = 0;
+    }
+    return ++log.generation;
+}
+
+DWORD GuestMemory::clearDirtyLog(DirtyLogID id)
+{
+    ASSERT(m_dirtyLogs[id].armed);
+    foldPendingDirtyPages();
+    auto& log = m_dirtyLogs[id];
+    std::fill(log.pages.begin(), log.pages.end(), 0);
+    return ++log.generation;
+}
+
+void GuestMemory::clearDirtyPage(DirtyLogID id, DWORD page)
+{
+    ASSERT(m_dirtyLogs[id].armed);
+    size_t word = page / 64;
+    if (QWORD bits = m_pendingDirtyPages[word]) {
+        for (auto& log : m_dirtyLogs) {
+            if (log.armed)
+                log.pages[word] |= bits;
+        }
+        m_pendingDirtyPages[word] = 0;
+    }
+    m_dirtyLogs[id].pages[word] &= ~((QWORD)1 << (page % 64));
+}
+
+bool GuestMemory::canCheckpoint() const
+{
+    return m_backing->kind == Backing::PrivateFile;
+}
+
+// A copy of the backing file, for a checkpoint that must not change the file under a fork
+// sharing it, or the RAM image the machine started from.
+std::shared_ptr<GuestMemory::Backing> GuestMemory::copyBacking() const
+{
+    int fd = createBackingFile(m_size);
+    if (fd < 0)
+        return nullptr;
+    void* source = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_backing->fd, 0);
+    if (source == MAP_FAILED) {
+        vlog(LogInit, "Failed to map guest RAM checkpoint for copying: %s", strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    bool ok = true;
+    for (size_t offset = 0; ok && offset < m_size; offset += pageSize) {
+        size_t length = std::min(pageSize, m_size - offset);
+        const BYTE* page = static_cast<const BYTE*>(source) + offset;
+        // The new file starts out as one big hole, so zero pages need no write.
+        if (page[0] == 0 && !memcmp(page, page + 1, length - 1))
+            continue;
+        if (pwrite(fd, page, length, offset) != (ssize_t)length) {
+            vlog(LogInit, "Failed to copy guest RAM checkpoint: %s", strerror(errno));
+            ok = false;
+        }
+    }
+    munmap(source, m_size);
+    if (!ok) {
+        close(fd);
+        return nullptr;
+    }
+    return std::make_shared<Backing>(Backing::PrivateFile, fd, "memfd");
+}
+
+bool GuestMemory::checkpoint()
+{
+    ASSERT(canCheckpoint());
+    std::shared_ptr<Backing> target = m_backing;
+    if (m_backing.use_count() > 1 || !m_backing->writable) {
+        target = copyBacking();
+        if (!target)
+            return false;
+    }
+
+    std::vector<std::pair<size_t, size_t>> runs;
+    std::vector<std::pair<size_t, size_t>> failedRuns;
+    forEachDirtyRun(checkpointLog, [&] (size_t offset, size_t length) {
+        if (pwrite(target->fd, m_data + offset, length, offset) != (ssize_t)length) {
+            vlog(LogInit, "Failed to write guest RAM checkpoint: %s", strerror(errno));
+            failedRuns.emplace_back(offset, length);
+            return;
+        }
+        runs.emplace_back(offset, length);
+    });
+
+    if (target != m_backing) {
+        // Nothing has changed yet, so a partial copy is simply dropped and every page stays dirty.
+        if (!failedRuns.empty()) {
+            failedRuns.insert(failedRuns.end(), runs.begin(), runs.end());
+            markCheckpointDirty(failedRuns);
+            return false;
+        }
+        // Mapping the copy over the old mapping drops every private page at once.
+        m_backing = std::move(target);
+        return map();
+    }
+
+    for (auto& run : runs)
+        madvise(m_data + run.first, run.second, MADV_DONTNEED);
+    // Pages that didn't make it to the file keep their private copy and stay dirty.
+    markCheckpointDirty(failedRuns);
+    return failedRuns.empty();
+}
+
+void GuestMemory::markCheckpointDirty(const std::vector<std::pair<size_t, size_t>>& runs)
+{
+    for (auto& run : runs) {
+        for (size_t page = run.first / pageSize; page * pageSize < run.first + run.second; ++page)
+            m_dirtyLogs[checkpointLog].pages[page / 64] |= (QWORD)1 << (page % 64);
+    }
+}
+
+void GuestMemory::restoreCheckpoint()
+{
+    ASSERT(canCheckpoint());
+    // Dropping the private copies of a MAP_PRIVATE mapping brings back the file contents.
+    forEachDirtyRun(checkpointLog, [this] (size_t offset, size_t length) {
+        madvise(m_data + offset, length, MADV_DONTNEED);
+        markRangeDirty(offset, length);
+    });
+
+    // The reverted pages changed as far as the other dirty logs are concerned, but not for the checkpoint.
+    foldPendingDirtyPages();
+    auto& checkpointPages = m_dirtyLogs[checkpointLog].pages;
+    std::fill(checkpointPages.begin(), checkpointPages.end(), 0);
+}
+
+OwnPtr<GuestMemory> GuestMemory::fork() const
+{
+    ASSERT(canCheckpoint());
+    OwnPtr<GuestMemory> memory(new GuestMemory(m_backing, m_size, m_configuration));
+    if (!memory->map())
+        return nullptr;
+    return memory;
+}
@@ -0,0 +1,141 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "Common.h"
+#include "OwnPtr.h"
+#include <QtCore/QVector>
+#include <memory>
+#include <vector>
+
+// Guest RAM, backed by a private mapping of a (memfd) file.
+//
+// The file holds the last checkpoint; the mapping is copy-on-write on top of it.
+// Pages written since the checkpoint are tracked in a bitmap, so both checkpoint()
+// and restoreCheckpoint() only touch those pages. A checkpoint costs one write per
+// dirty page, since it copies them into the file. fork() maps the same file again,
+// sharing every page the new instance doesn't write to. A checkpoint taken while
+// the file is shared, or while it is still the read-only RAM image, first copies
+// all of it into a private memfd, so the other instances and the image keep theirs.
+//
+// Writes only set a bit in a pending bitmap. Dirty logs (the checkpoint being one
+// of them) fold that bitmap into their own when they are harvested, so any number
+// of consumers can track changes independently.
+class GuestMemory {
+public:
+    static constexpr size_t pageSize = 4096;
+    static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+    enum class HugePages { None, Transparent, HugeTLB };
+
+    struct Configuration {
+        QString imagePath;
+        HugePages hugePages { HugePages::None };
+        bool prefault { false };
+        bool lock { false };
+        int numaNode { -1 };
+
+        bool operator==(const Configuration& other) const
+        {
+            return imagePath == other.imagePath && hugePages == other.hugePages && prefault == other.prefault && lock == other.lock && numaNode == other.numaNode;
+        }
+    };
+
+    static OwnPtr<GuestMemory> create(size_t size) { return create(size, Configuration()); }
+    static OwnPtr<GuestMemory> create(size_t size, const Configuration&);
+    ~GuestMemory();
+
+    BYTE* data() { return m_data; }
+    const BYTE* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    const Configuration& configuration() const { return m_configuration; }
+
+    // What the host actually gave us. Transparent huge pages only show up as the guest touches RAM.
+    QString backingReport() const;
+
+    void markDirty(DWORD address, unsigned length)
+    {
+        markPageDirty(address / pageSize);
+        if (UNLIKELY((address % pageSize) + length > pageSize))
+            markRangeDirty(address, length);
+    }
+    void markRangeDirty(DWORD address, size_t length);
+
+    // Only the default copy-on-write file backing supports checkpoints and forks.
+    bool canCheckpoint() const;
+    bool checkpoint();
+    void restoreCheckpoint();
+    // A new instance that starts out at the last checkpoint.
+    OwnPtr<GuestMemory> fork() const;
+
+    unsigned dirtyPageCount();
+
+    typedef unsigned DirtyLogID;
+    DirtyLogID armDirtyLog();
+    void disarmDirtyLog(DirtyLogID);
+    // Appends the pages written since the previous harvest (or clear) to `pages`. Returns the new generation.
+    DWORD harvestDirtyLog(DirtyLogID, QVector<DWORD>& pages);
+    DWORD clearDirtyLog(DirtyLogID);
+    DWORD dirtyLogGeneration(DirtyLogID id) const { return m_dirtyLogs[id].generation; }
+
+    // For consumers watching a handful of pages, this is much cheaper than a harvest.
+    bool isPageDirty(DirtyLogID id, DWORD page) const
+    {
+        return (m_pendingDirtyPages[page / 64] | m_dirtyLogs[id].pages[page / 64]) & ((QWORD)1 << (page % 64));
+    }
+    void clearDirtyPage(DirtyLogID, DWORD page);
+
+private:
+    struct Backing;
+
+    GuestMemory(std::shared_ptr<Backing>, size_t size, const Configuration&);
+    static std::shared_ptr<Backing> createBacking(size_t size, const Configuration&);
+
+    struct DirtyLog {
+        std::vector<QWORD> pages;
+        DWORD generation { 0 };
+        bool armed { false };
+    };
+
+    static const DirtyLogID checkpointLog = 0;
+
+    void markPageDirty(DWORD page) { m_pendingDirtyPages[page / 64] |= (QWORD)1 << (page % 64); }
+    void foldPendingDirtyPages();
+    template<typename Callback> void forEachDirtyRun(DirtyLogID, Callback);
+    bool map();
+    void applyPlacement();
+    void prefault();
+    bool loadImage(const QString& path);
+    std::shared_ptr<Backing> copyBacking() const;
+    void markCheckpointDirty(const std::vector<std::pair<size_t, size_t>>& runs);
+
+    std::shared_ptr<Backing> m_backing;
+    Configuration m_configuration;
+    BYTE* m_data { nullptr };
+    size_t m_size { 0 };
+    size_t m_mappedSize { 0 };
+    std::vector<QWORD> m_pendingDirtyPages;
+    std::vector<DirtyLog> m_dirtyLogs;
+};
@@ -0,0 +1,151 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "InputQueue.h"
+#include "busmouse.h"
+#include "debug.h"
+#include "keyboard.h"
+#include "machine.h"
+#include <algorithm>
+
+InputQueue::InputQueue(Machine& machine)
+    : m_machine(machine)
+{
+    m_clock.start();
+}
+
+InputQueue::~InputQueue()
+{
+}
+
+void InputQueue::post(Event& event)
+{
+    event.timestamp = m_clock.nsecsElapsed();
+    if (!m_events.enqueue(event))
+        ++m_dropped;
+}
+
+void InputQueue::postKeyPress(WORD biosKey, BYTE makeCode, bool extended)
+{
+    Event event;
+    event.type = Event::Type::KeyPress;
+    event.biosKey = biosKey;
+    event.code = makeCode;
+    event.extended = extended;
+    post(event);
+}
+
+void InputQueue::postKeyRelease(BYTE breakCode, bool extended)
+{
+    Event event;
+    event.type = Event::Type::KeyRelease;
+    event.code = breakCode;
+    event.extended = extended;
+    post(event);
+}
+
+void InputQueue::postMouseMove(WORD x, WORD y)
+{
+    Event event;
+    event.type = Event::Type::MouseMove;
+    event.x = x;
+    event.y = y;
+    post(event);
+}
+
+void InputQueue::postMouseButton(WORD x, WORD y, MouseButton button, bool pressed)
+{
+    Event event;
+    event.type = Event::Type::MouseButton;
+    event.x = x;
+    event.y = y;
+    event.button = button;
+    event.pressed = pressed;
+    post(event);
+}
+
+void InputQueue::deliver()
+{
+    qint64 now = m_clock.nsecsElapsed();
+    Event event;
+    Event move;
+    bool hasMove = false;
+    while (m_events.dequeue(event)) {
+        qint64 latency = now - event.timestamp;
+        m_statistics.totalLatency += latency;
+        m_statistics.maximumLatency = std::max(m_statistics.maximumLatency, latency);
+        ++m_statistics.delivered;
+
+        if (event.type == Event::Type::MouseMove) {
+            if (hasMove)
+                ++m_statistics.coalescedMoves;
+            move = event;
+            hasMove = true;
+            continue;
+        }
+        if (hasMove) {
+            deliver(move);
+            hasMove = false;
+        }
+        deliver(event);
+    }
+    if (hasMove)
+        deliver(move);
+}
+
+void InputQueue::deliver(const Event& event)
+{
+    MouseObserver& mouse = m_machine.busMouse();
+    auto& keyboard = m_machine.keyboard();
+
+    switch (event.type) {
+    case Event::Type::KeyPress:
+    case Event::Type::KeyRelease:
+        if (!keyboard.isEnabled()) {
+            vlog(LogKeyboard, "Key event while keyboard disabled");
+            return;
+        }
+        keyboard.enqueueKey(event.biosKey, event.code, event.extended);
+        break;
+    case Event::Type::MouseMove:
+        mouse.moveEvent(event.x, event.y);
+        break;
+    case Event::Type::MouseButton:
+        if (event.pressed)
+            mouse.buttonPressEvent(event.x, event.y, event.button);
+        else
+            mouse.buttonReleaseEvent(event.x, event.y, event.button);
+        break;
+    }
+}
+
+void InputQueue::dumpStatistics() const
+{
+    printf("input: %llu events delivered (%llu mouse moves coalesced), %llu dropped, latency %.3f ms average, %.3f ms maximum\n",
+        (unsigned long long)m_statistics.delivered,
+        (unsigned long long)m_statistics.coalescedMoves,
+        (unsigned long long)m_dropped.load(std::memory_order_relaxed),
+        m_statistics.delivered ? m_statistics.totalLatency / 1e6 / m_statistics.delivered : 0.0,
+        m_statistics.maximumLatency / 1e6);
+}
@@ -0,0 +1,86 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "MouseObserver.h"
+#include "SPSCQueue.h"
+#include "types.h"
+#include <QElapsedTimer>
+#include <atomic>
+
+class Machine;
+
+// Carries host key and mouse events from the GUI thread to the emulation thread.
+// The GUI posts timestamped events without locking; the CPU hands them to the devices
+// at its periodic host clock check, so they always land between instructions.
+class InputQueue {
+public:
+    explicit InputQueue(Machine&);
+    ~InputQueue();
+
+    // GUI thread.
+    // biosKey is the scan code/character pair for INT 16h, or 0 if the BIOS shouldn't see the key.
+    void postKeyPress(WORD biosKey, BYTE makeCode, bool extended);
+    void postKeyRelease(BYTE breakCode, bool extended);
+    void postMouseMove(WORD x, WORD y);
+    void postMouseButton(WORD x, WORD y, MouseButton, bool pressed);
+
+    // Emulation thread. Consecutive moves are collapsed into the last one.
+    bool hasPendingEvents() const { return !m_events.isEmpty(); }
+    void deliver();
+
+    struct Statistics {
+        QWORD delivered { 0 };
+        QWORD coalescedMoves { 0 };
+        qint64 totalLatency { 0 };
+        qint64 maximumLatency { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+    void dumpStatistics() const;
+
+private:
+    struct Event {
+        enum class Type : BYTE { KeyPress, KeyRelease, MouseMove, MouseButton };
+        Type type { Type::KeyPress };
+        BYTE code { 0 };
+        bool extended { false };
+        bool pressed { false };
+        MouseButton button { MouseButton::Left };
+        WORD biosKey { 0 };
+        WORD x { 0 };
+        WORD y { 0 };
+        // Nanoseconds on m_clock.
+        qint64 timestamp { 0 };
+    };
+
+    void post(Event&);
+    void deliver(const Event&);
+
+    Machine& m_machine;
+    QElapsedTimer m_clock;
+    SPSCQueue<Event, 256> m_events;
+    std::atomic<QWORD> m_dropped { 0 };
+    Statistics m_statistics;
+};
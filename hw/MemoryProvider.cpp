@@ -34,6 +34,12 @@ void MemoryProvider::writeMemory8(DWORD, BYTE)
 {
 }
 
+void MemoryProvider::writeMemoryBlock(DWORD address, const BYTE* data, DWORD length)
+{
+    for (DWORD i = 0; i < length; ++i)
+        writeMemory8(address + i, data[i]);
+}
+
 void MemoryProvider::writeMemory16(DWORD address, WORD data)
 {
     writeMemory8(address, leastSignificant<BYTE>(data));
@@ -26,6 +26,7 @@
 
 #include "debug.h"
 #include "types.h"
+#include <atomic>
 
 class MemoryProvider {
 public:
@@ -44,8 +45,21 @@ public:
     virtual void writeMemory16(DWORD address, WORD);
     virtual void writeMemory32(DWORD address, DWORD);
 
+    // Bulk write for REP STOS/MOVS. Must behave exactly like a writeMemory8() per byte.
+    virtual void writeMemoryBlock(DWORD address, const BYTE* data, DWORD length);
+
     const BYTE* pointerForDirectReadAccess() const { return m_pointerForDirectReadAccess; }
 
+    // The CPU stores straight into this memory; the provider only learns about it
+    // through its dirty page map (one flag per 4K page.)
+    BYTE* pointerForDirectWriteAccess() const { return m_pointerForDirectWriteAccess; }
+    void didWriteDirectly(DWORD address, DWORD size)
+    {
+        DWORD offset = address - m_baseAddress.get();
+        m_dirtyPages[offset >> 12].store(1, std::memory_order_relaxed);
+        m_dirtyPages[(offset + size - 1) >> 12].store(1, std::memory_order_relaxed);
+    }
+
     template<typename T> T read(DWORD address);
     template<typename T> void write(DWORD address, T);
 
@@ -53,6 +67,8 @@ protected:
     MemoryProvider(PhysicalAddress baseAddress, DWORD size = 0) : m_baseAddress(baseAddress) { setSize(size); }
     void setSize(DWORD);
     const BYTE* m_pointerForDirectReadAccess { nullptr };
+    BYTE* m_pointerForDirectWriteAccess { nullptr };
+    std::atomic<BYTE>* m_dirtyPages { nullptr };
 
 private:
     PhysicalAddress m_baseAddress;
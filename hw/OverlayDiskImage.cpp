@@ -0,0 +1,343 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "OverlayDiskImage.h"
+#include "debug.h"
+#include <QtCore/QFileInfo>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char overlayMagic[8] = { 'C', 'T', 'O', 'V', 'R', 'L', 'A', 'Y' };
+static const DWORD overlayVersion = 1;
+static const size_t headerSize = 4096;
+
+struct OverlayHeader {
+    char magic[8];
+    DWORD version;
+    DWORD clusterSize;
+    QWORD size;
+    DWORD clusterCount;
+    WORD basePathLength;
+    WORD reserved;
+    char basePath[headerSize - 32];
+};
+
+static_assert(sizeof(OverlayHeader) == headerSize, "OverlayHeader must fill exactly one header block");
+
+static bool readFully(int fd, void* buffer, size_t length, QWORD offset)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t nread = pread(fd, static_cast<BYTE*>(buffer) + done, length - done, offset + done);
+        if (nread < 0)
+            return false;
+        if (!nread)
+            break;
+        done += nread;
+    }
+    memset(static_cast<BYTE*>(buffer) + done, 0, length - done);
+    return true;
+}
+
+static bool writeFully(int fd, const void* data, size_t length, QWORD offset)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t nwritten = pwrite(fd, static_cast<const BYTE*>(data) + done, length - done, offset + done);
+        if (nwritten <= 0)
+            return false;
+        done += nwritten;
+    }
+    return true;
+}
+
+static QWORD dataOffsetForClusterCount(DWORD clusterCount)
+{
+    return (headerSize + (QWORD)clusterCount * sizeof(DWORD) + 4095) & ~(QWORD)4095;
+}
+
+bool OverlayDiskImage::hasOverlayHeader(int fd)
+{
+    char magic[sizeof(overlayMagic)];
+    return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && !memcmp(magic, overlayMagic, sizeof(magic));
+}
+
+OwnPtr<DiskImage> OverlayDiskImage::open(const QString& path, int fd, bool readOnly)
+{
+    OwnPtr<OverlayDiskImage> image(new OverlayDiskImage(path, fd, readOnly));
+    if (!image->load())
+        return nullptr;
+    return image;
+}
+
+static OwnPtr<OverlayDiskImage> openOverlay(const QString& path, bool readOnly)
+{
+    auto image = DiskImage::open(path, readOnly);
+    if (!image)
+        return nullptr;
+    if (readOnly != image->isReadOnly() || !image->isOverlay()) {
+        vlog(LogDisk, "%s is not a writable overlay image", qPrintable(path));
+        return nullptr;
+    }
+    return OwnPtr<OverlayDiskImage>(static_cast<OverlayDiskImage*>(image.leakPtr()));
+}
+
+OverlayDiskImage::OverlayDiskImage(const QString& path, int fd, bool readOnly)
+    : DiskImage(path, readOnly)
+    , m_fd(fd)
+{
+}
+
+OverlayDiskImage::~OverlayDiskImage()
+{
+    close(m_fd);
+}
+
+bool OverlayDiskImage::load()
+{
+    OverlayHeader header;
+    if (!readFully(m_fd, &header, sizeof(header), 0) || header.version != overlayVersion || !header.clusterSize || header.basePathLength > sizeof(header.basePath)) {
+        vlog(LogDisk, "%s has an unsupported overlay header", qPrintable(path()));
+        return false;
+    }
+
+    m_clusterSize = header.clusterSize;
+    m_size = header.size;
+    m_dataOffset = dataOffsetForClusterCount(header.clusterCount);
+    m_map.resize(header.clusterCount);
+    if (!readFully(m_fd, m_map.data(), m_map.size() * sizeof(DWORD), headerSize)) {
+        vlog(LogDisk, "Failed to read the cluster map of %s: %s", qPrintable(path()), strerror(errno));
+        return false;
+    }
+    m_allocatedClusterCount = m_map.size() - std::count(m_map.begin(), m_map.end(), 0);
+
+    m_base = DiskImage::open(QString::fromUtf8(header.basePath, header.basePathLength), true);
+    if (!m_base)
+        return false;
+    if (m_base->size() < m_size)
+        vlog(LogDisk, "Base image of %s shrank since the overlay was created", qPrintable(path()));
+
+    vlog(LogDisk, "%s: overlay on %s, %u of %zu clusters written", qPrintable(path()), qPrintable(m_base->path()), m_allocatedClusterCount, m_map.size());
+    return true;
+}
+
+bool OverlayDiskImage::create(const QString& path, const QString& basePath, DWORD clusterSize)
+{
+    if (clusterSize < 512 || (clusterSize & (clusterSize - 1))) {
+        vlog(LogDisk, "Overlay cluster size must be a power of two of at least 512 bytes");
+        return false;
+    }
+
+    auto base = DiskImage::open(basePath, true);
+    if (!base)
+        return false;
+
+    OverlayHeader header;
+    memset(&header, 0, sizeof(header));
+    QByteArray absoluteBasePath = QFileInfo(basePath).absoluteFilePath().toUtf8();
+    if ((size_t)absoluteBasePath.size() > sizeof(header.basePath)) {
+        vlog(LogDisk, "Base image path too long for an overlay: %s", qPrintable(basePath));
+        return false;
+    }
+    memcpy(header.magic, overlayMagic, sizeof(overlayMagic));
+    header.version = overlayVersion;
+    header.clusterSize = clusterSize;
+    header.size = base->size();
+    header.clusterCount = (header.size + clusterSize - 1) / clusterSize;
+    header.basePathLength = absoluteBasePath.size();
+    memcpy(header.basePath, absoluteBasePath.constData(), absoluteBasePath.size());
+
+    int fd = ::open(qPrintable(path), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        vlog(LogDisk, "Failed to create overlay %s: %s", qPrintable(path), strerror(errno));
+        return false;
+    }
+    // The cluster map starts out as a hole in the file, which reads back as all-zero entries.
+    bool ok = writeFully(fd, &header, sizeof(header), 0) && ftruncate(fd, dataOffsetForClusterCount(header.clusterCount)) == 0;
+    if (!ok)
+        vlog(LogDisk, "Failed to write overlay %s: %s", qPrintable(path), strerror(errno));
+    close(fd);
+    return ok;
+}
+
+bool OverlayDiskImage::readCluster(DWORD cluster, DWORD offsetInCluster, size_t length, BYTE* buffer)
+{
+    if (!m_map[cluster])
+        return m_base->read((QWORD)cluster * m_clusterSize + offsetInCluster, length, buffer);
+    if (!readFully(m_fd, buffer, length, clusterOffset(m_map[cluster] - 1) + offsetInCluster)) {
+        vlog(LogDisk, "Read from %s failed: %s", qPrintable(path()), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool OverlayDiskImage::allocateCluster(DWORD cluster, DWORD offsetInCluster, size_t length, const BYTE* data)
+{
+    std::vector<BYTE> contents(m_clusterSize);
+    if (length != m_clusterSize && !m_base->read((QWORD)cluster * m_clusterSize, m_clusterSize, contents.data()))
+        return false;
+    memcpy(contents.data() + offsetInCluster, data, length);
+
+    DWORD entry = m_allocatedClusterCount + 1;
+    if (!writeFully(m_fd, contents.data(), m_clusterSize, clusterOffset(entry - 1))
+        || fdatasync(m_fd) < 0
+        || !writeFully(m_fd, &entry, sizeof(entry), headerSize + (QWORD)cluster * sizeof(DWORD))) {
+        vlog(LogDisk, "Write to %s failed: %s", qPrintable(path()), strerror(errno));
+        return false;
+    }
+    m_map[cluster] = entry;
+    ++m_allocatedClusterCount;
+    return true;
+}
+
+bool OverlayDiskImage::read(QWORD offset, size_t length, BYTE* buffer)
+{
+    while (length) {
+        DWORD cluster = offset / m_clusterSize;
+        DWORD offsetInCluster = offset % m_clusterSize;
+        size_t chunk = std::min<size_t>(length, m_clusterSize - offsetInCluster);
+        if (cluster >= m_map.size())
+            memset(buffer, 0, chunk);
+        else if (!readCluster(cluster, offsetInCluster, chunk, buffer))
+            return false;
+        offset += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool OverlayDiskImage::write(QWORD offset, size_t length, const BYTE* data)
+{
+    if (isReadOnly()) {
+        vlog(LogDisk, "Write to read-only overlay %s", qPrintable(path()));
+        return false;
+    }
+    while (length) {
+        DWORD cluster = offset / m_clusterSize;
+        DWORD offsetInCluster = offset % m_clusterSize;
+        size_t chunk = std::min<size_t>(length, m_clusterSize - offsetInCluster);
+        if (cluster >= m_map.size()) {
+            vlog(LogDisk, "Write past the end of %s", qPrintable(path()));
+            return false;
+        }
+        if (m_map[cluster]) {
+            if (!writeFully(m_fd, data, chunk, clusterOffset(m_map[cluster] - 1) + offsetInCluster)) {
+                vlog(LogDisk, "Write to %s failed: %s", qPrintable(path()), strerror(errno));
+                return false;
+            }
+        } else if (!allocateCluster(cluster, offsetInCluster, chunk, data))
+            return false;
+        offset += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool OverlayDiskImage::clear()
+{
+    std::fill(m_map.begin(), m_map.end(), 0);
+    m_allocatedClusterCount = 0;
+    if (!writeFully(m_fd, m_map.data(), m_map.size() * sizeof(DWORD), headerSize) || fdatasync(m_fd) < 0 || ftruncate(m_fd, m_dataOffset) < 0) {
+        vlog(LogDisk, "Failed to empty %s: %s", qPrintable(path()), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool OverlayDiskImage::merge(const QString& path)
+{
+    auto overlay = openOverlay(path, false);
+    if (!overlay)
+        return false;
+    auto base = DiskImage::open(overlay->basePath());
+    if (!base)
+        return false;
+    if (base->isReadOnly()) {
+        vlog(LogDisk, "Can't merge %s into read-only %s", qPrintable(path), qPrintable(base->path()));
+        return false;
+    }
+
+    std::vector<BYTE> buffer(overlay->m_clusterSize);
+    DWORD merged = 0;
+    for (DWORD cluster = 0; cluster < overlay->m_map.size(); ++cluster) {
+        if (!overlay->m_map[cluster])
+            continue;
+        QWORD offset = (QWORD)cluster * overlay->m_clusterSize;
+        size_t length = std::min<QWORD>(overlay->m_clusterSize, overlay->m_size - offset);
+        if (!overlay->readCluster(cluster, 0, length, buffer.data()) || !base->write(offset, length, buffer.data()))
+            return false;
+        ++merged;
+    }
+
+    // The base image is now up to date, so nothing is lost if emptying the overlay fails halfway.
+    if (!overlay->clear())
+        return false;
+    printf("%s: merged %u clusters into %s\n", qPrintable(path), merged, qPrintable(base->path()));
+    return true;
+}
+
+bool OverlayDiskImage::compact(const QString& path)
+{
+    auto overlay = openOverlay(path, true);
+    if (!overlay)
+        return false;
+
+    QString compactedPath = path + ".compact";
+    if (!create(compactedPath, overlay->basePath(), overlay->m_clusterSize))
+        return false;
+    auto compacted = openOverlay(compactedPath, false);
+    if (!compacted)
+        return false;
+
+    std::vector<BYTE> data(overlay->m_clusterSize);
+    std::vector<BYTE> baseData(overlay->m_clusterSize);
+    for (DWORD cluster = 0; cluster < overlay->m_map.size(); ++cluster) {
+        if (!overlay->m_map[cluster])
+            continue;
+        QWORD offset = (QWORD)cluster * overlay->m_clusterSize;
+        size_t length = std::min<QWORD>(overlay->m_clusterSize, overlay->m_size - offset);
+        if (!overlay->readCluster(cluster, 0, length, data.data()) || !overlay->m_base->read(offset, length, baseData.data()))
+            return false;
+        if (!memcmp(data.data(), baseData.data(), length))
+            continue;
+        if (!compacted->write(offset, length, data.data()))
+            return false;
+    }
+
+    if (fdatasync(compacted->m_fd) < 0) {
+        vlog(LogDisk, "Failed to write %s: %s", qPrintable(compactedPath), strerror(errno));
+        return false;
+    }
+    if (rename(qPrintable(compactedPath), qPrintable(path)) < 0) {
+        vlog(LogDisk, "Failed to replace %s: %s", qPrintable(path), strerror(errno));
+        return false;
+    }
+    printf("%s: kept %u of %u clusters\n", qPrintable(path), compacted->m_allocatedClusterCount, overlay->m_allocatedClusterCount);
+    return true;
+}
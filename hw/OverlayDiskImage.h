@@ -0,0 +1,79 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include "DiskImage.h"
+#include <vector>
+
+// A sparse copy-on-write layer over a read-only base image.
+//
+// File layout: a 4 KiB header naming the base image, then one DWORD per cluster of the
+// virtual disk, then the data clusters in the order they were first written. A map entry
+// of zero means the cluster still lives in the base image; otherwise it is the 1-based
+// index of the cluster's copy in this file. A new cluster reaches the disk before its map
+// entry is written, so an interrupted write leaves the old contents in place.
+class OverlayDiskImage final : public DiskImage {
+public:
+    static constexpr DWORD defaultClusterSize = 64 * 1024;
+
+    static bool hasOverlayHeader(int fd);
+    static OwnPtr<DiskImage> open(const QString& path, int fd, bool readOnly);
+
+    // Creating an overlay only writes its header and an empty cluster map.
+    static bool create(const QString& path, const QString& basePath, DWORD clusterSize = defaultClusterSize);
+
+    // Writes every cluster of the overlay into its base image, then empties the overlay.
+    static bool merge(const QString& path);
+
+    // Drops clusters that match the base image and packs the rest, in disk order, into a new file.
+    static bool compact(const QString& path);
+
+    virtual ~OverlayDiskImage() override;
+
+    QString basePath() const { return m_base->path(); }
+    DWORD clusterSize() const { return m_clusterSize; }
+    DWORD allocatedClusterCount() const { return m_allocatedClusterCount; }
+
+    virtual bool isOverlay() const override { return true; }
+    virtual QWORD size() const override { return m_size; }
+    virtual bool read(QWORD offset, size_t length, BYTE* buffer) override;
+    virtual bool write(QWORD offset, size_t length, const BYTE* data) override;
+
+private:
+    OverlayDiskImage(const QString& path, int fd, bool readOnly);
+
+    bool load();
+    QWORD clusterOffset(DWORD index) const { return m_dataOffset + (QWORD)index * m_clusterSize; }
+    bool readCluster(DWORD cluster, DWORD offsetInCluster, size_t length, BYTE* buffer);
+    bool allocateCluster(DWORD cluster, DWORD offsetInCluster, size_t length, const BYTE* data);
+    bool clear();
+
+    int m_fd { -1 };
+    OwnPtr<DiskImage> m_base;
+    QWORD m_size { 0 };
+    DWORD m_clusterSize { 0 };
+    QWORD m_dataOffset { 0 };
+    std::vector<DWORD> m_map;
+    DWORD m_allocatedClusterCount { 0 };
+};
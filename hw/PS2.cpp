@@ -32,7 +32,7 @@
 PS2::PS2(Machine& machine)
     : IODevice("PS2", machine)
 {
-    listen(0x92, IODevice::ReadWrite);
+    listen<PS2>(0x92, IODevice::ReadWrite);
 }
 
 PS2::~PS2()
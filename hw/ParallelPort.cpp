@@ -0,0 +1,222 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ParallelPort.h"
+#include "SerialBackend.h"
+#include "Common.h"
+#include "debug.h"
+#include "machine.h"
+#include "TimerService.h"
+#include <QtCore/QByteArray>
+
+//#define LPT_DEBUG
+
+enum {
+    StatusNotError = 0x08,
+    StatusSelected = 0x10,
+    StatusPaperOut = 0x20,
+    StatusNotAcknowledge = 0x40,
+    StatusNotBusy = 0x80,
+
+    ControlStrobe = 0x01,
+    ControlNotInitialize = 0x04,
+    ControlIRQEnable = 0x10,
+};
+
+static const WORD basePort = 0x378;
+static const int flushThreshold = 4096;
+// A printer that has seen nothing for this long has finished its job.
+static const QWORD idleFlushDelay = 50000000;
+
+struct ParallelPort::Private
+{
+    OwnPtr<SerialBackend> backend;
+    BYTE data { 0 };
+    BYTE control { ControlNotInitialize };
+    QByteArray buffer;
+    QWORD lastOutput { 0 };
+    TimerService::TimerID idleTimer { 0 };
+    Statistics statistics;
+};
+
+ParallelPort::ParallelPort(Machine& machine)
+    : IODevice("LPT1", machine, 7)
+    , d(make<Private>())
+{
+    listen<ParallelPort>(basePort, IODevice::ReadWrite);
+    listen<ParallelPort>(basePort + 1, IODevice::ReadOnly);
+    listen<ParallelPort>(basePort + 2, IODevice::ReadWrite);
+
+    reset();
+}
+
+ParallelPort::~ParallelPort()
+{
+    flush();
+}
+
+void ParallelPort::attach(OwnPtr<SerialBackend>&& backend)
+{
+    flush();
+    d->backend = std::move(backend);
+    vlog(LogSerial, "%s attached to %s", name(), qPrintable(d->backend->description()));
+}
+
+void ParallelPort::reset()
+{
+    flush();
+    if (d->idleTimer)
+        machine().timerService().cancel(d->idleTimer);
+    d->idleTimer = 0;
+    d->data = 0;
+    d->control = ControlNotInitialize;
+}
+
+void ParallelPort::flush()
+{
+    if (d->buffer.isEmpty())
+        return;
+    // Like the old INT 17h hook, an unconfigured printer appends to prn0.txt.
+    if (!d->backend)
+        d->backend = SerialBackend::create("append:prn0.txt");
+    size_t written = d->backend ? d->backend->write(reinterpret_cast<const BYTE*>(d->buffer.constData()), d->buffer.size()) : 0;
+    d->statistics.dropped += d->buffer.size() - written;
+    ++d->statistics.hostWrites;
+    d->buffer.clear();
+}
+
+BYTE ParallelPort::status() const
+{
+    // Reserved bits read back as 1.
+    return StatusNotBusy | StatusNotAcknowledge | StatusSelected | StatusNotError | 0x07;
+}
+
+BYTE ParallelPort::biosStatus() const
+{
+    // The BIOS reports acknowledge and error with the opposite sense.
+    return (status() ^ (StatusNotAcknowledge | StatusNotError)) & 0xf8;
+}
+
+void ParallelPort::latch()
+{
+    d->buffer.append(static_cast<char>(d->data));
+    ++d->statistics.printed;
+
+    // A form feed ends the page, which is as good a place as any to hand it over.
+    if (d->data == 0x0c || d->buffer.size() >= flushThreshold)
+        flush();
+
+    // The printer acknowledges right away; that's when IRQ7 would fire.
+    if (d->control & ControlIRQEnable)
+        raiseIRQ();
+
+    d->lastOutput = machine().timerService().now();
+    scheduleIdleFlush();
+}
+
+void ParallelPort::scheduleIdleFlush()
+{
+    if (d->idleTimer || d->buffer.isEmpty())
+        return;
+    d->idleTimer = machine().timerService().scheduleAt(d->lastOutput + idleFlushDelay, [this] {
+        d->idleTimer = 0;
+        if (machine().timerService().now() < d->lastOutput + idleFlushDelay)
+            scheduleIdleFlush();
+        else
+            flush();
+    });
+}
+
+void ParallelPort::writeControl(BYTE data)
+{
+    BYTE previous = d->control;
+    d->control = data & 0x3f;
+
+    // The printer takes the data on the strobe's leading edge.
+    if (!(previous & ControlStrobe) && (data & ControlStrobe))
+        latch();
+
+    // Pulling /INIT low resets the printer: the end of one job or the start of the next.
+    if ((previous & ControlNotInitialize) && !(data & ControlNotInitialize))
+        flush();
+}
+
+BYTE ParallelPort::printCharacter(BYTE character)
+{
+    d->data = character;
+    writeControl(d->control | ControlStrobe);
+    writeControl(d->control & ~ControlStrobe);
+    return biosStatus();
+}
+
+BYTE ParallelPort::initializePrinter()
+{
+    writeControl(d->control & ~ControlNotInitialize);
+    writeControl(d->control | ControlNotInitialize);
+    return biosStatus();
+}
+
+BYTE ParallelPort::in8(WORD port)
+{
+    BYTE data = 0;
+    switch (port - basePort) {
+    case 0:
+        data = d->data;
+        break;
+    case 1:
+        data = status();
+        break;
+    case 2:
+        data = d->control | 0xc0;
+        break;
+    }
+#ifdef LPT_DEBUG
+    vlog(LogSerial, "%s in8 %03x = %02x", name(), port, data);
+#endif
+    return data;
+}
+
+void ParallelPort::out8(WORD port, BYTE data)
+{
+#ifdef LPT_DEBUG
+    vlog(LogSerial, "%s out8 %03x, %02x", name(), port, data);
+#endif
+    switch (port - basePort) {
+    case 0:
+        d->data = data;
+        break;
+    case 2:
+        writeControl(data);
+        break;
+    }
+}
+
+void ParallelPort::dumpStatistics() const
+{
+    printf("%s: %llu bytes printed in %llu host writes, %llu dropped\n",
+        name(),
+        (unsigned long long)d->statistics.printed,
+        (unsigned long long)d->statistics.hostWrites,
+        (unsigned long long)d->statistics.dropped);
+}
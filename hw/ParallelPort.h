@@ -0,0 +1,67 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "iodevice.h"
+#include "OwnPtr.h"
+
+class SerialBackend;
+
+// Standard parallel port at 0x378 with a printer that is always ready. Printed
+// bytes collect in a buffer and reach the host sink in bulk: when the printer
+// goes idle, on form feed or printer reset, when the buffer fills, and at exit.
+class ParallelPort final : public IODevice {
+public:
+    explicit ParallelPort(Machine&);
+    virtual ~ParallelPort();
+
+    virtual void reset() override;
+    virtual BYTE in8(WORD port) override;
+    virtual void out8(WORD port, BYTE data) override;
+
+    void attach(OwnPtr<SerialBackend>&&);
+    void flush();
+
+    // INT 17h: the data byte and strobe pulse a BIOS would send. Returns the BIOS status byte.
+    BYTE printCharacter(BYTE);
+    BYTE initializePrinter();
+    BYTE biosStatus() const;
+
+    struct Statistics {
+        QWORD printed { 0 };
+        QWORD hostWrites { 0 };
+        QWORD dropped { 0 };
+    };
+    void dumpStatistics() const;
+
+private:
+    BYTE status() const;
+    void writeControl(BYTE);
+    void latch();
+    void scheduleIdleFlush();
+
+    struct Private;
+    OwnPtr<Private> d;
+};
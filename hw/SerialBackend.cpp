@@ -0,0 +1,253 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SerialBackend.h"
+#include "debug.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static bool hasInput(int fd)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLIN | POLLHUP));
+}
+
+SerialBackend::SerialBackend(int readFD, int writeFD, const QString& description)
+    : m_readFD(readFD)
+    , m_writeFD(writeFD)
+    , m_description(description)
+{
+}
+
+SerialBackend::~SerialBackend()
+{
+    closeFDs();
+}
+
+void SerialBackend::closeFDs()
+{
+    if (m_readFD > STDERR_FILENO)
+        close(m_readFD);
+    if (m_writeFD > STDERR_FILENO && m_writeFD != m_readFD)
+        close(m_writeFD);
+    m_readFD = -1;
+    m_writeFD = -1;
+}
+
+ssize_t SerialBackend::writeSome(const BYTE* data, size_t size)
+{
+    return ::write(m_writeFD, data, size);
+}
+
+size_t SerialBackend::write(const BYTE* data, size_t size)
+{
+    size_t written = 0;
+    while (m_writeFD != -1 && written < size) {
+        ssize_t rc = writeSome(data + written, size - written);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            break;
+        written += rc;
+    }
+    return written;
+}
+
+size_t SerialBackend::read(BYTE* data, size_t size)
+{
+    if (m_readFD == -1 || !hasInput(m_readFD))
+        return 0;
+    ssize_t rc = ::read(m_readFD, data, size);
+    return rc > 0 ? rc : 0;
+}
+
+// Listens on a Unix socket and talks to one client at a time. Output with no
+// client connected is dropped, like a line with nobody on the other end.
+class UnixSocketSerialBackend final : public SerialBackend {
+public:
+    UnixSocketSerialBackend(int listenFD, const QString& path)
+        : SerialBackend(-1, -1, QString("unix socket %1").arg(path))
+        , m_listenFD(listenFD)
+        , m_path(path)
+    {
+    }
+
+    virtual ~UnixSocketSerialBackend() override
+    {
+        close(m_listenFD);
+        unlink(qPrintable(m_path));
+    }
+
+    virtual size_t write(const BYTE* data, size_t size) override
+    {
+        if (!connected())
+            return 0;
+        size_t written = SerialBackend::write(data, size);
+        if (!written && errno != EAGAIN)
+            closeFDs();
+        return written;
+    }
+
+    virtual size_t read(BYTE* data, size_t size) override
+    {
+        if (!connected() || !hasInput(m_readFD))
+            return 0;
+        ssize_t rc = ::read(m_readFD, data, size);
+        if (rc <= 0) {
+            closeFDs();
+            return 0;
+        }
+        return rc;
+    }
+
+protected:
+    // A client that hung up must not take the emulator down with SIGPIPE.
+    virtual ssize_t writeSome(const BYTE* data, size_t size) override
+    {
+        return send(m_writeFD, data, size, MSG_NOSIGNAL);
+    }
+
+private:
+    bool connected()
+    {
+        if (m_readFD != -1)
+            return true;
+        int fd = accept(m_listenFD, nullptr, nullptr);
+        if (fd < 0)
+            return false;
+        setNonBlocking(fd);
+        m_readFD = fd;
+        m_writeFD = fd;
+        return true;
+    }
+
+    int m_listenFD { -1 };
+    QString m_path;
+};
+
+static OwnPtr<SerialBackend> createUnixSocket(const QString& path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    QByteArray encodedPath = path.toLocal8Bit();
+    if ((size_t)encodedPath.size() >= sizeof(address.sun_path))
+        return nullptr;
+    memcpy(address.sun_path, encodedPath.constData(), encodedPath.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return nullptr;
+    unlink(encodedPath.constData());
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 1) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    setNonBlocking(fd);
+    return make<UnixSocketSerialBackend>(fd, path);
+}
+
+class FDSerialBackend final : public SerialBackend {
+public:
+    FDSerialBackend(int readFD, int writeFD, const QString& description)
+        : SerialBackend(readFD, writeFD, description)
+    {
+    }
+};
+
+static OwnPtr<SerialBackend> createPseudoTerminal()
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return nullptr;
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    struct termios termios;
+    if (tcgetattr(fd, &termios) == 0) {
+        cfmakeraw(&termios);
+        tcsetattr(fd, TCSANOW, &termios);
+    }
+    setNonBlocking(fd);
+    return make<FDSerialBackend>(fd, fd, QString("pty %1").arg(QString::fromLocal8Bit(ptsname(fd))));
+}
+
+// Reads <path>.in and writes <path>.out, so the guest never reads back its own output.
+// O_RDWR keeps opening a FIFO from blocking until the other end shows up.
+static OwnPtr<SerialBackend> createPipe(const QString& path)
+{
+    int readFD = open((path + ".in").toLocal8Bit().constData(), O_RDWR | O_NONBLOCK);
+    if (readFD < 0)
+        return nullptr;
+    int writeFD = open((path + ".out").toLocal8Bit().constData(), O_RDWR | O_NONBLOCK);
+    if (writeFD < 0) {
+        close(readFD);
+        return nullptr;
+    }
+    return make<FDSerialBackend>(readFD, writeFD, QString("pipes %1.in/%1.out").arg(path));
+}
+
+OwnPtr<SerialBackend> SerialBackend::create(const QString& spec)
+{
+    QString kind = spec.section(':', 0, 0);
+    QString path = spec.section(':', 1);
+
+    if (kind == "stdio")
+        return make<FDSerialBackend>(STDIN_FILENO, STDOUT_FILENO, "stdio");
+    if (kind == "pty")
+        return createPseudoTerminal();
+    if (path.isEmpty())
+        return nullptr;
+    if (kind == "file") {
+        int fd = open(path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return nullptr;
+        return make<FDSerialBackend>(-1, fd, QString("file %1").arg(path));
+    }
+    if (kind == "append") {
+        int fd = open(path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+            return nullptr;
+        return make<FDSerialBackend>(-1, fd, QString("file %1").arg(path));
+    }
+    if (kind == "pipe")
+        return createPipe(path);
+    if (kind == "unix")
+        return createUnixSocket(path);
+    return nullptr;
+}
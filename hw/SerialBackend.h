@@ -22,33 +22,37 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
-#include "ThreadedTimer.h"
-#include <QEventLoop>
-
-ThreadedTimer::ThreadedTimer(ThreadedTimer::Listener& listener, int ms)
-    : QThread(nullptr)
-    , m_listener(listener)
-    , m_ms(ms)
-{
-    start();
-}
-
-ThreadedTimer::~ThreadedTimer()
-{
-}
-
-void ThreadedTimer::run()
-{
-    QEventLoop eventLoop;
-    ThreadedTimerHelper helper(*this, m_ms);
-    eventLoop.exec();
-}
-
-void ThreadedTimer::helperTimerFired()
-{
-    m_listener.threadedTimerFired(Badge<ThreadedTimer>());
-}
-
-ThreadedTimer::Listener::~Listener()
-{
-}
+#pragma once
+
+#include "types.h"
+#include "OwnPtr.h"
+#include <QtCore/QString>
+#include <sys/types.h>
+
+// The host end of a serial port. read() never blocks. write() doesn't either on ptys, pipes
+// and sockets; stdio is left blocking since it shares its file status flags with the shell,
+// and O_NONBLOCK means nothing to regular files.
+class SerialBackend {
+public:
+    // "file:<path>", "append:<path>", "pipe:<path>" (<path>.in and <path>.out), "pty", "unix:<path>" or "stdio".
+    static OwnPtr<SerialBackend> create(const QString& spec);
+
+    virtual ~SerialBackend();
+
+    const QString& description() const { return m_description; }
+
+    // Returns how many bytes were taken.
+    virtual size_t write(const BYTE*, size_t);
+    // Returns how many bytes were waiting, up to `size`.
+    virtual size_t read(BYTE*, size_t);
+
+protected:
+    SerialBackend(int readFD, int writeFD, const QString& description);
+
+    void closeFDs();
+    virtual ssize_t writeSome(const BYTE*, size_t);
+
+    int m_readFD { -1 };
+    int m_writeFD { -1 };
+    QString m_description;
+};
@@ -0,0 +1,554 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SerialPort.h"
+#include "SerialBackend.h"
+#include "Common.h"
+#include "debug.h"
+#include "machine.h"
+#include "TimerService.h"
+#include <QtCore/QByteArray>
+#include <deque>
+
+//#define SERIAL_DEBUG
+
+enum {
+    IERReceivedData = 0x01,
+    IERTransmitterEmpty = 0x02,
+    IERLineStatus = 0x04,
+    IERModemStatus = 0x08,
+
+    IIRNone = 0x01,
+    IIRModemStatus = 0x00,
+    IIRTransmitterEmpty = 0x02,
+    IIRReceivedData = 0x04,
+    IIRReceiveTimeout = 0x0c,
+    IIRFIFOsEnabled = 0xc0,
+
+    FCREnable = 0x01,
+    FCRClearReceiver = 0x02,
+    FCRClearTransmitter = 0x04,
+
+    LCRDivisorLatch = 0x80,
+
+    MCRDTR = 0x01,
+    MCRRTS = 0x02,
+    MCROut1 = 0x04,
+    MCROut2 = 0x08,
+    MCRLoopback = 0x10,
+
+    LSRDataReady = 0x01,
+    LSRTransmitterHoldingEmpty = 0x20,
+    LSRTransmitterEmpty = 0x40,
+
+    MSRDeltaCTS = 0x01,
+    MSRDeltaDSR = 0x02,
+    MSRTrailingEdgeRI = 0x04,
+    MSRDeltaDCD = 0x08,
+    MSRCTS = 0x10,
+    MSRDSR = 0x20,
+    MSRRI = 0x40,
+    MSRDCD = 0x80,
+};
+
+static const unsigned fifoSize = 16;
+// 1.8432 MHz crystal, 16 clocks per bit.
+static const QWORD baudRateBase = 115200;
+static const QWORD nanosecondsPerSecond = 1000000000;
+static const int outputFlushThreshold = 4096;
+static const size_t inputBufferLimit = 4096;
+static const QWORD pollInterval = 1000000;
+
+struct SerialPort::Private
+{
+    WORD base { 0 };
+    OwnPtr<SerialBackend> backend;
+    TimerService::TimerID eventTimer { 0 };
+    TimerService::TimerID pollTimer { 0 };
+
+    WORD divisor { 12 };
+    BYTE interruptEnable { 0 };
+    BYTE lineControl { 0 };
+    BYTE modemControl { 0 };
+    BYTE modemStatusDelta { 0 };
+    BYTE scratch { 0 };
+    bool fifoEnabled { false };
+    unsigned triggerLevel { 1 };
+
+    // The newest character enters the shift register at transmitterLastStart and
+    // is on the wire until transmitterFree.
+    QWORD transmitterLastStart { 0 };
+    QWORD transmitterFree { 0 };
+    bool waitingForTransmitterEmpty { false };
+    bool transmitterEmptyInterrupt { false };
+    QByteArray output;
+
+    // Bytes from the host queue up in `input` and come off the line into the FIFO
+    // one character time apart.
+    std::deque<BYTE> input;
+    std::deque<BYTE> receiveFIFO;
+    QWORD nextArrival { 0 };
+    QWORD lastReceiveActivity { 0 };
+    BYTE receiveBuffer { 0 };
+
+    bool irqAsserted { false };
+    Statistics statistics;
+
+    unsigned receiveCapacity() const { return fifoEnabled ? fifoSize : 1; }
+    unsigned receiveThreshold() const { return fifoEnabled ? triggerLevel : 1; }
+    bool isLoopback() const { return modemControl & MCRLoopback; }
+};
+
+SerialPort::SerialPort(Machine& machine, const char* name, WORD base, int irq)
+    : IODevice(name, machine, irq)
+    , d(make<Private>())
+{
+    d->base = base;
+    for (WORD port = base; port < base + 8; ++port)
+        listen<SerialPort>(port, IODevice::ReadWrite);
+
+    machine.ioPortBus().registerOutputStream(base, [] (void* context, WORD port, const BYTE* data, unsigned count, unsigned size) {
+        auto& serialPort = *static_cast<SerialPort*>(context);
+        if (size == 1) {
+            serialPort.outStream(data, count);
+            return;
+        }
+        // Wider elements also hit the registers above THR, so they take the normal path.
+        auto& bus = serialPort.machine().ioPortBus();
+        for (unsigned i = 0; i < count; ++i, data += size) {
+            if (size == 2)
+                bus.out<WORD>(port, data[0] | data[1] << 8);
+            else
+                bus.out<DWORD>(port, data[0] | data[1] << 8 | data[2] << 16 | (DWORD)data[3] << 24);
+        }
+    }, this);
+
+    reset();
+}
+
+SerialPort::~SerialPort()
+{
+    flush();
+}
+
+void SerialPort::attach(OwnPtr<SerialBackend>&& backend)
+{
+    flush();
+    d->backend = std::move(backend);
+    vlog(LogSerial, "%s attached to %s", name(), qPrintable(d->backend->description()));
+    if (!d->pollTimer)
+        d->pollTimer = machine().timerService().schedulePeriodic(pollInterval, [this] { poll(); });
+}
+
+void SerialPort::reset()
+{
+    auto& timerService = machine().timerService();
+    if (d->eventTimer)
+        timerService.cancel(d->eventTimer);
+    d->eventTimer = 0;
+
+    flush();
+
+    QWORD now = timerService.now();
+    d->divisor = 12;
+    d->interruptEnable = 0;
+    d->lineControl = 0x03;
+    d->modemControl = 0;
+    d->modemStatusDelta = 0;
+    d->scratch = 0;
+    d->fifoEnabled = false;
+    d->triggerLevel = 1;
+    d->transmitterLastStart = now;
+    d->transmitterFree = now;
+    d->waitingForTransmitterEmpty = false;
+    d->transmitterEmptyInterrupt = false;
+    d->input.clear();
+    d->receiveFIFO.clear();
+    d->nextArrival = now;
+    d->lastReceiveActivity = now;
+    d->receiveBuffer = 0;
+
+    if (d->irqAsserted)
+        lowerIRQ();
+    d->irqAsserted = false;
+}
+
+void SerialPort::flush()
+{
+    if (d->output.isEmpty())
+        return;
+    if (d->backend) {
+        size_t written = d->backend->write(reinterpret_cast<const BYTE*>(d->output.constData()), d->output.size());
+        d->statistics.dropped += d->output.size() - written;
+        ++d->statistics.hostWrites;
+    }
+    d->output.clear();
+}
+
+QWORD SerialPort::characterTime() const
+{
+    unsigned dataBits = 5 + (d->lineControl & 3);
+    unsigned bits = 1 + dataBits + ((d->lineControl & 0x08) ? 1 : 0) + ((d->lineControl & 0x04) ? 2 : 1);
+    QWORD divisor = d->divisor ? d->divisor : 0x10000;
+    return bits * divisor * nanosecondsPerSecond / baudRateBase;
+}
+
+// Characters not yet fully sent, counting the one in the shift register.
+unsigned SerialPort::transmitterPending(QWORD now) const
+{
+    if (now >= d->transmitterFree)
+        return 0;
+    QWORD time = characterTime();
+    return (d->transmitterFree - now + time - 1) / time;
+}
+
+void SerialPort::transmit(BYTE data, QWORD now)
+{
+    unsigned capacity = d->fifoEnabled ? fifoSize : 1;
+    if (transmitterPending(now) > capacity) {
+        ++d->statistics.dropped;
+        return;
+    }
+
+    d->transmitterLastStart = std::max(now, d->transmitterFree);
+    d->transmitterFree = d->transmitterLastStart + characterTime();
+    d->waitingForTransmitterEmpty = true;
+    d->transmitterEmptyInterrupt = false;
+    ++d->statistics.transmitted;
+
+    if (d->isLoopback()) {
+        if (d->input.empty())
+            d->nextArrival = std::max(d->nextArrival, d->transmitterFree);
+        d->input.push_back(data);
+        return;
+    }
+
+    if (!d->backend)
+        return;
+    d->output.append(static_cast<char>(data));
+    if (d->output.size() >= outputFlushThreshold)
+        flush();
+}
+
+void SerialPort::outStream(const BYTE* data, unsigned count)
+{
+    if (d->lineControl & LCRDivisorLatch) {
+        for (unsigned i = 0; i < count; ++i)
+            out8(d->base, data[i]);
+        return;
+    }
+
+    QWORD now = machine().timerService().now();
+    for (unsigned i = 0; i < count; ++i)
+        transmit(data[i], now);
+    updateIRQ(now);
+    scheduleEvent(now);
+}
+
+void SerialPort::poll()
+{
+    flush();
+    if (!d->backend || d->isLoopback() || d->input.size() >= inputBufferLimit)
+        return;
+
+    BYTE buffer[inputBufferLimit];
+    size_t count = d->backend->read(buffer, inputBufferLimit - d->input.size());
+    if (!count)
+        return;
+
+    QWORD now = machine().timerService().now();
+    advanceReceiver(now);
+    if (d->input.empty())
+        d->nextArrival = std::max(d->nextArrival, now + characterTime());
+    d->input.insert(d->input.end(), buffer, buffer + count);
+    updateIRQ(now);
+    scheduleEvent(now);
+}
+
+void SerialPort::advanceReceiver(QWORD now)
+{
+    while (!d->input.empty() && d->nextArrival <= now) {
+        if (d->receiveFIFO.size() >= d->receiveCapacity()) {
+            // Hold the line until there's room, rather than overrunning.
+            d->nextArrival = now + characterTime();
+            break;
+        }
+        d->receiveFIFO.push_back(d->input.front());
+        d->input.pop_front();
+        d->lastReceiveActivity = d->nextArrival;
+        d->nextArrival += characterTime();
+        ++d->statistics.received;
+    }
+}
+
+bool SerialPort::hasReceiveTimeout(QWORD now) const
+{
+    return d->fifoEnabled && !d->receiveFIFO.empty() && now >= d->lastReceiveActivity + 4 * characterTime();
+}
+
+BYTE SerialPort::pendingInterrupt(QWORD now) const
+{
+    BYTE enabled = d->interruptEnable;
+    if ((enabled & IERReceivedData) && d->receiveFIFO.size() >= d->receiveThreshold())
+        return IIRReceivedData;
+    if ((enabled & IERReceivedData) && hasReceiveTimeout(now))
+        return IIRReceiveTimeout;
+    if ((enabled & IERTransmitterEmpty) && (d->transmitterEmptyInterrupt || (d->waitingForTransmitterEmpty && now >= d->transmitterLastStart)))
+        return IIRTransmitterEmpty;
+    if ((enabled & IERModemStatus) && d->modemStatusDelta)
+        return IIRModemStatus;
+    return IIRNone;
+}
+
+void SerialPort::updateIRQ(QWORD now)
+{
+    if (d->waitingForTransmitterEmpty && now >= d->transmitterLastStart) {
+        d->waitingForTransmitterEmpty = false;
+        d->transmitterEmptyInterrupt = true;
+    }
+
+    bool asserted = (d->modemControl & MCROut2) && pendingInterrupt(now) != IIRNone;
+    if (asserted == d->irqAsserted)
+        return;
+    d->irqAsserted = asserted;
+    if (asserted) {
+        ++d->statistics.interrupts;
+        raiseIRQ();
+    } else {
+        lowerIRQ();
+    }
+}
+
+// Only the next change that could raise the IRQ line gets an event. While the line
+// is up, or OUT2 keeps it disconnected, the guest has to touch a register first.
+void SerialPort::scheduleEvent(QWORD now)
+{
+    auto& timerService = machine().timerService();
+    if (d->eventTimer)
+        timerService.cancel(d->eventTimer);
+    d->eventTimer = 0;
+
+    if (d->irqAsserted || !(d->modemControl & MCROut2))
+        return;
+
+    QWORD time = characterTime();
+    QWORD deadline = std::numeric_limits<QWORD>::max();
+
+    if (d->interruptEnable & IERReceivedData) {
+        size_t count = d->receiveFIFO.size();
+        size_t threshold = d->receiveThreshold();
+        if (count < threshold && !d->input.empty()) {
+            size_t arrivals = std::min(threshold - count, d->input.size());
+            QWORD last = std::max(d->nextArrival, now) + (arrivals - 1) * time;
+            deadline = count + arrivals >= threshold ? last : last + 4 * time;
+        } else if (count && d->fifoEnabled) {
+            deadline = d->lastReceiveActivity + 4 * time;
+        }
+    }
+
+    if ((d->interruptEnable & IERTransmitterEmpty) && d->waitingForTransmitterEmpty)
+        deadline = std::min(deadline, d->transmitterLastStart);
+
+    if (deadline == std::numeric_limits<QWORD>::max())
+        return;
+
+    d->eventTimer = timerService.scheduleAt(std::max(deadline, now), [this] {
+        d->eventTimer = 0;
+        QWORD now = machine().timerService().now();
+        advanceReceiver(now);
+        updateIRQ(now);
+        scheduleEvent(now);
+    });
+}
+
+BYTE SerialPort::modemLines() const
+{
+    if (!d->isLoopback())
+        return d->backend ? (MSRDCD | MSRDSR | MSRCTS) : 0;
+    BYTE lines = 0;
+    if (d->modemControl & MCRRTS)
+        lines |= MSRCTS;
+    if (d->modemControl & MCRDTR)
+        lines |= MSRDSR;
+    if (d->modemControl & MCROut1)
+        lines |= MSRRI;
+    if (d->modemControl & MCROut2)
+        lines |= MSRDCD;
+    return lines;
+}
+
+void SerialPort::setModemControl(BYTE data)
+{
+    BYTE before = modemLines();
+    d->modemControl = data & 0x1f;
+    BYTE after = modemLines();
+    BYTE changed = before ^ after;
+    if (changed & MSRCTS)
+        d->modemStatusDelta |= MSRDeltaCTS;
+    if (changed & MSRDSR)
+        d->modemStatusDelta |= MSRDeltaDSR;
+    if ((before & MSRRI) && !(after & MSRRI))
+        d->modemStatusDelta |= MSRTrailingEdgeRI;
+    if (changed & MSRDCD)
+        d->modemStatusDelta |= MSRDeltaDCD;
+}
+
+BYTE SerialPort::in8(WORD port)
+{
+    QWORD now = machine().timerService().now();
+    advanceReceiver(now);
+    updateIRQ(now);
+
+    BYTE data = 0;
+    bool divisorLatch = d->lineControl & LCRDivisorLatch;
+    switch (port - d->base) {
+    case 0:
+        if (divisorLatch) {
+            data = leastSignificant<BYTE>(d->divisor);
+            break;
+        }
+        if (!d->receiveFIFO.empty()) {
+            d->receiveBuffer = d->receiveFIFO.front();
+            d->receiveFIFO.pop_front();
+            d->lastReceiveActivity = now;
+            advanceReceiver(now);
+        }
+        data = d->receiveBuffer;
+        break;
+    case 1:
+        data = divisorLatch ? mostSignificant<BYTE>(d->divisor) : d->interruptEnable;
+        break;
+    case 2:
+        data = pendingInterrupt(now);
+        if (data == IIRTransmitterEmpty)
+            d->transmitterEmptyInterrupt = false;
+        if (d->fifoEnabled)
+            data |= IIRFIFOsEnabled;
+        break;
+    case 3:
+        data = d->lineControl;
+        break;
+    case 4:
+        data = d->modemControl;
+        break;
+    case 5:
+        if (!d->receiveFIFO.empty())
+            data |= LSRDataReady;
+        if (now >= d->transmitterLastStart)
+            data |= LSRTransmitterHoldingEmpty;
+        if (now >= d->transmitterFree)
+            data |= LSRTransmitterEmpty;
+        break;
+    case 6:
+        data = modemLines() | d->modemStatusDelta;
+        d->modemStatusDelta = 0;
+        break;
+    case 7:
+        data = d->scratch;
+        break;
+    }
+
+#ifdef SERIAL_DEBUG
+    vlog(LogSerial, "%s in8 %03x = %02x", name(), port, data);
+#endif
+
+    updateIRQ(now);
+    scheduleEvent(now);
+    return data;
+}
+
+void SerialPort::out8(WORD port, BYTE data)
+{
+#ifdef SERIAL_DEBUG
+    vlog(LogSerial, "%s out8 %03x, %02x", name(), port, data);
+#endif
+
+    QWORD now = machine().timerService().now();
+    advanceReceiver(now);
+    updateIRQ(now);
+
+    bool divisorLatch = d->lineControl & LCRDivisorLatch;
+    switch (port - d->base) {
+    case 0:
+        if (divisorLatch)
+            d->divisor = weld<WORD>(mostSignificant<BYTE>(d->divisor), data);
+        else
+            transmit(data, now);
+        break;
+    case 1:
+        if (divisorLatch) {
+            d->divisor = weld<WORD>(data, leastSignificant<BYTE>(d->divisor));
+            break;
+        }
+        // Enabling the THRE interrupt with the holding register already empty raises it at once.
+        if ((data & IERTransmitterEmpty) && !(d->interruptEnable & IERTransmitterEmpty) && now >= d->transmitterLastStart)
+            d->transmitterEmptyInterrupt = true;
+        d->interruptEnable = data & 0x0f;
+        break;
+    case 2: {
+        bool enable = data & FCREnable;
+        if (enable != d->fifoEnabled || (data & FCRClearReceiver)) {
+            d->receiveFIFO.clear();
+            d->lastReceiveActivity = now;
+        }
+        if (enable != d->fifoEnabled || (data & FCRClearTransmitter)) {
+            // Whatever is in the shift register still goes out.
+            d->transmitterLastStart = std::min(d->transmitterLastStart, now);
+            d->transmitterFree = std::min(d->transmitterFree, now + characterTime());
+        }
+        d->fifoEnabled = enable;
+        static const unsigned triggerLevels[4] = { 1, 4, 8, 14 };
+        d->triggerLevel = triggerLevels[data >> 6];
+        break;
+    }
+    case 3:
+        d->lineControl = data;
+        break;
+    case 4:
+        setModemControl(data);
+        break;
+    case 7:
+        d->scratch = data;
+        break;
+    }
+
+    updateIRQ(now);
+    scheduleEvent(now);
+}
+
+const SerialPort::Statistics& SerialPort::statistics() const
+{
+    return d->statistics;
+}
+
+void SerialPort::dumpStatistics() const
+{
+    printf("%s: %llu bytes out in %llu host writes, %llu bytes in, %llu dropped, %llu interrupts\n",
+        name(),
+        (unsigned long long)d->statistics.transmitted,
+        (unsigned long long)d->statistics.hostWrites,
+        (unsigned long long)d->statistics.received,
+        (unsigned long long)d->statistics.dropped,
+        (unsigned long long)d->statistics.interrupts);
+}
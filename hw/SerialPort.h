@@ -0,0 +1,75 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "iodevice.h"
+#include "OwnPtr.h"
+
+class SerialBackend;
+
+// 16550A UART. Characters take their programmed line time in emulated time, but
+// reach the host in bulk: output is buffered and flushed, input is polled.
+class SerialPort final : public IODevice {
+public:
+    SerialPort(Machine&, const char* name, WORD base, int irq);
+    virtual ~SerialPort();
+
+    virtual void reset() override;
+    virtual BYTE in8(WORD port) override;
+    virtual void out8(WORD port, BYTE data) override;
+
+    void attach(OwnPtr<SerialBackend>&&);
+    // Hands buffered output to the backend.
+    void flush();
+
+    struct Statistics {
+        QWORD transmitted { 0 };
+        QWORD received { 0 };
+        QWORD hostWrites { 0 };
+        QWORD dropped { 0 };
+        QWORD interrupts { 0 };
+    };
+    const Statistics& statistics() const;
+    void dumpStatistics() const;
+
+private:
+    void outStream(const BYTE*, unsigned count);
+    void transmit(BYTE, QWORD now);
+    void poll();
+
+    QWORD characterTime() const;
+    unsigned transmitterPending(QWORD now) const;
+    void advanceReceiver(QWORD now);
+    bool hasReceiveTimeout(QWORD now) const;
+    BYTE pendingInterrupt(QWORD now) const;
+    BYTE modemLines() const;
+    void setModemControl(BYTE);
+
+    void updateIRQ(QWORD now);
+    void scheduleEvent(QWORD now);
+
+    struct Private;
+    OwnPtr<Private> d;
+};
@@ -0,0 +1,226 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "TimerService.h"
+#include "CPU.h"
+#include "machine.h"
+#include <algorithm>
+#include <limits>
+
+TimerService::TimerService(Machine& machine)
+    : m_machine(machine)
+{
+    m_timeCycle = m_machine.cpu().cycle();
+}
+
+TimerService::~TimerService()
+{
+}
+
+QWORD TimerService::now() const
+{
+    QWORD cycle = m_machine.cpu().cycle();
+    // The cycle counter starts over when the CPU is reset, emulated time doesn't.
+    if (cycle < m_timeCycle)
+        return m_time;
+    return m_time + (cycle - m_timeCycle) * nanosecondsPerInstruction;
+}
+
+void TimerService::setPacing(bool pacing)
+{
+    advanceClock();
+    m_pacing = pacing;
+    if (m_pacing) {
+        m_hostClock.start();
+        m_hostOffset = m_time;
+    }
+}
+
+void TimerService::advanceClock()
+{
+    m_time = now();
+    m_timeCycle = m_machine.cpu().cycle();
+
+    if (!m_pacing)
+        return;
+    QWORD hostTime = m_hostClock.nsecsElapsed() + m_hostOffset;
+    if (hostTime > m_time) {
+        ++m_statistics.catchUps;
+        m_statistics.catchUpTime += hostTime - m_time;
+        m_time = hostTime;
+    }
+}
+
+TimerService::TimerID TimerService::add(Timer&& timer)
+{
+    TimerID id = m_nextID++;
+    if (!id)
+        id = m_nextID++;
+    QWORD deadline = timer.deadline;
+    m_timers.insert(id, std::move(timer));
+    push(deadline, id);
+    updateNextCycle();
+    return id;
+}
+
+void TimerService::push(QWORD deadline, TimerID id)
+{
+    m_heap.push_back({ deadline, id });
+    std::push_heap(m_heap.begin(), m_heap.end());
+}
+
+TimerService::TimerID TimerService::schedule(QWORD delay, std::function<void()> callback)
+{
+    advanceClock();
+    Timer timer;
+    timer.deadline = m_time + delay;
+    timer.callback = std::move(callback);
+    return add(std::move(timer));
+}
+
+TimerService::TimerID TimerService::scheduleAt(QWORD deadline, std::function<void()> callback)
+{
+    advanceClock();
+    Timer timer;
+    timer.deadline = deadline;
+    timer.callback = std::move(callback);
+    return add(std::move(timer));
+}
+
+TimerService::TimerID TimerService::schedulePeriodic(QWORD interval, std::function<void()> callback)
+{
+    ASSERT(interval);
+    advanceClock();
+    Timer timer;
+    timer.deadline = m_time + interval;
+    timer.interval = interval;
+    timer.callback = std::move(callback);
+    return add(std::move(timer));
+}
+
+void TimerService::cancel(TimerID id)
+{
+    // The heap entry goes stale and is dropped when it reaches the top, unless
+    // cancelled timers start to dominate the heap.
+    if (!m_timers.remove(id))
+        return;
+    if (m_heap.size() > 64 && m_heap.size() > 4 * (size_t)m_timers.size()) {
+        m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(), [this] (const HeapEntry& entry) { return isStale(entry); }), m_heap.end());
+        std::make_heap(m_heap.begin(), m_heap.end());
+    }
+    updateNextCycle();
+}
+
+bool TimerService::isStale(const HeapEntry& entry) const
+{
+    auto it = m_timers.constFind(entry.id);
+    return it == m_timers.constEnd() || it->deadline != entry.deadline;
+}
+
+void TimerService::service()
+{
+    advanceClock();
+
+    while (!m_heap.empty() && m_heap.front().deadline <= m_time) {
+        HeapEntry entry = m_heap.front();
+        std::pop_heap(m_heap.begin(), m_heap.end());
+        m_heap.pop_back();
+        if (isStale(entry))
+            continue;
+
+        QWORD lateness = m_time - entry.deadline;
+        ++m_statistics.fired;
+        m_statistics.totalLateness += lateness;
+        m_statistics.maximumLateness = std::max(m_statistics.maximumLateness, lateness);
+
+        auto& timer = m_timers[entry.id];
+        // The callback may cancel or schedule timers, so don't hold on to this one.
+        std::function<void()> callback;
+        if (timer.interval) {
+            callback = timer.callback;
+            timer.deadline += timer.interval;
+            if (timer.deadline <= m_time) {
+                // Don't replay a backlog of periods, just get back on the grid.
+                QWORD missed = (m_time - timer.deadline) / timer.interval + 1;
+                m_statistics.missedPeriods += missed;
+                timer.deadline += missed * timer.interval;
+            }
+            push(timer.deadline, entry.id);
+        } else {
+            callback = std::move(timer.callback);
+            m_timers.remove(entry.id);
+        }
+        callback();
+    }
+
+    updateNextCycle();
+}
+
+void TimerService::idle()
+{
+    if (!m_pacing) {
+        while (!m_heap.empty() && isStale(m_heap.front())) {
+            std::pop_heap(m_heap.begin(), m_heap.end());
+            m_heap.pop_back();
+        }
+        if (!m_heap.empty()) {
+            advanceClock();
+            m_time = std::max(m_time, m_heap.front().deadline);
+        }
+    }
+    service();
+}
+
+void TimerService::updateNextCycle()
+{
+    while (!m_heap.empty() && isStale(m_heap.front())) {
+        std::pop_heap(m_heap.begin(), m_heap.end());
+        m_heap.pop_back();
+    }
+
+    auto& cpu = m_machine.cpu();
+    if (m_heap.empty()) {
+        cpu.setNextTimerCycle(std::numeric_limits<QWORD>::max());
+        return;
+    }
+
+    QWORD deadline = m_heap.front().deadline;
+    QWORD time = now();
+    QWORD cycle = cpu.cycle();
+    if (deadline <= time)
+        cpu.setNextTimerCycle(cycle);
+    else
+        cpu.setNextTimerCycle(cycle + (deadline - time + nanosecondsPerInstruction - 1) / nanosecondsPerInstruction);
+}
+
+void TimerService::dumpStatistics() const
+{
+    printf("timers: %llu fired, lateness %.3f us average, %.3f us maximum, %llu missed periods, %llu host catch-ups (%.3f ms)\n",
+        (unsigned long long)m_statistics.fired,
+        m_statistics.fired ? m_statistics.totalLateness / 1e3 / m_statistics.fired : 0.0,
+        m_statistics.maximumLateness / 1e3,
+        (unsigned long long)m_statistics.missedPeriods,
+        (unsigned long long)m_statistics.catchUps,
+        m_statistics.catchUpTime / 1e6);
+}
@@ -0,0 +1,113 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "types.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <functional>
+#include <vector>
+
+class Machine;
+
+// The machine's one source of timed events: a min-heap of deadlines in emulated time,
+// serviced on the emulation thread between instructions.
+//
+// Emulated time advances with executed instructions. When pacing, it also catches up
+// with the host clock whenever it has fallen behind, so guest timers keep wall-clock
+// rate on a slow host; without pacing it is a pure function of the instruction count.
+class TimerService {
+public:
+    typedef unsigned TimerID;
+
+    static constexpr QWORD nanosecondsPerInstruction = 1;
+
+    explicit TimerService(Machine&);
+    ~TimerService();
+
+    // Nanoseconds of emulated time.
+    QWORD now() const;
+
+    TimerID schedule(QWORD delay, std::function<void()>);
+    TimerID scheduleAt(QWORD deadline, std::function<void()>);
+    TimerID schedulePeriodic(QWORD interval, std::function<void()>);
+    void cancel(TimerID);
+
+    bool isPacing() const { return m_pacing; }
+    void setPacing(bool);
+
+    // Runs whatever is due. Called by the CPU at its host clock check, and at the
+    // instruction boundary it was told the earliest deadline falls on.
+    void service();
+    // The CPU is halted: without pacing, skip straight to the next deadline.
+    void idle();
+
+    struct Statistics {
+        QWORD fired { 0 };
+        QWORD totalLateness { 0 };
+        QWORD maximumLateness { 0 };
+        QWORD missedPeriods { 0 };
+        QWORD catchUps { 0 };
+        QWORD catchUpTime { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+    void dumpStatistics() const;
+
+private:
+    struct Timer {
+        QWORD deadline { 0 };
+        QWORD interval { 0 };
+        std::function<void()> callback;
+    };
+
+    struct HeapEntry {
+        QWORD deadline;
+        TimerID id;
+        // std::push_heap() builds a max-heap.
+        bool operator<(const HeapEntry& other) const { return deadline > other.deadline; }
+    };
+
+    TimerID add(Timer&&);
+    void push(QWORD deadline, TimerID);
+    bool isStale(const HeapEntry&) const;
+    void advanceClock();
+    void updateNextCycle();
+
+    Machine& m_machine;
+    QHash<TimerID, Timer> m_timers;
+    std::vector<HeapEntry> m_heap;
+    TimerID m_nextID { 1 };
+
+    // m_time is the emulated time as of CPU cycle m_timeCycle.
+    QWORD m_time { 0 };
+    QWORD m_timeCycle { 0 };
+
+    bool m_pacing { false };
+    QElapsedTimer m_hostClock;
+    // Emulated time minus host time, as of the last catch-up.
+    qint64 m_hostOffset { 0 };
+
+    Statistics m_statistics;
+};
@@ -28,14 +28,13 @@
 #include "Common.h"
 #include "CPU.h"
 #include "debug.h"
-#include <QtCore/QMutexLocker>
 
 BusMouse::BusMouse(Machine& machine)
     : IODevice("BusMouse", machine, 5)
 {
-    listen(0x23c, IODevice::ReadWrite);
-    listen(0x23d, IODevice::ReadOnly);
-    listen(0x23e, IODevice::ReadWrite);
+    listen<BusMouse>(0x23c, IODevice::ReadWrite);
+    listen<BusMouse>(0x23d, IODevice::ReadOnly);
+    listen<BusMouse>(0x23e, IODevice::ReadWrite);
 
     reset();
 }
@@ -89,11 +88,8 @@ void BusMouse::out8(WORD port, BYTE data)
 
 void BusMouse::moveEvent(WORD x, WORD y)
 {
-    {
-        QMutexLocker locker(&m_mutex);
-        m_currentX = x;
-        m_currentY = y;
-    }
+    m_currentX = x;
+    m_currentY = y;
 
     m_deltaX = m_currentX - m_lastX;
     m_deltaY = m_currentY - m_lastY;
@@ -106,16 +102,13 @@ void BusMouse::moveEvent(WORD x, WORD y)
 
 void BusMouse::buttonPressEvent(WORD x, WORD y, MouseButton button)
 {
-    {
-        QMutexLocker locker(&m_mutex);
-        if (button == MouseButton::Left)
-            m_buttons &= ~(1 << 7);
-        else
-            m_buttons &= ~(1 << 5);
-
-        m_currentX = x;
-        m_currentY = y;
-    }
+    if (button == MouseButton::Left)
+        m_buttons &= ~(1 << 7);
+    else
+        m_buttons &= ~(1 << 5);
+
+    m_currentX = x;
+    m_currentY = y;
 
     m_lastX = m_currentX;
     m_lastY = m_currentY;
@@ -128,16 +121,13 @@ void BusMouse::buttonPressEvent(WORD x, WORD y, MouseButton button)
 
 void BusMouse::buttonReleaseEvent(WORD x, WORD y, MouseButton button)
 {
-    {
-        QMutexLocker locker(&m_mutex);
-        if (button == MouseButton::Left)
-            m_buttons |= (1 << 7);
-        else
-            m_buttons |= (1 << 5);
-
-        m_currentX = x;
-        m_currentY = y;
-    }
+    if (button == MouseButton::Left)
+        m_buttons |= (1 << 7);
+    else
+        m_buttons |= (1 << 5);
+
+    m_currentX = x;
+    m_currentY = y;
 
     m_lastX = m_currentX;
     m_lastY = m_currentY;
@@ -154,8 +144,6 @@ BYTE BusMouse::in8(WORD port)
 
     BYTE ret = 0;
 
-    QMutexLocker locker(&m_mutex);
-
     switch (port) {
     case 0x23c:
         switch (m_command) {
@@ -26,7 +26,6 @@
 
 #include "iodevice.h"
 #include "MouseObserver.h"
-#include <QtCore/QMutex>
 
 class BusMouse final : public IODevice, public MouseObserver {
 public:
@@ -54,6 +53,4 @@ private:
     WORD m_lastY { 0 };
     WORD m_deltaX { 0 };
     WORD m_deltaY { 0 };
-
-    QMutex m_mutex;
 };
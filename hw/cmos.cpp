@@ -27,17 +27,72 @@
 #include "CPU.h"
 #include "machine.h"
 #include "DiskDrive.h"
+#include "TimerService.h"
 #include <QtCore/QDate>
 #include <QtCore/QTime>
+#include <algorithm>
+#include <limits>
 
 //#define CMOS_DEBUG
 
+enum {
+    RegisterAUpdateInProgress = 0x80,
+    RegisterBSet = 0x80,
+    RegisterBPeriodicInterruptEnable = 0x40,
+    RegisterBAlarmInterruptEnable = 0x20,
+    RegisterBUpdateEndedInterruptEnable = 0x10,
+    RegisterBBinaryMode = 0x04,
+    RegisterB24HourMode = 0x02,
+    RegisterCIRQFlag = 0x80,
+    RegisterCPeriodicFlag = 0x40,
+    RegisterCAlarmFlag = 0x20,
+    RegisterCUpdateEndedFlag = 0x10,
+    RegisterDValidRAMAndTime = 0x80,
+};
+
+static const QWORD nanosecondsPerSecond = 1000000000;
+static const QWORD dividerFrequency = 32768;
+// UIP goes high this long before each update cycle.
+static const QWORD updateInProgressLead = 244000;
+static const qint64 unixEpochJulianDay = 2440588;
+
+static QWORD dividerTicksAt(QWORD nanoseconds)
+{
+    return (nanoseconds / nanosecondsPerSecond) * dividerFrequency + (nanoseconds % nanosecondsPerSecond) * dividerFrequency / nanosecondsPerSecond;
+}
+
+static QWORD timeOfDividerTick(QWORD tick)
+{
+    return (tick / dividerFrequency) * nanosecondsPerSecond + ((tick % dividerFrequency) * nanosecondsPerSecond + dividerFrequency - 1) / dividerFrequency;
+}
+
+static qint64 toClockSeconds(const QDate& date, const QTime& time)
+{
+    return (date.toJulianDay() - unixEpochJulianDay) * 86400 + time.hour() * 3600 + time.minute() * 60 + time.second();
+}
+
+static qint64 hostClockSeconds()
+{
+    auto now = QDateTime::currentDateTime();
+    return toClockSeconds(now.date(), now.time());
+}
+
+static qint64 initialClockSeconds()
+{
+#ifdef CT_DETERMINISTIC
+    return toClockSeconds(QDate(2018, 2, 9), QTime(1, 2, 3, 4));
+#endif
+    return hostClockSeconds();
+}
+
 CMOS::CMOS(Machine& machine)
-    : IODevice("CMOS", machine)
+    : IODevice("CMOS", machine, 8)
 {
-    m_rtcTimer = make<ThreadedTimer>(*this, 250);
-    listen(0x70, IODevice::WriteOnly);
-    listen(0x71, IODevice::ReadWrite);
+    m_clockSeconds = initialClockSeconds() + options.rtcOffset;
+    m_hostOffset = m_clockSeconds - hostClockSeconds();
+
+    listen<CMOS>(0x70, IODevice::WriteOnly);
+    listen<CMOS>(0x71, IODevice::ReadWrite);
     reset();
 }
 
@@ -48,14 +103,15 @@ CMOS::~CMOS()
 void CMOS::reset()
 {
     auto& cpu = machine().cpu();
+    auto& timerService = machine().timerService();
 
     memset(m_ram, 0, sizeof(m_ram));
     m_registerIndex = 0;
 
-    // FIXME: This thing needs more work, 0x26 is just an initial value.
+    // 32.768 kHz time base, 1024 Hz periodic rate.
     m_ram[StatusRegisterA] = 0x26;
-
-    m_ram[StatusRegisterB] = 0x02;
+    m_ram[StatusRegisterB] = RegisterB24HourMode;
+    m_ram[StatusRegisterD] = RegisterDValidRAMAndTime;
 
     m_ram[BaseMemoryInKilobytesLSB] = leastSignificant<BYTE>(cpu.baseMemorySize() / 1024);
     m_ram[BaseMemoryInKilobytesMSB] = mostSignificant<BYTE>(cpu.baseMemorySize() / 1024);
@@ -67,56 +123,269 @@ void CMOS::reset()
     // FIXME: This clearly belongs elsewhere.
     m_ram[FloppyDriveTypes] = (machine().floppy0().floppyTypeForCMOS() << 4) | machine().floppy1().floppyTypeForCMOS();
 
-    updateClock();
+    // The clock itself is battery-backed and keeps running across resets.
+    storeClock();
+
+    QWORD now = timerService.now();
+    m_nextUpdate = now + nanosecondsPerSecond;
+    m_dividerBase = now;
+    m_periodicAcknowledged = 0;
+
+    if (m_irqAsserted)
+        lowerIRQ();
+    m_irqAsserted = false;
+    scheduleInterrupt();
 }
 
 bool CMOS::inBinaryClockMode() const
 {
-    return m_ram[StatusRegisterB] & 0x04;
+    return m_ram[StatusRegisterB] & RegisterBBinaryMode;
 }
 
 bool CMOS::in24HourMode() const
 {
-    return m_ram[StatusRegisterB] & 0x02;
+    return m_ram[StatusRegisterB] & RegisterB24HourMode;
 }
 
-static QDateTime currentDateTimeForCMOS()
+BYTE CMOS::toCurrentClockFormat(BYTE value) const
 {
-#ifdef CT_DETERMINISTIC
-    return QDateTime(QDate(2018, 2, 9), QTime(1, 2, 3, 4));
-#endif
-    return QDateTime::currentDateTime();
+    if (inBinaryClockMode())
+        return value;
+    return (value / 10 << 4) | (value - (value / 10) * 10);
 }
 
-BYTE CMOS::toCurrentClockFormat(BYTE value) const
+BYTE CMOS::fromCurrentClockFormat(BYTE value) const
 {
     if (inBinaryClockMode())
         return value;
-    return (value / 10 << 4) | (value - (value / 10) * 10);
+    return (value >> 4) * 10 + (value & 0xf);
+}
+
+static int secondOfDay(qint64 clockSeconds)
+{
+    int second = clockSeconds % 86400;
+    return second < 0 ? second + 86400 : second;
+}
+
+BYTE CMOS::toCurrentHourFormat(int hour) const
+{
+    if (in24HourMode())
+        return toCurrentClockFormat(hour);
+    return toCurrentClockFormat(hour % 12 ? hour % 12 : 12) | (hour >= 12 ? 0x80 : 0);
+}
+
+void CMOS::storeClock()
+{
+    int second = secondOfDay(m_clockSeconds);
+    QDate date = QDate::fromJulianDay((m_clockSeconds - second) / 86400 + unixEpochJulianDay);
+
+    m_ram[RTCSecond] = toCurrentClockFormat(second % 60);
+    m_ram[RTCMinute] = toCurrentClockFormat(second / 60 % 60);
+    m_ram[RTCHour] = toCurrentHourFormat(second / 3600);
+    // The RTC counts Sunday as day 1.
+    m_ram[RTCDayOfWeek] = toCurrentClockFormat(date.dayOfWeek() % 7 + 1);
+    m_ram[RTCDay] = toCurrentClockFormat(date.day());
+    m_ram[RTCMonth] = toCurrentClockFormat(date.month());
+    m_ram[RTCYear] = toCurrentClockFormat(date.year() % 100);
+    m_ram[RTCCentury] = toCurrentClockFormat(date.year() / 100);
+    m_ram[RTCCenturyPS2] = toCurrentClockFormat(date.year() / 100);
+}
+
+void CMOS::loadClock()
+{
+    int hour = fromCurrentClockFormat(m_ram[RTCHour] & 0x7f);
+    if (!in24HourMode()) {
+        hour %= 12;
+        if (m_ram[RTCHour] & 0x80)
+            hour += 12;
+    }
+    int year = fromCurrentClockFormat(m_ram[RTCCentury]) * 100 + fromCurrentClockFormat(m_ram[RTCYear]);
+    QDate date(year, fromCurrentClockFormat(m_ram[RTCMonth]), fromCurrentClockFormat(m_ram[RTCDay]));
+    QTime time(hour, fromCurrentClockFormat(m_ram[RTCMinute]), fromCurrentClockFormat(m_ram[RTCSecond]));
+
+    // Guests set the clock one register at a time; ignore the invalid dates in between.
+    if (!date.isValid() || !time.isValid())
+        return;
+    m_clockSeconds = toClockSeconds(date, time);
+    m_hostOffset = m_clockSeconds - hostClockSeconds();
+}
+
+bool CMOS::alarmMatches(qint64 clockSeconds) const
+{
+    static const BYTE alarmRegisters[3] = { RTCSecondAlarm, RTCMinuteAlarm, RTCHourAlarm };
+    int second = secondOfDay(clockSeconds);
+    const BYTE time[3] = {
+        toCurrentClockFormat(second % 60),
+        toCurrentClockFormat(second / 60 % 60),
+        toCurrentHourFormat(second / 3600),
+    };
+    for (int i = 0; i < 3; ++i) {
+        BYTE alarm = m_ram[alarmRegisters[i]];
+        // Values 0xC0-0xFF match anything.
+        if ((alarm & 0xc0) != 0xc0 && alarm != time[i])
+            return false;
+    }
+    return true;
+}
+
+// Every update cycle compares the alarm, so a catch-up over several seconds checks each of them.
+// The alarm only looks at the time of day, so a day's worth of seconds covers any longer gap.
+bool CMOS::alarmMatchesBetween(qint64 first, qint64 last) const
+{
+    for (qint64 clockSeconds = std::max(first, last - 86399); clockSeconds <= last; ++clockSeconds) {
+        if (alarmMatches(clockSeconds))
+            return true;
+    }
+    return false;
+}
+
+bool CMOS::isDividerRunning() const
+{
+    return (m_ram[StatusRegisterA] & 0x60) != 0x60;
+}
+
+bool CMOS::isUpdateInProgress(QWORD now) const
+{
+    if (!isDividerRunning() || (m_ram[StatusRegisterB] & RegisterBSet))
+        return false;
+    return now + updateInProgressLead >= m_nextUpdate;
+}
+
+// In divider ticks, or 0 if the periodic interrupt is off.
+QWORD CMOS::periodicInterval() const
+{
+    BYTE rate = m_ram[StatusRegisterA] & 0x0f;
+    if (!rate)
+        return 0;
+    // Rates 1 and 2 alias 8 and 9.
+    return rate < 3 ? 1 << (rate + 6) : 1 << (rate - 1);
+}
+
+bool CMOS::isPeriodicFlagPending(QWORD now) const
+{
+    QWORD interval = periodicInterval();
+    if (!interval || !isDividerRunning())
+        return false;
+    return dividerTicksAt(now - m_dividerBase) / interval > m_periodicAcknowledged / interval;
+}
+
+// Runs the update cycles due by `now`. Nothing is scheduled for them unless an
+// interrupt depends on it; register accesses catch up here instead.
+void CMOS::advanceClock(QWORD now)
+{
+    if (!isDividerRunning() || now < m_nextUpdate)
+        return;
+
+    QWORD seconds = (now - m_nextUpdate) / nanosecondsPerSecond + 1;
+    m_nextUpdate += seconds * nanosecondsPerSecond;
+
+    if (m_ram[StatusRegisterB] & RegisterBSet)
+        return;
+
+    qint64 previousClockSeconds = m_clockSeconds;
+    if (options.rtcHostSync)
+        m_clockSeconds = hostClockSeconds() + m_hostOffset;
+    else
+        m_clockSeconds += seconds;
+    storeClock();
+
+    m_ram[StatusRegisterC] |= RegisterCUpdateEndedFlag;
+    // A host clock that went backwards only gets the current second checked.
+    if (alarmMatchesBetween(std::min(previousClockSeconds + 1, m_clockSeconds), m_clockSeconds))
+        m_ram[StatusRegisterC] |= RegisterCAlarmFlag;
+}
+
+BYTE CMOS::readStatusRegisterC(QWORD now)
+{
+    BYTE flags = m_ram[StatusRegisterC];
+    if (isPeriodicFlagPending(now))
+        flags |= RegisterCPeriodicFlag;
+    if (flags & m_ram[StatusRegisterB] & 0x70)
+        flags |= RegisterCIRQFlag;
+
+    m_ram[StatusRegisterC] = 0;
+    if (isDividerRunning())
+        m_periodicAcknowledged = dividerTicksAt(now - m_dividerBase);
+
+    if (m_irqAsserted) {
+        lowerIRQ();
+        m_irqAsserted = false;
+    }
+    return flags;
+}
+
+void CMOS::updateIRQ(QWORD now)
+{
+    if (m_irqAsserted)
+        return;
+    BYTE flags = m_ram[StatusRegisterC];
+    if (isPeriodicFlagPending(now))
+        flags |= RegisterCPeriodicFlag;
+    if (!(flags & m_ram[StatusRegisterB] & 0x70))
+        return;
+#ifdef CMOS_DEBUG
+    vlog(LogCMOS, "Raising IRQ8, flags %02x", flags);
+#endif
+    m_irqAsserted = true;
+    raiseIRQ();
 }
 
-void CMOS::updateClock()
+// IRQ8 is level-triggered in effect: once raised, nothing more happens until
+// register C is read, so there is no event to schedule until then.
+void CMOS::scheduleInterrupt()
 {
-    // FIXME: Support 12-hour clock mode for RTCHour!
-    ASSERT(in24HourMode());
+    auto& timerService = machine().timerService();
+    if (m_interruptTimer)
+        timerService.cancel(m_interruptTimer);
+    m_interruptTimer = 0;
+
+    if (m_irqAsserted || !isDividerRunning())
+        return;
+
+    BYTE enables = m_ram[StatusRegisterB];
+    QWORD deadline = std::numeric_limits<QWORD>::max();
+    if ((enables & (RegisterBAlarmInterruptEnable | RegisterBUpdateEndedInterruptEnable)) && !(enables & RegisterBSet))
+        deadline = m_nextUpdate;
 
-    m_ram[StatusRegisterA] |= 0x80; // RTC update in progress
-    auto now = currentDateTimeForCMOS();
-    m_ram[RTCSecond] = toCurrentClockFormat(now.time().second());
-    m_ram[RTCMinute] = toCurrentClockFormat(now.time().minute());
-    m_ram[RTCHour] = toCurrentClockFormat(now.time().hour());
-    m_ram[RTCDayOfWeek] = toCurrentClockFormat(now.date().dayOfWeek());
-    m_ram[RTCDay] = toCurrentClockFormat(now.date().day());
-    m_ram[RTCMonth] = toCurrentClockFormat(now.date().month());
-    m_ram[RTCYear] = toCurrentClockFormat(now.date().year() % 100);
-    m_ram[RTCCentury] = toCurrentClockFormat(now.date().year() / 100);
-    m_ram[RTCCenturyPS2] = toCurrentClockFormat(now.date().year() / 100);
-    m_ram[StatusRegisterA] &= ~0x80; // RTC update finished
+    QWORD interval = periodicInterval();
+    if ((enables & RegisterBPeriodicInterruptEnable) && interval) {
+        QWORD tick = dividerTicksAt(timerService.now() - m_dividerBase);
+        deadline = std::min(deadline, m_dividerBase + timeOfDividerTick((tick / interval + 1) * interval));
+    }
+
+    if (deadline == std::numeric_limits<QWORD>::max())
+        return;
+
+    m_interruptTimer = timerService.scheduleAt(deadline, [this] {
+        m_interruptTimer = 0;
+        QWORD now = machine().timerService().now();
+        advanceClock(now);
+        updateIRQ(now);
+        scheduleInterrupt();
+    });
 }
 
 BYTE CMOS::in8(WORD)
 {
-    BYTE value = m_ram[m_registerIndex];
+    QWORD now = machine().timerService().now();
+    advanceClock(now);
+
+    BYTE value;
+    switch (m_registerIndex) {
+    case StatusRegisterA:
+        value = m_ram[StatusRegisterA] & ~RegisterAUpdateInProgress;
+        if (isUpdateInProgress(now))
+            value |= RegisterAUpdateInProgress;
+        break;
+    case StatusRegisterC:
+        value = readStatusRegisterC(now);
+        scheduleInterrupt();
+        break;
+    default:
+        value = m_ram[m_registerIndex];
+        break;
+    }
+
 #ifdef CMOS_DEBUG
     vlog(LogCMOS, "Read register %02x (%02x)", m_registerIndex, value);
 #endif
@@ -136,7 +405,58 @@ void CMOS::out8(WORD port, BYTE data)
 #ifdef CMOS_DEBUG
     vlog(LogCMOS, "Write register %02x <- %02x", m_registerIndex, data);
 #endif
-    m_ram[m_registerIndex] = data;
+
+    QWORD now = machine().timerService().now();
+    advanceClock(now);
+
+    switch (m_registerIndex) {
+    case StatusRegisterA: {
+        bool wasRunning = isDividerRunning();
+        m_ram[StatusRegisterA] = data & ~RegisterAUpdateInProgress;
+        // Coming out of divider reset, the first update follows half a second later.
+        if (!wasRunning && isDividerRunning()) {
+            m_nextUpdate = now + nanosecondsPerSecond / 2;
+            m_dividerBase = now;
+            m_periodicAcknowledged = 0;
+        }
+        break;
+    }
+    case StatusRegisterB: {
+        BYTE formatBits = RegisterBBinaryMode | RegisterB24HourMode;
+        bool formatChanged = (m_ram[StatusRegisterB] ^ data) & formatBits;
+        if (data & RegisterBSet)
+            data &= ~RegisterBUpdateEndedInterruptEnable;
+        m_ram[StatusRegisterB] = data;
+        if (formatChanged)
+            storeClock();
+        break;
+    }
+    case StatusRegisterC:
+    case StatusRegisterD:
+        break;
+    case RTCSecond:
+    case RTCMinute:
+    case RTCHour:
+    case RTCDayOfWeek:
+    case RTCDay:
+    case RTCMonth:
+    case RTCYear:
+        m_ram[m_registerIndex] = data;
+        loadClock();
+        break;
+    case RTCCentury:
+    case RTCCenturyPS2:
+        m_ram[RTCCentury] = data;
+        m_ram[RTCCenturyPS2] = data;
+        loadClock();
+        break;
+    default:
+        m_ram[m_registerIndex] = data;
+        break;
+    }
+
+    updateIRQ(now);
+    scheduleInterrupt();
 }
 
 void CMOS::set(RegisterIndex index, BYTE data)
@@ -150,8 +470,3 @@ BYTE CMOS::get(RegisterIndex index) const
     ASSERT((size_t)index < sizeof(m_ram));
     return m_ram[index];
 }
-
-void CMOS::threadedTimerFired(Badge<ThreadedTimer>)
-{
-    updateClock();
-}
@@ -26,14 +26,18 @@
 
 #include "iodevice.h"
 #include "Common.h"
-#include "ThreadedTimer.h"
 #include "OwnPtr.h"
+#include "TimerService.h"
 
-class CMOS final : public IODevice, public ThreadedTimer::Listener {
+// MC146818 real-time clock and CMOS RAM. The clock runs on emulated time, and
+// IRQ8 sources are scheduled only while they are enabled and unacknowledged.
+class CMOS final : public IODevice {
 public:
     enum RegisterIndex {
         StatusRegisterA = 0x0a,
         StatusRegisterB = 0x0b,
+        StatusRegisterC = 0x0c,
+        StatusRegisterD = 0x0d,
         FloppyDriveTypes = 0x10,
         BaseMemoryInKilobytesLSB = 0x15,
         BaseMemoryInKilobytesMSB = 0x16,
@@ -42,8 +46,11 @@ public:
         ExtendedMemoryInKilobytesAltLSB = 0x30,
         ExtendedMemoryInKilobytesAltMSB = 0x31,
         RTCSecond = 0x00,
+        RTCSecondAlarm = 0x01,
         RTCMinute = 0x02,
+        RTCMinuteAlarm = 0x03,
         RTCHour = 0x04,
+        RTCHourAlarm = 0x05,
         RTCDayOfWeek = 0x06,
         RTCDay = 0x07,
         RTCMonth = 0x08,
@@ -59,20 +66,44 @@ public:
     void out8(WORD port, BYTE data) override;
     BYTE in8(WORD port) override;
 
-    void updateClock();
-
     void set(RegisterIndex, BYTE);
     BYTE get(RegisterIndex) const;
 
 private:
-    virtual void threadedTimerFired(Badge<ThreadedTimer>) override;
-
     BYTE m_registerIndex { 0 };
-    BYTE m_ram[80];
+    BYTE m_ram[128];
 
     bool inBinaryClockMode() const;
     bool in24HourMode() const;
     BYTE toCurrentClockFormat(BYTE) const;
+    BYTE fromCurrentClockFormat(BYTE) const;
+    BYTE toCurrentHourFormat(int hour) const;
+
+    void storeClock();
+    void loadClock();
+    void advanceClock(QWORD now);
+    bool alarmMatches(qint64 clockSeconds) const;
+    bool alarmMatchesBetween(qint64 first, qint64 last) const;
+
+    bool isDividerRunning() const;
+    bool isUpdateInProgress(QWORD now) const;
+    QWORD periodicInterval() const;
+    bool isPeriodicFlagPending(QWORD now) const;
+    BYTE readStatusRegisterC(QWORD now);
+    void updateIRQ(QWORD now);
+    void scheduleInterrupt();
+
+    // Seconds since 1970 in the guest's local time.
+    qint64 m_clockSeconds { 0 };
+    // m_clockSeconds minus the host clock, for --rtc-host-sync.
+    qint64 m_hostOffset { 0 };
+
+    // Emulated times of the next update cycle and of the last divider reset.
+    QWORD m_nextUpdate { 0 };
+    QWORD m_dividerBase { 0 };
+    // Divider tick at which the periodic flag was last cleared.
+    QWORD m_periodicAcknowledged { 0 };
 
-    OwnPtr<ThreadedTimer> m_rtcTimer;
+    bool m_irqAsserted { false };
+    TimerService::TimerID m_interruptTimer { 0 };
 };
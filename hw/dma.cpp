@@ -1,176 +1,240 @@
-/*
- * Copyright (C) 2003-2011 Andreas Kling <kling@webkit.org>
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- *
- * THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
- * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
- * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
- * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
- * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#include "Common.h"
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "dma.h"
+#include "CPU.h"
 #include "debug.h"
+#include "machine.h"
 #include <string.h>
 
-#define DMA_CHANNELS 8
+//#define DMA_DEBUG
 
-struct dma_channel_t
-{
-    WORD count;
-    bool next_count_write_is_msb;
-    bool next_count_read_is_msb;
-
-    WORD address;
-    bool next_address_write_is_msb;
-    bool next_address_read_is_msb;
-};
-
-static dma_channel_t dma1_channel[DMA_CHANNELS];
-static dma_channel_t dma2_channel[DMA_CHANNELS];
+// Which of the 0x80-0x8F page registers holds bits 16-23 of each channel's address.
+static const BYTE pageRegisterForChannel[8] = { 0x07, 0x03, 0x01, 0x02, 0x0F, 0x0B, 0x09, 0x0A };
 
-static void dma_ch_count_write(VCpu* cpu, WORD port, BYTE data);
-static BYTE dma_ch_count_read(VCpu* cpu, WORD port);
-static void dma_ch_address_write(VCpu* cpu, WORD port, BYTE data);
-static BYTE dma_ch_address_read(VCpu* cpu, WORD port);
-
-void dma_init()
+DMA::DMA(Machine& machine)
+    : IODevice("DMA", machine)
 {
-    for (int i = 0; i < DMA_CHANNELS; ++i) {
-        memset(&dma1_channel[i], 0, sizeof(dma_channel_t));
-        memset(&dma2_channel[i], 0, sizeof(dma_channel_t));
-    }
-
-    vm_listen(0x000, dma_ch_address_read, dma_ch_address_write);
-    vm_listen(0x001, dma_ch_count_read, dma_ch_count_write);
-    vm_listen(0x002, dma_ch_address_read, dma_ch_address_write);
-    vm_listen(0x003, dma_ch_count_read, dma_ch_count_write);
-    vm_listen(0x004, dma_ch_address_read, dma_ch_address_write);
-    vm_listen(0x005, dma_ch_count_read, dma_ch_count_write);
-    vm_listen(0x006, dma_ch_address_read, dma_ch_address_write);
-    vm_listen(0x007, dma_ch_count_read, dma_ch_count_write);
+    for (WORD port = 0x00; port <= 0x0F; ++port)
+        listen<DMA>(port, IODevice::ReadWrite);
+    for (WORD port = 0xC0; port <= 0xDE; port += 2)
+        listen<DMA>(port, IODevice::ReadWrite);
+    // 0x80 is left alone, it's the POST code port.
+    for (WORD port = 0x81; port <= 0x8F; ++port)
+        listen<DMA>(port, IODevice::ReadWrite);
+
+    reset();
 }
 
-void dma_ch_count_write(VCpu*, WORD port, BYTE data)
+DMA::~DMA()
 {
-    dma_channel_t* c;
-    BYTE channel, chip = 0;
-
-    switch (port) {
-    case 0x001: channel = 0; break;
-    case 0x003: channel = 1; break;
-    case 0x005: channel = 2; break;
-    case 0x007: channel = 3; break;
-    default:
-        vlog(VM_DMAMSG, "Unknown channel for port %03X", port);
-        return;
-    }
-
-    c = &dma1_channel[channel];
-
-    if (c->next_count_write_is_msb)
-        c->count |= (data << 8);
-    else
-        c->count |= (data & 0xFF);
-
-    vlog(VM_DMAMSG, "Write DMA-%u channel %u count (%s), data: %02X", chip, channel, c->next_count_write_is_msb ? "MSB" : "LSB", data);
+}
 
-    c->next_count_write_is_msb = !c->next_count_write_is_msb;
+void DMA::reset()
+{
+    for (auto& controller : m_controller)
+        controller = Controller();
+    memset(m_pageRegister, 0, sizeof(m_pageRegister));
 }
 
-BYTE dma_ch_count_read(VCpu*, WORD port)
+PhysicalAddress DMA::currentPhysicalAddress(unsigned index) const
 {
-    dma_channel_t* c;
-    BYTE data;
-    BYTE channel, chip;
+    BYTE page = m_pageRegister[pageRegisterForChannel[index]];
+    WORD address = channel(index).currentAddress;
+    if (index >= 4)
+        return PhysicalAddress(((page & 0xFE) << 16) | (address << 1));
+    return PhysicalAddress((page << 16) | address);
+}
 
-    if (port == 0x001) {
-        channel = 0;
-        chip = 1;
+BYTE DMA::in8(WORD port)
+{
+    if (port >= 0x80)
+        return m_pageRegister[port & 0xF];
+
+    auto& controller = controllerForPort(port);
+    BYTE reg = port >= 0xC0 ? (port - 0xC0) >> 1 : port;
+
+    if (reg < 8) {
+        auto& channel = controller.channel[reg >> 1];
+        WORD value = (reg & 1) ? channel.currentCount : channel.currentAddress;
+        BYTE data = controller.flipFlop ? (value >> 8) : (value & 0xFF);
+        controller.flipFlop = !controller.flipFlop;
+        return data;
     }
-    else
-        vlog(VM_DMAMSG, "Unknown channel for port %03X", port);
 
-    c = (chip == 1) ? &dma1_channel[channel] : &dma2_channel[channel];
-
-    if (c->next_count_read_is_msb)
-        data = c->count >> 8;
-    else
-        data = c->count & 0xFF;
-
-    vlog(VM_DMAMSG, "Read DMA-%u channel %u count (%s), data: %02X", chip, channel, c->next_count_read_is_msb ? "MSB" : "LSB", data);
-
-    c->next_count_read_is_msb = !c->next_count_read_is_msb;
-    return data;
+    switch (reg) {
+    case 0x8: {
+        BYTE data = controller.status | (controller.request << 4);
+        // Reading the status clears the terminal count bits.
+        controller.status = 0;
+        return data;
+    }
+    case 0xD:
+        return 0;
+    case 0xF: {
+        BYTE data = 0xF0;
+        for (unsigned i = 0; i < 4; ++i) {
+            if (controller.channel[i].masked)
+                data |= 1 << i;
+        }
+        return data;
+    }
+    }
+    vlog(LogDMA, "Read from write-only register %02x", port);
+    return IODevice::JunkValue;
 }
 
-void dma_ch_address_write(VCpu*, WORD port, BYTE data)
+void DMA::out8(WORD port, BYTE data)
 {
-    dma_channel_t* c;
-    BYTE channel, chip = 0;
-
-    switch (port) {
-    case 0x000: channel = 0; break;
-    case 0x002: channel = 1; break;
-    case 0x004: channel = 2; break;
-    case 0x006: channel = 3; break;
-    default:
-        vlog(VM_DMAMSG, "Unknown channel for port %03X", port);
+#ifdef DMA_DEBUG
+    vlog(LogDMA, "out8 %03x, %02x", port, data);
+#endif
+    if (port >= 0x80) {
+        m_pageRegister[port & 0xF] = data;
         return;
     }
 
-    c = &dma1_channel[channel];
-
-    if (c->next_address_write_is_msb)
-        c->address |= data << 8;
-    else
-        c->address |= data & 0xFF;
+    auto& controller = controllerForPort(port);
+    BYTE reg = port >= 0xC0 ? (port - 0xC0) >> 1 : port;
+
+    if (reg < 8) {
+        auto& channel = controller.channel[reg >> 1];
+        WORD& base = (reg & 1) ? channel.baseCount : channel.baseAddress;
+        WORD& current = (reg & 1) ? channel.currentCount : channel.currentAddress;
+        if (controller.flipFlop)
+            base = (base & 0x00FF) | (data << 8);
+        else
+            base = (base & 0xFF00) | data;
+        current = base;
+        controller.flipFlop = !controller.flipFlop;
+        return;
+    }
 
-    vlog(VM_DMAMSG, "Write DMA-%u channel %u address (%s), data: %02X", chip, channel, c->next_address_write_is_msb ? "MSB" : "LSB", data);
+    switch (reg) {
+    case 0x8:
+        controller.command = data;
+        break;
+    case 0x9:
+        if (data & 4)
+            controller.request |= 1 << (data & 3);
+        else
+            controller.request &= ~(1 << (data & 3));
+        break;
+    case 0xA:
+        controller.channel[data & 3].masked = data & 4;
+        break;
+    case 0xB:
+        controller.channel[data & 3].mode = data;
+        break;
+    case 0xC:
+        controller.flipFlop = false;
+        break;
+    case 0xD:
+        // Master clear, the same as a hardware reset.
+        controller.flipFlop = false;
+        controller.command = 0;
+        controller.status = 0;
+        controller.request = 0;
+        for (auto& channel : controller.channel)
+            channel.masked = true;
+        break;
+    case 0xE:
+        for (auto& channel : controller.channel)
+            channel.masked = false;
+        break;
+    case 0xF:
+        for (unsigned i = 0; i < 4; ++i)
+            controller.channel[i].masked = data & (1 << i);
+        break;
+    }
+}
 
-    c->next_address_write_is_msb = !c->next_address_write_is_msb;
+DWORD DMA::bytesUntilTerminalCount(unsigned index) const
+{
+    auto& channel = this->channel(index);
+    if (channel.masked)
+        return 0;
+    return ((DWORD)channel.currentCount + 1) * (index >= 4 ? 2 : 1);
 }
 
-BYTE dma_ch_address_read(VCpu*, WORD port)
+template<typename Callback>
+DWORD DMA::transfer(unsigned index, TransferType type, DWORD size, Callback callback)
 {
-    dma_channel_t* c;
-    BYTE data;
-    BYTE channel, chip = 0;
-
-    switch (port) {
-    case 0x000: channel = 0; break;
-    case 0x002: channel = 1; break;
-    case 0x004: channel = 2; break;
-    case 0x006: channel = 3; break;
-    default:
-        vlog(VM_DMAMSG, "Unknown channel for port %03X", port);
+    ASSERT(index < 8);
+    auto& channel = this->channel(index);
+    if (channel.masked) {
+        vlog(LogDMA, "Transfer on masked channel %u", index);
+        return 0;
+    }
+    if (channel.transferType() != type) {
+        vlog(LogDMA, "Channel %u is programmed for transfer type %u, not %u", index, (unsigned)channel.transferType(), (unsigned)type);
         return 0;
     }
 
-    c = &dma1_channel[channel];
-
-    if (c->next_address_read_is_msb)
-        data = c->address >> 8;
-    else
-        data = c->address & 0xFF;
+    DWORD unitSize = index >= 4 ? 2 : 1;
+    DWORD bytesDone = 0;
+    while (bytesDone + unitSize <= size) {
+        DWORD unitsUntilTerminalCount = (DWORD)channel.currentCount + 1;
+        DWORD units = std::min(unitsUntilTerminalCount, (size - bytesDone) / unitSize);
+        // Only the low 16 bits of the address count, so runs stop where the address wraps.
+        if (channel.decrement())
+            units = 1;
+        else
+            units = std::min<DWORD>(units, 0x10000 - channel.currentAddress);
+
+        callback(currentPhysicalAddress(index), bytesDone, units * unitSize);
+        bytesDone += units * unitSize;
+
+        channel.currentAddress += channel.decrement() ? -units : units;
+        channel.currentCount -= units;
+
+        if (units == unitsUntilTerminalCount) {
+            m_controller[index >> 2].status |= 1 << (index & 3);
+            if (channel.autoInitialize()) {
+                channel.currentAddress = channel.baseAddress;
+                channel.currentCount = channel.baseCount;
+            } else {
+                channel.masked = true;
+            }
+            break;
+        }
+    }
+    return bytesDone;
+}
 
-    vlog(VM_DMAMSG, "Read DMA-%u channel %u address (%s), data: %02X", chip, channel, c->next_address_read_is_msb ? "MSB" : "LSB", data);
+DWORD DMA::writeToMemory(unsigned index, const BYTE* data, DWORD size)
+{
+    auto& cpu = machine().cpu();
+    return transfer(index, TransferType::WriteToMemory, size, [&] (PhysicalAddress address, DWORD offset, DWORD length) {
+        cpu.writePhysicalMemoryBlock(address, data + offset, length);
+    });
+}
 
-    c->next_address_read_is_msb = !c->next_address_read_is_msb;
-    return 1;
-    return data;
+DWORD DMA::readFromMemory(unsigned index, BYTE* data, DWORD size)
+{
+    auto& cpu = machine().cpu();
+    return transfer(index, TransferType::ReadFromMemory, size, [&] (PhysicalAddress address, DWORD offset, DWORD length) {
+        cpu.readPhysicalMemoryBlock(address, data + offset, length);
+    });
 }
@@ -0,0 +1,80 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "iodevice.h"
+
+// The two cascaded 8237s: channels 0-3 move bytes, channels 4-7 move words, and 4 is the cascade.
+class DMA final : public IODevice {
+public:
+    explicit DMA(Machine&);
+    virtual ~DMA();
+
+    virtual void reset() override;
+    virtual BYTE in8(WORD port) override;
+    virtual void out8(WORD port, BYTE data) override;
+
+    // Bytes the channel will move before terminal count, or 0 if it's masked.
+    DWORD bytesUntilTerminalCount(unsigned channel) const;
+
+    // Whole-block transfers on behalf of a peripheral, straight into or out of guest RAM.
+    // They stop at terminal count and return the number of bytes actually moved.
+    DWORD writeToMemory(unsigned channel, const BYTE* data, DWORD size);
+    DWORD readFromMemory(unsigned channel, BYTE* data, DWORD size);
+
+private:
+    enum class TransferType { Verify = 0, WriteToMemory = 1, ReadFromMemory = 2, Invalid = 3 };
+
+    struct Channel {
+        WORD baseAddress { 0 };
+        WORD baseCount { 0 };
+        WORD currentAddress { 0 };
+        WORD currentCount { 0 };
+        BYTE mode { 0 };
+        bool masked { true };
+
+        TransferType transferType() const { return static_cast<TransferType>((mode >> 2) & 3); }
+        bool autoInitialize() const { return mode & 0x10; }
+        bool decrement() const { return mode & 0x20; }
+    };
+
+    struct Controller {
+        Channel channel[4];
+        bool flipFlop { false };
+        BYTE command { 0 };
+        BYTE status { 0 };
+        BYTE request { 0 };
+    };
+
+    Controller& controllerForPort(WORD port) { return port >= 0xC0 ? m_controller[1] : m_controller[0]; }
+    Channel& channel(unsigned index) { return m_controller[index >> 2].channel[index & 3]; }
+    const Channel& channel(unsigned index) const { return m_controller[index >> 2].channel[index & 3]; }
+    PhysicalAddress currentPhysicalAddress(unsigned channel) const;
+
+    template<typename Callback> DWORD transfer(unsigned channel, TransferType, DWORD size, Callback);
+
+    Controller m_controller[2];
+    BYTE m_pageRegister[16];
+};
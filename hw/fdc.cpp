@@ -28,6 +28,8 @@
 #include "debug.h"
 #include "machine.h"
 #include "DiskDrive.h"
+#include "dma.h"
+#include "TimerService.h"
 
 #define FDC_NEC765
 #define FDC_DEBUG
@@ -46,6 +48,20 @@
 
 #define DATA_REGISTER_READY 0x80
 
+#define FDC_ST0_ABNORMAL_TERMINATION 0x40
+#define FDC_ST0_NOT_READY 0x08
+#define FDC_ST1_END_OF_CYLINDER 0x80
+#define FDC_ST1_OVERRUN 0x10
+#define FDC_ST1_NO_DATA 0x04
+
+// Floppy data always goes through this DMA channel.
+static const unsigned fdcDMAChannel = 2;
+
+// Commands with an execution phase finish this many nanoseconds after the last command byte.
+// Long enough for drivers to see the controller busy before the interrupt arrives,
+// and nowhere near the milliseconds a real drive would take.
+static const QWORD commandLatency = 20000;
+
 enum FDCCommand {
     SenseInterruptStatus = 0x08,
     SpecifyStepAndHeadLoad = 0x03,
@@ -115,6 +131,8 @@ struct FDC::Private
     BYTE perpendicularModeConfig { 0 };
     bool lock { false };
     BYTE expectedSenseInterruptCount { 0 };
+    unsigned pendingCommandEvent { 0 };
+    QByteArray transferBuffer;
 
     FDCDrive& currentDrive() { ASSERT(driveIndex < 2); return drive[driveIndex]; }
 };
@@ -123,12 +141,12 @@ FDC::FDC(Machine& machine)
     : IODevice("FDC", machine, 6)
     , d(make<Private>())
 {
-    listen(0x3F0, IODevice::ReadOnly);
-    listen(0x3F1, IODevice::ReadOnly);
-    listen(0x3F2, IODevice::WriteOnly);
-    listen(0x3F4, IODevice::ReadWrite);
-    listen(0x3F5, IODevice::ReadWrite);
-    listen(0x3F7, IODevice::ReadWrite);
+    listen<FDC>(0x3F0, IODevice::ReadOnly);
+    listen<FDC>(0x3F1, IODevice::ReadOnly);
+    listen<FDC>(0x3F2, IODevice::WriteOnly);
+    listen<FDC>(0x3F4, IODevice::ReadWrite);
+    listen<FDC>(0x3F5, IODevice::ReadWrite);
+    listen<FDC>(0x3F7, IODevice::ReadWrite);
 
     reset();
 }
@@ -165,6 +183,11 @@ bool FDC::usingDMA() const
 
 void FDC::resetController(ResetSource resetSource)
 {
+    if (d->pendingCommandEvent) {
+        machine().timerService().cancel(d->pendingCommandEvent);
+        d->pendingCommandEvent = 0;
+    }
+
     if (resetSource == Software) {
         vlog(LogFDC, "Reset by software");
     } else {
@@ -278,6 +301,21 @@ static bool isReadDataCommand(BYTE b)
     return (b & 0x1f) == 0x06;
 }
 
+static bool isWriteDataCommand(BYTE b)
+{
+    return (b & 0x3f) == 0x05;
+}
+
+static bool isReadIDCommand(BYTE b)
+{
+    return (b & 0xbf) == 0x0a;
+}
+
+static bool isFormatTrackCommand(BYTE b)
+{
+    return (b & 0xbf) == 0x0d;
+}
+
 void FDC::out8(WORD port, BYTE data)
 {
 #ifdef FDC_DEBUG
@@ -321,8 +359,12 @@ void FDC::out8(WORD port, BYTE data)
             d->mainStatusRegister &= FDC_MSR_DIO;
             d->mainStatusRegister |= FDC_MSR_RQM | FDC_MSR_CMDBSY;
             // Determine the command length
-            if (isReadDataCommand(data)) {
+            if (isReadDataCommand(data) || isWriteDataCommand(data)) {
                 d->commandSize = 9;
+            } else if (isReadIDCommand(data)) {
+                d->commandSize = 2;
+            } else if (isFormatTrackCommand(data)) {
+                d->commandSize = 6;
             } else {
                 switch (data) {
                 case GetVersion:
@@ -385,33 +427,254 @@ void FDC::resetControllerSoon()
     executeCommandSoon();
 }
 
-void FDC::executeReadDataCommand()
+DiskDrive* FDC::diskDrive(BYTE driveIndex)
+{
+    if (driveIndex == 0)
+        return &machine().floppy0();
+    if (driveIndex == 1)
+        return &machine().floppy1();
+    return nullptr;
+}
+
+static BYTE sizeCodeForSectorSize(unsigned bytesPerSector)
+{
+    BYTE sizeCode = 0;
+    while (sizeCode < 7 && (128u << sizeCode) < bytesPerSector)
+        ++sizeCode;
+    return sizeCode;
+}
+
+void FDC::finishDataCommand(BYTE st0, BYTE st1, BYTE st2, BYTE cylinder, BYTE head, BYTE sector, BYTE sizeCode)
 {
+    d->statusRegister[0] = st0 | ((head & 1) << 2) | d->driveIndex;
+    d->statusRegister[1] = st1;
+    d->statusRegister[2] = st2;
+    d->commandResult.clear();
+    d->commandResult.append(d->statusRegister[0]);
+    d->commandResult.append(d->statusRegister[1]);
+    d->commandResult.append(d->statusRegister[2]);
+    d->commandResult.append(cylinder);
+    d->commandResult.append(head);
+    d->commandResult.append(sector);
+    d->commandResult.append(sizeCode);
+    vlog(LogFDC, "Raise IRQ (ST0:%02x ST1:%02x ST2:%02x, next C:%u H:%u S:%u)", d->statusRegister[0], st1, st2, cylinder, head, sector);
+    raiseIRQ();
+}
+
+void FDC::executeReadWriteDataCommand()
+{
+    bool isWrite = isWriteDataCommand(d->command[0]);
+    bool multiTrack = d->command[0] & 0x80;
     d->driveIndex = d->command[1] & 3;
-    d->currentDrive().head = (d->command[1] >> 2) & 1;
-    d->currentDrive().cylinder = d->command[2];
-    d->currentDrive().head = d->command[3];
-    d->currentDrive().sector = d->command[4];
-    d->currentDrive().bytesPerSector = d->command[5];
-    d->currentDrive().endOfTrack = d->command[6];
-    d->currentDrive().gap3Length = d->command[7];
-    d->currentDrive().dataLength = d->command[8];
-    vlog(LogFDC, "ReadData { drive:%u, C:%u H:%u, S:%u / bpS:%u, EOT:%u, g3l:%u, dl:%u }",
+    BYTE cylinder = d->command[2];
+    BYTE head = d->command[3];
+    BYTE sector = d->command[4];
+    BYTE sizeCode = d->command[5];
+    BYTE endOfTrack = d->command[6];
+
+    vlog(LogFDC, "%s { drive:%u, C:%u H:%u, S:%u / bpS:%u, EOT:%u, g3l:%u, dl:%u, MT:%u }",
+        isWrite ? "WriteData" : "ReadData",
         d->driveIndex,
-        d->currentDrive().cylinder,
-        d->currentDrive().head,
-        d->currentDrive().sector,
-        128 << d->currentDrive().bytesPerSector,
-        d->currentDrive().endOfTrack,
-        d->currentDrive().gap3Length,
-        d->currentDrive().dataLength
+        cylinder,
+        head,
+        sector,
+        128 << (sizeCode & 7),
+        endOfTrack,
+        d->command[7],
+        d->command[8],
+        multiTrack
     );
+
+    auto* diskDrive = this->diskDrive(d->driveIndex);
+    if (!diskDrive || !diskDrive->present()) {
+        finishDataCommand(FDC_ST0_ABNORMAL_TERMINATION | FDC_ST0_NOT_READY, 0, 0, cylinder, head, sector, sizeCode);
+        return;
+    }
+
+    auto& drive = d->currentDrive();
+    drive.cylinder = cylinder;
+    drive.head = head & 1;
+    drive.sector = sector;
+    drive.bytesPerSector = sizeCode;
+    drive.endOfTrack = endOfTrack;
+    drive.gap3Length = d->command[7];
+    drive.dataLength = d->command[8];
+
+    unsigned sectorSize = 128u << (sizeCode & 7);
+    if (!usingDMA() || sectorSize != diskDrive->bytesPerSector() || !sector || sector > endOfTrack) {
+        // FIXME: Non-DMA (PIO) transfers aren't supported.
+        finishDataCommand(FDC_ST0_ABNORMAL_TERMINATION, FDC_ST1_NO_DATA, 0, cylinder, head, sector, sizeCode);
+        return;
+    }
+
+    // Move as many whole runs of sectors as the DMA channel will take before terminal count,
+    // which is how the host tells the controller to stop.
+    auto& dma = machine().dma();
+    DWORD bytesLeft = dma.bytesUntilTerminalCount(fdcDMAChannel);
+    BYTE st0 = 0;
+    BYTE st1 = 0;
+    for (;;) {
+        if (sector > endOfTrack) {
+            if (!multiTrack || (head & 1)) {
+                st0 = FDC_ST0_ABNORMAL_TERMINATION;
+                st1 = FDC_ST1_END_OF_CYLINDER;
+                break;
+            }
+            head |= 1;
+            sector = 1;
+        }
+        if (!bytesLeft) {
+            st0 = FDC_ST0_ABNORMAL_TERMINATION;
+            st1 = FDC_ST1_OVERRUN;
+            break;
+        }
+
+        unsigned count = std::min<DWORD>(endOfTrack - sector + 1, (bytesLeft + sectorSize - 1) / sectorSize);
+        DWORD lba = diskDrive->toLBA(cylinder, head & 1, sector);
+        if (lba + count > diskDrive->sectors()) {
+            st0 = FDC_ST0_ABNORMAL_TERMINATION;
+            st1 = FDC_ST1_NO_DATA;
+            break;
+        }
+
+        DWORD size = count * sectorSize;
+        d->transferBuffer.resize(size);
+        BYTE* buffer = reinterpret_cast<BYTE*>(d->transferBuffer.data());
+        DWORD transferred;
+        bool success;
+        if (isWrite) {
+            transferred = dma.readFromMemory(fdcDMAChannel, buffer, size);
+            // A sector cut short by terminal count is padded with zeroes, like the real thing does.
+            memset(buffer + transferred, 0, size - transferred);
+            success = transferred && diskDrive->writeSectors(lba, count, buffer);
+        } else {
+            success = diskDrive->readSectors(lba, count, buffer);
+            transferred = success ? dma.writeToMemory(fdcDMAChannel, buffer, size) : 0;
+        }
+
+        if (!success) {
+            st0 = FDC_ST0_ABNORMAL_TERMINATION;
+            st1 = transferred ? FDC_ST1_NO_DATA : FDC_ST1_OVERRUN;
+            break;
+        }
+
+        sector += count;
+        bytesLeft = transferred < size ? 0 : bytesLeft - transferred;
+        if (!bytesLeft)
+            break;
+    }
+
+    // Like the controller, report the sector after the last one transferred.
+    if (sector > endOfTrack) {
+        sector = 1;
+        if (multiTrack)
+            head ^= 1;
+        if (!multiTrack || !(head & 1))
+            ++cylinder;
+    }
+    drive.head = head & 1;
+    drive.sector = sector;
+    finishDataCommand(st0, st1, 0, cylinder, head, sector, sizeCode);
+}
+
+void FDC::executeReadIDCommand()
+{
+    d->driveIndex = d->command[1] & 3;
+    BYTE head = (d->command[1] >> 2) & 1;
+    vlog(LogFDC, "ReadID { drive:%u, H:%u }", d->driveIndex, head);
+
+    auto* diskDrive = this->diskDrive(d->driveIndex);
+    if (!diskDrive || !diskDrive->present()) {
+        finishDataCommand(FDC_ST0_ABNORMAL_TERMINATION | FDC_ST0_NOT_READY, 0, 0, 0, head, 1, 2);
+        return;
+    }
+
+    d->currentDrive().head = head;
+    finishDataCommand(0, 0, 0, d->currentDrive().cylinder, head, 1, sizeCodeForSectorSize(diskDrive->bytesPerSector()));
+}
+
+void FDC::executeFormatTrackCommand()
+{
+    d->driveIndex = d->command[1] & 3;
+    BYTE head = (d->command[1] >> 2) & 1;
+    BYTE sizeCode = d->command[2];
+    BYTE sectorsPerTrack = d->command[3];
+    BYTE filler = d->command[5];
+    vlog(LogFDC, "FormatTrack { drive:%u, H:%u, bpS:%u, SC:%u, filler:%02x }", d->driveIndex, head, 128 << (sizeCode & 7), sectorsPerTrack, filler);
+
+    auto* diskDrive = this->diskDrive(d->driveIndex);
+    if (!diskDrive || !diskDrive->present()) {
+        finishDataCommand(FDC_ST0_ABNORMAL_TERMINATION | FDC_ST0_NOT_READY, 0, 0, 0, head, 1, sizeCode);
+        return;
+    }
+
+    auto& drive = d->currentDrive();
+    drive.head = head;
+
+    unsigned sectorSize = 128u << (sizeCode & 7);
+    if (!usingDMA() || sectorSize != diskDrive->bytesPerSector()) {
+        finishDataCommand(FDC_ST0_ABNORMAL_TERMINATION, FDC_ST1_NO_DATA, 0, drive.cylinder, head, 1, sizeCode);
+        return;
+    }
+
+    // The host supplies a C/H/R/N address field for each sector, and every sector gets the filler byte.
+    auto& dma = machine().dma();
+    BYTE ids[256 * 4];
+    DWORD idSize = sectorsPerTrack * 4;
+    if (dma.readFromMemory(fdcDMAChannel, ids, idSize) < idSize) {
+        finishDataCommand(FDC_ST0_ABNORMAL_TERMINATION, FDC_ST1_OVERRUN, 0, drive.cylinder, head, 1, sizeCode);
+        return;
+    }
+
+    d->transferBuffer.fill(static_cast<char>(filler), sectorSize);
+    const BYTE* buffer = reinterpret_cast<const BYTE*>(d->transferBuffer.constData());
+    BYTE st0 = 0;
+    BYTE st1 = 0;
+    for (unsigned i = 0; i < sectorsPerTrack; ++i) {
+        BYTE sector = ids[i * 4 + 2];
+        if (!sector || sector > diskDrive->sectorsPerTrack())
+            continue;
+        DWORD lba = diskDrive->toLBA(drive.cylinder, head, sector);
+        if (lba >= diskDrive->sectors() || !diskDrive->writeSectors(lba, 1, buffer)) {
+            st0 = FDC_ST0_ABNORMAL_TERMINATION;
+            st1 = FDC_ST1_NO_DATA;
+            break;
+        }
+    }
+    finishDataCommand(st0, st1, 0, drive.cylinder, head, sectorsPerTrack, sizeCode);
+}
+
+bool FDC::commandHasExecutionPhase() const
+{
+    if (d->hasPendingReset)
+        return true;
+    if (d->command.isEmpty())
+        return false;
+    BYTE command = d->command[0];
+    return isReadDataCommand(command)
+        || isWriteDataCommand(command)
+        || isReadIDCommand(command)
+        || isFormatTrackCommand(command)
+        || command == SeekToTrack
+        || command == Recalibrate;
 }
 
 void FDC::executeCommandSoon()
 {
-    // FIXME: Don't do this immediately, do it "soon"!
-    executeCommand();
+    if (!commandHasExecutionPhase()) {
+        executeCommand();
+        return;
+    }
+
+    // Busy and deaf to the data register until the command completes.
+    d->mainStatusRegister &= ~FDC_MSR_RQM;
+    d->mainStatusRegister |= FDC_MSR_CMDBSY;
+    if (d->pendingCommandEvent)
+        machine().timerService().cancel(d->pendingCommandEvent);
+    d->pendingCommandEvent = machine().timerService().schedule(commandLatency, [this] {
+        d->pendingCommandEvent = 0;
+        executeCommand();
+    });
 }
 
 void FDC::executeCommand()
@@ -445,8 +708,12 @@ void FDC::executeCommandInternal()
     vlog(LogFDC, "Executing command %02x", d->command[0]);
     d->commandResult.clear();
 
-    if (isReadDataCommand(d->command[0]))
-        return executeReadDataCommand();
+    if (isReadDataCommand(d->command[0]) || isWriteDataCommand(d->command[0]))
+        return executeReadWriteDataCommand();
+    if (isReadIDCommand(d->command[0]))
+        return executeReadIDCommand();
+    if (isFormatTrackCommand(d->command[0]))
+        return executeFormatTrackCommand();
 
     switch (d->command[0]) {
     case SpecifyStepAndHeadLoad:
@@ -464,7 +731,7 @@ void FDC::executeCommandInternal()
     case SenseInterruptStatus:
         vlog(LogFDC, "SenseInterruptStatus");
         d->commandResult.append(d->statusRegister[0]);
-        d->commandResult.append(d->currentDrive().cylinder);
+        d->commandResult.append(d->driveIndex < 2 ? d->currentDrive().cylinder : 0);
         // Linux sends 4 SenseInterruptStatus commands after a controller reset because of "drive polling"
         if (d->expectedSenseInterruptCount) {
             BYTE driveIndex = 4 - d->expectedSenseInterruptCount;
@@ -477,11 +744,21 @@ void FDC::executeCommandInternal()
         break;
     case Recalibrate:
         d->driveIndex = d->command[1] & 3;
-        generateFDCInterrupt();
         vlog(LogFDC, "Recalibrate { drive:%u }", d->driveIndex);
+        if (!diskDrive(d->driveIndex)) {
+            finishSeekWithoutDrive();
+            break;
+        }
+        d->currentDrive().cylinder = 0;
+        generateFDCInterrupt(true);
         break;
     case SeekToTrack:
         d->driveIndex = d->command[1] & 3;
+        if (!diskDrive(d->driveIndex)) {
+            vlog(LogFDC, "SeekToTrack { drive:%u } without a drive", d->driveIndex);
+            finishSeekWithoutDrive();
+            break;
+        }
         d->currentDrive().head = (d->command[1] >> 2) & 1;
         d->currentDrive().cylinder = d->command[2];
         vlog(LogFDC, "SeekToTrack { drive:%u, C:%u, H:%u }",
@@ -555,6 +832,14 @@ void FDC::updateStatus(bool seekCompleted)
         d->statusRegister[0] |= 0x20;
 }
 
+// Seeks on drives 2 and 3 end at once with "not ready", without touching any drive state.
+void FDC::finishSeekWithoutDrive()
+{
+    d->statusRegister[0] = FDC_ST0_ABNORMAL_TERMINATION | FDC_ST0_NOT_READY | 0x20 | d->driveIndex;
+    vlog(LogFDC, "Raise IRQ (ST0:%02x, no drive)", d->statusRegister[0]);
+    raiseIRQ();
+}
+
 void FDC::generateFDCInterrupt(bool seekCompleted)
 {
     updateStatus(seekCompleted);
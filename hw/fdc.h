@@ -27,6 +27,8 @@
 #include "iodevice.h"
 #include "OwnPtr.h"
 
+class DiskDrive;
+
 class FDC final : public IODevice {
 public:
     explicit FDC(Machine&);
@@ -47,11 +49,17 @@ private:
     void resetControllerSoon();
     void generateFDCInterrupt(bool seekCompleted = false);
     void updateStatus(bool seekCompleted = false);
+    void finishSeekWithoutDrive();
 
+    bool commandHasExecutionPhase() const;
     void executeCommandSoon();
     void executeCommand();
     void executeCommandInternal();
-    void executeReadDataCommand();
+    void executeReadWriteDataCommand();
+    void executeReadIDCommand();
+    void executeFormatTrackCommand();
+    void finishDataCommand(BYTE st0, BYTE st1, BYTE st2, BYTE cylinder, BYTE head, BYTE sector, BYTE sizeCode);
+    DiskDrive* diskDrive(BYTE driveIndex);
 
     struct Private;
     OwnPtr<Private> d;
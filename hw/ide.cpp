@@ -85,16 +85,9 @@ void IDEController::readSectors(IDE& ide)
 #ifdef IDE_DEBUG
     vlog(LogIDE, "ide%u: Read sectors (LBA: %u, count: %u)", controllerIndex, lba(), sectorCount);
 #endif
-    FILE* f = fopen(qPrintable(drive().imagePath()), "rb");
-    RELEASE_ASSERT(f);
     m_readBuffer.resize(drive().bytesPerSector() * sectorCount);
-    int result;
-    result = fseek(f, lba() * drive().bytesPerSector(), SEEK_SET);
-    ASSERT(result != -1);
-    result = fread(m_readBuffer.data(), drive().bytesPerSector(), sectorCount, f);
-    ASSERT(result != -1);
-    result = fclose(f);
-    ASSERT(result != -1);
+    bool success = drive().readSectors(lba(), sectorCount, reinterpret_cast<BYTE*>(m_readBuffer.data()));
+    RELEASE_ASSERT(success);
     m_readBufferIndex = 0;
     ide.raiseIRQ();
 }
@@ -124,15 +117,8 @@ void IDEController::writeToSectorBuffer(IDE& ide, T data)
     if (m_writeBufferIndex < m_writeBuffer.size())
         return;
     vlog(LogIDE, "ide%u: Got all sector data, flushing to disk!", controllerIndex);
-    FILE* f = fopen(qPrintable(drive().imagePath()), "rb+");
-    RELEASE_ASSERT(f);
-    int result;
-    result = fseek(f, lba() * drive().bytesPerSector(), SEEK_SET);
-    ASSERT(result != -1);
-    result = fwrite(m_writeBuffer.data(), drive().bytesPerSector(), sectorCount, f);
-    ASSERT(result != -1);
-    result = fclose(f);
-    ASSERT(result != -1);
+    bool success = drive().writeSectors(lba(), sectorCount, reinterpret_cast<const BYTE*>(m_writeBuffer.constData()));
+    RELEASE_ASSERT(success);
     ide.raiseIRQ();
 }
 
@@ -164,24 +150,24 @@ IDE::IDE(Machine& machine)
     : IODevice("IDE", machine, 14)
     , d(make<Private>())
 {
-    listen(0x170, IODevice::ReadWrite);
-    listen(0x171, IODevice::ReadOnly);
-    listen(0x172, IODevice::ReadWrite);
-    listen(0x173, IODevice::ReadWrite);
-    listen(0x174, IODevice::ReadWrite);
-    listen(0x175, IODevice::ReadWrite);
-    listen(0x176, IODevice::ReadWrite);
-    listen(0x177, IODevice::ReadWrite);
-    listen(0x1F0, IODevice::ReadWrite);
-    listen(0x1F1, IODevice::ReadOnly);
-    listen(0x1F2, IODevice::ReadWrite);
-    listen(0x1F3, IODevice::ReadWrite);
-    listen(0x1F4, IODevice::ReadWrite);
-    listen(0x1F5, IODevice::ReadWrite);
-    listen(0x1F6, IODevice::ReadWrite);
-    listen(0x1F7, IODevice::ReadWrite);
-
-    listen(0x3f6, IODevice::ReadOnly);
+    listen<IDE>(0x170, IODevice::ReadWrite);
+    listen<IDE>(0x171, IODevice::ReadOnly);
+    listen<IDE>(0x172, IODevice::ReadWrite);
+    listen<IDE>(0x173, IODevice::ReadWrite);
+    listen<IDE>(0x174, IODevice::ReadWrite);
+    listen<IDE>(0x175, IODevice::ReadWrite);
+    listen<IDE>(0x176, IODevice::ReadWrite);
+    listen<IDE>(0x177, IODevice::ReadWrite);
+    listen<IDE>(0x1F0, IODevice::ReadWrite);
+    listen<IDE>(0x1F1, IODevice::ReadOnly);
+    listen<IDE>(0x1F2, IODevice::ReadWrite);
+    listen<IDE>(0x1F3, IODevice::ReadWrite);
+    listen<IDE>(0x1F4, IODevice::ReadWrite);
+    listen<IDE>(0x1F5, IODevice::ReadWrite);
+    listen<IDE>(0x1F6, IODevice::ReadWrite);
+    listen<IDE>(0x1F7, IODevice::ReadWrite);
+
+    listen<IDE>(0x3f6, IODevice::ReadOnly);
 
     reset();
 }
@@ -390,6 +376,13 @@ void IDE::executeCommand(IDEController& controller, BYTE command)
     case 0xEC:
         controller.identify(*this);
         break;
+    case 0xE7:
+    case 0xEA:
+        // FLUSH CACHE (EXT)
+        if (!controller.drive().flush())
+            controller.error = 0x04;
+        raiseIRQ();
+        break;
 #if 0
     case 0x90:
         // Run diagnostics, FIXME: this isn't a very nice implementation lol.
@@ -31,7 +31,68 @@
 //#define IODEVICE_DEBUG
 //#define IRQ_DEBUG
 
-QSet<WORD> IODevice::s_ignorePorts;
+static DWORD unhandledIn(void*, WORD port, unsigned)
+{
+    vlog(LogAlert, "Unhandled I/O read from port %03x", port);
+    return IODevice::JunkValue;
+}
+
+static void unhandledOut(void*, WORD port, DWORD data, unsigned)
+{
+    vlog(LogAlert, "Unhandled I/O write to port %03x, data %x", port, data);
+}
+
+static DWORD ignoredIn(void*, WORD, unsigned)
+{
+    return IODevice::JunkValue;
+}
+
+static void ignoredOut(void*, WORD, DWORD, unsigned)
+{
+}
+
+IOPortBus::IOPortBus()
+    : m_ports(65536)
+{
+    for (auto& handler : m_ports) {
+        handler.in = unhandledIn;
+        handler.out = unhandledOut;
+        handler.inSizes = 1 | 2 | 4;
+        handler.outSizes = 1 | 2 | 4;
+    }
+}
+
+void IOPortBus::registerInput(WORD port, IOPortHandler::InFunction function, void* context, BYTE sizes)
+{
+    ASSERT(sizes & 1);
+    auto& handler = m_ports[port];
+    handler.in = function;
+    handler.inContext = context;
+    handler.inSizes = sizes;
+}
+
+void IOPortBus::registerOutput(WORD port, IOPortHandler::OutFunction function, void* context, BYTE sizes)
+{
+    ASSERT(sizes & 1);
+    auto& handler = m_ports[port];
+    handler.out = function;
+    handler.outContext = context;
+    handler.outSizes = sizes;
+}
+
+void IOPortBus::registerOutputStream(WORD port, OutStreamFunction function, void* context)
+{
+    m_outputStreams.insert(port, { function, context });
+}
+
+void IOPortBus::ignorePort(WORD port)
+{
+    auto& handler = m_ports[port];
+    if (handler.in == unhandledIn)
+        handler.in = ignoredIn;
+    if (handler.out == unhandledOut)
+        handler.out = ignoredOut;
+}
 
 IODevice::IODevice(const char* name, Machine& machine, int irq)
     : m_machine(machine)
@@ -46,15 +107,9 @@ IODevice::~IODevice()
     m_machine.unregisterDevice(Badge<IODevice>(), *this);
 }
 
-void IODevice::listen(WORD port, ListenMask mask)
+IOPortBus& IODevice::ioPortBus()
 {
-    if (mask & ReadOnly)
-        machine().registerInputDevice(Badge<IODevice>(), port, *this);
-
-    if (mask & WriteOnly)
-        machine().registerOutputDevice(Badge<IODevice>(), port, *this);
-
-    m_ports.append(port);
+    return m_machine.ioPortBus();
 }
 
 QList<WORD> IODevice::ports() const
@@ -114,16 +169,6 @@ DWORD IODevice::in32(WORD port)
     return weld<DWORD>(in16(port + 2), in16(port));
 }
 
-void IODevice::ignorePort(WORD port)
-{
-    s_ignorePorts.insert(port);
-}
-
-bool IODevice::shouldIgnorePort(WORD port)
-{
-    return s_ignorePorts.contains(port);
-}
-
 void IODevice::raiseIRQ()
 {
     ASSERT(m_irq != -1);
@@ -24,12 +24,63 @@
 
 #pragma once
 
+#include "Common.h"
 #include "debug.h"
 #include "types.h"
+#include <QHash>
 #include <QList>
+#include <type_traits>
+#include <vector>
 
 class Machine;
 
+// One entry in the machine's port table: a handler pair, the object they work on,
+// and the access sizes (in bytes, OR'ed together) each of them takes directly.
+// Wider accesses that a handler doesn't take are split into byte accesses.
+struct IOPortHandler {
+    typedef DWORD (*InFunction)(void* context, WORD port, unsigned size);
+    typedef void (*OutFunction)(void* context, WORD port, DWORD data, unsigned size);
+
+    InFunction in { nullptr };
+    OutFunction out { nullptr };
+    void* inContext { nullptr };
+    void* outContext { nullptr };
+    BYTE inSizes { 0 };
+    BYTE outSizes { 0 };
+};
+
+class IOPortBus {
+public:
+    IOPortBus();
+
+    void registerInput(WORD port, IOPortHandler::InFunction, void* context, BYTE sizes);
+    void registerOutput(WORD port, IOPortHandler::OutFunction, void* context, BYTE sizes);
+
+    // Silence reads and writes to a port nobody listens to.
+    void ignorePort(WORD port);
+
+    template<typename T> T in(WORD port);
+    template<typename T> void out(WORD port, T data);
+
+    // Optional bulk handlers for REP OUTS. `data` holds `count` little-endian elements of `size` bytes.
+    typedef void (*OutStreamFunction)(void* context, WORD port, const BYTE* data, unsigned count, unsigned size);
+    void registerOutputStream(WORD port, OutStreamFunction, void* context);
+    bool hasOutputStream(WORD port) const { return m_outputStreams.contains(port); }
+    template<typename T> void outStream(WORD port, const T* data, unsigned count);
+
+private:
+    template<typename T> T splitIn(WORD port);
+    template<typename T> void splitOut(WORD port, T data);
+
+    struct OutputStream {
+        OutStreamFunction function { nullptr };
+        void* context { nullptr };
+    };
+
+    std::vector<IOPortHandler> m_ports;
+    QHash<WORD, OutputStream> m_outputStreams;
+};
+
 class IODevice {
 public:
     IODevice(const char* name, Machine&, int irq = -1);
@@ -44,9 +95,6 @@ public:
 
     virtual void reset() = 0;
 
-    template<typename T> T in(WORD port);
-    template<typename T> void out(WORD port, T data);
-
     virtual BYTE in8(WORD port);
     virtual WORD in16(WORD port);
     virtual DWORD in32(WORD port);
@@ -54,9 +102,6 @@ public:
     virtual void out16(WORD port, WORD data);
     virtual void out32(WORD port, DWORD data);
 
-    static bool shouldIgnorePort(WORD port);
-    static void ignorePort(WORD port);
-
     QList<WORD> ports() const;
 
     enum { JunkValue = 0xff };
@@ -67,33 +112,89 @@ protected:
         WriteOnly = 2,
         ReadWrite = 3
     };
-    virtual void listen(WORD port, ListenMask mask);
+    // Device is the concrete (final) class, so the port table can call its handlers without virtual dispatch.
+    template<typename Device> void listen(WORD port, ListenMask mask);
 
 private:
+    template<typename Device> static DWORD deviceIn(void* context, WORD port, unsigned size);
+    template<typename Device> static void deviceOut(void* context, WORD port, DWORD data, unsigned size);
+
+    IOPortBus& ioPortBus();
+
     Machine& m_machine;
     const char* m_name { nullptr };
     int m_irq { 0 };
     QList<WORD> m_ports;
-
-    static QSet<WORD> s_ignorePorts;
 };
 
-template<typename T> inline T IODevice::in(WORD port)
+template<typename Device> DWORD IODevice::deviceIn(void* context, WORD port, unsigned size)
+{
+    auto& device = *static_cast<Device*>(context);
+    if (size == 1)
+        return device.in8(port);
+    if (size == 2)
+        return device.in16(port);
+    return device.in32(port);
+}
+
+template<typename Device> void IODevice::deviceOut(void* context, WORD port, DWORD data, unsigned size)
+{
+    auto& device = *static_cast<Device*>(context);
+    if (size == 1)
+        return device.out8(port, data);
+    if (size == 2)
+        return device.out16(port, data);
+    return device.out32(port, data);
+}
+
+template<typename Device> inline void IODevice::listen(WORD port, ListenMask mask)
+{
+    static_assert(std::is_final<Device>::value, "Port handlers are only devirtualized for final classes");
+    auto* device = static_cast<Device*>(this);
+    if (mask & ReadOnly)
+        ioPortBus().registerInput(port, &deviceIn<Device>, device, 1 | 2 | 4);
+    if (mask & WriteOnly)
+        ioPortBus().registerOutput(port, &deviceOut<Device>, device, 1 | 2 | 4);
+    m_ports.append(port);
+}
+
+template<typename T> inline T IOPortBus::in(WORD port)
+{
+    auto& handler = m_ports[port];
+    if (LIKELY(handler.inSizes & sizeof(T)))
+        return handler.in(handler.inContext, port, sizeof(T));
+    return splitIn<T>(port);
+}
+
+template<typename T> inline void IOPortBus::out(WORD port, T data)
+{
+    auto& handler = m_ports[port];
+    if (LIKELY(handler.outSizes & sizeof(T)))
+        return handler.out(handler.outContext, port, data, sizeof(T));
+    splitOut<T>(port, data);
+}
+
+template<typename T> void IOPortBus::outStream(WORD port, const T* data, unsigned count)
+{
+    auto it = m_outputStreams.constFind(port);
+    if (it == m_outputStreams.constEnd()) {
+        for (unsigned i = 0; i < count; ++i)
+            out<T>(port, data[i]);
+        return;
+    }
+    it->function(it->context, port, reinterpret_cast<const BYTE*>(data), count, sizeof(T));
+}
+
+template<typename T> T IOPortBus::splitIn(WORD port)
 {
-    if (sizeof(T) == 1)
-        return in8(port);
-    if (sizeof(T) == 2)
-        return in16(port);
-    ASSERT(sizeof(T) == 4);
-    return in32(port);
+    T data = 0;
+    for (unsigned i = 0; i < sizeof(T); ++i)
+        data |= (T)in<BYTE>(port + i) << (i * 8);
+    return data;
 }
 
-template<typename T> inline void IODevice::out(WORD port, T data)
+template<typename T> void IOPortBus::splitOut(WORD port, T data)
 {
-    if (sizeof(T) == 1)
-        return out8(port, data);
-    if (sizeof(T) == 2)
-        return out16(port, data);
-    ASSERT(sizeof(T) == 4);
-    return out32(port, data);
+    for (unsigned i = 0; i < sizeof(T); ++i)
+        out<BYTE>(port + i, data >> (i * 8));
 }
@@ -26,6 +26,7 @@
 #include "CPU.h"
 #include "keyboard.h"
 #include "pic.h"
+#include "pit.h"
 #include "debug.h"
 #include "machine.h"
 
@@ -55,14 +56,12 @@
 #define CMD_DISABLE_KBD               0xAD
 #define CMD_ENABLE_KBD                0xAE
 
-extern bool kbd_has_data();
-
 Keyboard::Keyboard(Machine& machine)
     : IODevice("Keyboard", machine, 1)
 {
-    listen(0x60, IODevice::ReadWrite);
-    listen(0x61, IODevice::ReadWrite);
-    listen(0x64, IODevice::ReadWrite);
+    listen<Keyboard>(0x60, IODevice::ReadWrite);
+    listen<Keyboard>(0x61, IODevice::ReadWrite);
+    listen<Keyboard>(0x64, IODevice::ReadWrite);
 
     reset();
 }
@@ -91,7 +90,6 @@ void Keyboard::reset()
 
 BYTE Keyboard::in8(WORD port)
 {
-    extern BYTE kbd_pop_raw();
     BYTE data = 0;
 
     if (port == 0x60) {
@@ -103,7 +101,7 @@ BYTE Keyboard::in8(WORD port)
         } else if (m_lastWasCommand && m_command == CMD_SET_LEDS) {
             data = 0xFA; // ACK
         } else {
-            BYTE key = kbd_pop_raw();
+            BYTE key = m_rawQueue.isEmpty() ? 0 : m_rawQueue.dequeue();
 #ifdef KBD_DEBUG
             vlog(LogKeyboard, "keyboard_data = %02X", key);
 #endif
@@ -113,19 +111,19 @@ BYTE Keyboard::in8(WORD port)
         // POST completed successfully.
         BYTE status = (m_ram[0] & ATKBD_SYSTEM_FLAG);
         status |= m_lastWasCommand ? ATKBD_CMD_DATA : 0;
-        if (kbd_has_data())
+        if (hasRawData())
             status |= ATKBD_OUTPUT_STATUS;
         if (isEnabled())
             status |= ATKBD_UNLOCKED;
         //vlog(LogKeyboard, "Keyboard status queried (%02X)", status);
         data = status;
     } else if (port == 0x61) {
-        // HACK: This should be implemented properly in the 8254 emulation.
-        if (m_systemControlPortData & 0x10)
-            m_systemControlPortData &= ~0x10;
-        else
-            m_systemControlPortData |= 0x10;
-        data = m_systemControlPortData;
+        auto& pit = machine().pit();
+        data = m_systemControlPortData & 0x0f;
+        if (pit.refreshToggle())
+            data |= 0x10;
+        if (pit.output(2))
+            data |= 0x20;
     }
 
 #ifdef KBD_DEBUG
@@ -143,6 +141,7 @@ void Keyboard::out8(WORD port, BYTE data)
     if (port == 0x61) {
         //vlog(LogKeyboard, "System control port <- %02X", data);
         m_systemControlPortData = data;
+        machine().pit().setGate(2, data & 1);
         return;
     }
 
@@ -220,6 +219,32 @@ void Keyboard::out8(WORD port, BYTE data)
     IODevice::out8(port, data);
 }
 
+void Keyboard::enqueueKey(WORD biosKey, BYTE code, bool extended)
+{
+    if (biosKey)
+        m_keyQueue.enqueue(biosKey);
+    if (extended)
+        m_rawQueue.enqueue(0xE0);
+    m_rawQueue.enqueue(code);
+    didEnqueueData();
+}
+
+WORD Keyboard::nextKey()
+{
+    m_rawQueue.clear();
+    if (!m_keyQueue.isEmpty())
+        return m_keyQueue.dequeue();
+    return 0;
+}
+
+WORD Keyboard::peekKey()
+{
+    m_rawQueue.clear();
+    if (!m_keyQueue.isEmpty())
+        return m_keyQueue.head();
+    return 0;
+}
+
 void Keyboard::didEnqueueData()
 {
     if (m_ram[0] & CCB_KEYBOARD_INTERRUPT_ENABLE)
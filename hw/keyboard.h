@@ -25,6 +25,7 @@
 #pragma once
 
 #include "iodevice.h"
+#include <QtCore/QQueue>
 
 class Keyboard final : public QObject, public IODevice {
     Q_OBJECT
@@ -44,8 +45,15 @@ public:
 
     bool isEnabled() const { return m_enabled; }
 
+    // Host key events, handed over by the InputQueue. biosKey is 0 if INT 16h shouldn't see the key.
+    void enqueueKey(WORD biosKey, BYTE code, bool extended);
+    bool hasRawData() const { return !m_rawQueue.isEmpty(); }
     void didEnqueueData();
 
+    // For the BIOS keyboard services. Taking a key throws away the raw scan codes.
+    WORD nextKey();
+    WORD peekKey();
+
 signals:
     void ledsChanged(int);
 
@@ -57,4 +65,7 @@ private:
     bool m_lastWasCommand;
     BYTE m_leds { 0 };
     bool m_enabled { true };
+
+    QQueue<WORD> m_keyQueue;
+    QQueue<BYTE> m_rawQueue;
 };
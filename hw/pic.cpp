@@ -62,8 +62,8 @@ PIC::PIC(bool isMaster, Machine& machine)
     , m_irqBase(isMaster ? 0 : 8)
     , m_isMaster(isMaster)
 {    
-    listen(m_baseAddress, IODevice::ReadWrite);
-    listen(m_baseAddress + 1, IODevice::ReadWrite);
+    listen<PIC>(m_baseAddress, IODevice::ReadWrite);
+    listen<PIC>(m_baseAddress + 1, IODevice::ReadWrite);
 
     reset();
 }
@@ -217,7 +217,7 @@ void PIC::raise(BYTE num)
 
 void PIC::lower(BYTE num)
 {
-    m_irr &= 1 << num;
+    m_irr &= ~(1 << num);
 }
 
 void PIC::raiseIRQ(Machine& machine, BYTE num)
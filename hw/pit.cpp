@@ -26,46 +26,181 @@
 #include "debug.h"
 #include "pic.h"
 #include "pit.h"
-#include <math.h>
-#include <QElapsedTimer>
+#include "machine.h"
+#include "TimerService.h"
 
 //#define PIT_DEBUG
 
-static const double baseFrequency = 1193.1816666; // 1.193182 MHz
+static const QWORD baseFrequency = 1193182;
+static const QWORD nanosecondsPerSecond = 1000000000;
 
-enum DecrementMode { DecrementBinary = 0, DecrementBCD = 1 };
-enum CounterAccessState { ReadLatchedLSB, ReadLatchedMSB, AccessMSBOnly, AccessLSBOnly, AccessLSBThenMSB, AccessMSBThenLSB };
+// Counter state is a function of the tick count, so nothing runs between reads
+// except the one event per IRQ0 edge.
+static QWORD ticksAt(QWORD nanoseconds)
+{
+    return (nanoseconds / nanosecondsPerSecond) * baseFrequency + (nanoseconds % nanosecondsPerSecond) * baseFrequency / nanosecondsPerSecond;
+}
+
+// The first instant at which ticksAt() reaches `tick`.
+static QWORD timeOfTick(QWORD tick)
+{
+    return (tick / baseFrequency) * nanosecondsPerSecond + ((tick % baseFrequency) * nanosecondsPerSecond + baseFrequency - 1) / baseFrequency;
+}
+
+static WORD toBCD(unsigned value)
+{
+    return (value % 10) | ((value / 10) % 10) << 4 | ((value / 100) % 10) << 8 | ((value / 1000) % 10) << 12;
+}
 
-struct CounterInfo {
-    WORD startValue { 0xffff };
-    WORD reload { 0xffff };
-    WORD value();
+static unsigned fromBCD(WORD value)
+{
+    return (value & 0xf) + ((value >> 4) & 0xf) * 10 + ((value >> 8) & 0xf) * 100 + ((value >> 12) & 0xf) * 1000;
+}
+
+enum AccessMode { AccessLatch = 0, AccessLSBOnly = 1, AccessMSBOnly = 2, AccessLSBThenMSB = 3 };
+
+struct PIT::Counter {
     BYTE mode { 0 };
-    DecrementMode decrementMode { DecrementBinary };
-    WORD latchedValue { 0xffff };
-    CounterAccessState accessState { ReadLatchedLSB };
-    BYTE format { 0 };
-    QElapsedTimer qtimer;
-
-    void check(PIT&);
-    bool rolledOver { false };
+    bool bcd { false };
+    AccessMode accessMode { AccessLSBThenMSB };
+    bool gate { true };
+
+    // `count` is the last count written, `initialCount` the one being counted down.
+    unsigned count { 0x10000 };
+    unsigned initialCount { 0x10000 };
+    bool nullCount { true };
+    BYTE pendingLSB { 0 };
+    bool writingMSB { false };
+    bool readingMSB { false };
+
+    bool countLatched { false };
+    WORD latchedCount { 0 };
+    bool statusLatched { false };
+    BYTE latchedStatus { 0 };
+
+    // A count has been written since the mode was set.
+    bool loaded { false };
+    // ...and, in modes 1 and 5, triggered by the gate.
+    bool counting { false };
+    // ...and not held by a low gate, which freezes it at `stoppedElapsed` ticks.
+    bool running { false };
+    QWORD startTick { 0 };
+    QWORD stoppedElapsed { 0 };
+    // What reads return while not counting.
+    WORD idleValue { 0 };
+
+    // Modes 2 and 3 pick up a new count at the end of the current cycle.
+    bool reloadPending { false };
+    QWORD reloadTick { 0 };
+
+    BYTE effectiveMode() const { return mode > 5 ? mode - 4 : mode; }
+    unsigned modulus() const { return bcd ? 10000 : 0x10000; }
+    QWORD elapsed(QWORD tick) const { return running ? tick - startTick : stoppedElapsed; }
+
+    WORD value(QWORD tick) const;
+    bool output(QWORD tick) const;
+    BYTE status(QWORD tick) const;
+    bool nextRisingEdge(QWORD tick, QWORD& edge) const;
 };
 
+WORD PIT::Counter::value(QWORD tick) const
+{
+    if (!counting)
+        return idleValue;
+
+    QWORD e = elapsed(tick);
+    unsigned n = initialCount;
+    unsigned v;
+    switch (effectiveMode()) {
+    case 2:
+        v = n - e % n;
+        break;
+    case 3: {
+        // Counts down by two through each half of the cycle; the high half is one tick longer for odd counts.
+        QWORD phase = e % n;
+        QWORD high = (n + 1) / 2;
+        v = (n & ~1u) - 2 * (phase < high ? phase : phase - high);
+        break;
+    }
+    default:
+        v = (n + modulus() - e % modulus()) % modulus();
+        break;
+    }
+    v %= modulus();
+    return bcd ? toBCD(v) : v;
+}
+
+bool PIT::Counter::output(QWORD tick) const
+{
+    if (!loaded)
+        return effectiveMode() != 0;
+    if (!counting)
+        return true;
+
+    QWORD e = elapsed(tick);
+    unsigned n = initialCount;
+    switch (effectiveMode()) {
+    case 0:
+    case 1:
+        return e >= n;
+    case 2:
+        // Low for the one tick the count spends at 1.
+        return !running || n < 2 || e % n != n - 1;
+    case 3:
+        return !running || e % n < (n + 1) / 2;
+    default:
+        return e != n;
+    }
+}
+
+BYTE PIT::Counter::status(QWORD tick) const
+{
+    return output(tick) << 7 | nullCount << 6 | accessMode << 4 | mode << 1 | bcd;
+}
+
+bool PIT::Counter::nextRisingEdge(QWORD tick, QWORD& edge) const
+{
+    if (!counting || !running)
+        return false;
+
+    QWORD e = tick - startTick;
+    unsigned n = initialCount;
+    switch (effectiveMode()) {
+    case 0:
+    case 1:
+        if (e >= n)
+            return false;
+        edge = startTick + n;
+        return true;
+    case 2:
+    case 3:
+        if (n < 2)
+            return false;
+        // A pending reload lands on this same cycle boundary.
+        edge = startTick + (e / n + 1) * n;
+        return true;
+    default:
+        if (e > n)
+            return false;
+        edge = startTick + n + 1;
+        return true;
+    }
+}
+
 struct PIT::Private
 {
-    CounterInfo counter[3];
-    int frequency { 0 };
-    OwnPtr<ThreadedTimer> threadedTimer;
+    Counter counter[3];
+    TimerService::TimerID edgeTimer { 0 };
 };
 
 PIT::PIT(Machine& machine)
     : IODevice("PIT", machine, 0)
     , d(make<Private>())
 {
-    listen(0x40, IODevice::ReadWrite);
-    listen(0x41, IODevice::ReadWrite);
-    listen(0x42, IODevice::ReadWrite);
-    listen(0x43, IODevice::ReadWrite);
+    listen<PIT>(0x40, IODevice::ReadWrite);
+    listen<PIT>(0x41, IODevice::ReadWrite);
+    listen<PIT>(0x42, IODevice::ReadWrite);
+    listen<PIT>(0x43, IODevice::ReadWrite);
 
     reset();
 }
@@ -76,128 +211,281 @@ PIT::~PIT()
 
 void PIT::reset()
 {
-    d->frequency = 0;
-    d->counter[0] = CounterInfo();
-    d->counter[1] = CounterInfo();
-    d->counter[2] = CounterInfo();
+    if (d->edgeTimer)
+        machine().timerService().cancel(d->edgeTimer);
+    d->edgeTimer = 0;
+
+    d->counter[0] = Counter();
+    d->counter[1] = Counter();
+    d->counter[2] = Counter();
+    d->counter[2].gate = false;
+
+    // FIXME: This should be done by the BIOS instead.
+    // System tick at 18.2 Hz, refresh request every 15 us, speaker tone at 896 Hz.
+    out8(0x43, 0x36);
+    out8(0x40, 0x00);
+    out8(0x40, 0x00);
+    out8(0x43, 0x54);
+    out8(0x41, 18);
+    out8(0x43, 0xb6);
+    out8(0x42, 0x33);
+    out8(0x42, 0x05);
+}
+
+QWORD PIT::currentTick() const
+{
+    return ticksAt(machine().timerService().now());
 }
 
-WORD CounterInfo::value()
+void PIT::sync(Counter& counter, QWORD tick)
 {
-    double nsec = qtimer.nsecsElapsed() / 1000;
-    int ticks = floor(nsec * baseFrequency);
-
-    int currentValue = startValue - ticks;
-    if (currentValue >= reload) {
-        vlog(LogTimer, "Current value{%d} >= reload{%d}", currentValue, reload);
-        if (reload == 0)
-            currentValue = 0;
-        else
-            currentValue %= reload;
-        rolledOver = true;
-    } else if (currentValue < 0) {
-        if (reload == 0)
-            currentValue = 0;
-        else
-            currentValue = currentValue % reload + reload;
-        rolledOver = true;
-    }
+    if (!counter.reloadPending || !counter.running || tick < counter.reloadTick)
+        return;
+    counter.initialCount = counter.count;
+    counter.startTick = counter.reloadTick;
+    counter.reloadPending = false;
+    counter.nullCount = false;
+}
+
+void PIT::start(Counter& counter, QWORD tick)
+{
+    counter.initialCount = counter.count;
+    counter.counting = true;
+    counter.nullCount = false;
+    counter.reloadPending = false;
+    counter.startTick = tick;
+    counter.stoppedElapsed = 0;
+
+    BYTE mode = counter.effectiveMode();
+    counter.running = counter.gate || mode == 1 || mode == 5;
+}
+
+void PIT::scheduleNextEdge()
+{
+    if (d->edgeTimer)
+        machine().timerService().cancel(d->edgeTimer);
+    d->edgeTimer = 0;
+
+#ifndef CT_DETERMINISTIC
+    auto& counter = d->counter[0];
+    QWORD tick = currentTick();
+    sync(counter, tick);
+
+    QWORD edge;
+    if (!counter.nextRisingEdge(tick, edge))
+        return;
+
+    d->edgeTimer = machine().timerService().scheduleAt(timeOfTick(edge), [this] {
+        d->edgeTimer = 0;
+        raiseIRQ();
+        scheduleNextEdge();
+    });
+#endif
+}
+
+void PIT::loadCount(int index, WORD data)
+{
+    auto& counter = d->counter[index];
+    QWORD tick = currentTick();
+    sync(counter, tick);
+
+    counter.count = counter.bcd ? fromBCD(data) : data;
+    if (!counter.count)
+        counter.count = counter.modulus();
+    counter.nullCount = true;
 
 #ifdef PIT_DEBUG
-    vlog(LogTimer, "nsec elapsed: %g, ticks: %g, value: %u", nsec, ticks, currentValue);
+    vlog(LogTimer, "Counter %d loaded with %u", index, counter.count);
 #endif
-    return currentValue;
+
+    bool wasLoaded = counter.loaded;
+    counter.loaded = true;
+
+    switch (counter.effectiveMode()) {
+    case 1:
+    case 5:
+        // Waits for a rising edge on the gate.
+        break;
+    case 2:
+    case 3:
+        if (wasLoaded && counter.counting && counter.running) {
+            QWORD e = tick - counter.startTick;
+            counter.reloadPending = true;
+            counter.reloadTick = counter.startTick + (e / counter.initialCount + 1) * counter.initialCount;
+            break;
+        }
+        start(counter, tick);
+        break;
+    default:
+        start(counter, tick);
+        break;
+    }
+
+    if (index == 0)
+        scheduleNextEdge();
 }
 
-void CounterInfo::check(PIT& pit)
+void PIT::setGate(int index, bool level)
 {
-    value();
-    if (rolledOver) {
-        if (mode == 0)
-            pit.raiseIRQ();
-        rolledOver = false;
+    auto& counter = d->counter[index];
+    if (counter.gate == level)
+        return;
+
+    QWORD tick = currentTick();
+    sync(counter, tick);
+    counter.gate = level;
+
+    switch (counter.effectiveMode()) {
+    case 0:
+    case 4:
+        if (!counter.counting)
+            break;
+        if (level) {
+            counter.startTick = tick - counter.stoppedElapsed;
+            counter.running = true;
+        } else {
+            counter.stoppedElapsed = tick - counter.startTick;
+            counter.running = false;
+        }
+        break;
+    case 1:
+    case 5:
+        if (level && counter.loaded)
+            start(counter, tick);
+        break;
+    case 2:
+    case 3:
+        if (!counter.counting)
+            break;
+        if (level) {
+            start(counter, tick);
+        } else {
+            counter.stoppedElapsed = tick - counter.startTick;
+            counter.running = false;
+            counter.reloadPending = false;
+        }
+        break;
     }
+
+    if (index == 0)
+        scheduleNextEdge();
 }
 
-void PIT::reconfigureTimer(BYTE index)
+bool PIT::output(int index)
 {
     auto& counter = d->counter[index];
-    counter.qtimer.start();
+    QWORD tick = currentTick();
+    sync(counter, tick);
+    return counter.output(tick);
 }
 
-void PIT::boot()
+bool PIT::refreshToggle()
 {
-    d->threadedTimer = make<ThreadedTimer>(*this, 5);
+    auto& counter = d->counter[1];
+    QWORD tick = currentTick();
+    sync(counter, tick);
+    BYTE mode = counter.effectiveMode();
+    if (counter.counting && counter.running && (mode == 2 || mode == 3) && counter.initialCount >= 2)
+        return ((tick - counter.startTick) / counter.initialCount) & 1;
+    // Software polls this for short delays, so keep it moving even if counter 1 was reprogrammed.
+    return (tick / 18) & 1;
+}
 
-    // FIXME: This should be done by the BIOS instead.
-    reconfigureTimer(0);
-    reconfigureTimer(1);
-    reconfigureTimer(2);
+void PIT::latchCount(int index)
+{
+    auto& counter = d->counter[index];
+    if (counter.countLatched)
+        return;
+    QWORD tick = currentTick();
+    sync(counter, tick);
+    counter.latchedCount = counter.value(tick);
+    counter.countLatched = true;
 }
 
-void PIT::threadedTimerFired(Badge<ThreadedTimer>)
+void PIT::readBack(BYTE data)
 {
-#ifndef CT_DETERMINISTIC
-    d->counter[0].check(*this);
-    d->counter[1].check(*this);
-    d->counter[2].check(*this);
-#endif
+    for (int index = 0; index < 3; ++index) {
+        if (!(data & (2 << index)))
+            continue;
+        if (!(data & 0x20))
+            latchCount(index);
+        auto& counter = d->counter[index];
+        if (!(data & 0x10) && !counter.statusLatched) {
+            QWORD tick = currentTick();
+            sync(counter, tick);
+            counter.latchedStatus = counter.status(tick);
+            counter.statusLatched = true;
+        }
+    }
 }
 
-BYTE PIT::readCounter(BYTE index)
+BYTE PIT::readCounter(int index)
 {
     auto& counter = d->counter[index];
+    if (counter.statusLatched) {
+        counter.statusLatched = false;
+        return counter.latchedStatus;
+    }
+
+    WORD value;
+    if (counter.countLatched) {
+        value = counter.latchedCount;
+    } else {
+        QWORD tick = currentTick();
+        sync(counter, tick);
+        value = counter.value(tick);
+    }
+
     BYTE data = 0;
-    switch (counter.accessState) {
-    case ReadLatchedLSB:
-        data = leastSignificant<BYTE>(counter.latchedValue);
-        counter.accessState = ReadLatchedMSB;
-        break;
-    case ReadLatchedMSB:
-        data = mostSignificant<BYTE>(counter.latchedValue);
-        counter.accessState = ReadLatchedLSB;
-        break;
+    switch (counter.accessMode) {
     case AccessLSBOnly:
-        data = leastSignificant<BYTE>(counter.latchedValue);
+        data = leastSignificant<BYTE>(value);
+        counter.countLatched = false;
         break;
     case AccessMSBOnly:
-        data = mostSignificant<BYTE>(counter.latchedValue);
-        break;
-    case AccessLSBThenMSB:
-        data = leastSignificant<BYTE>(counter.value());
-        counter.accessState = AccessMSBThenLSB;
+        data = mostSignificant<BYTE>(value);
+        counter.countLatched = false;
         break;
-    case AccessMSBThenLSB:
-        data = mostSignificant<BYTE>(counter.value());
-        counter.accessState = AccessLSBThenMSB;
+    default:
+        if (counter.readingMSB) {
+            data = mostSignificant<BYTE>(value);
+            counter.countLatched = false;
+        } else {
+            data = leastSignificant<BYTE>(value);
+        }
+        counter.readingMSB = !counter.readingMSB;
         break;
     }
     return data;
 }
 
-void PIT::writeCounter(BYTE index, BYTE data)
+void PIT::writeCounter(int index, BYTE data)
 {
     auto& counter = d->counter[index];
-    switch (counter.accessState) {
-    case ReadLatchedLSB:
-    case ReadLatchedMSB:
-        break;
+    switch (counter.accessMode) {
     case AccessLSBOnly:
-        counter.reload = weld<WORD>(mostSignificant<BYTE>(counter.reload), data);
-        reconfigureTimer(index);
+        loadCount(index, data);
         break;
     case AccessMSBOnly:
-        counter.reload = weld<WORD>(data, leastSignificant<BYTE>(counter.reload));
-        reconfigureTimer(index);
+        loadCount(index, weld<WORD>(data, 0));
         break;
-    case AccessLSBThenMSB:
-        counter.reload = weld<WORD>(mostSignificant<BYTE>(counter.reload), data);
-        counter.accessState = AccessMSBThenLSB;
-        break;
-    case AccessMSBThenLSB:
-        counter.reload = weld<WORD>(data, leastSignificant<BYTE>(counter.reload));
-        counter.accessState = AccessLSBThenMSB;
-        reconfigureTimer(index);
+    default:
+        if (counter.writingMSB) {
+            counter.writingMSB = false;
+            loadCount(index, weld<WORD>(data, counter.pendingLSB));
+            break;
+        }
+        counter.pendingLSB = data;
+        counter.writingMSB = true;
+        // In mode 0, writing the first byte stops the count and drops the output.
+        if (counter.effectiveMode() == 0 && counter.counting) {
+            QWORD tick = currentTick();
+            counter.idleValue = counter.value(tick);
+            counter.loaded = false;
+            counter.counting = false;
+            if (index == 0)
+                scheduleNextEdge();
+        }
         break;
     }
 }
@@ -212,7 +500,8 @@ BYTE PIT::in8(WORD port)
         data = readCounter(port - 0x40);
         break;
     case 0x43:
-        ASSERT_NOT_REACHED();
+        // The control word register is write-only.
+        data = IODevice::JunkValue;
         break;
     }
 
@@ -234,52 +523,51 @@ void PIT::out8(WORD port, BYTE data)
         writeCounter(port - 0x40, data);
         break;
     case 0x43:
-        modeControl(0, data);
+        modeControl(data);
         break;
     }
 }
 
-void PIT::modeControl(int timerIndex, BYTE data)
+void PIT::modeControl(BYTE data)
 {
-    ASSERT(timerIndex == 0 || timerIndex == 1);
-
-    BYTE counterIndex = (data >> 6);
+    int index = data >> 6;
+    if (index == 3) {
+        readBack(data);
+        return;
+    }
 
-    if (counterIndex > 2) {
-        vlog(LogTimer, "Invalid counter index %d specified.", counterIndex);
+    auto accessMode = static_cast<AccessMode>((data >> 4) & 3);
+    if (accessMode == AccessLatch) {
+        latchCount(index);
         return;
     }
 
-    ASSERT(counterIndex <= 2);
-    CounterInfo& counter = d->counter[counterIndex];
+    auto& counter = d->counter[index];
+    QWORD tick = currentTick();
+    sync(counter, tick);
+    counter.idleValue = counter.value(tick);
 
-    counter.decrementMode = static_cast<DecrementMode>(data & 1);
+    counter.bcd = data & 1;
     counter.mode = (data >> 1) & 7;
-
-    counter.format = (data >> 4) & 3;
-    switch (counter.format) {
-    case 0:
-        counter.accessState = ReadLatchedLSB;
-        counter.latchedValue = counter.value();
-        break;
-    case 1:
-        counter.accessState = AccessMSBOnly;
-        break;
-    case 2:
-        counter.accessState = AccessLSBOnly;
-        break;
-    case 3:
-        counter.accessState = AccessLSBThenMSB;
-        break;
-    }
+    counter.accessMode = accessMode;
+    counter.loaded = false;
+    counter.counting = false;
+    counter.running = false;
+    counter.reloadPending = false;
+    counter.nullCount = true;
+    counter.writingMSB = false;
+    counter.readingMSB = false;
+    counter.countLatched = false;
+    counter.statusLatched = false;
 
 #ifdef PIT_DEBUG
-    vlog(LogTimer, "Setting mode for counter %u { dec: %s, mode: %u, fmt: %02x }",
-        counterIndex,
-        (counter.decrementMode == DecrementBCD) ? "BCD" : "binary",
+    vlog(LogTimer, "Setting mode for counter %d { dec: %s, mode: %u, access: %u }",
+        index,
+        counter.bcd ? "BCD" : "binary",
         counter.mode,
-        counter.format);
+        counter.accessMode);
 #endif
 
-    reconfigureTimer(counterIndex);
+    if (index == 0)
+        scheduleNextEdge();
 }
@@ -26,9 +26,8 @@
 
 #include "iodevice.h"
 #include "OwnPtr.h"
-#include "ThreadedTimer.h"
 
-class PIT final : public IODevice, public ThreadedTimer::Listener {
+class PIT final : public IODevice {
 public:
     explicit PIT(Machine&);
     virtual ~PIT();
@@ -37,18 +36,28 @@ public:
     virtual BYTE in8(WORD port) override;
     virtual void out8(WORD port, BYTE data) override;
 
-    void boot();
-
-    virtual void threadedTimerFired(Badge<ThreadedTimer>) override;
+    // Counter 2's gate and output are wired to the system control port (0x61).
+    void setGate(int index, bool);
+    bool output(int index);
+    // The refresh request flip-flop, toggled by every rising edge of counter 1's output.
+    bool refreshToggle();
 
 private:
     friend class CPU;
+    struct Counter;
+
+    BYTE readCounter(int index);
+    void writeCounter(int index, BYTE data);
+    void loadCount(int index, WORD);
 
-    BYTE readCounter(BYTE index);
-    void writeCounter(BYTE index, BYTE data);
+    void modeControl(BYTE data);
+    void readBack(BYTE data);
+    void latchCount(int index);
 
-    void modeControl(int timerIndex, BYTE data);
-    void reconfigureTimer(BYTE index);
+    QWORD currentTick() const;
+    void sync(Counter&, QWORD tick);
+    void start(Counter&, QWORD tick);
+    void scheduleNextEdge();
 
     struct Private;
     OwnPtr<Private> d;
@@ -0,0 +1,358 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "vbe.h"
+#include "CPU.h"
+#include "debug.h"
+#include "machine.h"
+#include "vga.h"
+#include "FrameSnapshot.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+static const WORD maximumXResolution = 2560;
+static const WORD maximumYResolution = 1600;
+static const WORD maximumBitsPerPixel = 32;
+static const DWORD bankSize = 65536;
+
+// The 64K banked window at 0xA0000, mapped over the VGA's while VBE is enabled.
+class VBE::BankWindow final : public MemoryProvider {
+public:
+    explicit BankWindow(VBE& vbe)
+        : MemoryProvider(PhysicalAddress(0xa0000), bankSize)
+        , m_vbe(vbe)
+    {
+    }
+
+    virtual BYTE readMemory8(DWORD address) override
+    {
+        return m_vbe.m_videoMemory[offsetForAddress(address)];
+    }
+
+    virtual void writeMemory8(DWORD address, BYTE data) override
+    {
+        DWORD offset = offsetForAddress(address);
+        m_vbe.m_videoMemory[offset] = data;
+        m_vbe.markRangeDirty(offset, 1);
+    }
+
+    virtual void writeMemoryBlock(DWORD address, const BYTE* data, DWORD length) override
+    {
+        DWORD offset = offsetForAddress(address);
+        memcpy(&m_vbe.m_videoMemory[offset], data, length);
+        m_vbe.markRangeDirty(offset, length);
+    }
+
+private:
+    DWORD offsetForAddress(DWORD address) const
+    {
+        return m_vbe.m_registers[Bank] * bankSize + (address - baseAddress().get());
+    }
+
+    VBE& m_vbe;
+};
+
+VBE::VBE(Machine& machine)
+    : IODevice("VBE", machine)
+    , MemoryProvider(PhysicalAddress(linearFramebufferAddress), videoMemorySize)
+    , m_dirtyPageMap(videoMemorySize / 4096)
+    , m_bankWindow(make<BankWindow>(*this))
+{
+    // calloc() hands out untouched zero pages, so unused video memory costs nothing.
+    m_videoMemory = static_cast<BYTE*>(calloc(videoMemorySize, 1));
+    RELEASE_ASSERT(m_videoMemory);
+
+    m_pointerForDirectReadAccess = m_videoMemory;
+    m_pointerForDirectWriteAccess = m_videoMemory;
+    m_dirtyPages = m_dirtyPageMap.data();
+
+    memset(m_registers, 0, sizeof(m_registers));
+
+    machine.cpu().registerMemoryProvider(*this);
+
+    listen<VBE>(0x1ce, IODevice::ReadWrite);
+    listen<VBE>(0x1cf, IODevice::ReadWrite);
+
+    reset();
+}
+
+VBE::~VBE()
+{
+    free(m_videoMemory);
+}
+
+void VBE::reset()
+{
+    setEnable(0);
+
+    m_registerIndex = 0;
+    m_registers[ID] = 0xb0c5;
+    m_registers[XResolution] = 640;
+    m_registers[YResolution] = 480;
+    m_registers[BitsPerPixel] = 8;
+    m_registers[Bank] = 0;
+    m_registers[VirtualWidth] = 640;
+    m_registers[XOffset] = 0;
+    m_registers[YOffset] = 0;
+    m_registers[VideoMemory64K] = videoMemorySize / 65536;
+    updateVirtualHeight();
+    modeDidChange();
+}
+
+DWORD VBE::displayStartOffset() const
+{
+    return m_registers[YOffset] * bytesPerLine() + m_registers[XOffset] * bytesPerPixel();
+}
+
+void VBE::modeDidChange()
+{
+    m_modeGeneration.store(m_modeGeneration.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    machine().notifyScreen();
+}
+
+void VBE::updateVirtualHeight()
+{
+    DWORD pitch = bytesPerLine();
+    m_registers[VirtualHeight] = pitch ? std::min<DWORD>(videoMemorySize / pitch, 0xffff) : 0;
+}
+
+void VBE::setEnable(WORD flags)
+{
+    bool wasEnabled = isEnabled();
+
+    if ((flags & Enabled) && !wasEnabled) {
+        WORD bpp = m_registers[BitsPerPixel];
+        if (bpp != 8 && bpp != 15 && bpp != 16 && bpp != 24 && bpp != 32) {
+            vlog(LogVGA, "VBE: Refusing to enable with unsupported depth %u", bpp);
+            return;
+        }
+        if (!width() || !height() || (DWORD)width() * height() * bytesPerPixel() > videoMemorySize) {
+            vlog(LogVGA, "VBE: Refusing to enable %ux%ux%u, doesn't fit in video memory", width(), height(), bpp);
+            return;
+        }
+        vlog(LogVGA, "VBE: Enable %ux%ux%u", width(), height(), bpp);
+
+        m_registers[VirtualWidth] = width();
+        m_registers[XOffset] = 0;
+        m_registers[YOffset] = 0;
+        m_registers[Bank] = 0;
+        updateVirtualHeight();
+
+        if (!(flags & NoClearMemory)) {
+            DWORD length = bytesPerLine() * height();
+            memset(m_videoMemory, 0, length);
+            markRangeDirty(0, length);
+        }
+
+        machine().cpu().registerMemoryProvider(*m_bankWindow);
+    } else if (!(flags & Enabled) && wasEnabled) {
+        vlog(LogVGA, "VBE: Disable");
+        machine().cpu().registerMemoryProvider(machine().vga());
+    }
+
+    m_registers[Enable] = flags & (Enabled | GetCapabilities | EightBitDAC | LinearFramebufferEnabled);
+    if ((flags & Enabled) != wasEnabled)
+        modeDidChange();
+}
+
+void VBE::writeRegister(WORD index, WORD data)
+{
+    switch (index) {
+    case ID:
+        if (data >= 0xb0c0 && data <= 0xb0c5)
+            m_registers[ID] = data;
+        break;
+    case XResolution:
+    case YResolution:
+    case BitsPerPixel:
+        if (isEnabled()) {
+            vlog(LogVGA, "VBE: Ignoring write to register %u while enabled", index);
+            break;
+        }
+        if (index == BitsPerPixel && !data)
+            data = 8;
+        m_registers[index] = data;
+        break;
+    case Enable:
+        setEnable(data);
+        break;
+    case Bank:
+        if ((DWORD)data * bankSize >= videoMemorySize) {
+            vlog(LogVGA, "VBE: Bank %u out of range", data);
+            break;
+        }
+        m_registers[Bank] = data;
+        break;
+    case VirtualWidth:
+        m_registers[VirtualWidth] = std::max(data, width());
+        updateVirtualHeight();
+        modeDidChange();
+        break;
+    case XOffset:
+    case YOffset:
+        m_registers[index] = data;
+        modeDidChange();
+        break;
+    default:
+        vlog(LogVGA, "VBE: Write to unknown register %u <- %04x", index, data);
+        break;
+    }
+}
+
+WORD VBE::readRegister(WORD index) const
+{
+    if (index >= RegisterCount) {
+        vlog(LogVGA, "VBE: Read from unknown register %u", index);
+        return 0;
+    }
+    if (m_registers[Enable] & GetCapabilities) {
+        switch (index) {
+        case XResolution:
+            return maximumXResolution;
+        case YResolution:
+            return maximumYResolution;
+        case BitsPerPixel:
+            return maximumBitsPerPixel;
+        }
+    }
+    return m_registers[index];
+}
+
+void VBE::out16(WORD port, WORD data)
+{
+    if (port == 0x1ce)
+        m_registerIndex = data;
+    else
+        writeRegister(m_registerIndex, data);
+}
+
+WORD VBE::in16(WORD port)
+{
+    if (port == 0x1ce)
+        return m_registerIndex;
+    return readRegister(m_registerIndex);
+}
+
+// The DISPI ports are 16 bits wide, byte accesses just use the low half.
+void VBE::out8(WORD port, BYTE data)
+{
+    out16(port, data);
+}
+
+BYTE VBE::in8(WORD port)
+{
+    return in16(port);
+}
+
+void VBE::markRangeDirty(DWORD offset, DWORD length)
+{
+    if (!length)
+        return;
+    for (DWORD page = offset >> 12; page <= (offset + length - 1) >> 12; ++page)
+        m_dirtyPageMap[page].store(1, std::memory_order_relaxed);
+}
+
+bool VBE::collectDirtyPages()
+{
+    bool collected = false;
+    for (DWORD page = 0; page < m_dirtyPageMap.size(); ++page) {
+        if (m_dirtyPageMap[page].load(std::memory_order_relaxed)) {
+            m_dirtyPageMap[page].store(0, std::memory_order_relaxed);
+            m_collectedPages.append(page);
+            collected = true;
+        }
+    }
+    return collected;
+}
+
+void VBE::copyToFrame(FrameSnapshot& frame, DWORD offset, DWORD length)
+{
+    DWORD start = displayStartOffset();
+    DWORD end = start + frame.vbe.memory.size();
+    offset = std::max(offset, start);
+    DWORD last = std::min(offset + length, end);
+    if (offset < last)
+        memcpy(frame.vbe.memory.data() + (offset - start), &m_videoMemory[offset], last - offset);
+}
+
+void VBE::captureFrame(FrameSnapshot& frame)
+{
+    collectDirtyPages();
+
+    auto& latest = m_captureHistory[++m_captureSerial % 4];
+    latest.serial = m_captureSerial;
+    latest.pages.swap(m_collectedPages);
+    m_collectedPages.clear();
+
+    auto& vbe = frame.vbe;
+    vbe.enabled = isEnabled();
+    if (!vbe.enabled)
+        return;
+
+    bool canUpdate = vbe.modeGeneration == modeGeneration() && vbe.serial && m_captureSerial - vbe.serial < 4;
+
+    vbe.width = width();
+    vbe.height = height();
+    vbe.bitsPerPixel = bitsPerPixel();
+    vbe.bytesPerLine = bytesPerLine();
+    vbe.modeGeneration = modeGeneration();
+
+    if (!canUpdate) {
+        DWORD start = displayStartOffset();
+        vbe.memory.resize(std::min<DWORD>(bytesPerLine() * height(), start < videoMemorySize ? videoMemorySize - start : 0));
+        copyToFrame(frame, start, vbe.memory.size());
+    } else {
+        for (QWORD serial = vbe.serial + 1; serial <= m_captureSerial; ++serial) {
+            for (DWORD page : m_captureHistory[serial % 4].pages)
+                copyToFrame(frame, page * 4096, 4096);
+        }
+    }
+    vbe.serial = m_captureSerial;
+}
+
+const BYTE* VBE::memoryPointer(DWORD address) const
+{
+    return &m_videoMemory[address - baseAddress().get()];
+}
+
+BYTE VBE::readMemory8(DWORD address)
+{
+    return m_videoMemory[address - baseAddress().get()];
+}
+
+void VBE::writeMemory8(DWORD address, BYTE data)
+{
+    DWORD offset = address - baseAddress().get();
+    m_videoMemory[offset] = data;
+    markRangeDirty(offset, 1);
+}
+
+void VBE::writeMemoryBlock(DWORD address, const BYTE* data, DWORD length)
+{
+    DWORD offset = address - baseAddress().get();
+    length = std::min(length, videoMemorySize - offset);
+    memcpy(&m_videoMemory[offset], data, length);
+    markRangeDirty(offset, length);
+}
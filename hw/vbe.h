@@ -0,0 +1,127 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "iodevice.h"
+#include "MemoryProvider.h"
+#include "OwnPtr.h"
+#include <QtCore/QVector>
+#include <atomic>
+#include <vector>
+
+// Bochs VBE extensions ("DISPI"), programmed through ports 0x1CE (index) and 0x1CF (data).
+// Video memory is mapped linearly at 0xE0000000, and 64K at a time at 0xA0000 while enabled.
+struct FrameSnapshot;
+
+class VBE final : public IODevice, public MemoryProvider {
+public:
+    enum RegisterIndex {
+        ID = 0,
+        XResolution,
+        YResolution,
+        BitsPerPixel,
+        Enable,
+        Bank,
+        VirtualWidth,
+        VirtualHeight,
+        XOffset,
+        YOffset,
+        VideoMemory64K,
+        RegisterCount
+    };
+
+    enum EnableFlags {
+        Enabled = 0x01,
+        GetCapabilities = 0x02,
+        EightBitDAC = 0x20,
+        LinearFramebufferEnabled = 0x40,
+        NoClearMemory = 0x80,
+    };
+
+    static const DWORD linearFramebufferAddress = 0xe0000000;
+    static const DWORD videoMemorySize = 16 * 1048576;
+
+    explicit VBE(Machine&);
+    virtual ~VBE();
+
+    // IODevice
+    virtual void reset() override;
+    virtual BYTE in8(WORD port) override;
+    virtual WORD in16(WORD port) override;
+    virtual void out8(WORD port, BYTE data) override;
+    virtual void out16(WORD port, WORD data) override;
+
+    // MemoryProvider
+    virtual const BYTE* memoryPointer(DWORD address) const override;
+    virtual BYTE readMemory8(DWORD address) override;
+    virtual void writeMemory8(DWORD address, BYTE) override;
+    virtual void writeMemoryBlock(DWORD address, const BYTE* data, DWORD length) override;
+
+    bool isEnabled() const { return m_registers[Enable] & Enabled; }
+    WORD width() const { return m_registers[XResolution]; }
+    WORD height() const { return m_registers[YResolution]; }
+    WORD bitsPerPixel() const { return m_registers[BitsPerPixel]; }
+    DWORD bytesPerPixel() const { return (bitsPerPixel() + 7) / 8; }
+    DWORD bytesPerLine() const { return m_registers[VirtualWidth] * bytesPerPixel(); }
+    DWORD displayStartOffset() const;
+    const BYTE* videoMemory() const { return m_videoMemory; }
+
+    // Bumped whenever the display geometry, depth or start address changes.
+    DWORD modeGeneration() const { return m_modeGeneration.load(std::memory_order_relaxed); }
+
+    // Moves the pages written since the last call over to the next captured frame.
+    // Returns true if there were any.
+    bool collectDirtyPages();
+
+    // Brings the frame's copy of the visible framebuffer up to date. Only pages written
+    // since the frame was last captured into are copied, if we still remember which.
+    void captureFrame(FrameSnapshot&);
+
+private:
+    class BankWindow;
+
+    void writeRegister(WORD index, WORD data);
+    WORD readRegister(WORD index) const;
+    void setEnable(WORD flags);
+    void updateVirtualHeight();
+    void markRangeDirty(DWORD offset, DWORD length);
+    void modeDidChange();
+    void copyToFrame(FrameSnapshot&, DWORD offset, DWORD length);
+
+    WORD m_registerIndex { 0 };
+    WORD m_registers[RegisterCount];
+    BYTE* m_videoMemory { nullptr };
+    std::vector<std::atomic<BYTE>> m_dirtyPageMap;
+    OwnPtr<BankWindow> m_bankWindow;
+    std::atomic<DWORD> m_modeGeneration { 0 };
+
+    QVector<DWORD> m_collectedPages;
+    QWORD m_captureSerial { 0 };
+    struct CapturedPages {
+        QWORD serial { 0 };
+        QVector<DWORD> pages;
+    };
+    CapturedPages m_captureHistory[4];
+};
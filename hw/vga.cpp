@@ -27,8 +27,10 @@
 #include "debug.h"
 #include "machine.h"
 #include "CPU.h"
+#include "FrameSnapshot.h"
 #include <QtGui/QColor>
 #include <QtGui/QBrush>
+#include <atomic>
 
 struct RGBColor {
     BYTE red;
@@ -37,13 +39,78 @@ struct RGBColor {
     operator QColor() const { return QColor::fromRgb(red << 2, green << 2, blue << 2); }
 };
 
+// The write pipeline state, derived from the Graphics Controller and Sequencer registers.
+// Planes are packed into a DWORD (plane N in byte N) so all four are processed at once.
+struct PlanarWriteState {
+    typedef DWORD (*WriteFunction)(const PlanarWriteState&, DWORD latch, BYTE value);
+
+    WriteFunction write { nullptr };
+    DWORD setReset { 0 };
+    DWORD enableSetReset { 0 };
+    DWORD bitMask { 0 };
+    BYTE rotateCount { 0 };
+    BYTE mapMask { 0 };
+    bool chain4 { false };
+    DWORD windowStart { 0 };
+    DWORD windowEnd { 0 };
+};
+
+static const DWORD planeMaskTable[16] = {
+    0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff, 0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
+    0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff, 0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff,
+};
+
+static ALWAYS_INLINE DWORD expandToPlanes(BYTE value)
+{
+    return value * 0x01010101u;
+}
+
+static ALWAYS_INLINE BYTE rotateRight(BYTE value, BYTE count)
+{
+    return count ? (value >> count) | (value << (8 - count)) : value;
+}
+
+template<unsigned writeMode, unsigned logicalOp>
+static DWORD planarWrite(const PlanarWriteState& state, DWORD latch, BYTE value)
+{
+    if (writeMode == 1)
+        return latch;
+
+    DWORD data;
+    DWORD bitMask = state.bitMask;
+    if (writeMode == 0) {
+        data = (expandToPlanes(rotateRight(value, state.rotateCount)) & ~state.enableSetReset) | (state.setReset & state.enableSetReset);
+    } else if (writeMode == 2) {
+        data = planeMaskTable[value & 0xf];
+    } else {
+        data = state.setReset;
+        bitMask &= expandToPlanes(rotateRight(value, state.rotateCount));
+    }
+
+    switch (logicalOp) {
+    case 1: data &= latch; break;
+    case 2: data |= latch; break;
+    case 3: data ^= latch; break;
+    }
+
+    return (data & bitMask) | (latch & ~bitMask);
+}
+
+static const PlanarWriteState::WriteFunction planarWriteFunctions[4][4] = {
+    { planarWrite<0, 0>, planarWrite<0, 1>, planarWrite<0, 2>, planarWrite<0, 3> },
+    { planarWrite<1, 0>, planarWrite<1, 0>, planarWrite<1, 0>, planarWrite<1, 0> },
+    { planarWrite<2, 0>, planarWrite<2, 1>, planarWrite<2, 2>, planarWrite<2, 3> },
+    { planarWrite<3, 0>, planarWrite<3, 1>, planarWrite<3, 2>, planarWrite<3, 3> },
+};
+
 struct VGA::Private
 {
     QColor color[16];
     QBrush brush[16];
     BYTE* memory { nullptr };
     BYTE* plane[4];
-    BYTE latch[4];
+    DWORD latch { 0 };
+    PlanarWriteState planarWrite;
 
     struct {
         BYTE reg_index;
@@ -99,11 +166,11 @@ struct VGA::Private
 
     bool vga_enabled;
 
-    bool paletteDirty { true };
+    std::atomic<DWORD> paletteGeneration { 0 };
+    bool paletteChangeSignalled { false };
 
     bool write_protect;
 
-    bool screenInRefresh { false };
     BYTE statusRegister { 0 };
 };
 
@@ -131,16 +198,23 @@ VGA::VGA(Machine& m)
 {
     machine().cpu().registerMemoryProvider(*this);
 
-    listen(0x3B4, IODevice::ReadWrite);
-    listen(0x3B5, IODevice::ReadWrite);
-    listen(0x3BA, IODevice::ReadWrite);
+    listen<VGA>(0x3B4, IODevice::ReadWrite);
+    listen<VGA>(0x3B5, IODevice::ReadWrite);
+    listen<VGA>(0x3BA, IODevice::ReadWrite);
 
     for (WORD port = 0x3c0; port <= 0x3cf; ++port)
-        listen(port, IODevice::ReadWrite);
+        listen<VGA>(port, IODevice::ReadWrite);
 
-    listen(0x3D4, IODevice::ReadWrite);
-    listen(0x3D5, IODevice::ReadWrite);
-    listen(0x3DA, IODevice::ReadWrite);
+    listen<VGA>(0x3D4, IODevice::ReadWrite);
+    listen<VGA>(0x3D5, IODevice::ReadWrite);
+    listen<VGA>(0x3DA, IODevice::ReadWrite);
+
+    // Palette uploads and register streams (REP OUTSB/OUTSW) are handled in one go.
+    for (WORD port : { 0x3B4, 0x3C0, 0x3C4, 0x3C8, 0x3C9, 0x3CE, 0x3D4 }) {
+        machine().ioPortBus().registerOutputStream(port, [] (void* context, WORD port, const BYTE* data, unsigned count, unsigned size) {
+            static_cast<VGA*>(context)->outStream(port, data, count, size);
+        }, this);
+    }
 
     reset();
 }
@@ -201,8 +275,6 @@ void VGA::reset()
 
     memcpy(d->dac.color, default_vga_color_registers, sizeof(default_vga_color_registers));
 
-    d->paletteDirty = true;
-    d->screenInRefresh = false;
     d->statusRegister = 0;
 
     d->memory = new BYTE[0x40000];
@@ -213,20 +285,51 @@ void VGA::reset()
 
     memset(d->memory, 0x00, 0x40000);
 
-    d->latch[0] = 0;
-    d->latch[1] = 0;
-    d->latch[2] = 0;
-    d->latch[3] = 0;
+    d->latch = 0;
 
     d->write_protect = false;
 
+    updatePlanarWriteState();
+
     synchronizeColors();
-    setPaletteDirty(true);
+    paletteDidChange();
 }
 
 void VGA::out8(WORD port, BYTE data)
 {
+    if (writeRegister(port, data))
+        machine().notifyScreen();
+}
+
+void VGA::outStream(WORD port, const BYTE* data, unsigned count, unsigned size)
+{
+    bool changed = false;
+    for (unsigned i = 0; i < count * size; ++i)
+        changed |= writeRegister(port + i % size, data[i]);
+    if (changed)
+        machine().notifyScreen();
+}
+
+void VGA::paletteDidChange()
+{
+    d->paletteGeneration.store(d->paletteGeneration.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (d->paletteChangeSignalled)
+        return;
+    d->paletteChangeSignalled = true;
+    emit paletteChanged();
     machine().notifyScreen();
+}
+
+DWORD VGA::paletteGeneration() const
+{
+    return d->paletteGeneration.load(std::memory_order_relaxed);
+}
+
+// Returns true if the write may have changed what's on screen. Palette changes are
+// announced separately, through the palette generation.
+bool VGA::writeRegister(WORD port, BYTE data)
+{
+    bool changed = false;
 
     switch (port) {
     case 0x3B4:
@@ -268,6 +371,7 @@ void VGA::out8(WORD port, BYTE data)
             if (data & 0x40)
                 d->crtc.vertical_display_end |= 0x200;
         }
+        changed = d->crtc.reg[d->crtc.reg_index] != data;
         d->crtc.reg[d->crtc.reg_index] = data;
         break;
 
@@ -285,6 +389,7 @@ void VGA::out8(WORD port, BYTE data)
         d->misc_output.vertical_sync_polarity = (data >> 7) & 1;
         // FIXME: Support remapping between 3bx/3dx
         ASSERT(d->misc_output.input_output_address_select == true);
+        changed = true;
         break;
 
     case 0x3C0: {
@@ -293,8 +398,12 @@ void VGA::out8(WORD port, BYTE data)
             d->attr.palette_address_source = data & 0x20;
         } else {
             if (d->attr.reg_index < 0x10) {
-                d->attr.palette_reg[d->attr.reg_index] = data;
+                if (d->attr.palette_reg[d->attr.reg_index] != data) {
+                    d->attr.palette_reg[d->attr.reg_index] = data;
+                    paletteDidChange();
+                }
             } else {
+                changed = true;
                 switch (d->attr.reg_index) {
                 case 0x10:
                     d->attr.mode_control = data;
@@ -322,6 +431,7 @@ void VGA::out8(WORD port, BYTE data)
     }
 
     case 0x3C3:
+        changed = d->vga_enabled != (data & 1);
         d->vga_enabled = data & 1;
         break;
 
@@ -336,10 +446,14 @@ void VGA::out8(WORD port, BYTE data)
             vlog(LogVGA, "Invalid VGA sequencer register #%u written (data: %02x)", d->sequencer.reg_index, data);
             break;
         }
+        changed = d->sequencer.reg[d->sequencer.reg_index] != data;
         d->sequencer.reg[d->sequencer.reg_index] = data;
+        if (changed)
+            updatePlanarWriteState();
         break;
 
     case 0x3C6:
+        changed = d->dac.mask != data;
         d->dac.mask = data;
         break;
 
@@ -372,7 +486,7 @@ void VGA::out8(WORD port, BYTE data)
             break;
         }
 
-        setPaletteDirty(true);
+        paletteDidChange();
         break;
     }
 
@@ -393,6 +507,7 @@ void VGA::out8(WORD port, BYTE data)
             vlog(LogVGA, "Write to invalid graphics register %u <- %02x", d->graphics_ctrl.reg_index, data);
             break;
         }
+        changed = d->graphics_ctrl.reg[d->graphics_ctrl.reg_index] != data;
         d->graphics_ctrl.reg[d->graphics_ctrl.reg_index] = data;
         if (d->graphics_ctrl.reg_index == 6) {
             d->graphics_ctrl.memory_map_select = (data >> 2) & 3;
@@ -400,6 +515,8 @@ void VGA::out8(WORD port, BYTE data)
             //vlog(LogVGA, "Memory map select: %u", d->graphics_ctrl.memory_map_select);
             //vlog(LogVGA, "Alphanumeric mode disable: %u", d->graphics_ctrl.alphanumeric_mode_disable);
         }
+        if (changed)
+            updatePlanarWriteState();
         break;
 
     default:
@@ -407,17 +524,44 @@ void VGA::out8(WORD port, BYTE data)
         ASSERT_NOT_REACHED();
         IODevice::out8(port, data);
     }
+
+    return changed;
 }
 
-void VGA::willRefreshScreen()
+void VGA::vsync()
 {
-    d->screenInRefresh = true;
+    d->paletteChangeSignalled = false;
+    d->statusRegister |= 0x08;
 }
 
-void VGA::didRefreshScreen()
+void VGA::captureFrame(FrameSnapshot& frame) const
 {
-    d->screenInRefresh = false;
-    d->statusRegister |= 0x08;
+    auto& cpu = machine().cpu();
+
+    frame.videoMode = currentVideoMode();
+    // FIXME: Don't get these through the BDA.
+    frame.rows = cpu.readPhysicalMemory<BYTE>(PhysicalAddress(0x484)) + 1;
+    frame.columns = cpu.readPhysicalMemory<BYTE>(PhysicalAddress(0x44a));
+    frame.startAddress = start_address();
+    frame.cursorLocation = cursor_location();
+    frame.cursorStartScanline = cursor_start_scanline();
+    frame.cursorEndScanline = cursor_end_scanline();
+    frame.cursorEnabled = cursor_enabled();
+    memcpy(frame.crtc, d->crtc.reg, sizeof(frame.crtc));
+
+    for (int i = 0; i < 256; ++i)
+        frame.color[i] = color(i).rgb();
+    for (int i = 0; i < 16; ++i)
+        frame.paletteColor[i] = paletteColor(i).rgb();
+
+    frame.vgaMemory.resize(0x40000);
+    memcpy(frame.vgaMemory.data(), d->memory, 0x40000);
+
+    if (frame.videoMode == 0x03) {
+        auto vector = cpu.getRealModeInterruptVector(0x43);
+        if (auto* font = cpu.pointerToPhysicalMemory(PhysicalAddress::fromRealMode(vector)))
+            memcpy(frame.font, font, sizeof(frame.font));
+    }
 }
 
 BYTE VGA::in8(WORD port)
@@ -586,19 +730,6 @@ BYTE VGA::readRegister(BYTE index) const
     return d->crtc.reg[index];
 }
 
-void VGA::setPaletteDirty(bool dirty)
-{
-    if (dirty == d->paletteDirty)
-        return;
-    d->paletteDirty = dirty;
-    emit paletteChanged();
-}
-
-bool VGA::isPaletteDirty()
-{
-    return d->paletteDirty;
-}
-
 QColor VGA::paletteColor(int attribute_register_index) const
 {
     const RGBColor& c = d->dac.color[d->attr.palette_reg[attribute_register_index]];
@@ -658,231 +789,87 @@ BYTE VGA::read_map_select() const
     return d->graphics_ctrl.reg[4] & 3;
 }
 
-void VGA::writeMemory8(DWORD address, BYTE value)
+void VGA::updatePlanarWriteState()
 {
-    DWORD offset;
+    auto& state = d->planarWrite;
+
+    if (write_mode() == 0 && rotate_count())
+        vlog(LogVGA, "rotate_count non-zero!");
+
+    state.write = planarWriteFunctions[write_mode()][logical_op()];
+    state.setReset = planeMaskTable[d->graphics_ctrl.reg[0] & 0xf];
+    state.enableSetReset = planeMaskTable[d->graphics_ctrl.reg[1] & 0xf];
+    state.bitMask = expandToPlanes(bit_mask());
+    state.rotateCount = rotate_count();
+    state.mapMask = d->sequencer.reg[2] & 0x0f;
+    state.chain4 = inChain4Mode();
+
     switch (d->graphics_ctrl.memory_map_select) {
     case 0: // A0000h-BFFFFh (128K region)
-        if (address < 0xa0000 || address > 0xbffff)
-            return;
-        offset = address - 0xa0000;
+        state.windowStart = 0xa0000;
+        state.windowEnd = 0xbffff;
         break;
     case 1: // A0000h-AFFFFh (64K region)
-        if (address < 0xa0000 || address > 0xaffff)
-            return;
-        offset = address - 0xa0000;
+        state.windowStart = 0xa0000;
+        state.windowEnd = 0xaffff;
         break;
     case 2: // B0000h-B7FFFh (32K region)
-        if (address < 0xb0000 || address > 0xb7fff)
-            return;
-        offset = address - 0xb0000;
+        state.windowStart = 0xb0000;
+        state.windowEnd = 0xb7fff;
         break;
     default: // B8000h-BFFFFh (32K region)
-        if (address < 0xb8000 || address > 0xbffff)
-            return;
-        offset = address - 0xb8000;
+        state.windowStart = 0xb8000;
+        state.windowEnd = 0xbffff;
         break;
     }
+}
 
-    machine().notifyScreen();
+ALWAYS_INLINE void VGA::writePlanar(DWORD offset, BYTE value)
+{
+    auto& state = d->planarWrite;
 
-    if (inChain4Mode()) {
+    if (state.chain4) {
         d->memory[(offset & ~0x03) + (offset % 4)*65536] = value;
         return;
     }
 
-    BYTE new_val[4];
-
-    if (write_mode() == 2) {
-        new_val[0] = d->latch[0] & ~bit_mask();
-        new_val[1] = d->latch[1] & ~bit_mask();
-        new_val[2] = d->latch[2] & ~bit_mask();
-        new_val[3] = d->latch[3] & ~bit_mask();
-
-        switch (logical_op()) {
-        case 0:
-            new_val[0] |= (value & 1) ? bit_mask() : 0;
-            new_val[1] |= (value & 2) ? bit_mask() : 0;
-            new_val[2] |= (value & 4) ? bit_mask() : 0;
-            new_val[3] |= (value & 8) ? bit_mask() : 0;
-            break;
-        default:
-            vlog(LogVGA, "Gaah, unsupported draw_op %d in mode 2 :(\n", logical_op());
-            hard_exit(1);
-        }
-    } else if (write_mode() == 0) {
-        BYTE set_reset = d->graphics_ctrl.reg[0];
-        BYTE enable_set_reset = d->graphics_ctrl.reg[1];
-        BYTE val = value;
-
-        if (rotate_count()) {
-            vlog(LogVGA, "rotate_count non-zero!");
-            val = (val >> rotate_count()) | (val << (8 - rotate_count()));
-        }
-
-        new_val[0] = d->latch[0] & ~bit_mask();
-        new_val[1] = d->latch[1] & ~bit_mask();
-        new_val[2] = d->latch[2] & ~bit_mask();
-        new_val[3] = d->latch[3] & ~bit_mask();
-
-        val &= bit_mask();
-
-        switch (logical_op()) {
-        case 0:
-            new_val[0] |= ((enable_set_reset & 1)
-                ? ((set_reset & 1) ? bit_mask() : 0)
-                : (val & bit_mask()));
-            new_val[1] |= ((enable_set_reset & 2)
-                ? ((set_reset & 2) ? bit_mask() : 0)
-                : (val & bit_mask()));
-            new_val[2] |= ((enable_set_reset & 4)
-                ? ((set_reset & 4) ? bit_mask() : 0)
-                : (val & bit_mask()));
-            new_val[3] |= ((enable_set_reset & 8)
-                ? ((set_reset & 8) ? bit_mask() : 0)
-                : (val & bit_mask()));
-            break;
-        case 1:
-            new_val[0] |= ((enable_set_reset & 1)
-                ? ((set_reset & 1)
-                    ? (~d->latch[0] & bit_mask())
-                    : (d->latch[0] & bit_mask()))
-                : (val & d->latch[0]) & bit_mask());
-
-            new_val[1] |= ((enable_set_reset & 2)
-                ? ((set_reset & 2)
-                    ? (~d->latch[1] & bit_mask())
-                    : (d->latch[1] & bit_mask()))
-                : (val & d->latch[1]) & bit_mask());
-
-            new_val[2] |= ((enable_set_reset & 4)
-                ? ((set_reset & 4)
-                    ? (~d->latch[2] & bit_mask())
-                    : (d->latch[2] & bit_mask()))
-                : (val & d->latch[2]) & bit_mask());
-
-            new_val[3] |= ((enable_set_reset & 8)
-                ? ((set_reset & 8)
-                    ? (~d->latch[3] & bit_mask())
-                    : (d->latch[3] & bit_mask()))
-                : (val & d->latch[3]) & bit_mask());
-            break;
-        case 2:
-            new_val[0] |= ((enable_set_reset & 1)
-                ? ((set_reset & 1)
-                    ? (~d->latch[0] & bit_mask())
-                    : (d->latch[0] & bit_mask()))
-                : (val | d->latch[0]) & bit_mask());
-
-            new_val[1] |= ((enable_set_reset & 2)
-                ? ((set_reset & 2)
-                    ? (~d->latch[1] & bit_mask())
-                    : (d->latch[1] & bit_mask()))
-                : (val | d->latch[1]) & bit_mask());
-
-            new_val[2] |= ((enable_set_reset & 4)
-                ? ((set_reset & 4)
-                    ? (~d->latch[2] & bit_mask())
-                    : (d->latch[2] & bit_mask()))
-                : (val | d->latch[2]) & bit_mask());
-
-            new_val[3] |= ((enable_set_reset & 8)
-                ? ((set_reset & 8)
-                    ? (~d->latch[3] & bit_mask())
-                    : (d->latch[3] & bit_mask()))
-                : (val | d->latch[3]) & bit_mask());
-            break;
-        case 3:
-            new_val[0] |= ((enable_set_reset & 1)
-                ? ((set_reset & 1)
-                    ? (~d->latch[0] & bit_mask())
-                    : (d->latch[0] & bit_mask()))
-                : (val ^ d->latch[0]) & bit_mask());
-
-            new_val[1] |= ((enable_set_reset & 2)
-                ? ((set_reset & 2)
-                    ? (~d->latch[1] & bit_mask())
-                    : (d->latch[1] & bit_mask()))
-                : (val ^ d->latch[1]) & bit_mask());
-
-            new_val[2] |= ((enable_set_reset & 4)
-                ? ((set_reset & 4)
-                    ? (~d->latch[2] & bit_mask())
-                    : (d->latch[2] & bit_mask()))
-                : (val ^ d->latch[2]) & bit_mask());
-
-            new_val[3] |= ((enable_set_reset & 8)
-                ? ((set_reset & 8)
-                    ? (~d->latch[3] & bit_mask())
-                    : (d->latch[3] & bit_mask()))
-                : (val ^ d->latch[3]) & bit_mask());
-            break;
-        }
-    } else if (write_mode() == 3) {
-        BYTE set_reset = d->graphics_ctrl.reg[0];
-        BYTE val = value;
-
-        if (rotate_count()) {
-            vlog(LogVGA, "rotate_count non-zero!");
-            val = (val >> rotate_count()) | (val << (8 - rotate_count()));
-        }
-
-        new_val[0] = d->latch[0] & ~bit_mask();
-        new_val[1] = d->latch[1] & ~bit_mask();
-        new_val[2] = d->latch[2] & ~bit_mask();
-        new_val[3] = d->latch[3] & ~bit_mask();
+    DWORD packed = state.write(state, d->latch, value);
+    if (state.mapMask & 0x01)
+        d->plane[0][offset] = packed;
+    if (state.mapMask & 0x02)
+        d->plane[1][offset] = packed >> 8;
+    if (state.mapMask & 0x04)
+        d->plane[2][offset] = packed >> 16;
+    if (state.mapMask & 0x08)
+        d->plane[3][offset] = packed >> 24;
+}
 
-        val &= bit_mask();
+void VGA::writeMemory8(DWORD address, BYTE value)
+{
+    auto& state = d->planarWrite;
+    if (address < state.windowStart || address > state.windowEnd)
+        return;
 
-        switch (logical_op()) {
-        case 0:
-            new_val[0] |= (set_reset & 1) ? value : 0;
-            new_val[1] |= (set_reset & 2) ? value : 0;
-            new_val[2] |= (set_reset & 4) ? value : 0;
-            new_val[3] |= (set_reset & 8) ? value : 0;
-            break;
-        case 1:
-            new_val[0] |= ((set_reset & 1) ? value : 0) & d->latch[0];
-            new_val[1] |= ((set_reset & 2) ? value : 0) & d->latch[1];
-            new_val[2] |= ((set_reset & 4) ? value : 0) & d->latch[2];
-            new_val[3] |= ((set_reset & 8) ? value : 0) & d->latch[3];
-            break;
-        case 2:
-            new_val[0] |= ((set_reset & 1) ? value : 0) | d->latch[0];
-            new_val[1] |= ((set_reset & 2) ? value : 0) | d->latch[1];
-            new_val[2] |= ((set_reset & 4) ? value : 0) | d->latch[2];
-            new_val[3] |= ((set_reset & 8) ? value : 0) | d->latch[3];
-            break;
-        case 3:
-            new_val[0] |= ((set_reset & 1) ? value : 0) ^ d->latch[0];
-            new_val[1] |= ((set_reset & 2) ? value : 0) ^ d->latch[1];
-            new_val[2] |= ((set_reset & 4) ? value : 0) ^ d->latch[2];
-            new_val[3] |= ((set_reset & 8) ? value : 0) ^ d->latch[3];
-            break;
-        }
-    } else if(write_mode() == 1) {
-        new_val[0] = d->latch[0];
-        new_val[1] = d->latch[1];
-        new_val[2] = d->latch[2];
-        new_val[3] = d->latch[3];
-    } else {
-        vlog(LogVGA, "Unsupported VGA write mode %d", write_mode());
-        hard_exit(1);
+    machine().notifyScreen();
+    writePlanar(address - state.windowStart, value);
+}
 
-        // This is just here to make GCC stop worrying about accessing new_val[] uninitialized.
+void VGA::writeMemoryBlock(DWORD address, const BYTE* data, DWORD length)
+{
+    auto& state = d->planarWrite;
+    DWORD end = address + length - 1;
+    if (!length || end < state.windowStart || address > state.windowEnd)
         return;
-    }
 
-    BYTE map_mask = d->sequencer.reg[2] & 0x0f;
+    if (address < state.windowStart) {
+        data += state.windowStart - address;
+        address = state.windowStart;
+    }
+    end = std::min(end, state.windowEnd);
 
-    if (map_mask & 0x01)
-        d->plane[0][offset] = new_val[0];
-    if (map_mask & 0x02)
-        d->plane[1][offset] = new_val[1];
-    if (map_mask & 0x04)
-        d->plane[2][offset] = new_val[2];
-    if (map_mask & 0x08)
-        d->plane[3][offset] = new_val[3];
+    machine().notifyScreen();
+    for (DWORD offset = address - state.windowStart; address <= end; ++address, ++offset)
+        writePlanar(offset, *(data++));
 }
 
 BYTE VGA::readMemory8(DWORD address)
@@ -917,12 +904,12 @@ BYTE VGA::readMemory8(DWORD address)
         hard_exit(1);
     }
 
-    d->latch[0] = d->plane[0][offset];
-    d->latch[1] = d->plane[1][offset];
-    d->latch[2] = d->plane[2][offset];
-    d->latch[3] = d->plane[3][offset];
+    d->latch = d->plane[0][offset]
+        | (d->plane[1][offset] << 8)
+        | (d->plane[2][offset] << 16)
+        | ((DWORD)d->plane[3][offset] << 24);
 
-    return d->latch[read_map_select()];
+    return d->latch >> (read_map_select() * 8);
 }
 
 const BYTE* VGA::plane(int index) const
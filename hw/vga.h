@@ -30,6 +30,8 @@
 #include <QtCore/QObject>
 #include <QtGui/QColor>
 
+struct FrameSnapshot;
+
 class VGA final : public QObject, public IODevice, public MemoryProvider {
     Q_OBJECT
 public:
@@ -40,16 +42,18 @@ public:
     virtual void reset() override;
     virtual BYTE in8(WORD port) override;
     virtual void out8(WORD port, BYTE data) override;
+    void outStream(WORD port, const BYTE* data, unsigned count, unsigned size);
 
     // MemoryProvider
     virtual void writeMemory8(DWORD address, BYTE value) override;
+    virtual void writeMemoryBlock(DWORD address, const BYTE* data, DWORD length) override;
     virtual BYTE readMemory8(DWORD address) override;
 
     const BYTE* plane(int index) const;
     const BYTE* text_memory() const;
 
-    void setPaletteDirty(bool);
-    bool isPaletteDirty();
+    // Bumped on every DAC or attribute palette change, consumers resync when it moves.
+    DWORD paletteGeneration() const;
 
     BYTE readRegister(BYTE index) const;
 
@@ -65,8 +69,9 @@ public:
 
     WORD start_address() const;
 
-    void willRefreshScreen();
-    void didRefreshScreen();
+    // Called at vertical retrace.
+    void vsync();
+    void captureFrame(FrameSnapshot&) const;
 
     bool inChain4Mode() const;
 
@@ -76,6 +81,10 @@ signals:
     void paletteChanged();
 
 private:
+    bool writeRegister(WORD port, BYTE data);
+    void updatePlanarWriteState();
+    void writePlanar(DWORD offset, BYTE value);
+    void paletteDidChange();
     void synchronizeColors();
     BYTE read_mode() const;
     BYTE write_mode() const;
@@ -34,12 +34,14 @@
 
 #include "types.h"
 #include <QString>
+#include <vector>
 
 #define CRASH() __builtin_trap()
 #define ALWAYS_INLINE __attribute__ ((always_inline)) inline
 #define NEVER_INLINE __attribute__ ((__noinline__))
 #define FLATTEN __attribute__ ((__flatten__))
 #define PURE __attribute__ ((pure))
+#define PRINTF_LIKE(formatIndex, firstArgIndex) __attribute__ ((format(printf, formatIndex, firstArgIndex)))
 #define LIKELY(x) __builtin_expect(!!(x), 1)
 #define UNLIKELY(x) __builtin_expect(!!(x), 0)
 #define UNUSED_PARAM(x) (void)(x)
@@ -63,6 +65,21 @@ struct RuntimeOptions {
     bool crashOnGPF { false };
     bool crashOnException { false };
     bool stacklog { false };
+    bool benchmark { false };
+    bool fusion { true };
+    bool pacing { true };
+    qint64 rtcOffset { 0 };
+    bool rtcHostSync { false };
+    QString serialPort;
+    QString parallelPort;
+    bool headless { false };
+    std::vector<QWORD> captureCycles;
+    QString captureDirectory { "." };
+    QString captureFormat { "png" };
+    QString captureReference;
+    int captureTolerance { 0 };
+    unsigned memorySize { 0 };
+    QString memoryBacking;
     QString autotestPath;
     QString configPath;
 #ifdef DISASSEMBLE_EVERYTHING
@@ -0,0 +1,65 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+
+// Lock-free bounded FIFO for exactly one producer thread and one consumer thread.
+// Each side only ever writes its own index, so neither one waits for the other;
+// a full queue makes enqueue() fail instead.
+template<typename T, unsigned capacity>
+class SPSCQueue {
+    static_assert(capacity && !(capacity & (capacity - 1)), "Capacity must be a power of two");
+
+public:
+    // Producer side.
+    bool enqueue(const T& value)
+    {
+        unsigned tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == capacity)
+            return false;
+        m_slots[tail & (capacity - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool isEmpty() const { return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire); }
+    bool dequeue(T& value)
+    {
+        unsigned head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        value = m_slots[head & (capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_slots[capacity];
+    // Kept apart so the two threads don't fight over one cache line.
+    alignas(64) std::atomic<unsigned> m_head { 0 };
+    alignas(64) std::atomic<unsigned> m_tail { 0 };
+};
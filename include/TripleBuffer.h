@@ -0,0 +1,62 @@
+// Computron x86 PC Emulator
+// Copyright (C) 2003-2018 Andreas Kling <awesomekling@gmail.com>
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY ANDREAS KLING ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL ANDREAS KLING OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer, single consumer triple buffer.
+// The producer fills back() and publish()es it; the consumer take()s the most recently
+// published slot and reads it through front(). Neither side ever waits for the other,
+// and a slow consumer simply skips the intermediate values.
+template<typename T>
+class TripleBuffer {
+public:
+    // Producer side.
+    T& back() { return m_slots[m_backIndex]; }
+    void publish()
+    {
+        m_backIndex = m_middle.exchange(m_backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Consumer side. Returns false if nothing was published since the last take().
+    bool take()
+    {
+        if (!(m_middle.load(std::memory_order_relaxed) & freshBit))
+            return false;
+        m_frontIndex = m_middle.exchange(m_frontIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+    T& front() { return m_slots[m_frontIndex]; }
+    const T& front() const { return m_slots[m_frontIndex]; }
+
+private:
+    static const unsigned freshBit = 4;
+    static const unsigned indexMask = 3;
+
+    T m_slots[3];
+    unsigned m_backIndex { 0 };
+    unsigned m_frontIndex { 1 };
+    std::atomic<unsigned> m_middle { 2 };
+};
@@ -60,6 +60,8 @@ enum VLogChannel {
     LogDump,
     LogScreen,
     LogTimer,
+    LogDMA,
+    LogSerial,
 #ifdef DEBUG_SERENITY
     LogSerenity,
 #endif
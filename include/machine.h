@@ -30,23 +30,34 @@
 #include "OwnPtr.h"
 #include "Common.h"
 #include "ROM.h"
+#include "iodevice.h"
+#include "FrameSnapshot.h"
+#include "TripleBuffer.h"
 #include <QHash>
 #include <QSet>
 #include <QWaitCondition>
 #include <QMutex>
 
 class IODevice;
+class BlockCache;
 class BusMouse;
 class CMOS;
+class DMA;
 class DiskDrive;
 class FDC;
 class IDE;
+class InputQueue;
 class Keyboard;
 class PIC;
 class PIT;
+class ParallelPort;
 class PS2;
+class SerialPort;
 class Settings;
+class TimerService;
 class CPU;
+class FrameCapture;
+class VBE;
 class VGA;
 class VomCtl;
 class Worker;
@@ -64,6 +75,7 @@ public:
 
     CPU& cpu() { return *m_cpu; }
     VGA& vga() { return *m_vga; }
+    VBE& vbe() { return *m_vbe; }
     PIT& pit() { return *m_pit; }
     BusMouse& busMouse() { return *m_busMouse; }
     Keyboard& keyboard() { return *m_keyboard; }
@@ -71,12 +83,22 @@ public:
     PIC& masterPIC() { return *m_masterPIC; }
     PIC& slavePIC() { return *m_slavePIC; }
     CMOS& cmos() { return *m_cmos; }
+    DMA& dma() { return *m_dma; }
+    SerialPort& serialPort(int index) { return *m_serialPorts[index]; }
+    ParallelPort& parallelPort() { return *m_parallelPort; }
     Settings& settings() { return *m_settings; }
 
     DiskDrive& floppy0();
     DiskDrive& floppy1();
     DiskDrive& fixed0();
     DiskDrive& fixed1();
+    BlockCache& blockCache() { return *m_blockCache; }
+    InputQueue& inputQueue() { return *m_inputQueue; }
+    TimerService& timerService() { return *m_timerService; }
+    // Writes back whatever the block cache holds, e.g. before the process exits.
+    void flushDisks();
+    // Hands buffered serial and printer output to the host.
+    void flushOutputPorts();
 
     bool isForAutotest() PURE;
 
@@ -84,15 +106,22 @@ public:
     void setWidget(MachineWidget* widget) { m_widget = widget; }
 
     void resetAllIODevices();
-    void notifyScreen();
+
+    // Something visible changed, a new frame will be published at the next vsync.
+    void notifyScreen() { m_screenDirty = true; }
+
+    // Runs at vertical retrace, every 1/60 s of emulated time. Publishes a FrameSnapshot
+    // into frames() if anything changed, and tells the screen about it.
+    void vsync();
+    TripleBuffer<FrameSnapshot>& frames() { return m_frames; }
+
+    // Renders and saves a frame for --capture-at, called by the CPU when one is due.
+    void captureFrame();
 
     void forEachIODevice(std::function<void(IODevice&)>);
 
-    IODevice* inputDeviceForPort(WORD port);
-    IODevice* outputDeviceForPort(WORD port);
+    IOPortBus& ioPortBus() { return m_ioPortBus; }
 
-    void registerInputDevice(Badge<IODevice>, WORD port, IODevice&);
-    void registerOutputDevice(Badge<IODevice>, WORD port, IODevice&);
     void registerDevice(Badge<IODevice>, IODevice&);
     void unregisterDevice(Badge<IODevice>, IODevice&);
 
@@ -115,13 +144,13 @@ private:
 
     void applySettings();
 
-    Worker& worker() { return *m_worker; }
+    static const QWORD vsyncInterval = 1000000000 / 60;
 
-    IODevice* inputDeviceForPortSlowCase(WORD port);
-    IODevice* outputDeviceForPortSlowCase(WORD port);
+    Worker& worker() { return *m_worker; }
 
     OwnPtr<Settings> m_settings;
     OwnPtr<CPU> m_cpu;
+    OwnPtr<TimerService> m_timerService;
 
     OwnPtr<Worker> m_worker;
     QMutex m_workerMutex;
@@ -129,9 +158,11 @@ private:
 
     // IODevices
     OwnPtr<VGA> m_vga;
+    OwnPtr<VBE> m_vbe;
     OwnPtr<PIT> m_pit;
     OwnPtr<BusMouse> m_busMouse;
     OwnPtr<CMOS> m_cmos;
+    OwnPtr<DMA> m_dma;
     OwnPtr<FDC> m_fdc;
     OwnPtr<IDE> m_ide;
     OwnPtr<Keyboard> m_keyboard;
@@ -139,7 +170,13 @@ private:
     OwnPtr<PIC> m_slavePIC;
     OwnPtr<PS2> m_ps2;
     OwnPtr<VomCtl> m_vomCtl;
+    OwnPtr<SerialPort> m_serialPorts[2];
+    OwnPtr<ParallelPort> m_parallelPort;
+
+    OwnPtr<InputQueue> m_inputQueue;
 
+    // Outlives the drives, which flush into it when they go away.
+    OwnPtr<BlockCache> m_blockCache;
     OwnPtr<DiskDrive> m_floppy0;
     OwnPtr<DiskDrive> m_floppy1;
     OwnPtr<DiskDrive> m_fixed0;
@@ -147,27 +184,14 @@ private:
 
     MachineWidget* m_widget { nullptr };
 
-    QSet<IODevice*> m_allDevices;
+    TripleBuffer<FrameSnapshot> m_frames;
+    QWORD m_frameSerial { 0 };
+    OwnPtr<FrameCapture> m_frameCapture;
+    bool m_screenDirty { true };
 
-    IODevice* m_fastInputDevices[1024];
-    IODevice* m_fastOutputDevices[1024];
+    QSet<IODevice*> m_allDevices;
 
-    QHash<WORD, IODevice*> m_allInputDevices;
-    QHash<WORD, IODevice*> m_allOutputDevices;
+    IOPortBus m_ioPortBus;
 
     QVector<ROM*> m_roms;
 };
-
-inline IODevice* Machine::inputDeviceForPort(WORD port)
-{
-    if (port < 1024)
-        return m_fastInputDevices[port];
-    return inputDeviceForPortSlowCase(port);
-}
-
-inline IODevice* Machine::outputDeviceForPort(WORD port)
-{
-    if (port < 1024)
-        return m_fastOutputDevices[port];
-    return outputDeviceForPortSlowCase(port);
-}
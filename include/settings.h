@@ -29,6 +29,7 @@
 #include "types.h"
 #include "OwnPtr.h"
 #include "DiskDrive.h"
+#include "GuestMemory.h"
 
 class QStringList;
 
@@ -40,6 +41,13 @@ public:
 
     unsigned memorySize() const { return m_memorySize; }
     void setMemorySize(unsigned size) { m_memorySize = size; }
+    const GuestMemory::Configuration& memoryConfiguration() const { return m_memoryConfiguration; }
+
+    // In bytes, shared by all disk drives. Zero disables the block cache.
+    unsigned diskCacheSize() const { return m_diskCacheSize; }
+
+    // Shared by the memory-backing directive and --memory-backing.
+    static bool parseMemoryBacking(const QStringList&, GuestMemory::Configuration&);
 
     WORD entryCS() const { return m_entryCS; }
     WORD entryIP() const { return m_entryIP; }
@@ -50,6 +58,9 @@ public:
     QHash<DWORD, QString> files() const { return m_files; }
     QHash<DWORD, QString> romImages() const { return m_romImages; }
     QString keymap() const { return m_keymap; }
+    // A SerialBackend spec for COM1 or COM2, empty if nothing is attached.
+    QString serialPort(unsigned index) const { return index < 2 ? m_serialPorts[index] : QString(); }
+    QString parallelPort() const { return m_parallelPort; }
 
     bool isForAutotest() const { return m_forAutotest; }
     void setForAutotest(bool b) { m_forAutotest = b; }
@@ -69,19 +80,29 @@ private:
     bool handleROMImage(const QStringList&);
     bool handleLoadFile(const QStringList&);
     bool handleMemorySize(const QStringList&);
+    bool handleMemoryImage(const QStringList&);
+    bool handleMemoryBacking(const QStringList&);
     bool handleFixedDisk(const QStringList&);
     bool handleFloppyDisk(const QStringList&);
+    bool handleDiskOverlay(const QStringList&);
+    bool handleDiskCache(const QStringList&);
     bool handleKeymap(const QStringList&);
+    bool handleSerialPort(const QStringList&);
+    bool handleParallelPort(const QStringList&);
 
     DiskDrive::Configuration m_floppy0;
     DiskDrive::Configuration m_floppy1;
     DiskDrive::Configuration m_fixed0;
     DiskDrive::Configuration m_fixed1;
+    GuestMemory::Configuration m_memoryConfiguration;
 
     QHash<DWORD, QString> m_files;
     QHash<DWORD, QString> m_romImages;
     QString m_keymap;
+    QString m_serialPorts[2];
+    QString m_parallelPort;
     unsigned m_memorySize { 0 };
+    unsigned m_diskCacheSize { 32 * 1024 * 1024 };
     WORD m_entryCS { 0 };
     WORD m_entryIP { 0 };
     WORD m_entryDS { 0 };
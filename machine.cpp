@@ -25,22 +25,32 @@
 #include "machine.h"
 #include "settings.h"
 #include "CPU.h"
+#include "BlockCache.h"
 #include "DiskDrive.h"
 #include "iodevice.h"
 #include "fdc.h"
 #include "ide.h"
+#include "InputQueue.h"
+#include "TimerService.h"
 #include "PS2.h"
 #include "busmouse.h"
 #include "keyboard.h"
 #include "pic.h"
 #include "pit.h"
 #include "vga.h"
+#include "vbe.h"
 #include "cmos.h"
+#include "dma.h"
 #include "vomctl.h"
+#include "SerialBackend.h"
+#include "SerialPort.h"
+#include "ParallelPort.h"
 #include "worker.h"
 #include "screen.h"
 #include "machinewidget.h"
+#include "FrameCapture.h"
 #include <QtCore/QFile>
+#include <chrono>
 
 OwnPtr<Machine> Machine::createFromFile(const QString& fileName)
 {
@@ -74,39 +84,39 @@ Machine::Machine(OwnPtr<Settings>&& settings, QObject* parent)
     if (!m_settings->isForAutotest()) {
         // FIXME: Move this somewhere else.
         // Mitigate spam about uninteresting ports.
-        IODevice::ignorePort(0x220);
-        IODevice::ignorePort(0x221);
-        IODevice::ignorePort(0x222);
-        IODevice::ignorePort(0x223);
-        IODevice::ignorePort(0x201); // Gameport.
-        IODevice::ignorePort(0x80); // Linux outb_p() uses this for small delays.
-        IODevice::ignorePort(0x330); // MIDI
-        IODevice::ignorePort(0x331); // MIDI
-        IODevice::ignorePort(0x334); // SCSI (BusLogic)
-
-        IODevice::ignorePort(0x237);
-        IODevice::ignorePort(0x337);
-
-        IODevice::ignorePort(0x322);
-
-        IODevice::ignorePort(0x0C8F);
-        IODevice::ignorePort(0x1C8F);
-        IODevice::ignorePort(0x2C8F);
-        IODevice::ignorePort(0x3C8F);
-        IODevice::ignorePort(0x4C8F);
-        IODevice::ignorePort(0x5C8F);
-        IODevice::ignorePort(0x6C8F);
-        IODevice::ignorePort(0x7C8F);
-        IODevice::ignorePort(0x8C8F);
-        IODevice::ignorePort(0x9C8F);
-        IODevice::ignorePort(0xAC8F);
-        IODevice::ignorePort(0xBC8F);
-        IODevice::ignorePort(0xCC8F);
-        IODevice::ignorePort(0xDC8F);
-        IODevice::ignorePort(0xEC8F);
-        IODevice::ignorePort(0xFC8F);
-
-        IODevice::ignorePort(0x3f6);
+        m_ioPortBus.ignorePort(0x220);
+        m_ioPortBus.ignorePort(0x221);
+        m_ioPortBus.ignorePort(0x222);
+        m_ioPortBus.ignorePort(0x223);
+        m_ioPortBus.ignorePort(0x201); // Gameport.
+        m_ioPortBus.ignorePort(0x80); // Linux outb_p() uses this for small delays.
+        m_ioPortBus.ignorePort(0x330); // MIDI
+        m_ioPortBus.ignorePort(0x331); // MIDI
+        m_ioPortBus.ignorePort(0x334); // SCSI (BusLogic)
+
+        m_ioPortBus.ignorePort(0x237);
+        m_ioPortBus.ignorePort(0x337);
+
+        m_ioPortBus.ignorePort(0x322);
+
+        m_ioPortBus.ignorePort(0x0C8F);
+        m_ioPortBus.ignorePort(0x1C8F);
+        m_ioPortBus.ignorePort(0x2C8F);
+        m_ioPortBus.ignorePort(0x3C8F);
+        m_ioPortBus.ignorePort(0x4C8F);
+        m_ioPortBus.ignorePort(0x5C8F);
+        m_ioPortBus.ignorePort(0x6C8F);
+        m_ioPortBus.ignorePort(0x7C8F);
+        m_ioPortBus.ignorePort(0x8C8F);
+        m_ioPortBus.ignorePort(0x9C8F);
+        m_ioPortBus.ignorePort(0xAC8F);
+        m_ioPortBus.ignorePort(0xBC8F);
+        m_ioPortBus.ignorePort(0xCC8F);
+        m_ioPortBus.ignorePort(0xDC8F);
+        m_ioPortBus.ignorePort(0xEC8F);
+        m_ioPortBus.ignorePort(0xFC8F);
+
+        m_ioPortBus.ignorePort(0x3f6);
     }
 }
 
@@ -124,42 +134,79 @@ void Machine::makeCPU(Badge<Worker>)
 {
     RELEASE_ASSERT(QThread::currentThread() == m_worker.ptr());
     m_cpu = make<CPU>(*this);
+    m_timerService = make<TimerService>(*this);
+    m_timerService->setPacing(options.pacing && !isForAutotest());
 }
 
 void Machine::makeDevices(Badge<Worker>)
 {
     RELEASE_ASSERT(QThread::currentThread() == m_worker.ptr());
-    m_floppy0 = make<DiskDrive>("floppy0");
-    m_floppy1 = make<DiskDrive>("floppy1");
-    m_fixed0 = make<DiskDrive>("fixed0");
-    m_fixed1 = make<DiskDrive>("fixed1");
+    m_blockCache = make<BlockCache>(settings().diskCacheSize());
+    m_floppy0 = make<DiskDrive>("floppy0", *m_blockCache);
+    m_floppy1 = make<DiskDrive>("floppy1", *m_blockCache);
+    m_fixed0 = make<DiskDrive>("fixed0", *m_blockCache);
+    m_fixed1 = make<DiskDrive>("fixed1", *m_blockCache);
 
     applySettings();
 
-    memset(m_fastInputDevices, 0, sizeof(m_fastInputDevices));
-    memset(m_fastOutputDevices, 0, sizeof(m_fastOutputDevices));
-
     cpu().setBaseMemorySize(640 * 1024);
 
     m_masterPIC = make<PIC>(true, *this);
     m_slavePIC = make<PIC>(false, *this);
     m_busMouse = make<BusMouse>(*this);
     m_cmos = make<CMOS>(*this);
+    m_dma = make<DMA>(*this);
     m_fdc = make<FDC>(*this);
     m_ide = make<IDE>(*this);
     m_keyboard = make<Keyboard>(*this);
     m_ps2 = make<PS2>(*this);
     m_vomCtl = make<VomCtl>(*this);
+    m_serialPorts[0] = make<SerialPort>(*this, "COM1", 0x3f8, 4);
+    m_serialPorts[1] = make<SerialPort>(*this, "COM2", 0x2f8, 3);
+    m_parallelPort = make<ParallelPort>(*this);
     m_pit = make<PIT>(*this);
     m_vga = make<VGA>(*this);
+    m_vbe = make<VBE>(*this);
+    m_inputQueue = make<InputQueue>(*this);
+
+    // Retraces are on the emulated clock, so a missed period is dropped rather than replayed.
+    m_timerService->schedulePeriodic(vsyncInterval, [this] { vsync(); });
+
+    if (!options.captureCycles.empty())
+        m_frameCapture = make<FrameCapture>(*this);
+
+    for (unsigned i = 0; i < 2; ++i) {
+        QString spec = (i == 0 && !options.serialPort.isEmpty()) ? options.serialPort : settings().serialPort(i);
+        if (spec.isEmpty())
+            continue;
+        auto backend = SerialBackend::create(spec);
+        if (!backend) {
+            vlog(LogSerial, "Couldn't open \"%s\" for COM%u", qPrintable(spec), i + 1);
+            continue;
+        }
+        m_serialPorts[i]->attach(std::move(backend));
+    }
 
-    pit().boot();
+    QString printerSpec = !options.parallelPort.isEmpty() ? options.parallelPort : settings().parallelPort();
+    if (!printerSpec.isEmpty()) {
+        auto backend = SerialBackend::create(printerSpec);
+        if (backend)
+            m_parallelPort->attach(std::move(backend));
+        else
+            vlog(LogSerial, "Couldn't open \"%s\" for LPT1", qPrintable(printerSpec));
+    }
 }
 
 void Machine::applySettings()
 {
-    cpu().setExtendedMemorySize(settings().memorySize());
-    cpu().setMemorySizeAndReallocateIfNeeded(settings().memorySize());
+    DWORD memorySize = options.memorySize ? options.memorySize * 1024 : settings().memorySize();
+    auto memoryConfiguration = settings().memoryConfiguration();
+    if (!options.memoryBacking.isEmpty())
+        Settings::parseMemoryBacking(options.memoryBacking.split(','), memoryConfiguration);
+
+    cpu().setExtendedMemorySize(memorySize);
+    // Auto-test settings don't name a size, so those keep the CPU's default RAM.
+    cpu().setMemorySizeAndReallocateIfNeeded(memorySize ? memorySize : cpu().guestMemory().size(), memoryConfiguration);
 
     cpu().setCS(settings().entryCS());
     cpu().setIP(settings().entryIP());
@@ -249,10 +296,36 @@ bool Machine::isForAutotest()
     return settings().isForAutotest();
 }
 
-void Machine::notifyScreen()
+void Machine::captureFrame()
+{
+    if (m_frameCapture)
+        m_frameCapture->capture();
+}
+
+void Machine::vsync()
 {
+    vga().vsync();
+
+    // Keep nudging the guest about scan codes it hasn't picked up yet.
+    if (keyboard().hasRawData() && cpu().getIF())
+        keyboard().didEnqueueData();
+
+    bool changed = m_screenDirty;
+    if (vbe().isEnabled())
+        changed |= vbe().collectDirtyPages();
+    if (!changed)
+        return;
+    m_screenDirty = false;
+
+    auto& frame = m_frames.back();
+    frame.serial = ++m_frameSerial;
+    frame.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    vga().captureFrame(frame);
+    vbe().captureFrame(frame);
+    m_frames.publish();
+
     if (widget())
-        widget()->screen().notify();
+        widget()->screen().frameAvailable();
 }
 
 void Machine::forEachIODevice(std::function<void (IODevice &)> function)
@@ -269,38 +342,34 @@ void Machine::resetAllIODevices()
     });
 }
 
-IODevice* Machine::inputDeviceForPortSlowCase(WORD port)
-{
-    return m_allInputDevices.value(port, nullptr);
-}
-
-IODevice* Machine::outputDeviceForPortSlowCase(WORD port)
-{
-    return m_allOutputDevices.value(port, nullptr);
-}
-
-void Machine::registerInputDevice(Badge<IODevice>, WORD port, IODevice& device)
+void Machine::registerDevice(Badge<IODevice>, IODevice& device)
 {
-    if (port < 1024)
-        m_fastInputDevices[port] = &device;
-    m_allInputDevices.insert(port, &device);
+    m_allDevices.insert(&device);
 }
 
-void Machine::registerOutputDevice(Badge<IODevice>, WORD port, IODevice& device)
+void Machine::unregisterDevice(Badge<IODevice>, IODevice& device)
 {
-    if (port < 1024)
-        m_fastOutputDevices[port] = &device;
-    m_allOutputDevices.insert(port, &device);
+    m_allDevices.remove(&device);
 }
 
-void Machine::registerDevice(Badge<IODevice>, IODevice& device)
+void Machine::flushDisks()
 {
-    m_allDevices.insert(&device);
+    if (!m_blockCache)
+        return;
+    m_floppy0->flush();
+    m_floppy1->flush();
+    m_fixed0->flush();
+    m_fixed1->flush();
 }
 
-void Machine::unregisterDevice(Badge<IODevice>, IODevice& device)
+void Machine::flushOutputPorts()
 {
-    m_allDevices.remove(&device);
+    for (auto& port : m_serialPorts) {
+        if (port)
+            port->flush();
+    }
+    if (m_parallelPort)
+        m_parallelPort->flush();
 }
 
 DiskDrive& Machine::floppy0()
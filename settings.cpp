@@ -120,6 +120,50 @@ bool Settings::handleMemorySize(const QStringList& arguments)
     return true;
 }
 
+bool Settings::handleMemoryImage(const QStringList& arguments)
+{
+    // memory-image <path/to/file>
+
+    if (arguments.count() != 1)
+        return false;
+
+    m_memoryConfiguration.imagePath = arguments.at(0);
+    return true;
+}
+
+bool Settings::parseMemoryBacking(const QStringList& arguments, GuestMemory::Configuration& configuration)
+{
+    for (auto& argument : arguments) {
+        if (argument == QLatin1String("hugepages"))
+            configuration.hugePages = GuestMemory::HugePages::Transparent;
+        else if (argument == QLatin1String("hugetlbfs"))
+            configuration.hugePages = GuestMemory::HugePages::HugeTLB;
+        else if (argument == QLatin1String("prefault"))
+            configuration.prefault = true;
+        else if (argument == QLatin1String("lock"))
+            configuration.lock = true;
+        else if (argument.startsWith(QLatin1String("node="))) {
+            bool ok;
+            unsigned node = argument.mid(5).toUInt(&ok);
+            if (!ok || node >= 64)
+                return false;
+            configuration.numaNode = node;
+        } else
+            return false;
+    }
+    return true;
+}
+
+bool Settings::handleMemoryBacking(const QStringList& arguments)
+{
+    // memory-backing [hugepages|hugetlbfs] [prefault] [lock] [node=<n>]
+
+    if (arguments.isEmpty())
+        return false;
+
+    return parseMemoryBacking(arguments, m_memoryConfiguration);
+}
+
 bool Settings::handleKeymap(const QStringList& arguments)
 {
     // keymap <path/to/file>
@@ -136,6 +180,35 @@ bool Settings::handleKeymap(const QStringList& arguments)
     return true;
 }
 
+bool Settings::handleSerialPort(const QStringList& arguments)
+{
+    // serial-port <index> <file:path|pipe:path|pty|unix:path|stdio>
+
+    if (arguments.count() != 2)
+        return false;
+
+    bool ok;
+    unsigned index = arguments.at(0).toUInt(&ok);
+    if (!ok || index > 1)
+        return false;
+
+    vlog(LogConfig, "Serial port %u: %s", index, qPrintable(arguments.at(1)));
+    m_serialPorts[index] = arguments.at(1);
+    return true;
+}
+
+bool Settings::handleParallelPort(const QStringList& arguments)
+{
+    // parallel-port <file:path|append:path|pipe:path|pty|unix:path|stdio>
+
+    if (arguments.count() != 1)
+        return false;
+
+    vlog(LogConfig, "Parallel port: %s", qPrintable(arguments.at(0)));
+    m_parallelPort = arguments.at(0);
+    return true;
+}
+
 bool Settings::handleFixedDisk(const QStringList& arguments)
 {
     // fixed-disk <index> <path/to/file> <size>
@@ -208,6 +281,50 @@ bool Settings::handleFloppyDisk(const QStringList& arguments)
     return true;
 }
 
+bool Settings::handleDiskOverlay(const QStringList& arguments)
+{
+    // disk-overlay <floppy0|floppy1|fixed0|fixed1> <path/to/overlay> [discard]
+
+    if (arguments.count() != 2 && arguments.count() != 3)
+        return false;
+
+    DiskDrive::Configuration* config = nullptr;
+    if (arguments.at(0) == QLatin1String("floppy0"))
+        config = &m_floppy0;
+    else if (arguments.at(0) == QLatin1String("floppy1"))
+        config = &m_floppy1;
+    else if (arguments.at(0) == QLatin1String("fixed0"))
+        config = &m_fixed0;
+    else if (arguments.at(0) == QLatin1String("fixed1"))
+        config = &m_fixed1;
+    else
+        return false;
+
+    if (arguments.count() == 3 && arguments.at(2) != QLatin1String("discard"))
+        return false;
+
+    config->overlayPath = arguments.at(1);
+    config->discardOverlay = arguments.count() == 3;
+    vlog(LogConfig, "Disk overlay %s: %s%s", qPrintable(arguments.at(0)), qPrintable(config->overlayPath), config->discardOverlay ? " (discarded on start)" : "");
+    return true;
+}
+
+bool Settings::handleDiskCache(const QStringList& arguments)
+{
+    // disk-cache <size in KiB>
+
+    if (arguments.count() != 1)
+        return false;
+
+    bool ok;
+    unsigned size = arguments.at(0).toUInt(&ok);
+    if (!ok)
+        return false;
+
+    m_diskCacheSize = size * 1024;
+    return true;
+}
+
 OwnPtr<Settings> Settings::createForAutotest(const QString& fileName)
 {
     static const WORD autotestEntryCS = 0x1000;
@@ -270,12 +387,24 @@ OwnPtr<Settings> Settings::createFromFile(const QString& fileName)
             success = settings->handleROMImage(arguments);
         else if (command == QLatin1String("memory-size"))
             success = settings->handleMemorySize(arguments);
+        else if (command == QLatin1String("memory-image"))
+            success = settings->handleMemoryImage(arguments);
+        else if (command == QLatin1String("memory-backing"))
+            success = settings->handleMemoryBacking(arguments);
         else if (command == QLatin1String("fixed-disk"))
             success = settings->handleFixedDisk(arguments);
         else if (command == QLatin1String("floppy-disk"))
             success = settings->handleFloppyDisk(arguments);
+        else if (command == QLatin1String("disk-overlay"))
+            success = settings->handleDiskOverlay(arguments);
+        else if (command == QLatin1String("disk-cache"))
+            success = settings->handleDiskCache(arguments);
         else if (command == QLatin1String("keymap"))
             success = settings->handleKeymap(arguments);
+        else if (command == QLatin1String("serial-port"))
+            success = settings->handleSerialPort(arguments);
+        else if (command == QLatin1String("parallel-port"))
+            success = settings->handleParallelPort(arguments);
 
         if (!success) {
             vlog(LogConfig, "Failed parsing %s:%u %s", qPrintable(fileName), lineNumber, qPrintable(line));
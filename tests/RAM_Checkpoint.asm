@@ -0,0 +1,14 @@
+[bits 16]
+
+mov word [data], 0x1234
+mov ax, 0x3334      ; checkpoint guest RAM
+out 0xe6, al
+mov word [data], 0x5678
+mov ax, 0x3335      ; restore the checkpoint
+out 0xe6, al
+mov bx, [data]
+
+db 0xf1
+
+data:
+    dw 0
@@ -0,0 +1,18 @@
+[bits 16]
+
+mov word [data], 0x1234
+mov ax, 0x3334      ; checkpoint guest RAM
+out 0xe6, al
+mov word [data], 0x5678
+mov ax, 0x3336      ; fork from the checkpoint
+out 0xe6, al
+mov bx, [data]      ; the fork sees the checkpoint
+mov word [data], 0x9abc
+mov ax, 0x3337      ; join, dropping the fork's write
+out 0xe6, al
+mov cx, [data]      ; the parent still has its own write
+
+db 0xf1
+
+data:
+    dw 0
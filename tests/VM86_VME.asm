@@ -0,0 +1,111 @@
+[bits 16]
+
+; Enter VM86 mode with CR4.VME=1 and IOPL=0, then:
+;   STI/CLI flip VIF, which PUSHF shows as IF with IOPL=3 (AX=3202, BX=3002)
+;   INT 30h, clear in the redirection bitmap, goes through the IVT (DX=3030)
+;   INT 31h, set in the bitmap, is a #GP through the IDT; the monitor sets VIP
+;   POPF with VIP=1 and IF=1 is a #GP; the monitor sets IOPL=3
+;   INT 31h now goes through its own IDT gate
+
+cli
+mov word [es:0x30 * 4], int30
+mov word [es:0x30 * 4 + 2], 0x1000
+lgdt [gdtr]
+lidt [idtr]
+mov eax, 1
+mov cr0, eax
+jmp dword 0x08:pm
+
+[bits 32]
+pm:
+mov ax, 0x10
+mov ss, ax
+mov esp, 0x3000
+mov ax, 0x18
+ltr ax
+mov eax, 1          ; CR4.VME
+mov cr4, eax
+push strict dword 0         ; GS
+push strict dword 0         ; FS
+push strict dword 0x1000    ; DS
+push strict dword 0         ; ES
+push strict dword 0x2000    ; SS
+push strict dword 0x1000    ; ESP
+push strict dword 0x20002   ; EFLAGS: VM=1, IOPL=0, IF=0
+push strict dword 0x1000    ; CS
+push strict dword v86       ; EIP
+iretd
+
+[bits 16]
+v86:
+sti
+pushf
+pop ax
+cli
+pushf
+pop bx
+int 0x30
+int 0x31
+after_int31:
+push word 0x0200
+popf
+after_popf:
+int 0x31
+
+int30:
+mov dx, 0x3030
+iret
+
+[bits 32]
+gp_handler:
+jecxz .first
+mov dword [esp + 12], 0x23002   ; VM=1, IOPL=3
+mov dword [esp + 4], after_popf
+lea esp, [esp + 4]
+iretd
+.first:
+mov cl, 1
+mov dword [esp + 12], 0x120002  ; VM=1, VIP=1, IOPL=0
+mov dword [esp + 4], after_int31
+lea esp, [esp + 4]
+iretd
+
+int31_handler:
+db 0xf1
+
+gdtr:
+    dw gdt_end - gdt - 1
+    dd 0x10000 + gdt
+
+idtr:
+    dw idt_end - idt - 1
+    dd 0x10000 + idt
+
+gdt:
+    dq 0
+    dw 0xffff, 0x0000
+    db 0x01, 0x9a, 0x40, 0x00   ; 0x08: ring 0 code, base 0x10000, 32-bit
+    dw 0xffff, 0x0000
+    db 0x01, 0x92, 0x40, 0x00   ; 0x10: ring 0 data, base 0x10000, 32-bit
+    dw tss_end - tss - 1, tss
+    db 0x01, 0x89, 0x00, 0x00   ; 0x18: 32-bit TSS
+gdt_end:
+
+idt:
+    times 13 dq 0
+    dw gp_handler, 0x08, 0x8e00, 0      ; #GP: ring 0 interrupt gate
+    times 0x31 - 14 dq 0
+    dw int31_handler, 0x08, 0xee00, 0   ; INT 31h: ring 3 interrupt gate
+idt_end:
+
+tss:
+    dd 0
+    dd 0x3000           ; ESP0
+    dd 0x10             ; SS0
+    times 22 dd 0
+    dw 0
+    dw tss_end - tss    ; I/O map base, just past the redirection bitmap
+    times 6 db 0
+    db 0x02             ; INT 31h set, INT 30h clear
+    times 25 db 0
+tss_end:
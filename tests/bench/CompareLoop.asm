@@ -0,0 +1,30 @@
+[bits 16]
+
+; Nested counted loops dominated by CMP/TEST + Jcc and DEC + JNZ pairs.
+
+    xor ax, ax
+    xor bx, bx
+    mov dx, 100
+outer:
+    mov cx, 0xffff
+inner:
+    cmp cx, 0x1234
+    je skip
+    test cl, 1
+    jz skip
+    inc ax
+skip:
+    dec cx
+    jnz inner
+    dec dx
+    jnz outer
+
+    mov ecx, 10000000
+loop32:
+    cmp ecx, ebx
+    jb done
+    dec ecx
+    jnz loop32
+done:
+
+db 0xf1
@@ -0,0 +1,34 @@
+[bits 16]
+
+; Divide errors delivered through the real-mode IVT, one fault per iteration.
+; Every fault goes through the CPU's exception path, so this measures its per-fault cost.
+
+    xor ax, ax
+    mov es, ax
+    mov word [es:0], handler
+    mov word [es:2], cs
+
+    xor bx, bx
+    mov dx, 10
+outer:
+    mov cx, 0xffff
+inner:
+    push dx
+    xor dx, dx
+    mov ax, 1
+    div bx
+    pop dx
+    dec cx
+    jnz inner
+    dec dx
+    jnz outer
+
+db 0xf1
+
+; DIV BX is two bytes; step the saved IP over it.
+handler:
+    push bp
+    mov bp, sp
+    add word [bp + 2], 2
+    pop bp
+    iret
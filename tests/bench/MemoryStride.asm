@@ -0,0 +1,47 @@
+; bench-args: --memory-size 262144
+[bits 16]
+
+; Scattered read-modify-writes over 256 MiB of RAM, which is mostly host TLB misses.
+; To compare RAM backings:
+;   perf stat -e dTLB-load-misses,dTLB-store-misses ../../computron --no-gui --no-vlog --bench \
+;       --memory-size 262144 --memory-backing hugepages --run tmp.bin
+
+    cli
+    mov al, 2
+    out 0x92, al
+
+    lgdt [gdtr]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp dword 0x08:(0x10000 + flat)
+
+[bits 32]
+flat:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    mov ecx, 8000000
+    mov ebx, 12345
+next:
+    imul ebx, ebx, 1103515245
+    add ebx, 12345
+    mov eax, ebx
+    and eax, 0x0ffffffc
+    or eax, 0x00100000
+    add [eax], ecx
+    dec ecx
+    jnz next
+
+db 0xf1
+
+align 8
+gdt:
+    dq 0
+    dq 0x00cf9a000000ffff
+    dq 0x00cf92000000ffff
+gdtr:
+    dw gdtr - gdt - 1
+    dd 0x10000 + gdt
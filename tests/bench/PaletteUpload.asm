@@ -0,0 +1,27 @@
+[bits 16]
+
+; Uploads a full 256-color DAC palette with REP OUTSB, over and over.
+
+    push cs
+    pop ds
+    cld
+    mov bx, 5000
+again:
+    mov dx, 0x3c8
+    xor al, al
+    out dx, al
+    inc dx
+    mov si, palette
+    mov cx, 768
+    rep outsb
+    dec bx
+    jnz again
+
+db 0xf1
+
+palette:
+%assign i 0
+%rep 768
+    db (i * 7) & 0x3f
+%assign i i + 1
+%endrep
@@ -0,0 +1,26 @@
+[bits 16]
+
+; Clears the A0000 window with REP STOSW through the planar write path
+; (all four planes enabled, write mode 0 with set/reset), over and over.
+
+    mov ax, 0xa000
+    mov es, ax
+    cld
+    mov dx, 0x3c4
+    mov ax, 0x0f02
+    out dx, ax
+    mov dx, 0x3ce
+    mov ax, 0x0500
+    out dx, ax
+    mov ax, 0x0f01
+    out dx, ax
+    mov bx, 2000
+again:
+    xor di, di
+    mov cx, 19200
+    xor ax, ax
+    rep stosw
+    dec bx
+    jnz again
+
+db 0xf1
@@ -0,0 +1,27 @@
+[bits 16]
+
+; Tight port I/O loop: VGA CRTC index/data pokes, VGA status polling,
+; PIT counter latches and PIC mask reads.
+
+    mov bx, 20
+outer:
+    mov cx, 0xffff
+inner:
+    mov dx, 0x3d4
+    mov al, 0x0e
+    out dx, al
+    inc dx
+    in al, dx
+    mov dx, 0x3da
+    in al, dx
+    xor al, al
+    out 0x43, al
+    in al, 0x40
+    in al, 0x40
+    in al, 0x21
+    dec cx
+    jnz inner
+    dec bx
+    jnz outer
+
+db 0xf1
@@ -0,0 +1,35 @@
+; bench-args: --parallel file:/dev/null
+[bits 16]
+
+; Drives LPT1 the way a polling printer driver does: put the byte on the data
+; lines, wait for the printer to go not-busy, then pulse strobe.
+
+    cli
+    mov bx, 0x378
+    mov cx, 200000 / 50
+page:
+    mov si, line
+line_loop:
+    mov dx, bx
+    mov al, [cs:si]
+    out dx, al
+    inc dx
+busy:
+    in al, dx
+    test al, 0x80
+    jz busy
+    inc dx
+    mov al, 0x0d
+    out dx, al
+    mov al, 0x0c
+    out dx, al
+    inc si
+    cmp si, line_end
+    jne line_loop
+    loop page
+
+db 0xf1
+
+line:
+    db "The quick brown fox jumps over the lazy dog 0123", 13, 10
+line_end:
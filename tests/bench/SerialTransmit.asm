@@ -0,0 +1,82 @@
+; bench-args: --serial file:/dev/null
+[bits 16]
+
+; Streams COM1 output at 115200 baud: each transmitter-empty interrupt refills
+; the FIFO with one 16-byte REP OUTSB burst, and the CPU halts in between.
+
+    cli
+    xor ax, ax
+    mov es, ax
+    mov word [es:0x0c * 4], thre_handler
+    mov word [es:0x0c * 4 + 2], cs
+
+    ; Master PIC: vectors 08h-0Fh, everything but IRQ4 masked.
+    mov al, 0x11
+    out 0x20, al
+    mov al, 0x08
+    out 0x21, al
+    mov al, 0x04
+    out 0x21, al
+    mov al, 0x01
+    out 0x21, al
+    mov al, 0xef
+    out 0x21, al
+
+    mov dx, 0x3fb
+    mov al, 0x80
+    out dx, al
+    mov dx, 0x3f8
+    mov al, 1
+    out dx, al
+    inc dx
+    xor al, al
+    out dx, al
+    mov dx, 0x3fb
+    mov al, 0x03        ; 8N1
+    out dx, al
+    mov dx, 0x3fa
+    mov al, 0x07        ; FIFOs enabled and cleared
+    out dx, al
+    mov dx, 0x3fc
+    mov al, 0x0b        ; DTR, RTS, OUT2
+    out dx, al
+    mov dx, 0x3f9
+    mov al, 0x02        ; THRE interrupt, raised right away
+    out dx, al
+
+    cld
+    sti
+wait:
+    hlt
+    cmp word [remaining], 0
+    jnz wait
+
+db 0xf1
+
+thre_handler:
+    push ax
+    push cx
+    push dx
+    push si
+    mov dx, 0x3fa
+    in al, dx
+    cmp word [remaining], 0
+    jz .done
+    mov dx, 0x3f8
+    mov si, payload
+    mov cx, 16
+    rep outsb
+    dec word [remaining]
+.done:
+    mov al, 0x20
+    out 0x20, al
+    pop si
+    pop dx
+    pop cx
+    pop ax
+    iret
+
+remaining:
+    dw 2000
+payload:
+    db "0123456789abcde", 10
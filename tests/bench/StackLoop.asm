@@ -0,0 +1,22 @@
+[bits 16]
+
+; Save/restore sequences as found in function prologues and epilogues.
+
+    mov dx, 100
+outer:
+    mov cx, 0xffff
+inner:
+    push ax
+    push bx
+    push si
+    push di
+    pop di
+    pop si
+    pop bx
+    pop ax
+    dec cx
+    jnz inner
+    dec dx
+    jnz outer
+
+db 0xf1
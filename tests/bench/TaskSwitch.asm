@@ -0,0 +1,63 @@
+[bits 16]
+
+; Round trips between two tasks: CALL through a TSS selector, then IRET back via the back link.
+
+tssA equ 0x20000
+tssB equ 0x20100
+
+    cli
+    mov al, 2
+    out 0x92, al
+
+    lgdt [gdtr]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp dword 0x08:(0x10000 + flat)
+
+[bits 32]
+flat:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    mov esp, 0x40000
+
+    xor eax, eax
+    mov edi, tssA
+    mov ecx, 0x200 / 4
+    rep stosd
+
+    mov dword [tssB + 0x20], 0x10000 + taskB   ; EIP
+    mov dword [tssB + 0x24], 0x00000002         ; EFLAGS
+    mov dword [tssB + 0x38], 0x30000            ; ESP
+    mov word [tssB + 0x48], 0x10                ; ES
+    mov word [tssB + 0x4c], 0x08                ; CS
+    mov word [tssB + 0x50], 0x10                ; SS
+    mov word [tssB + 0x54], 0x10                ; DS
+
+    mov ax, 0x18
+    ltr ax
+
+    mov ecx, 500000
+next:
+    call 0x20:0
+    dec ecx
+    jnz next
+
+db 0xf1
+
+taskB:
+    iret
+    jmp taskB
+
+align 8
+gdt:
+    dq 0
+    dq 0x00cf9a000000ffff
+    dq 0x00cf92000000ffff
+    dq 0x000089020000006f   ; TSS A at 0x20000
+    dq 0x000089020100006f   ; TSS B at 0x20100
+gdtr:
+    dw gdtr - gdt - 1
+    dd 0x10000 + gdt
@@ -0,0 +1,25 @@
+#!/bin/bash
+
+if [ "$1" = "" ] ; then
+	echo "usage: $0 <benchfile>"
+	exit 1
+fi
+
+# A bench can ask for extra options on its first line, e.g. "; bench-args: --memory-size 262144"
+BENCH=$1
+ARGS=$(head -1 $BENCH | sed -n 's/^; bench-args: *//p')
+PROGRAM="../../computron --no-gui --no-vlog --bench $ARGS"
+COMPILED=tmp.bin
+
+nasm -f bin -o $COMPILED $BENCH || \
+	{ rm -f $COMPILED
+	  exit 1
+	}
+
+echo $BENCH
+echo -n "    fused:   "
+$PROGRAM --run $COMPILED
+echo -n "    unfused: "
+$PROGRAM --no-fusion --run $COMPILED
+
+rm -f $COMPILED
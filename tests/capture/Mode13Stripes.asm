@@ -0,0 +1,45 @@
+; capture-at: 200000
+[bits 16]
+
+; Sets up chain-4 320x200x256 by hand (no BIOS in auto-test mode), draws one
+; horizontal stripe per DAC color, then idles while the frame is captured.
+
+    xor ax, ax
+    mov ds, ax
+    mov byte [0x449], 0x13
+
+    mov dx, 0x3c4
+    mov ax, 0x0e04          ; Sequencer memory mode: chain-4
+    out dx, ax
+    mov ax, 0x0f02          ; All planes
+    out dx, ax
+
+    mov dx, 0x3ce
+    mov ax, 0x0506          ; A0000-AFFFF, graphics mode
+    out dx, ax
+
+    mov dx, 0x3d4
+    mov ax, 0x2813          ; Offset: 40 doublewords per line
+    out dx, ax
+    mov ax, 0x4014          ; Doubleword addressing
+    out dx, ax
+
+    mov ax, 0xa000
+    mov es, ax
+    xor di, di
+    cld
+    xor bx, bx
+line:
+    mov al, bl
+    shr al, 2
+    mov cx, 320
+    rep stosb
+    inc bx
+    cmp bx, 200
+    jne line
+
+    mov ecx, 1000000
+idle:
+    loop idle, ecx
+
+db 0xf1
@@ -0,0 +1,50 @@
+#!/bin/bash
+
+UPDATE=
+if [ "$1" = "--update" ] ; then
+	UPDATE=1
+	shift
+fi
+
+if [ "$1" = "" ] ; then
+	echo "usage: $0 [--update] <testfile>"
+	exit 1
+fi
+
+# Each test names the instruction counts to capture at on its first line, e.g. "; capture-at: 500000"
+TEST=$1
+CYCLES=$(head -1 $TEST | sed -n 's/^; capture-at: *//p')
+REFERENCE=$(echo $TEST | sed s/.asm//).reference
+OUTPUT=`mktemp -d /tmp/capture.XXXXXX || exit 1`
+PROGRAM="../../computron --no-gui --no-vlog --capture-dir $OUTPUT --capture-at $CYCLES"
+COMPILED=tmp.bin
+STATUS=0
+
+nasm -f bin -o $COMPILED $TEST || \
+	{ rm -rf $COMPILED $OUTPUT
+	  exit 1
+	}
+
+if [ -n "$UPDATE" ]; then
+    $PROGRAM --run $COMPILED > /dev/null
+    rm -rf $REFERENCE
+    mkdir -p $REFERENCE
+    cp $OUTPUT/frame-* $REFERENCE/
+    echo -ne "\033[33;1mUPDATED\033[0m: "
+elif [ ! -d $REFERENCE ]; then
+    echo -ne "\033[31;1mFAIL\033[0m: no $REFERENCE (record it with --update): "
+    STATUS=1
+elif $PROGRAM --capture-reference $REFERENCE --run $COMPILED > $OUTPUT/log.txt; then
+    echo -ne "\033[32;1mPASS\033[0m: "
+else
+    echo -ne "\033[31;1mFAIL\033[0m: "
+    grep FAIL $OUTPUT/log.txt
+    echo "    frames kept in $OUTPUT"
+    OUTPUT=
+    STATUS=1
+fi
+echo $TEST
+
+rm -f $COMPILED
+[ -n "$OUTPUT" ] && rm -rf $OUTPUT
+exit $STATUS
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Writes through an overlay with 4 KiB clusters, covering both a partial and a whole
+# cluster, then reads the disk back through a fresh open of the overlay.
+PROGRAM=../../computron
+WORK=`mktemp -d /tmp/overlay.XXXXXX || exit 1`
+STATUS=0
+
+fail()
+{
+    echo -e "\033[31;1mFAIL\033[0m: $1"
+    STATUS=1
+}
+
+yes "base image contents" | head -c 65536 > $WORK/base.img
+cp $WORK/base.img $WORK/base.orig
+yes "written through the overlay" | head -c 6000 > $WORK/data
+
+cp $WORK/base.img $WORK/expected.img
+dd if=$WORK/data of=$WORK/expected.img bs=1 seek=3000 conv=notrunc status=none
+
+$PROGRAM --overlay-create $WORK/overlay.img $WORK/base.img 4 || fail "--overlay-create"
+$PROGRAM --overlay-write $WORK/overlay.img 3000 $WORK/data || fail "--overlay-write"
+$PROGRAM --overlay-read $WORK/overlay.img 0 65536 > $WORK/readback.img || fail "--overlay-read"
+
+cmp -s $WORK/expected.img $WORK/readback.img || fail "overlay contents differ from what was written"
+cmp -s $WORK/base.orig $WORK/base.img || fail "base image was modified"
+
+[ $STATUS -eq 0 ] && echo -e "\033[32;1mPASS\033[0m: overlay round trip"
+rm -rf $WORK
+exit $STATUS
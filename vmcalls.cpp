@@ -27,6 +27,8 @@
 #include "debug.h"
 #include "machine.h"
 #include "DiskDrive.h"
+#include "keyboard.h"
+#include "ParallelPort.h"
 #include <stdio.h>
 #include <time.h>
 #include <sys/time.h>
@@ -88,9 +90,6 @@ static DiskDrive* diskDriveForBIOSIndex(Machine& machine, BYTE index)
 
 void vm_handleE6(CPU& cpu)
 {
-    extern WORD kbd_hit();
-    extern WORD kbd_getc();
-
     struct    tm *t;
     time_t    curtime;
     struct    timeval timv;
@@ -99,8 +98,8 @@ void vm_handleE6(CPU& cpu)
 
     switch (cpu.getAX()) {
     case 0x1601:
-        if (kbd_hit()) {
-            cpu.setAX(kbd_hit());
+        if (WORD key = cpu.machine().keyboard().peekKey()) {
+            cpu.setAX(key);
             cpu.setZF(0);
         } else {
             cpu.setAX(0);
@@ -203,18 +202,22 @@ void vm_handleE6(CPU& cpu)
         break;
 
     case 0x1600:
-        cpu.setAX(kbd_getc());
+        cpu.setAX(cpu.machine().keyboard().nextKey());
         break;
 
     case 0x1700:
         // Interrupt 17, 00: Print character on LPT
-        {
-            char tmp[80];
-            sprintf(tmp, "prn%d.txt", cpu.getDX());
-            FILE* fpdrv = fopen(tmp, "a");
-            fputc(cpu.getCL(), fpdrv);
-            fclose(fpdrv);
-        }
+        cpu.setAH(cpu.getDX() == 0 ? cpu.machine().parallelPort().printCharacter(cpu.getCL()) : 0x01);
+        break;
+
+    case 0x1701:
+        // Interrupt 17, 01: Initialize printer port
+        cpu.setAH(cpu.getDX() == 0 ? cpu.machine().parallelPort().initializePrinter() : 0x01);
+        break;
+
+    case 0x1702:
+        // Interrupt 17, 02: Get printer status
+        cpu.setAH(cpu.getDX() == 0 ? cpu.machine().parallelPort().biosStatus() : 0x01);
         break;
 
     case 0x1A01:
@@ -247,6 +250,51 @@ void vm_handleE6(CPU& cpu)
         }
         break;
 
+    /* 0x3334: Checkpoint guest RAM
+     * 0x3335: Restore guest RAM to the last checkpoint
+     *
+     * Only RAM is covered; registers and devices are left alone.
+     *
+     * Returns:
+     * AL = 0x01 on success
+     *    = 0x00 if guest RAM can't be checkpointed
+     *
+     * CF = !AL
+     */
+    case 0x3334:
+    case 0x3335: {
+        auto& memory = cpu.guestMemory();
+        bool success = memory.canCheckpoint();
+        if (success && cpu.getAX() == 0x3334)
+            success = memory.checkpoint();
+        else if (success)
+            memory.restoreCheckpoint();
+        cpu.setAL(success);
+        cpu.setCF(!success);
+        break;
+    }
+
+    /* 0x3336: Fork guest RAM from the last checkpoint
+     * 0x3337: Join the fork, discarding it
+     *
+     * Between the two, the guest runs on a copy-on-write fork of its last RAM
+     * checkpoint. Joining brings RAM back exactly as it was when forking.
+     * Forks don't nest.
+     *
+     * Returns:
+     * AL = 0x01 on success
+     *    = 0x00 if guest RAM can't be forked, or there is no fork to join
+     *
+     * CF = !AL
+     */
+    case 0x3336:
+    case 0x3337: {
+        bool success = cpu.getAX() == 0x3336 ? cpu.forkGuestMemory() : cpu.joinGuestMemoryFork();
+        cpu.setAL(success);
+        cpu.setCF(!success);
+        break;
+    }
+
     default:
         vlog(LogAlert, "Unknown VM call %04X received!!", cpu.getAX());
         //hard_exit(0);
@@ -255,7 +303,7 @@ void vm_handleE6(CPU& cpu)
 }
 
 
-static void bios_disk_read(CPU& cpu, FILE* fp, DiskDrive& drive, WORD cylinder, WORD head, WORD sector, WORD count, WORD segment, WORD offset)
+static bool bios_disk_read(CPU& cpu, DiskDrive& drive, WORD cylinder, WORD head, WORD sector, WORD count, WORD segment, WORD offset)
 {
     auto lba = drive.toLBA(cylinder, head, sector);
 
@@ -263,24 +311,26 @@ static void bios_disk_read(CPU& cpu, FILE* fp, DiskDrive& drive, WORD cylinder,
         vlog(LogDisk, "%s reading %u sectors at %u/%u/%u (LBA %u) to %04x:%04x", qPrintable(drive.name()), count, cylinder, head, sector, lba, segment, offset);
 
     QByteArray data(drive.bytesPerSector() * count, Qt::Uninitialized);
-    fread(data.data(), drive.bytesPerSector(), count, fp);
+    if (!drive.readSectors(lba, count, reinterpret_cast<BYTE*>(data.data())))
+        return false;
     LinearAddress dest((segment << 4) + offset);
     for (int i = 0; i < data.size(); ++i)
         cpu.writeMemory<BYTE>(dest.offset(i), data[i]);
+    return true;
 }
 
-static void bios_disk_write(CPU& cpu, FILE* fp, DiskDrive& drive, WORD cylinder, WORD head, WORD sector, WORD count, WORD segment, WORD offset)
+static bool bios_disk_write(CPU& cpu, DiskDrive& drive, WORD cylinder, WORD head, WORD sector, WORD count, WORD segment, WORD offset)
 {
     auto lba = drive.toLBA(cylinder, head, sector);
 
     if (options.disklog)
         vlog(LogDisk, "%s writing %u sectors at %u/%u/%u (LBA %u) from %04x:%04x", qPrintable(drive.name()), count, cylinder, head, sector, lba, segment, offset);
 
-    const void* source = cpu.memoryPointer(LogicalAddress(segment, offset));
-    fwrite(source, drive.bytesPerSector(), count, fp);
+    const BYTE* source = cpu.memoryPointer(LogicalAddress(segment, offset));
+    return drive.writeSectors(lba, count, source);
 }
 
-static void bios_disk_verify(CPU&, FILE* fp, DiskDrive& drive, WORD cylinder, WORD head, WORD sector, WORD count, WORD segment, WORD offset)
+static bool bios_disk_verify(CPU&, DiskDrive& drive, WORD cylinder, WORD head, WORD sector, WORD count, WORD segment, WORD offset)
 {
     auto lba = drive.toLBA(cylinder, head, sector);
 
@@ -288,13 +338,15 @@ static void bios_disk_verify(CPU&, FILE* fp, DiskDrive& drive, WORD cylinder, WO
         vlog(LogDisk, "%s verifying %u sectors at %u/%u/%u (LBA %u)", qPrintable(drive.name()), count, cylinder, head, sector, lba);
 
     BYTE dummy[count * drive.bytesPerSector()];
-    WORD veri = fread(dummy, drive.bytesPerSector(), count, fp);
-    if (veri != count)
+    if (!drive.readSectors(lba, count, dummy)) {
         vlog(LogAlert, "veri != count, something went wrong");
+        return false;
+    }
 
     // FIXME: Actually compare something..
     Q_UNUSED(segment);
     Q_UNUSED(offset);
+    return true;
 }
 
 void bios_disk_call(CPU& cpu, DiskCallFunction function)
@@ -307,8 +359,8 @@ void bios_disk_call(CPU& cpu, DiskCallFunction function)
     BYTE driveIndex = cpu.getDL();
     BYTE head = cpu.getDH();
     WORD sectorCount = cpu.getAL();
-    FILE* fp;
     DWORD lba;
+    bool success = false;
 
     auto* drive = diskDriveForBIOSIndex(cpu.machine(), driveIndex);
     BYTE error = FD_NO_ERROR;
@@ -338,28 +390,24 @@ void bios_disk_call(CPU& cpu, DiskCallFunction function)
         goto epilogue;
     }
 
-    fp = fopen(qPrintable(drive->imagePath()), function == WriteSectors ? "rb+" : "rb");
-    if (!fp) {
-        vlog(LogDisk, "PANIC: Could not access drive %d image (%s)!", driveIndex, qPrintable(drive->imagePath()));
-        hard_exit(1);
-    }
-
-    fseek(fp, lba * drive->bytesPerSector(), SEEK_SET);
-
     switch (function) {
     case ReadSectors:
-        bios_disk_read(cpu, fp, *drive, cylinder, head, sector, sectorCount, cpu.getES(), cpu.getBX());
+        success = bios_disk_read(cpu, *drive, cylinder, head, sector, sectorCount, cpu.getES(), cpu.getBX());
         break;
     case WriteSectors:
-        bios_disk_write(cpu, fp, *drive, cylinder, head, sector, sectorCount, cpu.getES(), cpu.getBX());
+        success = bios_disk_write(cpu, *drive, cylinder, head, sector, sectorCount, cpu.getES(), cpu.getBX());
         break;
     case VerifySectors:
-        bios_disk_verify(cpu, fp, *drive, cylinder, head, sector, sectorCount, cpu.getES(), cpu.getBX());
+        success = bios_disk_verify(cpu, *drive, cylinder, head, sector, sectorCount, cpu.getES(), cpu.getBX());
         break;
     }
 
+    if (!success) {
+        vlog(LogDisk, "PANIC: Could not access drive %d image (%s)!", driveIndex, qPrintable(drive->imagePath()));
+        hard_exit(1);
+    }
+
     error = FD_NO_ERROR;
-    fclose(fp);
 
 epilogue:
     if (error == FD_NO_ERROR) {
@@ -29,6 +29,11 @@
 #include "debugger.h"
 #include "pic.h"
 #include "settings.h"
+#include "BlockCache.h"
+#include "InputQueue.h"
+#include "TimerService.h"
+#include "SerialPort.h"
+#include "ParallelPort.h"
 #include <unistd.h>
 #include "pit.h"
 #include "Tasking.h"
@@ -37,8 +42,6 @@
 #define CRASH_ON_OPCODE_00_00
 //#define CRASH_ON_EXECUTE_00000000
 #define CRASH_ON_PE_JMP_00000000
-#define CRASH_ON_VME
-#define CRASH_ON_PVI
 #define A20_ENABLED
 #define DEBUG_PHYSICAL_OOB
 //#define DEBUG_ON_UD0
@@ -118,7 +121,7 @@ template void CPU::writeRegister<DWORD>(int, DWORD);
 FLATTEN void CPU::decodeNext()
 {
 #ifdef CT_TRACE
-    if (UNLIKELY(m_isForAutotest))
+    if (UNLIKELY(m_isForAutotest) && !options.benchmark)
         dumpTrace();
 #endif
 
@@ -130,20 +133,131 @@ FLATTEN void CPU::decodeNext()
     }
 #endif
 
-#ifdef CRASH_ON_VME
-    if (UNLIKELY(getVME()))
-        ASSERT_NOT_REACHED();
+    auto insn = Instruction::fromStream(*this, m_operandSize32, m_addressSize32);
+    if (!insn.isValid())
+        throw InvalidOpcode("Undecodable instruction");
+    execute(insn);
+
+    if (insn.fusionKind() != FusionKind::None && canFuseSuccessor())
+        executeFusedSuccessor(insn.fusionKind());
+}
+
+// Fusion skips the main loop between two instructions, so only do it when the main loop
+// would have had nothing to do there anyway.
+ALWAYS_INLINE bool CPU::canFuseSuccessor() const
+{
+#ifdef CT_DETERMINISTIC
+    return false;
+#endif
+#ifdef CT_TRACE
+    if (UNLIKELY(m_isForAutotest) && !options.benchmark)
+        return false;
 #endif
+    if (UNLIKELY(m_mainLoopNeedsSlowStuff || m_nextInstructionIsUninterruptible || getTF()))
+        return false;
+    if (PIC::hasPendingIRQ() && getIF())
+        return false;
+    return options.fusion;
+}
+
+// Decide a fused Jcc from what the head instruction left in the lazy flag state, without
+// producing any flags. CMP leaves both operands, TEST leaves its result with CF and OF clear.
+ALWAYS_INLINE bool CPU::evaluateFused(BYTE conditionCode) const
+{
+    const DWORD arithmeticFlags = Flag::CF | Flag::AF | Flag::OF | Flag::PF | Flag::ZF | Flag::SF;
+    const DWORD signBit = 1u << (m_lastOpSize - 1);
+
+    if ((m_dirtyFlags & arithmeticFlags) == arithmeticFlags && m_lastOperation == LazyFlagOperation::Sub) {
+        DWORD dest = m_lastOperand1;
+        DWORD src = m_lastOperand2;
+        switch (conditionCode) {
+        case  2: return dest < src;                                      // B
+        case  3: return dest >= src;                                     // AE
+        case  4: return dest == src;                                     // E
+        case  5: return dest != src;                                     // NE
+        case  6: return dest <= src;                                     // BE
+        case  7: return dest > src;                                      // A
+        case 12: return (dest ^ signBit) < (src ^ signBit);              // L
+        case 13: return (dest ^ signBit) >= (src ^ signBit);             // GE
+        case 14: return (dest ^ signBit) <= (src ^ signBit);             // LE
+        case 15: return (dest ^ signBit) > (src ^ signBit);              // G
+        }
+        return evaluate(conditionCode);
+    }
+
+    if ((m_dirtyFlags & (Flag::ZF | Flag::SF)) == (Flag::ZF | Flag::SF) && !(m_dirtyFlags & (Flag::CF | Flag::OF)) && !CF && !OF) {
+        bool zero = !m_lastResult;
+        bool negative = m_lastResult & signBit;
+        switch (conditionCode) {
+        case  2: return false;                                           // B
+        case  3: return true;                                            // AE
+        case  4: case  6: return zero;                                   // E, BE
+        case  5: case  7: return !zero;                                  // NE, A
+        case  8: case 12: return negative;                               // S, L
+        case  9: case 13: return !negative;                              // NS, GE
+        case 14: return negative || zero;                                // LE
+        case 15: return !negative && !zero;                              // G
+        }
+        return evaluate(conditionCode);
+    }
+
+    return evaluate(conditionCode);
+}
+
+void CPU::executeFusedSuccessor(FusionKind kind)
+{
+    clearPrefix();
+    saveBaseAddress();
+
+    // NOTE: Only unprefixed successors are fused. Anything else is left for the main loop.
+    BYTE op = readInstruction8();
 
-#ifdef CRASH_ON_PVI
-    if (UNLIKELY(getPVI()))
+    switch (kind) {
+    case FusionKind::CompareAndBranch:
+        if (op >= 0x70 && op <= 0x7F) {
+            SIGNED_BYTE displacement = readInstruction8();
+            if (evaluateFused(op & 0xF))
+                jumpRelative8(displacement);
+            ++m_cycle;
+            return;
+        }
+        if (op == 0x0F) {
+            BYTE subOp = readInstruction8();
+            if (subOp >= 0x80 && subOp <= 0x8F) {
+                DWORD displacement = a32() ? readInstruction32() : readInstruction16();
+                if (evaluateFused(subOp & 0xF))
+                    jumpRelative32(displacement);
+                ++m_cycle;
+                return;
+            }
+        }
+        break;
+    case FusionKind::StackRun:
+        while (op >= 0x50 && op <= 0x5F) {
+            if (op < 0x58) {
+                if (o32())
+                    push32(mutableReg32(static_cast<RegisterIndex32>(op & 7)));
+                else
+                    push16(mutableReg16(static_cast<RegisterIndex16>(op & 7)));
+            } else {
+                if (o32())
+                    mutableReg32(static_cast<RegisterIndex32>(op & 7)) = pop32();
+                else
+                    mutableReg16(static_cast<RegisterIndex16>(op & 7)) = pop16();
+            }
+            ++m_cycle;
+            if (!canFuseSuccessor())
+                return;
+            saveBaseAddress();
+            op = readInstruction8();
+        }
+        break;
+    case FusionKind::None:
         ASSERT_NOT_REACHED();
-#endif
+        break;
+    }
 
-    auto insn = Instruction::fromStream(*this, m_operandSize32, m_addressSize32);
-    if (!insn.isValid())
-        throw InvalidOpcode();
-    execute(insn);
+    setEIP(currentBaseInstructionPointer());
 }
 
 FLATTEN void CPU::execute(Instruction& insn)
@@ -185,6 +299,9 @@ void CPU::_INVLPG(Instruction&)
     if (getPE() && getCPL() != 0) {
         throw GeneralProtectionFault(0, "INVLPG");
     }
+    invalidateIOPermissionMap();
+    invalidateInterruptGateCache();
+    invalidateTSSDescriptorCache();
 }
 
 void CPU::_VKILL(Instruction&)
@@ -195,21 +312,72 @@ void CPU::_VKILL(Instruction&)
     }
     vlog(LogCPU, "0xF1: Secret shutdown command received!");
     //dumpAll();
+    if (options.benchmark) {
+        printf("%llu instructions in %lld ms\n", (unsigned long long)m_cycle, (long long)m_benchmarkTimer.elapsed());
+        printf("guest RAM: %s\n", qPrintable(m_guestMemory->backingReport()));
+        machine().blockCache().dumpStatistics();
+        machine().timerService().dumpStatistics();
+        machine().serialPort(0).dumpStatistics();
+        machine().parallelPort().dumpStatistics();
+        dumpVM86Statistics();
+    }
     hard_exit(0);
 }
 
-void CPU::setMemorySizeAndReallocateIfNeeded(DWORD size)
+void CPU::setMemorySizeAndReallocateIfNeeded(DWORD size, const GuestMemory::Configuration& configuration)
 {
-    if (m_memorySize == size)
+    if (m_memorySize == size && m_guestMemory->configuration() == configuration)
         return;
-    delete [] m_memory;
-    m_memorySize = size;
-    m_memory = new BYTE[m_memorySize];
-    if (!m_memory) {
+    auto memory = GuestMemory::create(size, configuration);
+    if (!memory) {
         vlog(LogInit, "Insufficient memory available.");
         hard_exit(1);
     }
-    memset(m_memory, 0x0, m_memorySize);
+    adoptGuestMemory(std::move(memory));
+}
+
+void CPU::adoptGuestMemory(OwnPtr<GuestMemory>&& memory)
+{
+    if (m_guestMemory)
+        disarmGuestMemoryLogs();
+    m_guestMemory = std::move(memory);
+    m_memory = m_guestMemory->data();
+    m_memorySize = m_guestMemory->size();
+    m_ioPermissionMapLog = armDirtyLog();
+    m_interruptGateLog = armDirtyLog();
+    m_tssDescriptorLog = armDirtyLog();
+    invalidateIOPermissionMap();
+    invalidateInterruptGateCache();
+    invalidateTSSDescriptorCache();
+}
+
+// The logs are re-armed on whichever GuestMemory is adopted next.
+void CPU::disarmGuestMemoryLogs()
+{
+    disarmDirtyLog(m_ioPermissionMapLog);
+    disarmDirtyLog(m_interruptGateLog);
+    disarmDirtyLog(m_tssDescriptorLog);
+}
+
+bool CPU::forkGuestMemory()
+{
+    if (m_parentGuestMemory || !m_guestMemory->canCheckpoint())
+        return false;
+    auto fork = m_guestMemory->fork();
+    if (!fork)
+        return false;
+    disarmGuestMemoryLogs();
+    m_parentGuestMemory = std::move(m_guestMemory);
+    adoptGuestMemory(std::move(fork));
+    return true;
+}
+
+bool CPU::joinGuestMemoryFork()
+{
+    if (!m_parentGuestMemory)
+        return false;
+    adoptGuestMemory(std::move(m_parentGuestMemory));
+    return true;
 }
 
 CPU::CPU(Machine& m)
@@ -324,6 +492,9 @@ void CPU::reset()
     this->TR.limit = 0xffff;
     this->TR.base = LinearAddress();
     this->TR.is32Bit = false;
+    invalidateIOPermissionMap();
+    invalidateInterruptGateCache();
+    invalidateTSSDescriptorCache();
 
     memset(m_descriptor, 0, sizeof(m_descriptor));
 
@@ -357,6 +528,8 @@ void CPU::reset()
     m_lastOpSize = ByteSize;
 
     m_cycle = 0;
+    m_nextVSyncCheckCycle = 0;
+    m_nextTimerCycle = std::numeric_limits<QWORD>::max();
 
     initWatches();
 
@@ -365,8 +538,6 @@ void CPU::reset()
 
 CPU::~CPU()
 {
-    delete [] m_memory;
-    m_memory = nullptr;
 }
 
 class InstructionExecutionContext {
@@ -388,7 +559,7 @@ FLATTEN void CPU::executeOneInstruction()
         }
 #endif
         decodeNext();
-    } catch(Exception e) {
+    } catch (const Exception& e) {
         if (options.log_exceptions)
             dumpDisassembled(cachedDescriptor(SegmentRegisterIndex::CS), m_baseEIP, 3);
         raiseException(e);
@@ -411,9 +582,23 @@ void CPU::haltedLoop()
             saveBaseAddress();
             debugger().doConsole();
         }
+        machine().timerService().idle();
         if (PIC::hasPendingIRQ() && getIF())
             PIC::serviceIRQ(*this);
+        vsyncCheck();
+    }
+}
+
+void CPU::vsyncCheck()
+{
+    if (UNLIKELY(m_cycle >= m_nextFrameCaptureCycle)) {
+        m_nextFrameCaptureCycle = std::numeric_limits<QWORD>::max();
+        machine().captureFrame();
     }
+    machine().timerService().service();
+    if (machine().inputQueue().hasPendingEvents())
+        machine().inputQueue().deliver();
+    m_nextVSyncCheckCycle = std::min({ m_cycle + vsyncCheckInterval, m_nextFrameCaptureCycle, m_nextTimerCycle });
 }
 
 void CPU::queueCommand(Command command)
@@ -496,6 +681,9 @@ NEVER_INLINE bool CPU::mainLoopSlowStuff()
 
 FLATTEN void CPU::mainLoop()
 {
+    if (options.benchmark)
+        m_benchmarkTimer.start();
+
     forever {
         if (UNLIKELY(m_mainLoopNeedsSlowStuff)) {
             mainLoopSlowStuff();
@@ -523,6 +711,9 @@ FLATTEN void CPU::mainLoop()
         if (PIC::hasPendingIRQ() && getIF())
             PIC::serviceIRQ(*this);
 
+        if (UNLIKELY(m_cycle >= m_nextVSyncCheckCycle))
+            vsyncCheck();
+
 #ifdef CT_DETERMINISTIC
         if (getIF() && ((cycle() + 1) % 100 == 0)) {
             machine().pit().raiseIRQ();
@@ -639,14 +830,14 @@ void CPU::protectedModeFarJump(LogicalAddress address, JumpType type, Gate* gate
     auto descriptor = getDescriptor(selector);
 
     if (descriptor.isNull()) {
-        throw GeneralProtectionFault(0, QString("%1 to null selector").arg(toString(type)));
+        throw GeneralProtectionFault(0, "%s to null selector", toString(type));
     }
 
     if (descriptor.isOutsideTableLimits())
-        throw GeneralProtectionFault(selector & 0xfffc, QString("%1 to selector outside table limit").arg(toString(type)));
+        throw GeneralProtectionFault(selector & 0xfffc, "%s to selector outside table limit", toString(type));
 
     if (!descriptor.isCode() && !descriptor.isCallGate() && !descriptor.isTaskGate() && !descriptor.isTSS())
-        throw GeneralProtectionFault(selector & 0xfffc, QString("%1 to invalid descriptor type").arg(toString(type)));
+        throw GeneralProtectionFault(selector & 0xfffc, "%s to invalid descriptor type", toString(type));
 
     if (descriptor.isGate() && gate) {
         dumpDescriptor(*gate);
@@ -670,13 +861,13 @@ void CPU::protectedModeFarJump(LogicalAddress address, JumpType type, Gate* gate
         }
 
         if (gate.DPL() < getCPL())
-            throw GeneralProtectionFault(selector & 0xfffc, QString("%1 to gate with DPL(%2) < CPL(%3)").arg(toString(type)).arg(gate.DPL()).arg(getCPL()));
+            throw GeneralProtectionFault(selector & 0xfffc, "%s to gate with DPL(%u) < CPL(%u)", toString(type), gate.DPL(), getCPL());
 
         if (selectorRPL > gate.DPL())
-            throw GeneralProtectionFault(selector & 0xfffc, QString("%1 to gate with RPL(%2) > DPL(%3)").arg(toString(type)).arg(selectorRPL).arg(gate.DPL()));
+            throw GeneralProtectionFault(selector & 0xfffc, "%s to gate with RPL(%u) > DPL(%u)", toString(type), selectorRPL, gate.DPL());
 
         if (!gate.present()) {
-            throw NotPresent(selector & 0xfffc, QString("Gate not present"));
+            throw NotPresent(selector & 0xfffc, "Gate not present");
         }
 
         // NOTE: We recurse here, jumping to the gate entry point.
@@ -692,9 +883,9 @@ void CPU::protectedModeFarJump(LogicalAddress address, JumpType type, Gate* gate
         vlog(LogCPU, "%s to TSS descriptor (%s) -> %08x", toString(type), tssDescriptor.typeName(), tssDescriptor.base());
 #endif
         if (tssDescriptor.DPL() < getCPL())
-            throw GeneralProtectionFault(selector & 0xfffc, QString("%1 to TSS descriptor with DPL < CPL").arg(toString(type)));
+            throw GeneralProtectionFault(selector & 0xfffc, "%s to TSS descriptor with DPL < CPL", toString(type));
         if (tssDescriptor.DPL() < selectorRPL)
-            throw GeneralProtectionFault(selector & 0xfffc, QString("%1 to TSS descriptor with DPL < RPL").arg(toString(type)));
+            throw GeneralProtectionFault(selector & 0xfffc, "%s to TSS descriptor with DPL < RPL", toString(type));
         if (!tssDescriptor.present())
             throw NotPresent(selector & 0xfffc, "TSS not present");
         taskSwitch(selector, tssDescriptor, type);
@@ -707,14 +898,14 @@ void CPU::protectedModeFarJump(LogicalAddress address, JumpType type, Gate* gate
     if ((type == JumpType::CALL || type == JumpType::JMP) && !gate) {
         if (codeSegment.conforming()) {
             if (codeSegment.DPL() > getCPL()) {
-                throw GeneralProtectionFault(selector & 0xfffc, QString("%1 -> Code segment DPL(%2) > CPL(%3)").arg(toString(type)).arg(codeSegment.DPL()).arg(getCPL()));
+                throw GeneralProtectionFault(selector & 0xfffc, "%s -> Code segment DPL(%u) > CPL(%u)", toString(type), codeSegment.DPL(), getCPL());
             }
         } else {
             if (selectorRPL > codeSegment.DPL()) {
-                throw GeneralProtectionFault(selector & 0xfffc, QString("%1 -> Code segment RPL(%2) > CPL(%3)").arg(toString(type)).arg(selectorRPL).arg(codeSegment.DPL()));
+                throw GeneralProtectionFault(selector & 0xfffc, "%s -> Code segment RPL(%u) > CPL(%u)", toString(type), selectorRPL, codeSegment.DPL());
             }
             if (codeSegment.DPL() != getCPL()) {
-                throw GeneralProtectionFault(selector & 0xfffc, QString("%1 -> Code segment DPL(%2) != CPL(%3)").arg(toString(type)).arg(codeSegment.DPL()).arg(getCPL()));
+                throw GeneralProtectionFault(selector & 0xfffc, "%s -> Code segment DPL(%u) != CPL(%u)", toString(type), codeSegment.DPL(), getCPL());
             }
         }
     }
@@ -730,7 +921,7 @@ void CPU::protectedModeFarJump(LogicalAddress address, JumpType type, Gate* gate
     }
 
     if (!codeSegment.present()) {
-        throw NotPresent(selector & 0xfffc, QString("Code segment not present"));
+        throw NotPresent(selector & 0xfffc, "Code segment not present");
     }
 
     if (offset > codeSegment.effectiveLimit()) {
@@ -764,7 +955,7 @@ void CPU::protectedModeFarJump(LogicalAddress address, JumpType type, Gate* gate
         }
 
         if (newSSDescriptor.DPL() != descriptor.DPL()) {
-            throw InvalidTSS(newSS & 0xfffc, QString("New ss DPL(%1) != code segment DPL(%2)").arg(newSSDescriptor.DPL()).arg(descriptor.DPL()));
+            throw InvalidTSS(newSS & 0xfffc, "New ss DPL(%u) != code segment DPL(%u)", newSSDescriptor.DPL(), descriptor.DPL());
         }
 
         if (!newSSDescriptor.isData() || !newSSDescriptor.asDataSegmentDescriptor().writable()) {
@@ -857,7 +1048,7 @@ void CPU::protectedFarReturn(WORD stackAdjustment)
     }
 
     if (selectorRPL < getCPL())
-        throw GeneralProtectionFault(selector & 0xfffc, QString("RETF with RPL(%1) < CPL(%2)").arg(selectorRPL).arg(getCPL()));
+        throw GeneralProtectionFault(selector & 0xfffc, "RETF with RPL(%u) < CPL(%u)", selectorRPL, getCPL());
 
     auto& codeSegment = descriptor.asCodeSegmentDescriptor();
 
@@ -944,7 +1135,7 @@ void CPU::_NOP(Instruction&)
 void CPU::_HLT(Instruction&)
 {
     if (getCPL() != 0) {
-        throw GeneralProtectionFault(0, QString("HLT with CPL!=0(%1)").arg(getCPL()));
+        throw GeneralProtectionFault(0, "HLT with CPL!=0(%u)", getCPL());
     }
 
     setState(CPU::Halted);
@@ -1004,20 +1195,25 @@ template<typename T, class Accessor>
 void CPU::doDEC(Accessor accessor)
 {
     T value = accessor.get();
-    setOF(value == (T)std::numeric_limits<typename std::make_signed<T>::type>::min());
-    accessor.set(--value);
-    adjustFlag(value, value + 1, 1);
-    updateFlags<T>(value);
+    T result = value - 1;
+    accessor.set(result);
+
+    // DEC leaves CF alone, so resolve it before the lazy flag state is replaced.
+    bool cf = getCF();
+    cmpFlags<T>(result, value, 1);
+    setCF(cf);
 }
 
 template<typename T, class Accessor>
 void CPU::doINC(Accessor accessor)
 {
     T value = accessor.get();
-    setOF(value == (T)std::numeric_limits<typename std::make_signed<T>::type>::max());
-    accessor.set(++value);
-    adjustFlag(value, value - 1, 1);
-    updateFlags<T>(value);
+    T result = value + 1;
+    accessor.set(result);
+
+    bool cf = getCF();
+    mathFlags<T>(result, value, 1);
+    setCF(cf);
 }
 
 void CPU::_DEC_reg16(Instruction& insn)
@@ -1331,7 +1527,7 @@ ALWAYS_INLINE void CPU::validateAddress(const SegmentDescriptor& descriptor, DWO
 #if 0
     // FIXME: Is this appropriate somehow? Need to figure it out. The code below as-is breaks IRET.
     if (getCPL() > descriptor.DPL()) {
-        throw GeneralProtectionFault(0, QString("Insufficient privilege for access (CPL=%1, DPL=%2)").arg(getCPL()).arg(descriptor.DPL()));
+        throw GeneralProtectionFault(0, "Insufficient privilege for access (CPL=%u, DPL=%u)", getCPL(), descriptor.DPL());
     }
 #endif
 
@@ -1366,9 +1562,10 @@ template<typename T>
 ALWAYS_INLINE bool CPU::validatePhysicalAddress(PhysicalAddress physicalAddress, MemoryAccessType accessType)
 {
     UNUSED_PARAM(accessType);
-    if (physicalAddress.get() < m_memorySize)
+    if (LIKELY(physicalAddress.get() < m_memorySize))
         return true;
-    return false;
+    auto* provider = highMemoryProviderForAddress(physicalAddress);
+    return provider && (physicalAddress.get() + sizeof(T)) <= (provider->baseAddress().get() + provider->size());
 }
 
 template<typename T>
@@ -1405,9 +1602,15 @@ void CPU::writePhysicalMemory(PhysicalAddress physicalAddress, T data)
         return;
     }
     if (auto* provider = memoryProviderForAddress(physicalAddress)) {
+        if (auto* directWriteAccessPointer = provider->pointerForDirectWriteAccess()) {
+            *reinterpret_cast<T*>(&directWriteAccessPointer[physicalAddress.get() - provider->baseAddress().get()]) = data;
+            provider->didWriteDirectly(physicalAddress.get(), sizeof(T));
+            return;
+        }
         provider->write<T>(physicalAddress.get(), data);
     } else {
         *reinterpret_cast<T*>(&m_memory[physicalAddress.get()]) = data;
+        m_guestMemory->markDirty(physicalAddress.get(), sizeof(T));
     }
 }
 
@@ -1572,6 +1775,87 @@ void CPU::writeMemory8(SegmentRegisterIndex segment, DWORD offset, BYTE value) {
 void CPU::writeMemory16(SegmentRegisterIndex segment, DWORD offset, WORD value) { writeMemory(segment, offset, value); }
 void CPU::writeMemory32(SegmentRegisterIndex segment, DWORD offset, DWORD value) { writeMemory(segment, offset, value); }
 
+// Walks a supervisor access to linear memory one page at a time, translating every page up front
+// so that a fault can't leave a block transfer half done. Blocks are at most a page long (a TSS),
+// so they span at most two pages.
+template<typename Callback>
+void CPU::forEachPhysicalSpan(LinearAddress address, DWORD size, MemoryAccessType accessType, Callback callback)
+{
+    ASSERT(size <= GuestMemory::pageSize);
+    PhysicalAddress physicalAddresses[2];
+    DWORD lengths[2];
+    unsigned spanCount = 0;
+    for (DWORD offset = 0; offset < size; offset += lengths[spanCount++]) {
+        lengths[spanCount] = std::min<DWORD>(size - offset, GuestMemory::pageSize - (address.offset(offset).get() % GuestMemory::pageSize));
+        physicalAddresses[spanCount] = translateAddress(address.offset(offset), accessType, 0);
+#ifdef A20_ENABLED
+        physicalAddresses[spanCount].mask(a20Mask());
+#endif
+    }
+    DWORD offset = 0;
+    for (unsigned i = 0; i < spanCount; ++i) {
+        callback(physicalAddresses[i], offset, lengths[i]);
+        offset += lengths[i];
+    }
+}
+
+bool CPU::isPlainRAM(PhysicalAddress address, DWORD length)
+{
+    return address.get() + length <= m_memorySize
+        && !memoryProviderForAddress(address)
+        && !memoryProviderForAddress(PhysicalAddress(address.get() + length - 1));
+}
+
+void CPU::readMemoryMetalBlock(LinearAddress address, void* data, DWORD size)
+{
+    auto* bytes = static_cast<BYTE*>(data);
+    forEachPhysicalSpan(address, size, MemoryAccessType::Read, [&] (PhysicalAddress physicalAddress, DWORD offset, DWORD length) {
+        if (isPlainRAM(physicalAddress, length)) {
+            memcpy(bytes + offset, &m_memory[physicalAddress.get()], length);
+            return;
+        }
+        for (DWORD i = 0; i < length; ++i)
+            bytes[offset + i] = readPhysicalMemory<BYTE>(PhysicalAddress(physicalAddress.get() + i));
+    });
+}
+
+void CPU::writeMemoryMetalBlock(LinearAddress address, const void* data, DWORD size)
+{
+    auto* bytes = static_cast<const BYTE*>(data);
+    forEachPhysicalSpan(address, size, MemoryAccessType::Write, [&] (PhysicalAddress physicalAddress, DWORD offset, DWORD length) {
+        if (isPlainRAM(physicalAddress, length)) {
+            memcpy(&m_memory[physicalAddress.get()], bytes + offset, length);
+            m_guestMemory->markDirty(physicalAddress.get(), length);
+            return;
+        }
+        for (DWORD i = 0; i < length; ++i)
+            writePhysicalMemory(PhysicalAddress(physicalAddress.get() + i), bytes[offset + i]);
+    });
+}
+
+void CPU::readPhysicalMemoryBlock(PhysicalAddress address, void* data, DWORD size)
+{
+    auto* bytes = static_cast<BYTE*>(data);
+    if (isPlainRAM(address, size)) {
+        memcpy(bytes, &m_memory[address.get()], size);
+        return;
+    }
+    for (DWORD i = 0; i < size; ++i)
+        bytes[i] = readPhysicalMemory<BYTE>(PhysicalAddress(address.get() + i));
+}
+
+void CPU::writePhysicalMemoryBlock(PhysicalAddress address, const void* data, DWORD size)
+{
+    auto* bytes = static_cast<const BYTE*>(data);
+    if (isPlainRAM(address, size)) {
+        memcpy(&m_memory[address.get()], bytes, size);
+        m_guestMemory->markDirty(address.get(), size);
+        return;
+    }
+    for (DWORD i = 0; i < size; ++i)
+        writePhysicalMemory(PhysicalAddress(address.get() + i), bytes[i]);
+}
+
 void CPU::updateDefaultSizes()
 {
 #ifdef VERBOSE_DEBUG
@@ -1719,7 +2003,7 @@ void CPU::_CPUID(Instruction&)
         DWORD type = 0;
         setEAX(stepping | (model << 4) | (family << 8) | (type << 12));
         setEBX(0);
-        setEDX((1 << 4) | (1 << 15)); // RDTSC + CMOV
+        setEDX((1 << 1) | (1 << 4) | (1 << 15)); // VME + RDTSC + CMOV
         setECX(0);
         return;
     }
@@ -1767,6 +2051,13 @@ void CPU::initWatches()
 
 void CPU::registerMemoryProvider(MemoryProvider& provider)
 {
+    if (provider.baseAddress().get() >= 1048576) {
+        vlog(LogConfig, "Register memory provider %p for %08x-%08x", &provider, provider.baseAddress().get(), provider.baseAddress().get() + provider.size() - 1);
+        if (!m_highMemoryProviders.contains(&provider))
+            m_highMemoryProviders.append(&provider);
+        return;
+    }
+
     if ((provider.baseAddress().get() + provider.size()) > 1048576) {
         vlog(LogConfig, "Can't register mapper with length %u @ %08x", provider.size(), provider.baseAddress().get());
         ASSERT_NOT_REACHED();
@@ -1778,11 +2069,13 @@ void CPU::registerMemoryProvider(MemoryProvider& provider)
     }
 }
 
-ALWAYS_INLINE MemoryProvider* CPU::memoryProviderForAddress(PhysicalAddress address)
+MemoryProvider* CPU::highMemoryProviderForAddress(PhysicalAddress address)
 {
-    if (address.get() >= 1048576)
-        return nullptr;
-    return m_memoryProviders[address.get() / memoryProviderBlockSize];
+    for (auto* provider : m_highMemoryProviders) {
+        if (address.get() >= provider->baseAddress().get() && address.get() - provider->baseAddress().get() < provider->size())
+            return provider;
+    }
+    return nullptr;
 }
 
 template<typename T>
@@ -1804,7 +2097,7 @@ void CPU::doBOUND(Instruction& insn)
         isWithinBounds ? "yes" : "no");
 #endif
     if (!isWithinBounds)
-        throw BoundRangeExceeded(QString("%1 not within [%2, %3]").arg(arrayIndex).arg(lowerBound).arg(upperBound));
+        throw BoundRangeExceeded("%d not within [%d, %d]", arrayIndex, lowerBound, upperBound);
 }
 
 void CPU::_BOUND(Instruction& insn)
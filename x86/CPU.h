@@ -26,9 +26,15 @@
 
 #include "Common.h"
 #include "debug.h"
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QVector>
+#include <algorithm>
+#include <limits>
+#include <optional>
 #include <set>
+#include <type_traits>
 #include "OwnPtr.h"
+#include "GuestMemory.h"
 #include "Instruction.h"
 #include "Descriptor.h"
 
@@ -76,9 +82,13 @@ enum Flags {
 
 struct HardwareInterruptDuringREP { };
 
+// NOTE: Exception is thrown on every guest fault, so it is kept trivially copyable.
+//       The reason is a static string (usually the printf format the fault was raised with);
+//       the formatted text only exists in the log, and only if exception logging is enabled.
+//       The throw itself still costs a runtime allocation and an unwind (see tests/bench/FaultLoop.asm).
 class Exception {
 public:
-    Exception(BYTE num, WORD code, DWORD address, const QString& reason)
+    Exception(BYTE num, WORD code, DWORD address, const char* reason)
         : m_num(num)
         , m_code(code)
         , m_address(address)
@@ -87,7 +97,7 @@ public:
     {
     }
 
-    Exception(BYTE num, WORD code, const QString& reason)
+    Exception(BYTE num, WORD code, const char* reason)
         : m_num(num)
         , m_code(code)
         , m_hasCode(true)
@@ -95,29 +105,29 @@ public:
     {
     }
 
-    Exception(BYTE num, const QString& reason)
+    Exception(BYTE num, const char* reason)
         : m_num(num)
         , m_hasCode(false)
         , m_reason(reason)
     {
     }
 
-    ~Exception() { }
-
     BYTE num() const { return m_num; }
     WORD code() const { return m_code; }
     bool hasCode() const { return m_hasCode; }
     DWORD address() const { return m_address; }
-    QString reason() const { return m_reason; }
+    const char* reason() const { return m_reason; }
 
 private:
     BYTE m_num { 0 };
     WORD m_code { 0 };
     DWORD m_address { 0 };
     bool m_hasCode { false };
-    QString m_reason;
+    const char* m_reason { nullptr };
 };
 
+static_assert(std::is_trivially_copyable<Exception>::value, "Exception must stay cheap to throw");
+
 union PartAddressableRegister {
     struct {
         DWORD fullDWORD;
@@ -223,12 +233,34 @@ public:
     };
 
     void registerMemoryProvider(MemoryProvider&);
-    MemoryProvider* memoryProviderForAddress(PhysicalAddress);
+    MemoryProvider* memoryProviderForAddress(PhysicalAddress address)
+    {
+        if (LIKELY(address.get() < 1048576))
+            return m_memoryProviders[address.get() / memoryProviderBlockSize];
+        if (LIKELY(address.get() < m_memorySize))
+            return nullptr;
+        return highMemoryProviderForAddress(address);
+    }
+    MemoryProvider* highMemoryProviderForAddress(PhysicalAddress);
 
     void recomputeMainLoopNeedsSlowStuff();
 
     QWORD cycle() const { return m_cycle; }
 
+    // Calls Machine::captureFrame() at the first instruction boundary at or after the given cycle.
+    void setNextFrameCaptureCycle(QWORD cycle)
+    {
+        m_nextFrameCaptureCycle = cycle;
+        m_nextVSyncCheckCycle = std::min(m_nextVSyncCheckCycle, cycle);
+    }
+
+    // Calls TimerService::service() at the first instruction boundary at or after the given cycle.
+    void setNextTimerCycle(QWORD cycle)
+    {
+        m_nextTimerCycle = cycle;
+        m_nextVSyncCheckCycle = std::min(m_nextVSyncCheckCycle, cycle);
+    }
+
     void reset();
 
     Machine& machine() const { return m_machine; }
@@ -343,7 +375,25 @@ public:
     DWORD baseMemorySize() const { return m_baseMemorySize; }
     void setBaseMemorySize(DWORD size) { m_baseMemorySize = size; }
 
-    void setMemorySizeAndReallocateIfNeeded(DWORD);
+    void setMemorySizeAndReallocateIfNeeded(DWORD size) { setMemorySizeAndReallocateIfNeeded(size, GuestMemory::Configuration()); }
+    void setMemorySizeAndReallocateIfNeeded(DWORD, const GuestMemory::Configuration&);
+
+    GuestMemory& guestMemory() { return *m_guestMemory; }
+    void adoptGuestMemory(OwnPtr<GuestMemory>&&);
+
+    // Each consumer arms its own log and harvests the physical pages written since its last harvest.
+    // Logs belong to the current guest RAM, so adopting or forking RAM invalidates them.
+    GuestMemory::DirtyLogID armDirtyLog() { return m_guestMemory->armDirtyLog(); }
+    void disarmDirtyLog(GuestMemory::DirtyLogID id) { m_guestMemory->disarmDirtyLog(id); }
+    DWORD harvestDirtyLog(GuestMemory::DirtyLogID id, QVector<DWORD>& pages) { return m_guestMemory->harvestDirtyLog(id, pages); }
+    DWORD clearDirtyLog(GuestMemory::DirtyLogID id) { return m_guestMemory->clearDirtyLog(id); }
+    bool isPageDirty(GuestMemory::DirtyLogID id, DWORD page) const { return m_guestMemory->isPageDirty(id, page); }
+    void clearDirtyPage(GuestMemory::DirtyLogID id, DWORD page) { m_guestMemory->clearDirtyPage(id, page); }
+
+    // Runs on a fork of the last RAM checkpoint until joinGuestMemoryFork(), which
+    // throws the fork away and brings back RAM exactly as it was when forking.
+    bool forkGuestMemory();
+    bool joinGuestMemoryFork();
 
     void kill();
 
@@ -355,33 +405,44 @@ public:
     enum class InterruptSource { Internal = 0, External = 1 };
 
     void realModeInterrupt(BYTE isr, InterruptSource);
-    void protectedModeInterrupt(BYTE isr, InterruptSource, QVariant errorCode);
-    void interrupt(BYTE isr, InterruptSource, QVariant errorCode = QVariant());
-    void interruptToTaskGate(BYTE isr, InterruptSource, QVariant errorCode, Gate&);
+    void protectedModeInterrupt(BYTE isr, InterruptSource, std::optional<WORD> errorCode);
+    void interrupt(BYTE isr, InterruptSource, std::optional<WORD> errorCode = std::nullopt);
+    void interruptToTaskGate(BYTE isr, InterruptSource, std::optional<WORD> errorCode, Gate&);
 
-    void interruptFromVM86Mode(Gate&, DWORD offset, CodeSegmentDescriptor&, InterruptSource, QVariant errorCode);
+    void interruptFromVM86Mode(Gate&, DWORD offset, CodeSegmentDescriptor&, InterruptSource, std::optional<WORD> errorCode);
+    void interruptThroughGate(Gate&, CodeSegmentDescriptor&, DWORD offset, InterruptSource, std::optional<WORD> errorCode);
     void iretToVM86Mode(TransactionalPopper&, LogicalAddress, DWORD flags);
     void iretFromVM86Mode();
     void iretFromRealMode();
 
-    Exception GeneralProtectionFault(WORD selector, const QString& reason);
-    Exception StackFault(WORD selector, const QString& reason);
-    Exception NotPresent(WORD selector, const QString& reason);
-    Exception InvalidTSS(WORD selector, const QString& reason);
+    // Counts of VM86 monitor entries vs. sensitive instructions VME let us handle without one.
+    struct VM86Statistics {
+        QWORD monitorEntries { 0 };
+        QWORD generalProtectionEntries { 0 };
+        QWORD redirectedInterrupts { 0 };
+        QWORD virtualInterruptFlagUpdates { 0 };
+    };
+    const VM86Statistics& vm86Statistics() const { return m_vm86Statistics; }
+    void dumpVM86Statistics() const;
+
+    Exception GeneralProtectionFault(WORD selector, const char* reason, ...) PRINTF_LIKE(3, 4);
+    Exception StackFault(WORD selector, const char* reason, ...) PRINTF_LIKE(3, 4);
+    Exception NotPresent(WORD selector, const char* reason, ...) PRINTF_LIKE(3, 4);
+    Exception InvalidTSS(WORD selector, const char* reason, ...) PRINTF_LIKE(3, 4);
     Exception PageFault(LinearAddress, PageFaultFlags::Flags, MemoryAccessType, bool inUserMode, const char* faultTable, DWORD pde, DWORD pte = 0);
-    Exception DivideError(const QString& reason);
-    Exception InvalidOpcode(const QString& reason = QString());
-    Exception BoundRangeExceeded(const QString& reason);
+    Exception DivideError(const char* reason, ...) PRINTF_LIKE(2, 3);
+    Exception InvalidOpcode(const char* reason, ...) PRINTF_LIKE(2, 3);
+    Exception BoundRangeExceeded(const char* reason, ...) PRINTF_LIKE(2, 3);
 
     void raiseException(const Exception&);
 
     void setIF(bool value) { this->IF = value; }
-    void setCF(bool value) { this->CF = value; }
+    void setCF(bool value) { m_dirtyFlags &= ~Flag::CF; this->CF = value; }
     void setDF(bool value) { this->DF = value; }
     void setSF(bool value) { m_dirtyFlags &= ~Flag::SF; this->SF = value; }
-    void setAF(bool value) { this->AF = value; }
+    void setAF(bool value) { m_dirtyFlags &= ~Flag::AF; this->AF = value; }
     void setTF(bool value) { this->TF = value; }
-    void setOF(bool value) { this->OF = value; }
+    void setOF(bool value) { m_dirtyFlags &= ~Flag::OF; this->OF = value; }
     void setPF(bool value) { m_dirtyFlags &= ~Flag::PF; this->PF = value; }
     void setZF(bool value) { m_dirtyFlags &= ~Flag::ZF; this->ZF = value; }
     void setVIF(bool value) { this->VIF = value; }
@@ -391,12 +452,12 @@ public:
     void setIOPL(unsigned int value) { this->IOPL = value; }
 
     bool getIF() const { return this->IF; }
-    bool getCF() const { return this->CF; }
+    bool getCF() const;
     bool getDF() const { return this->DF; }
     bool getSF() const;
-    bool getAF() const { return this->AF; }
+    bool getAF() const;
     bool getTF() const { return this->TF; }
-    bool getOF() const { return this->OF; }
+    bool getOF() const;
     bool getPF() const;
     bool getZF() const;
 
@@ -581,6 +642,10 @@ public:
     void decodeNext();
     void execute(Instruction&);
 
+    bool canFuseSuccessor() const;
+    void executeFusedSuccessor(FusionKind);
+    bool evaluateFused(BYTE conditionCode) const;
+
     void executeOneInstruction();
 
     // CPU main loop - will fetch & decode until stopped
@@ -590,6 +655,10 @@ public:
     // CPU main loop when halted (HLT) - will do nothing until an IRQ is raised
     void haltedLoop();
 
+    // Tells the machine about vertical retrace, 60 times per second of host time,
+    // and about frame captures that are due.
+    void vsyncCheck();
+
     void push32(DWORD value);
     DWORD pop32();
     void push16(WORD value);
@@ -636,11 +705,6 @@ public:
     template<typename T> void mathFlags(typename TypeDoubler<T>::type result, T dest, T src);
     template<typename T> void cmpFlags(typename TypeDoubler<T>::type result, T dest, T src);
 
-    void adjustFlag(QWORD result, DWORD src, DWORD dest)
-    {
-        setAF((((result ^ (src ^ dest)) & 0x10) >> 4) & 1);
-    }
-
     template<typename T> T readRegister(int registerIndex) const;
     template<typename T> void writeRegister(int registerIndex, T value);
 
@@ -665,12 +729,23 @@ public:
     template<typename T> void writeMemory(LinearAddress, T, BYTE effectiveCPL = 0xff);
     template<typename T> void writeMemory(const SegmentDescriptor&, DWORD offset, T);
     template<typename T> void writeMemory(SegmentRegisterIndex, DWORD offset, T);
+    template<typename Callback> void forEachPhysicalSpan(LinearAddress, DWORD size, MemoryAccessType, Callback);
+    bool isPlainRAM(PhysicalAddress, DWORD length);
 
     PhysicalAddress translateAddress(LinearAddress, MemoryAccessType, BYTE effectiveCPL = 0xff);
     void snoop(LinearAddress, MemoryAccessType);
     void snoop(SegmentRegisterIndex, DWORD offset, MemoryAccessType);
 
     template<typename T> void validateIOAccess(WORD port);
+    void invalidateIOPermissionMap() { m_ioPermissionMapValid = false; }
+    bool isIOPermissionMapCurrent() const;
+    bool refreshIOPermissionMap();
+    BYTE readTSSByte(DWORD offset);
+    bool isInterruptRedirected(BYTE isr);
+    void redirectVM86Interrupt(BYTE isr);
+    bool usesVirtualInterruptFlag() const;
+    WORD virtualizedFlags() const;
+    void setVirtualizedFlags(WORD);
 
     BYTE readMemory8(LinearAddress);
     BYTE readMemory8(SegmentRegisterIndex, DWORD offset);
@@ -688,6 +763,11 @@ public:
     void writeMemory32(SegmentRegisterIndex, DWORD offset, DWORD data);
     void writeMemoryMetal16(LinearAddress, WORD);
     void writeMemoryMetal32(LinearAddress, DWORD);
+    void readMemoryMetalBlock(LinearAddress, void*, DWORD size);
+    void writeMemoryMetalBlock(LinearAddress, const void*, DWORD size);
+    // Bus master copies (DMA): no paging, no segmentation.
+    void readPhysicalMemoryBlock(PhysicalAddress, void*, DWORD size);
+    void writePhysicalMemoryBlock(PhysicalAddress, const void*, DWORD size);
 
     enum State { Dead, Alive, Halted };
     State state() const { return m_state; }
@@ -826,6 +906,8 @@ protected:
     template<typename T> void doMOVS(Instruction&);
     template<typename T> void doINS(Instruction&);
     template<typename T> void doOUTS(Instruction&);
+    template<typename T> void doStreamedOUTS();
+    template<typename T> void doBulkStringWrite(bool isMOVS);
     template<typename T> void doCMPS(Instruction&);
     template<typename T> void doSCAS(Instruction&);
 
@@ -1431,6 +1513,59 @@ private:
 
     std::set<LogicalAddress> m_breakpoints;
 
+    // Shadow of the current TSS's I/O permission bitmap (plus the trailing 0xFF byte.)
+    // Set bits are denied ports, and so is anything beyond the TSS limit.
+    BYTE m_ioPermissionMap[65536 / 8 + 1];
+    // The VME interrupt redirection bitmap just below it, refreshed along with it.
+    // Set bits send INT n to the protected-mode IDT.
+    BYTE m_interruptRedirectionMap[256 / 8];
+    bool m_ioPermissionMapValid { false };
+    GuestMemory::DirtyLogID m_ioPermissionMapLog { 0 };
+    DWORD m_ioPermissionMapPages[8];
+    unsigned m_ioPermissionMapPageCount { 0 };
+
+    // Protected-mode IDT gates that passed every check not depending on CPL or the interrupt
+    // source, along with their target code descriptor and entry offset. An entry is live while
+    // its generation matches and none of the pages holding the two descriptors are dirty.
+    struct InterruptGateCacheEntry {
+        Descriptor gate;
+        Descriptor code;
+        DWORD offset { 0 };
+        DWORD generation { 0 };
+        DWORD pages[4];
+        unsigned pageCount { 0 };
+    };
+    InterruptGateCacheEntry m_interruptGateCache[256];
+    DWORD m_interruptGateCacheGeneration { 1 };
+    bool m_interruptGateLogCleared { false };
+    GuestMemory::DirtyLogID m_interruptGateLog { 0 };
+
+    void invalidateInterruptGateCache();
+    InterruptGateCacheEntry* lookupInterruptGate(BYTE isr);
+    void cacheInterruptGate(BYTE isr, const Gate&, const CodeSegmentDescriptor&, DWORD offset);
+
+    // Recently used TSS descriptors, keyed by GDT slot. Busy bit updates made by task switches are
+    // written through, so only guest writes to the GDT pages invalidate them.
+    struct TSSDescriptorCacheEntry {
+        Descriptor descriptor;
+        WORD slot { 0 };
+        DWORD generation { 0 };
+        DWORD pages[2];
+        unsigned pageCount { 0 };
+    };
+    static constexpr unsigned tssDescriptorCacheSize = 8;
+    TSSDescriptorCacheEntry m_tssDescriptorCache[tssDescriptorCacheSize];
+    DWORD m_tssDescriptorCacheGeneration { 1 };
+    GuestMemory::DirtyLogID m_tssDescriptorLog { 0 };
+
+    void invalidateTSSDescriptorCache();
+    bool isTSSDescriptorCacheCurrent() const;
+    bool gdtPagesForSelector(WORD selector, DWORD* pages, unsigned& pageCount);
+    Descriptor getTSSDescriptor(WORD selector);
+    void writeTSSDescriptorToGDT(TSSDescriptor&);
+
+    VM86Statistics m_vm86Statistics;
+
     bool m_a20Enabled { false };
     bool m_nextInstructionIsUninterruptible { false };
 
@@ -1440,6 +1575,13 @@ private:
     static const size_t memoryProviderBlockSize = 16384;
     MemoryProvider* m_memoryProviders[1048576 / memoryProviderBlockSize];
 
+    // Providers mapped above the end of RAM (i.e linear framebuffers.)
+    QVector<MemoryProvider*> m_highMemoryProviders;
+
+    void disarmGuestMemoryLogs();
+
+    OwnPtr<GuestMemory> m_guestMemory;
+    OwnPtr<GuestMemory> m_parentGuestMemory;
     BYTE* m_memory { nullptr };
     size_t m_memorySize { 0 };
 
@@ -1473,12 +1615,26 @@ private:
 #endif
 
     bool m_isForAutotest { false };
+    QElapsedTimer m_benchmarkTimer;
 
     QWORD m_cycle { 0 };
 
+    // The host clock is only looked at every vsyncCheckInterval instructions.
+    static const QWORD vsyncCheckInterval = 4096;
+    QWORD m_nextVSyncCheckCycle { 0 };
+    QWORD m_nextFrameCaptureCycle { std::numeric_limits<QWORD>::max() };
+    QWORD m_nextTimerCycle { std::numeric_limits<QWORD>::max() };
+
+    // Lazy flags: bits set in m_dirtyFlags are computed from the last ALU operation on demand.
+    enum class LazyFlagOperation : BYTE { Add, Sub };
+    void materializeArithmeticFlags() const;
+
     mutable DWORD m_dirtyFlags { 0 };
     QWORD m_lastResult { 0 };
+    DWORD m_lastOperand1 { 0 };
+    DWORD m_lastOperand2 { 0 };
     unsigned m_lastOpSize { ByteSize };
+    LazyFlagOperation m_lastOperation { LazyFlagOperation::Add };
 };
 
 extern CPU* g_cpu;
@@ -1490,22 +1646,22 @@ ALWAYS_INLINE bool CPU::evaluate(BYTE conditionCode) const
     ASSERT(conditionCode <= 0xF);
 
     switch (conditionCode) {
-    case  0: return this->OF;                            // O
-    case  1: return !this->OF;                           // NO
-    case  2: return this->CF;                            // B, C, NAE
-    case  3: return !this->CF;                           // NB, NC, AE
+    case  0: return getOF();                             // O
+    case  1: return !getOF();                            // NO
+    case  2: return getCF();                             // B, C, NAE
+    case  3: return !getCF();                            // NB, NC, AE
     case  4: return getZF();                             // E, Z
     case  5: return !getZF();                            // NE, NZ
-    case  6: return (this->CF | getZF());                // BE, NA
-    case  7: return !(this->CF | getZF());               // NBE, A
+    case  6: return (getCF() | getZF());                 // BE, NA
+    case  7: return !(getCF() | getZF());                // NBE, A
     case  8: return getSF();                             // S
     case  9: return !getSF();                            // NS
     case 10: return getPF();                             // P, PE
     case 11: return !getPF();                            // NP, PO
-    case 12: return getSF() ^ this->OF;                  // L, NGE
-    case 13: return !(getSF() ^ this->OF);               // NL, GE
-    case 14: return (getSF() ^ this->OF) | getZF();      // LE, NG
-    case 15: return !((getSF() ^ this->OF) | getZF());   // NLE, G
+    case 12: return getSF() ^ getOF();                   // L, NGE
+    case 13: return !(getSF() ^ getOF());                // NL, GE
+    case 14: return (getSF() ^ getOF()) | getZF();       // LE, NG
+    case 15: return !((getSF() ^ getOF()) | getZF());    // NLE, G
     }
     return 0;
 }
@@ -1643,22 +1799,25 @@ inline void MemoryOrRegisterReference::write16(WORD data) { return write(data);
 inline void MemoryOrRegisterReference::write32(DWORD data) { ASSERT(m_cpu->o32()); return write(data); }
 
 template<typename T>
-void CPU::mathFlags(typename TypeDoubler<T>::type result, T dest, T src)
+ALWAYS_INLINE void CPU::mathFlags(typename TypeDoubler<T>::type result, T dest, T src)
 {
-    typedef typename TypeDoubler<T>::type DT;
-    m_dirtyFlags |= Flag::PF | Flag::ZF | Flag::SF;
+    m_dirtyFlags |= Flag::CF | Flag::PF | Flag::AF | Flag::ZF | Flag::SF | Flag::OF;
     m_lastResult = result;
+    m_lastOperand1 = dest;
+    m_lastOperand2 = src;
     m_lastOpSize = TypeTrivia<T>::bits;
-
-    setCF(result & ((DT)TypeTrivia<T>::mask << TypeTrivia<T>::bits));
-    adjustFlag(result, dest, src);
+    m_lastOperation = LazyFlagOperation::Add;
 }
 
 template<typename T>
-inline void CPU::cmpFlags(typename TypeDoubler<T>::type result, T dest, T src)
+ALWAYS_INLINE void CPU::cmpFlags(typename TypeDoubler<T>::type result, T dest, T src)
 {
-    mathFlags<T>(result, dest, src);
-    setOF((((result ^ dest) & (src ^ dest)) >> (TypeTrivia<T>::bits - 1)) & 1);
+    m_dirtyFlags |= Flag::CF | Flag::PF | Flag::AF | Flag::ZF | Flag::SF | Flag::OF;
+    m_lastResult = result;
+    m_lastOperand1 = dest;
+    m_lastOperand2 = src;
+    m_lastOpSize = TypeTrivia<T>::bits;
+    m_lastOperation = LazyFlagOperation::Sub;
 }
 
 ALWAYS_INLINE void Instruction::execute(CPU& cpu)
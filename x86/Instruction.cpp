@@ -156,6 +156,8 @@ struct InstructionDescriptor {
     }
 
     IsLockPrefixAllowed lockPrefixAllowed { LockPrefixNotAllowed };
+
+    FusionKind fusionKind { FusionKind::None };
 };
 
 static InstructionDescriptor s_table16[256];
@@ -378,6 +380,52 @@ static void build0FSlash(BYTE op, BYTE slash, const char* mnemonic, InstructionF
     buildSlash(s_0F_table32, op, slash, mnemonic, format, impl, lockPrefixAllowed);
 }
 
+static void setFusionKind(InstructionDescriptor& d, FusionKind kind)
+{
+    ASSERT(d.impl);
+    d.fusionKind = kind;
+}
+
+static void setFusionKind(BYTE op, FusionKind kind)
+{
+    setFusionKind(s_table16[op], kind);
+    setFusionKind(s_table32[op], kind);
+}
+
+static void setFusionKind(BYTE op, BYTE slash, FusionKind kind)
+{
+    setFusionKind(s_table16[op].slashes[slash], kind);
+    setFusionKind(s_table32[op].slashes[slash], kind);
+}
+
+static void buildFusionTables()
+{
+    // CMP
+    for (BYTE op = 0x38; op <= 0x3D; ++op)
+        setFusionKind(op, FusionKind::CompareAndBranch);
+    setFusionKind(0x80, 7, FusionKind::CompareAndBranch);
+    setFusionKind(0x81, 7, FusionKind::CompareAndBranch);
+    setFusionKind(0x83, 7, FusionKind::CompareAndBranch);
+
+    // TEST
+    setFusionKind(0x84, FusionKind::CompareAndBranch);
+    setFusionKind(0x85, FusionKind::CompareAndBranch);
+    setFusionKind(0xA8, FusionKind::CompareAndBranch);
+    setFusionKind(0xA9, FusionKind::CompareAndBranch);
+    setFusionKind(0xF6, 0, FusionKind::CompareAndBranch);
+    setFusionKind(0xF7, 0, FusionKind::CompareAndBranch);
+
+    for (BYTE i = 0; i < 8; ++i) {
+        // INC reg, DEC reg
+        setFusionKind(0x40 + i, FusionKind::CompareAndBranch);
+        setFusionKind(0x48 + i, FusionKind::CompareAndBranch);
+
+        // PUSH reg, POP reg
+        setFusionKind(0x50 + i, FusionKind::StackRun);
+        setFusionKind(0x58 + i, FusionKind::StackRun);
+    }
+}
+
 void buildOpcodeTablesIfNeeded()
 {
     static bool hasBuiltTables = false;
@@ -816,9 +864,17 @@ void buildOpcodeTablesIfNeeded()
     build0F(0xBF, "0xBF",  OP,             nullptr,       "MOVSX", OP_reg32_RM16,  &CPU::_MOVSX_reg32_RM16);
     build0F(0xFF, "UD0",   OP,             &CPU::_UD0);
 
+    buildFusionTables();
+
     hasBuiltTables = true;
 }
 
+FusionKind Instruction::fusionKind() const
+{
+    ASSERT(m_descriptor);
+    return m_descriptor->fusionKind;
+}
+
 FLATTEN Instruction Instruction::fromStream(InstructionStream& stream, bool o32, bool a32)
 {
     return Instruction(stream, o32, a32);
@@ -35,6 +35,15 @@ struct InstructionDescriptor;
 
 typedef void (CPU::*InstructionImpl)(Instruction&);
 
+// Instructions that commonly lead into a predictable successor. After executing one of
+// these, CPU::executeFusedSuccessor() may run the following instruction without going
+// back through the main loop.
+enum class FusionKind : BYTE {
+    None,
+    CompareAndBranch,   // CMP, TEST, INC reg, DEC reg -> Jcc
+    StackRun,           // PUSH reg, POP reg -> more of the same
+};
+
 struct Prefix {
 enum Op {
     OperandSizeOverride = 0x66,
@@ -165,6 +174,8 @@ public:
 
     bool isValid() const { return m_descriptor; }
 
+    FusionKind fusionKind() const;
+
     unsigned length() const;
 
     QString mnemonic() const;
@@ -65,6 +65,7 @@ void CPU::_LTR_RM16(Instruction& insn)
     TR.base = tssDescriptor.base();
     TR.limit = tssDescriptor.limit();
     TR.is32Bit = tssDescriptor.is32Bit();
+    invalidateIOPermissionMap();
 #ifdef DEBUG_TASK_SWITCH
     vlog(LogAlert, "LTR { segment: %04x => base:%08x, limit:%08x }", TR.selector, TR.base.get(), TR.limit);
 #endif
@@ -99,7 +100,7 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
         EXCEPTION_ON(GeneralProtectionFault, task_selector & 0xfffc, incomingTSSDescriptor.isBusy(), "Incoming TSS descriptor is busy");
     }
 
-    auto outgoingDescriptor = getDescriptor(TR.selector);
+    auto outgoingDescriptor = getTSSDescriptor(TR.selector);
     if (!outgoingDescriptor.isTSS()) {
         // Hmm, what have we got ourselves into now?
         vlog(LogCPU, "Switching tasks and outgoing TSS is not a TSS:");
@@ -114,41 +115,41 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
 
     TSS outgoingTSS(*this, TR.base, outgoingTSSDescriptor.is32Bit());
 
-    outgoingTSS.setEAX(getEAX());
-    outgoingTSS.setEBX(getEBX());
-    outgoingTSS.setECX(getECX());
-    outgoingTSS.setEDX(getEDX());
-    outgoingTSS.setEBP(getEBP());
-    outgoingTSS.setESP(getESP());
-    outgoingTSS.setESI(getESI());
-    outgoingTSS.setEDI(getEDI());
-
-    if (source == JumpType::JMP || source == JumpType::IRET) {
-        outgoingTSSDescriptor.setAvailable();
-        writeToGDT(outgoingTSSDescriptor);
-    }
-
     DWORD outgoingEFlags = getEFlags();
 
     if (source == JumpType::IRET) {
         outgoingEFlags &= ~Flag::NT;
     }
 
-    outgoingTSS.setEFlags(outgoingEFlags);
-
-    outgoingTSS.setCS(getCS());
-    outgoingTSS.setDS(getDS());
-    outgoingTSS.setES(getES());
-    outgoingTSS.setFS(getFS());
-    outgoingTSS.setGS(getGS());
-    outgoingTSS.setSS(getSS());
-    outgoingTSS.setLDT(m_LDTR.selector());
-    outgoingTSS.setEIP(getEIP());
+    TaskState outgoingState;
+    outgoingState.CR3 = getCR3();
+    outgoingState.EIP = getEIP();
+    outgoingState.EFlags = outgoingEFlags;
+    outgoingState.EAX = getEAX();
+    outgoingState.ECX = getECX();
+    outgoingState.EDX = getEDX();
+    outgoingState.EBX = getEBX();
+    outgoingState.ESP = getESP();
+    outgoingState.EBP = getEBP();
+    outgoingState.ESI = getESI();
+    outgoingState.EDI = getEDI();
+    outgoingState.ES = getES();
+    outgoingState.CS = getCS();
+    outgoingState.SS = getSS();
+    outgoingState.DS = getDS();
+    outgoingState.FS = getFS();
+    outgoingState.GS = getGS();
+    outgoingState.LDT = m_LDTR.selector();
+    outgoingTSS.storeTaskState(outgoingState, getPG());
 
-    if (getPG())
-        outgoingTSS.setCR3(getCR3());
+    if (source == JumpType::JMP || source == JumpType::IRET) {
+        outgoingTSSDescriptor.setAvailable();
+        writeTSSDescriptorToGDT(outgoingTSSDescriptor);
+    }
 
     TSS incomingTSS(*this, incomingTSSDescriptor.base(), incomingTSSDescriptor.is32Bit());
+    TaskState incomingState;
+    incomingTSS.loadTaskState(incomingState);
 
 #ifdef DEBUG_TASK_SWITCH
     vlog(LogCPU, "Outgoing TSS @ %08x:", outgoingTSSDescriptor.base());
@@ -158,20 +159,26 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
 #endif
 
     // First, load all registers from TSS without validating contents.
-    m_CR3 = incomingTSS.getCR3();
+    // A 16-bit TSS has no CR3 slot, so the incoming task keeps the current page tables.
+    if (incomingTSS.is32Bit()) {
+        if (getPG() && incomingState.CR3 != m_CR3)
+            invalidateTSSDescriptorCache();
+        m_CR3 = incomingState.CR3;
+    }
 
-    m_LDTR.setSelector(incomingTSS.getLDT());
+    m_LDTR.setSelector(incomingState.LDT);
     m_LDTR.setBase(LinearAddress());
     m_LDTR.setLimit(0);
+    invalidateInterruptGateCache();
 
-    CS = incomingTSS.getCS();
-    DS = incomingTSS.getDS();
-    ES = incomingTSS.getES();
-    FS = incomingTSS.getFS();
-    GS = incomingTSS.getGS();
-    SS = incomingTSS.getSS();
+    CS = incomingState.CS;
+    DS = incomingState.DS;
+    ES = incomingState.ES;
+    FS = incomingState.FS;
+    GS = incomingState.GS;
+    SS = incomingState.SS;
 
-    DWORD incomingEFlags = incomingTSS.getEFlags();
+    DWORD incomingEFlags = incomingState.EFlags;
 
     if (incomingEFlags & Flag::VM) {
         vlog(LogCPU, "Incoming task is in VM86 mode, this needs work!");
@@ -187,14 +194,14 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
     else
         setFlags(incomingEFlags);
 
-    setEAX(incomingTSS.getEAX());
-    setEBX(incomingTSS.getEBX());
-    setECX(incomingTSS.getECX());
-    setEDX(incomingTSS.getEDX());
-    setEBP(incomingTSS.getEBP());
-    setESP(incomingTSS.getESP());
-    setESI(incomingTSS.getESI());
-    setEDI(incomingTSS.getEDI());
+    setEAX(incomingState.EAX);
+    setEBX(incomingState.EBX);
+    setECX(incomingState.ECX);
+    setEDX(incomingState.EDX);
+    setEBP(incomingState.EBP);
+    setESP(incomingState.ESP);
+    setESI(incomingState.ESI);
+    setEDI(incomingState.EDI);
 
     if (source == JumpType::CALL || source == JumpType::INT) {
         incomingTSS.setBacklink(TR.selector);
@@ -204,10 +211,11 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
     TR.base = incomingTSSDescriptor.base();
     TR.limit = incomingTSSDescriptor.limit();
     TR.is32Bit = incomingTSSDescriptor.is32Bit();
+    invalidateIOPermissionMap();
 
     if (source != JumpType::IRET) {
         incomingTSSDescriptor.setBusy();
-        writeToGDT(incomingTSSDescriptor);
+        writeTSSDescriptorToGDT(incomingTSSDescriptor);
     }
 
     m_CR0 |= CR0::TS; // Task Switched
@@ -227,7 +235,7 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
     if (csDescriptor.isCode()) {
         if (csDescriptor.isNonconformingCode()) {
             if (csDescriptor.DPL() != (getCS() & 3))
-                throw InvalidTSS(getCS() & 0xfffc, QString("CS is non-conforming with DPL(%1) != RPL(%2)").arg(csDescriptor.DPL()).arg(getCS() & 3));
+                throw InvalidTSS(getCS() & 0xfffc, "CS is non-conforming with DPL(%u) != RPL(%u)", csDescriptor.DPL(), getCS() & 3);
         } else if (csDescriptor.isConformingCode()) {
             if (csDescriptor.DPL() > (getCS() & 3))
                 throw InvalidTSS(getCS() & 0xfffc, "CS is conforming with DPL > RPL");
@@ -244,7 +252,7 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
         if (!ssDescriptor.present())
             throw StackFault(getSS() & 0xfffc, "SS is not present");
         if (ssDescriptor.DPL() != incomingCPL)
-            throw InvalidTSS(getSS() & 0xfffc, QString("SS DPL(%1) != CPL(%2)").arg(ssDescriptor.DPL()).arg(incomingCPL));
+            throw InvalidTSS(getSS() & 0xfffc, "SS DPL(%u) != CPL(%u)", ssDescriptor.DPL(), incomingCPL);
     }
 
     if (!ldtDescriptor.isNull()) {
@@ -282,14 +290,14 @@ void CPU::taskSwitch(WORD task_selector, TSSDescriptor& incomingTSSDescriptor, J
 
     EXCEPTION_ON(GeneralProtectionFault, 0, getEIP() > cachedDescriptor(SegmentRegisterIndex::CS).effectiveLimit(), "Task switch to EIP outside CS limit");
 
-    setLDT(incomingTSS.getLDT());
-    setCS(incomingTSS.getCS());
-    setES(incomingTSS.getES());
-    setDS(incomingTSS.getDS());
-    setFS(incomingTSS.getFS());
-    setGS(incomingTSS.getGS());
-    setSS(incomingTSS.getSS());
-    setEIP(incomingTSS.getEIP());
+    setLDT(incomingState.LDT);
+    setCS(incomingState.CS);
+    setES(incomingState.ES);
+    setDS(incomingState.DS);
+    setFS(incomingState.FS);
+    setGS(incomingState.GS);
+    setSS(incomingState.SS);
+    setEIP(incomingState.EIP);
 
     if (getTF()) {
         vlog(LogCPU, "Leaving task switch with TF=1");
@@ -319,11 +327,107 @@ void CPU::dumpTSS(const TSS &tss)
 
 void CPU::taskSwitch(WORD task_selector, JumpType source)
 {
-    auto descriptor = getDescriptor(task_selector);
+    auto descriptor = getTSSDescriptor(task_selector);
     auto& tssDescriptor = descriptor.asTSSDescriptor();
     taskSwitch(task_selector, tssDescriptor, source);
 }
 
+void CPU::invalidateTSSDescriptorCache()
+{
+    if (++m_tssDescriptorCacheGeneration == 0) {
+        for (auto& entry : m_tssDescriptorCache)
+            entry.generation = 0;
+        m_tssDescriptorCacheGeneration = 1;
+    }
+}
+
+bool CPU::isTSSDescriptorCacheCurrent() const
+{
+    for (auto& entry : m_tssDescriptorCache) {
+        if (entry.generation != m_tssDescriptorCacheGeneration)
+            continue;
+        for (unsigned i = 0; i < entry.pageCount; ++i) {
+            if (isPageDirty(m_tssDescriptorLog, entry.pages[i]))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool CPU::gdtPagesForSelector(WORD selector, DWORD* pages, unsigned& pageCount)
+{
+    pageCount = 0;
+    LinearAddress address = m_GDTR.base().offset(selector & 0xfff8);
+    for (auto byte : { address, address.offset(7) }) {
+        auto physicalAddress = translateAddress(byte, MemoryAccessType::Read, 0);
+        if (!isPlainRAM(physicalAddress, 1))
+            return false;
+        DWORD page = physicalAddress.get() / GuestMemory::pageSize;
+        if (!pageCount || pages[pageCount - 1] != page)
+            pages[pageCount++] = page;
+    }
+    return true;
+}
+
+Descriptor CPU::getTSSDescriptor(WORD selector)
+{
+    WORD slot = selector & 0xfffc;
+    auto& entry = m_tssDescriptorCache[(selector >> 3) % tssDescriptorCacheSize];
+    if (entry.generation == m_tssDescriptorCacheGeneration && entry.slot == slot) {
+        bool clean = true;
+        for (unsigned i = 0; i < entry.pageCount; ++i)
+            clean = clean && !isPageDirty(m_tssDescriptorLog, entry.pages[i]);
+        if (clean) {
+            Descriptor descriptor = entry.descriptor;
+            descriptor.m_index = selector;
+            descriptor.m_RPL = selector & 3;
+            return descriptor;
+        }
+        invalidateTSSDescriptorCache();
+    }
+
+    auto descriptor = getDescriptor(selector);
+    if (!descriptor.isGlobal() || !descriptor.isTSS())
+        return descriptor;
+
+    entry.generation = 0;
+    if (!gdtPagesForSelector(selector, entry.pages, entry.pageCount))
+        return descriptor;
+    // Earlier writes to these pages are already reflected in what we just read, but they may
+    // also have hit descriptors cached in other slots.
+    if (!isTSSDescriptorCacheCurrent())
+        invalidateTSSDescriptorCache();
+    for (unsigned i = 0; i < entry.pageCount; ++i)
+        clearDirtyPage(m_tssDescriptorLog, entry.pages[i]);
+    entry.descriptor = descriptor;
+    entry.slot = slot;
+    entry.generation = m_tssDescriptorCacheGeneration;
+    return descriptor;
+}
+
+void CPU::writeTSSDescriptorToGDT(TSSDescriptor& descriptor)
+{
+    bool wasCurrent = isTSSDescriptorCacheCurrent();
+    writeToGDT(descriptor);
+    if (!wasCurrent) {
+        invalidateTSSDescriptorCache();
+        return;
+    }
+
+    DWORD pages[2];
+    unsigned pageCount;
+    if (!gdtPagesForSelector(descriptor.index(), pages, pageCount)) {
+        invalidateTSSDescriptorCache();
+        return;
+    }
+    for (unsigned i = 0; i < pageCount; ++i)
+        clearDirtyPage(m_tssDescriptorLog, pages[i]);
+
+    auto& entry = m_tssDescriptorCache[(descriptor.index() >> 3) % tssDescriptorCacheSize];
+    if (entry.generation == m_tssDescriptorCacheGeneration && entry.slot == (descriptor.index() & 0xfffc))
+        entry.descriptor = descriptor;
+}
+
 TSS CPU::currentTSS()
 {
     return TSS(*this, TR.base, TR.is32Bit);
@@ -376,6 +480,106 @@ TSS::TSS(CPU& cpu, LinearAddress base, bool is32Bit)
 {
 }
 
+void TSS::loadTaskState(TaskState& state) const
+{
+    if (m_is32Bit) {
+        TSS32 tss;
+        m_cpu.readMemoryMetalBlock(m_base, &tss, sizeof(tss));
+        state.CR3 = tss.CR3;
+        state.EIP = tss.EIP;
+        state.EFlags = tss.EFlags;
+        state.EAX = tss.EAX;
+        state.ECX = tss.ECX;
+        state.EDX = tss.EDX;
+        state.EBX = tss.EBX;
+        state.ESP = tss.ESP;
+        state.EBP = tss.EBP;
+        state.ESI = tss.ESI;
+        state.EDI = tss.EDI;
+        state.ES = tss.ES;
+        state.CS = tss.CS;
+        state.SS = tss.SS;
+        state.DS = tss.DS;
+        state.FS = tss.FS;
+        state.GS = tss.GS;
+        state.LDT = tss.LDT;
+        return;
+    }
+    TSS16 tss;
+    m_cpu.readMemoryMetalBlock(m_base, &tss, sizeof(tss));
+    state.CR3 = 0;
+    state.EIP = tss.IP;
+    state.EFlags = tss.Flags;
+    state.EAX = tss.AX;
+    state.ECX = tss.CX;
+    state.EDX = tss.DX;
+    state.EBX = tss.BX;
+    state.ESP = tss.SP;
+    state.EBP = tss.BP;
+    state.ESI = tss.SI;
+    state.EDI = tss.DI;
+    state.ES = tss.ES;
+    state.CS = tss.CS;
+    state.SS = tss.SS;
+    state.DS = tss.DS;
+    state.FS = tss.FS;
+    state.GS = tss.GS;
+    state.LDT = tss.LDT;
+}
+
+void TSS::storeTaskState(const TaskState& state, bool includeCR3)
+{
+    if (m_is32Bit) {
+        // Read the span back in first, so the reserved upper halves of the selector slots survive.
+        TSS32 tss;
+        auto* bytes = reinterpret_cast<BYTE*>(&tss);
+        size_t begin = includeCR3 ? offsetof(TSS32, CR3) : offsetof(TSS32, EIP);
+        size_t end = offsetof(TSS32, __ldth);
+        m_cpu.readMemoryMetalBlock(m_base.offset(begin), bytes + begin, end - begin);
+        tss.CR3 = state.CR3;
+        tss.EIP = state.EIP;
+        tss.EFlags = state.EFlags;
+        tss.EAX = state.EAX;
+        tss.ECX = state.ECX;
+        tss.EDX = state.EDX;
+        tss.EBX = state.EBX;
+        tss.ESP = state.ESP;
+        tss.EBP = state.EBP;
+        tss.ESI = state.ESI;
+        tss.EDI = state.EDI;
+        tss.ES = state.ES;
+        tss.CS = state.CS;
+        tss.SS = state.SS;
+        tss.DS = state.DS;
+        tss.FS = state.FS;
+        tss.GS = state.GS;
+        tss.LDT = state.LDT;
+        m_cpu.writeMemoryMetalBlock(m_base.offset(begin), bytes + begin, end - begin);
+        return;
+    }
+    TSS16 tss;
+    auto* bytes = reinterpret_cast<BYTE*>(&tss);
+    size_t begin = offsetof(TSS16, IP);
+    tss.IP = state.EIP;
+    tss.Flags = state.EFlags;
+    tss.AX = state.EAX;
+    tss.CX = state.ECX;
+    tss.DX = state.EDX;
+    tss.BX = state.EBX;
+    tss.SP = state.ESP;
+    tss.BP = state.EBP;
+    tss.SI = state.ESI;
+    tss.DI = state.EDI;
+    tss.ES = state.ES;
+    tss.CS = state.CS;
+    tss.SS = state.SS;
+    tss.DS = state.DS;
+    tss.FS = state.FS;
+    tss.GS = state.GS;
+    tss.LDT = state.LDT;
+    m_cpu.writeMemoryMetalBlock(m_base.offset(begin), bytes + begin, sizeof(tss) - begin);
+}
+
 #define TSS_FIELD_16(name) \
     void TSS::set ## name(WORD value) { \
         if (m_is32Bit) \
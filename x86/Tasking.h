@@ -29,6 +29,28 @@
 
 class CPU;
 
+// The registers a task switch moves between the CPU and a TSS.
+struct TaskState {
+    DWORD CR3 { 0 };
+    DWORD EIP { 0 };
+    DWORD EFlags { 0 };
+    DWORD EAX { 0 };
+    DWORD ECX { 0 };
+    DWORD EDX { 0 };
+    DWORD EBX { 0 };
+    DWORD ESP { 0 };
+    DWORD EBP { 0 };
+    DWORD ESI { 0 };
+    DWORD EDI { 0 };
+    WORD ES { 0 };
+    WORD CS { 0 };
+    WORD SS { 0 };
+    WORD DS { 0 };
+    WORD FS { 0 };
+    WORD GS { 0 };
+    WORD LDT { 0 };
+};
+
 class TSS {
 public:
     TSS(CPU&, LinearAddress, bool is32Bit);
@@ -37,6 +59,10 @@ public:
 
     WORD getIOMapBase() const;
 
+    // Bulk transfers of the whole register file, translating the TSS once per page.
+    void loadTaskState(TaskState&) const;
+    void storeTaskState(const TaskState&, bool includeCR3);
+
     DWORD getRingESP(BYTE) const;
     WORD getRingSS(BYTE) const;
 
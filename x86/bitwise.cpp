@@ -76,9 +76,9 @@ template <typename T>
 T CPU::doOR(T dest, T src)
 {
     T result = dest | src;
-    updateFlags<T>(result);
     setOF(0);
     setCF(0);
+    updateFlags<T>(result);
     return result;
 }
 
@@ -86,9 +86,9 @@ template<typename T>
 T CPU::doXOR(T dest, T src)
 {
     T result = dest ^ src;
-    updateFlags<T>(result);
     setOF(0);
     setCF(0);
+    updateFlags<T>(result);
     return result;
 }
 
@@ -96,9 +96,9 @@ template<typename T>
 T CPU::doAND(T dest, T src)
 {
     T result = dest & src;
-    updateFlags<T>(result);
     setOF(0);
     setCF(0);
+    updateFlags<T>(result);
     return result;
 }
 
@@ -24,6 +24,43 @@
 
 #include "CPU.h"
 
+bool CPU::getCF() const
+{
+    if (m_dirtyFlags & Flag::CF) {
+        CF = (m_lastResult >> m_lastOpSize) & 1;
+        m_dirtyFlags &= ~Flag::CF;
+    }
+    return CF;
+}
+
+bool CPU::getAF() const
+{
+    if (m_dirtyFlags & Flag::AF) {
+        AF = ((m_lastResult ^ m_lastOperand1 ^ m_lastOperand2) >> 4) & 1;
+        m_dirtyFlags &= ~Flag::AF;
+    }
+    return AF;
+}
+
+bool CPU::getOF() const
+{
+    if (m_dirtyFlags & Flag::OF) {
+        if (m_lastOperation == LazyFlagOperation::Add)
+            OF = (((m_lastResult ^ m_lastOperand1) & (m_lastResult ^ m_lastOperand2)) >> (m_lastOpSize - 1)) & 1;
+        else
+            OF = (((m_lastResult ^ m_lastOperand1) & (m_lastOperand2 ^ m_lastOperand1)) >> (m_lastOpSize - 1)) & 1;
+        m_dirtyFlags &= ~Flag::OF;
+    }
+    return OF;
+}
+
+void CPU::materializeArithmeticFlags() const
+{
+    getCF();
+    getAF();
+    getOF();
+}
+
 bool CPU::getPF() const
 {
     if (m_dirtyFlags & Flag::PF) {
@@ -53,6 +90,9 @@ bool CPU::getSF() const
 
 void CPU::updateFlags32(DWORD data)
 {
+    // CF, AF and OF are not produced here, so they must not end up derived from this result.
+    if (UNLIKELY(m_dirtyFlags & (Flag::CF | Flag::AF | Flag::OF)))
+        materializeArithmeticFlags();
     m_dirtyFlags |= Flag::PF | Flag::ZF | Flag::SF;
     m_lastResult = data;
     m_lastOpSize = DWordSize;
@@ -60,6 +100,8 @@ void CPU::updateFlags32(DWORD data)
 
 void CPU::updateFlags16(WORD data)
 {
+    if (UNLIKELY(m_dirtyFlags & (Flag::CF | Flag::AF | Flag::OF)))
+        materializeArithmeticFlags();
     m_dirtyFlags |= Flag::PF | Flag::ZF | Flag::SF;
     m_lastResult = data;
     m_lastOpSize = WordSize;
@@ -67,6 +109,8 @@ void CPU::updateFlags16(WORD data)
 
 void CPU::updateFlags8(BYTE data)
 {
+    if (UNLIKELY(m_dirtyFlags & (Flag::CF | Flag::AF | Flag::OF)))
+        materializeArithmeticFlags();
     m_dirtyFlags |= Flag::PF | Flag::ZF | Flag::SF;
     m_lastResult = data;
     m_lastOpSize = ByteSize;
@@ -82,6 +126,31 @@ void CPU::_STD(Instruction&)
     setDF(1);
 }
 
+// VME (in VM86 mode) and PVI (at CPL 3) let code that lacks IOPL flip VIF instead of faulting.
+bool CPU::usesVirtualInterruptFlag() const
+{
+    if (!getPE() || getIOPL() == 3)
+        return false;
+    if (getVM())
+        return getVME();
+    return getCPL() == 3 && getPVI();
+}
+
+// What PUSHF shows with VME: VIF in place of IF, and IOPL=3 so the code believes it owns IF.
+WORD CPU::virtualizedFlags() const
+{
+    return (getFlags() & ~Flag::IF) | (getVIF() * Flag::IF) | Flag::IOPL;
+}
+
+void CPU::setVirtualizedFlags(WORD flags)
+{
+    if ((getVIP() && (flags & Flag::IF)) || (flags & Flag::TF))
+        throw GeneralProtectionFault(0, "Virtual flags update with VIP=1 && IF=1, or TF=1");
+    setFlags((flags & ~(Flag::IF | Flag::IOPL)) | (getFlags() & (Flag::IF | Flag::IOPL)));
+    setVIF(flags & Flag::IF);
+    ++m_vm86Statistics.virtualInterruptFlagUpdates;
+}
+
 void CPU::_STI(Instruction&)
 {
     if (!getPE() || getIOPL() >= getCPL()) {
@@ -91,13 +160,14 @@ void CPU::_STI(Instruction&)
         return;
     }
 
-    if (!getVME() && !getPVI())
-        throw GeneralProtectionFault(0, "STI with VME=0 && PVI=0");
+    if (!usesVirtualInterruptFlag())
+        throw GeneralProtectionFault(0, "STI with IOPL(%u) < CPL(%u)", getIOPL(), getCPL());
 
     if (getVIP())
         throw GeneralProtectionFault(0, "STI with VIP=1");
 
     setVIF(1);
+    ++m_vm86Statistics.virtualInterruptFlagUpdates;
 }
 
 void CPU::_CLI(Instruction&)
@@ -107,10 +177,11 @@ void CPU::_CLI(Instruction&)
         return;
     }
 
-    if (!getVME() && !getPVI())
-        throw GeneralProtectionFault(0, "CLI with VME=0 && PVI=0");
+    if (!usesVirtualInterruptFlag())
+        throw GeneralProtectionFault(0, "CLI with IOPL(%u) < CPL(%u)", getIOPL(), getCPL());
 
     setVIF(0);
+    ++m_vm86Statistics.virtualInterruptFlagUpdates;
 }
 
 void CPU::_CLC(Instruction&)
@@ -179,8 +250,8 @@ void CPU::setEFlags(DWORD eflags)
     setRF(eflags & Flag::RF);
     setVM(eflags & Flag::VM);
 //    this->AC = (eflags & 0x40000) != 0;
-//    this->VIF = (eflags & 0x80000) != 0;
-//    this->VIP = (eflags & 0x100000) != 0;
+    this->VIF = (eflags & Flag::VIF) != 0;
+    this->VIP = (eflags & Flag::VIP) != 0;
 //    this->ID = (eflags & 0x200000) != 0;
 }
 
@@ -190,8 +261,8 @@ DWORD CPU::getEFlags() const
          | (this->RF * Flag::RF)
          | (this->VM * Flag::VM)
 //         | (this->AC << 18)
-//         | (this->VIF << 19)
-//         | (this->VIP << 20)
+         | (this->VIF * Flag::VIF)
+         | (this->VIP * Flag::VIP)
 //         | (this->ID << 21);
          ;
     return eflags;
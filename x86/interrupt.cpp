@@ -40,6 +40,10 @@ void CPU::_INT_imm8(Instruction& insn)
         }
     }
 #endif
+    if (getPE() && getVM() && getVME() && isInterruptRedirected(insn.imm8())) {
+        redirectVM86Interrupt(insn.imm8());
+        return;
+    }
     interrupt(insn.imm8(), InterruptSource::Internal);
 }
 
@@ -57,10 +61,42 @@ void CPU::_INTO(Instruction&)
         interrupt(4, InterruptSource::Internal);
 }
 
+// INT n through the 8086 vector table, as VME allows for vectors clear in the redirection bitmap.
+void CPU::redirectVM86Interrupt(BYTE isr)
+{
+    WORD offset = readMemory16(LinearAddress(isr * 4));
+    WORD selector = readMemory16(LinearAddress(isr * 4 + 2));
+
+    bool virtualIF = getIOPL() < 3;
+    push16(virtualIF ? virtualizedFlags() : getFlags());
+    push16(getCS());
+    push16(getIP());
+
+    if (virtualIF)
+        setVIF(0);
+    else
+        setIF(0);
+    setTF(0);
+    setCS(selector);
+    setEIP(offset);
+    ++m_vm86Statistics.redirectedInterrupts;
+}
+
 void CPU::iretFromVM86Mode()
 {
-    if (getIOPL() != 3)
-        throw GeneralProtectionFault(0, "IRET in VM86 mode with IOPL != 3");
+    if (getIOPL() != 3) {
+        if (!getVME() || o32())
+            throw GeneralProtectionFault(0, "IRET in VM86 mode with IOPL != 3");
+        TransactionalPopper popper(*this);
+        WORD offset = popper.pop16();
+        WORD selector = popper.pop16();
+        WORD flags = popper.pop16();
+        setVirtualizedFlags(flags);
+        setCS(selector);
+        setEIP(offset);
+        popper.commit();
+        return;
+    }
 
     BYTE originalCPL = getCPL();
 
@@ -146,9 +182,9 @@ static WORD makeErrorCode(WORD num, bool idt, CPU::InterruptSource source)
     return (num & 0xfc) | (WORD)source;
 }
 
-void CPU::interruptToTaskGate(BYTE, InterruptSource source, QVariant errorCode, Gate& gate)
+void CPU::interruptToTaskGate(BYTE, InterruptSource source, std::optional<WORD> errorCode, Gate& gate)
 {
-    auto descriptor = getDescriptor(gate.selector());
+    auto descriptor = getTSSDescriptor(gate.selector());
     if (options.trapint) {
         dumpDescriptor(descriptor);
     }
@@ -166,11 +202,11 @@ void CPU::interruptToTaskGate(BYTE, InterruptSource source, QVariant errorCode,
         throw GeneralProtectionFault(makeErrorCode(gate.selector(), 0, source), "Interrupt to task gate referencing non-present TSS descriptor");
     }
     taskSwitch(gate.selector(), tssDescriptor, JumpType::INT);
-    if (errorCode.isValid()) {
+    if (errorCode) {
         if (tssDescriptor.is32Bit())
-            push32(errorCode.value<WORD>());
+            push32(*errorCode);
         else
-            push16(errorCode.value<WORD>());
+            push16(*errorCode);
     }
 }
 
@@ -219,7 +255,66 @@ static void logSerenitySyscall(CPU& cpu)
 
 static const int ignoredInterrupt = -1;
 
-void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant errorCode)
+void CPU::invalidateInterruptGateCache()
+{
+    if (++m_interruptGateCacheGeneration == 0) {
+        for (auto& entry : m_interruptGateCache)
+            entry.generation = 0;
+        m_interruptGateCacheGeneration = 1;
+    }
+    m_interruptGateLogCleared = false;
+}
+
+CPU::InterruptGateCacheEntry* CPU::lookupInterruptGate(BYTE isr)
+{
+    auto& entry = m_interruptGateCache[isr];
+    if (entry.generation != m_interruptGateCacheGeneration)
+        return nullptr;
+    for (unsigned i = 0; i < entry.pageCount; ++i) {
+        if (isPageDirty(m_interruptGateLog, entry.pages[i])) {
+            // We can't tell which of the other entries the write touched, so start over.
+            invalidateInterruptGateCache();
+            return nullptr;
+        }
+    }
+    return &entry;
+}
+
+void CPU::cacheInterruptGate(BYTE isr, const Gate& gate, const CodeSegmentDescriptor& codeDescriptor, DWORD offset)
+{
+    auto& entry = m_interruptGateCache[isr];
+    entry.generation = 0;
+    entry.pageCount = 0;
+
+    auto watchDescriptor = [&] (LinearAddress address) {
+        for (auto byte : { address, address.offset(7) }) {
+            auto physicalAddress = translateAddress(byte, MemoryAccessType::Read, 0);
+            if (physicalAddress.get() >= m_memorySize || memoryProviderForAddress(physicalAddress))
+                return false;
+            DWORD page = physicalAddress.get() / GuestMemory::pageSize;
+            if (!entry.pageCount || entry.pages[entry.pageCount - 1] != page)
+                entry.pages[entry.pageCount++] = page;
+        }
+        return true;
+    };
+
+    auto& table = codeDescriptor.isGlobal() ? m_GDTR : m_LDTR;
+    if (!watchDescriptor(m_IDTR.base().offset(isr * 8)) || !watchDescriptor(table.base().offset(codeDescriptor.index() & 0xfff8)))
+        return;
+
+    // The descriptors were just read, so anything logged before now is stale news.
+    if (!m_interruptGateLogCleared) {
+        clearDirtyLog(m_interruptGateLog);
+        m_interruptGateLogCleared = true;
+    }
+
+    entry.gate = gate;
+    entry.code = codeDescriptor;
+    entry.offset = offset;
+    entry.generation = m_interruptGateCacheGeneration;
+}
+
+void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, std::optional<WORD> errorCode)
 {
     ASSERT(getPE());
 
@@ -232,10 +327,31 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
     bool logAsSyscall = false;
 #endif
 
+    if (getVM()) {
+        ++m_vm86Statistics.monitorEntries;
+        if (isr == 13)
+            ++m_vm86Statistics.generalProtectionEntries;
+    }
+
     if (source == InterruptSource::Internal && getVM() && getIOPL() != 3) {
         throw GeneralProtectionFault(0, "Software INT in VM86 mode with IOPL != 3");
     }
 
+    if (!options.trapint) {
+        if (auto* cached = lookupInterruptGate(isr)) {
+            auto& gate = cached->gate.asGate();
+            if (source == InterruptSource::Internal && gate.DPL() < getCPL()) {
+                throw GeneralProtectionFault(makeErrorCode(isr, 1, source), "Software interrupt trying to escalate privilege (CPL=%u, DPL=%u, VM=%u)", getCPL(), gate.DPL(), getVM());
+            }
+            auto& codeDescriptor = cached->code.asCodeSegmentDescriptor();
+            if (codeDescriptor.DPL() > getCPL()) {
+                throw GeneralProtectionFault(makeErrorCode(gate.selector(), 0, source), "Interrupt gate to segment with DPL(%u)>CPL(%u)", codeDescriptor.DPL(), getCPL());
+            }
+            interruptThroughGate(gate, codeDescriptor, cached->offset, source, errorCode);
+            return;
+        }
+    }
+
     auto idtEntry = getInterruptDescriptor(isr);
     if (!idtEntry.isTaskGate() && !idtEntry.isTrapGate() && !idtEntry.isInterruptGate()) {
         throw GeneralProtectionFault(makeErrorCode(isr, 1, source), "Interrupt to invalid gate type");
@@ -244,7 +360,7 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
 
     if (source == InterruptSource::Internal) {
         if (gate.DPL() < getCPL()) {
-            throw GeneralProtectionFault(makeErrorCode(isr, 1, source), QString("Software interrupt trying to escalate privilege (CPL=%1, DPL=%2, VM=%3)").arg(getCPL()).arg(gate.DPL()).arg(getVM()));
+            throw GeneralProtectionFault(makeErrorCode(isr, 1, source), "Software interrupt trying to escalate privilege (CPL=%u, DPL=%u, VM=%u)", getCPL(), gate.DPL(), getVM());
         }
     }
 
@@ -289,7 +405,7 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
 
     auto& codeDescriptor = descriptor.asCodeSegmentDescriptor();
     if (codeDescriptor.DPL() > getCPL()) {
-        throw GeneralProtectionFault(makeErrorCode(gate.selector(), 0, source), QString("Interrupt gate to segment with DPL(%1)>CPL(%2)").arg(codeDescriptor.DPL()).arg(getCPL()));
+        throw GeneralProtectionFault(makeErrorCode(gate.selector(), 0, source), "Interrupt gate to segment with DPL(%u)>CPL(%u)", codeDescriptor.DPL(), getCPL());
     }
 
     if (!codeDescriptor.present()) {
@@ -297,13 +413,6 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
     }
 
     DWORD offset = gate.offset();
-    DWORD flags = getEFlags();
-
-    WORD originalSS = getSS();
-    DWORD originalESP = getESP();
-    WORD originalCPL = getCPL();
-    WORD originalCS = getCS();
-    DWORD originalEIP = getEIP();
 
     if (!gate.is32Bit() || !codeDescriptor.is32Bit()) {
         if (offset & 0xffff0000) {
@@ -317,19 +426,33 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
         throw GeneralProtectionFault(0, "Offset outside segment limit");
     }
 
+    cacheInterruptGate(isr, gate, codeDescriptor, offset);
+    interruptThroughGate(gate, codeDescriptor, offset, source, errorCode);
+}
+
+void CPU::interruptThroughGate(Gate& gate, CodeSegmentDescriptor& codeDescriptor, DWORD offset, InterruptSource source, std::optional<WORD> errorCode)
+{
+    DWORD flags = getEFlags();
+
+    WORD originalSS = getSS();
+    DWORD originalESP = getESP();
+    WORD originalCPL = getCPL();
+    WORD originalCS = getCS();
+    DWORD originalEIP = getEIP();
+
     if (getVM()) {
         interruptFromVM86Mode(gate, offset, codeDescriptor, source, errorCode);
         return;
     }
 
-    if (!codeDescriptor.conforming() && descriptor.DPL() < originalCPL) {
+    if (!codeDescriptor.conforming() && codeDescriptor.DPL() < originalCPL) {
 #ifdef DEBUG_JUMPS
-        vlog(LogCPU, "Interrupt escalating privilege from ring%u to ring%u", originalCPL, descriptor.DPL(), descriptor);
+        vlog(LogCPU, "Interrupt escalating privilege from ring%u to ring%u", originalCPL, codeDescriptor.DPL());
 #endif
         auto tss = currentTSS();
 
-        WORD newSS = tss.getRingSS(descriptor.DPL());
-        DWORD newESP = tss.getRingESP(descriptor.DPL());
+        WORD newSS = tss.getRingSS(codeDescriptor.DPL());
+        DWORD newESP = tss.getRingESP(codeDescriptor.DPL());
         auto newSSDescriptor = getDescriptor(newSS);
 
         if (newSSDescriptor.isNull()) {
@@ -340,8 +463,8 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
             throw InvalidTSS(makeErrorCode(newSS, 0, source), "New ss outside table limits");
         }
 
-        if (newSSDescriptor.DPL() != descriptor.DPL()) {
-            throw InvalidTSS(makeErrorCode(newSS, 0, source), QString("New ss DPL(%1) != code segment DPL(%2)").arg(newSSDescriptor.DPL()).arg(descriptor.DPL()));
+        if (newSSDescriptor.DPL() != codeDescriptor.DPL()) {
+            throw InvalidTSS(makeErrorCode(newSS, 0, source), "New ss DPL(%u) != code segment DPL(%u)", newSSDescriptor.DPL(), codeDescriptor.DPL());
         }
 
         if (!newSSDescriptor.isData() || !newSSDescriptor.asDataSegmentDescriptor().writable()) {
@@ -353,7 +476,7 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
         }
 
         BEGIN_ASSERT_NO_EXCEPTIONS
-        setCPL(descriptor.DPL());
+        setCPL(codeDescriptor.DPL());
         setSS(newSS);
         setESP(newESP);
 
@@ -366,7 +489,7 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
         END_ASSERT_NO_EXCEPTIONS
     } else if (codeDescriptor.conforming() || codeDescriptor.DPL() == originalCPL) {
 #ifdef DEBUG_JUMPS
-        vlog(LogCPU, "Interrupt same privilege from ring%u to ring%u", originalCPL, descriptor.DPL());
+        vlog(LogCPU, "Interrupt same privilege from ring%u to ring%u", originalCPL, codeDescriptor.DPL());
 #endif
         if (getVM() && (codeDescriptor.conforming() || codeDescriptor.DPL() != 0)) {
             ASSERT_NOT_REACHED();
@@ -388,8 +511,8 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
     pushValueWithSize(flags, gate.size());
     pushValueWithSize(originalCS, gate.size());
     pushValueWithSize(originalEIP, gate.size());
-    if (errorCode.isValid()) {
-        pushValueWithSize(errorCode.value<WORD>(), gate.size());
+    if (errorCode) {
+        pushValueWithSize(*errorCode, gate.size());
     }
 
     if (gate.isInterruptGate())
@@ -403,7 +526,7 @@ void CPU::protectedModeInterrupt(BYTE isr, InterruptSource source, QVariant erro
     END_ASSERT_NO_EXCEPTIONS
 }
 
-void CPU::interruptFromVM86Mode(Gate& gate, DWORD offset, CodeSegmentDescriptor& codeDescriptor, InterruptSource source, QVariant errorCode)
+void CPU::interruptFromVM86Mode(Gate& gate, DWORD offset, CodeSegmentDescriptor& codeDescriptor, InterruptSource source, std::optional<WORD> errorCode)
 {
 #ifdef DEBUG_VM86
     vlog(LogCPU, "Interrupt from VM86 mode -> %04x:%08x", gate.selector(), offset);
@@ -432,11 +555,11 @@ void CPU::interruptFromVM86Mode(Gate& gate, DWORD offset, CodeSegmentDescriptor&
     }
 
     if ((newSS & 3) != 0) {
-        throw InvalidTSS(makeErrorCode(newSS, 0, source), QString("New ss RPL(%1) != 0").arg(newSS & 3));
+        throw InvalidTSS(makeErrorCode(newSS, 0, source), "New ss RPL(%u) != 0", newSS & 3);
     }
 
     if (newSSDescriptor.DPL() != 0) {
-        throw InvalidTSS(makeErrorCode(newSS, 0, source), QString("New ss DPL(%1) != 0").arg(newSSDescriptor.DPL()));
+        throw InvalidTSS(makeErrorCode(newSS, 0, source), "New ss DPL(%u) != 0", newSSDescriptor.DPL());
     }
 
     if (!newSSDescriptor.isData() || !newSSDescriptor.asDataSegmentDescriptor().writable()) {
@@ -479,8 +602,8 @@ void CPU::interruptFromVM86Mode(Gate& gate, DWORD offset, CodeSegmentDescriptor&
     pushValueWithSize(originalFlags, gate.size());
     pushValueWithSize(getCS(), gate.size());
     pushValueWithSize(getEIP(), gate.size());
-    if (errorCode.isValid()) {
-        pushValueWithSize(errorCode.value<WORD>(), gate.size());
+    if (errorCode) {
+        pushValueWithSize(*errorCode, gate.size());
     }
     setGS(0);
     setFS(0);
@@ -492,7 +615,23 @@ void CPU::interruptFromVM86Mode(Gate& gate, DWORD offset, CodeSegmentDescriptor&
     END_ASSERT_NO_EXCEPTIONS
 }
 
-void CPU::interrupt(BYTE isr, InterruptSource source, QVariant errorCode)
+void CPU::dumpVM86Statistics() const
+{
+    if (!m_vm86Statistics.monitorEntries && !m_vm86Statistics.redirectedInterrupts && !m_vm86Statistics.virtualInterruptFlagUpdates)
+        return;
+    double seconds = m_benchmarkTimer.isValid() ? m_benchmarkTimer.elapsed() / 1000.0 : 0;
+    auto rate = [&] (QWORD count) { return seconds > 0 ? count / seconds : 0.0; };
+    printf("vm86: %llu monitor entries (%.0f/s, %llu #GP), %llu redirected INTs (%.0f/s), %llu virtual IF updates (%.0f/s)\n",
+        (unsigned long long)m_vm86Statistics.monitorEntries,
+        rate(m_vm86Statistics.monitorEntries),
+        (unsigned long long)m_vm86Statistics.generalProtectionEntries,
+        (unsigned long long)m_vm86Statistics.redirectedInterrupts,
+        rate(m_vm86Statistics.redirectedInterrupts),
+        (unsigned long long)m_vm86Statistics.virtualInterruptFlagUpdates,
+        rate(m_vm86Statistics.virtualInterruptFlagUpdates));
+}
+
+void CPU::interrupt(BYTE isr, InterruptSource source, std::optional<WORD> errorCode)
 {
     if (getPE())
         protectedModeInterrupt(isr, source, errorCode);
@@ -533,7 +672,7 @@ void CPU::protectedIRET(TransactionalPopper& popper, LogicalAddress address)
     }
 
     if (selectorRPL < getCPL())
-        throw GeneralProtectionFault(selector & 0xfffc, QString("IRET with RPL(%1) < CPL(%2)").arg(selectorRPL).arg(getCPL()));
+        throw GeneralProtectionFault(selector & 0xfffc, "IRET with RPL(%u) < CPL(%u)", selectorRPL, getCPL());
 
     auto& codeSegment = descriptor.asCodeSegmentDescriptor();
 
@@ -89,32 +89,140 @@ void CPU::_IN_EAX_DX(Instruction&)
     setEAX(in32(getDX()));
 }
 
-template<typename T>
-void CPU::validateIOAccess(WORD port)
+bool CPU::isIOPermissionMapCurrent() const
 {
-    if (!getPE())
-        return;
-    if (!getVM() && !(getCPL() > getIOPL()))
-        return;
+    if (!m_ioPermissionMapValid)
+        return false;
+    for (unsigned i = 0; i < m_ioPermissionMapPageCount; ++i) {
+        if (isPageDirty(m_ioPermissionMapLog, m_ioPermissionMapPages[i]))
+            return false;
+    }
+    return true;
+}
+
+// Returns false, leaving the shadow invalid, when the map can't be watched for changes.
+// Nothing is copied then; callers read the bytes they need from the TSS instead.
+bool CPU::refreshIOPermissionMap()
+{
+    m_ioPermissionMapValid = false;
+    m_ioPermissionMapPageCount = 0;
+    memset(m_ioPermissionMap, 0xff, sizeof(m_ioPermissionMap));
+    memset(m_interruptRedirectionMap, 0xff, sizeof(m_interruptRedirectionMap));
+
     auto tss = currentTSS();
     if (!tss.is32Bit()) {
         vlog(LogCPU, "validateIOAccess for 16-bit TSS, what do?");
         ASSERT_NOT_REACHED();
     }
 
-    if (TR.limit < 103)
-        throw GeneralProtectionFault(0, "TSS too small, I/O map missing");
+    bool cacheable = true;
+    auto watchPage = [&] (LinearAddress address) {
+        auto physicalAddress = translateAddress(address, MemoryAccessType::Read, 0);
+        if (physicalAddress.get() >= m_memorySize || memoryProviderForAddress(physicalAddress)) {
+            cacheable = false;
+            return physicalAddress;
+        }
+        DWORD page = physicalAddress.get() / GuestMemory::pageSize;
+        for (unsigned i = 0; i < m_ioPermissionMapPageCount; ++i) {
+            if (m_ioPermissionMapPages[i] == page)
+                return physicalAddress;
+        }
+        ASSERT(m_ioPermissionMapPageCount < sizeof(m_ioPermissionMapPages) / sizeof(DWORD));
+        m_ioPermissionMapPages[m_ioPermissionMapPageCount++] = page;
+        return physicalAddress;
+    };
+
+    if (TR.limit >= 103) {
+        LinearAddress iomapBaseAddress = TR.base.offset(102);
+        watchPage(iomapBaseAddress);
+        watchPage(iomapBaseAddress.offset(1));
+        if (!cacheable)
+            return false;
+        WORD iomapBase = tss.getIOMapBase();
+
+        DWORD mapSize = 0;
+        if (TR.limit >= iomapBase)
+            mapSize = std::min<DWORD>(TR.limit - iomapBase + 1, 65536 / 8);
+        DWORD redirectionMapBase = iomapBase - sizeof(m_interruptRedirectionMap);
+        DWORD redirectionMapSize = 0;
+        if (iomapBase >= sizeof(m_interruptRedirectionMap) && TR.limit >= redirectionMapBase)
+            redirectionMapSize = std::min<DWORD>(TR.limit - redirectionMapBase + 1, sizeof(m_interruptRedirectionMap));
+
+        // Translate (and watch) every page before copying anything, a page at a time.
+        struct Span { BYTE* destination; PhysicalAddress source; DWORD size; };
+        Span spans[8];
+        unsigned spanCount = 0;
+        auto addSpans = [&] (BYTE* destination, DWORD base, DWORD size) {
+            DWORD offset = 0;
+            while (offset < size && cacheable) {
+                LinearAddress address = TR.base.offset(base + offset);
+                DWORD chunkSize = std::min<DWORD>(size - offset, GuestMemory::pageSize - (address.get() % GuestMemory::pageSize));
+                ASSERT(spanCount < sizeof(spans) / sizeof(spans[0]));
+                spans[spanCount++] = { destination + offset, watchPage(address), chunkSize };
+                offset += chunkSize;
+            }
+        };
+        addSpans(m_ioPermissionMap, iomapBase, mapSize);
+        addSpans(m_interruptRedirectionMap, redirectionMapBase, redirectionMapSize);
+        if (!cacheable) {
+            memset(m_ioPermissionMap, 0xff, sizeof(m_ioPermissionMap));
+            return false;
+        }
+
+        for (unsigned i = 0; i < spanCount; ++i)
+            readPhysicalMemoryBlock(spans[i].source, spans[i].destination, spans[i].size);
+    }
 
-    WORD iomapBase = tss.getIOMapBase();
-    WORD highPort = port + sizeof(T) - 1;
+    clearDirtyLog(m_ioPermissionMapLog);
+    m_ioPermissionMapValid = true;
+    return true;
+}
 
-    if (TR.limit < (iomapBase + highPort / 8))
-        throw GeneralProtectionFault(0, "TSS I/O map too small");
+BYTE CPU::readTSSByte(DWORD offset)
+{
+    return readPhysicalMemory<BYTE>(translateAddress(TR.base.offset(offset), MemoryAccessType::Read, 0));
+}
 
-    WORD mask = (1 << (sizeof(T) - 1)) << (port & 7);
-    LinearAddress address = TR.base.offset(iomapBase + (port / 8));
-    WORD perm = mask & 0xff00 ? readMemory16(address) : readMemory8(address);
-    if (perm & mask)
+bool CPU::isInterruptRedirected(BYTE isr)
+{
+    if (isIOPermissionMapCurrent() || refreshIOPermissionMap())
+        return !(m_interruptRedirectionMap[isr / 8] & (1 << (isr % 8)));
+
+    if (TR.limit < 103)
+        return false;
+    WORD iomapBase = currentTSS().getIOMapBase();
+    if (iomapBase < sizeof(m_interruptRedirectionMap))
+        return false;
+    DWORD offset = iomapBase - sizeof(m_interruptRedirectionMap) + isr / 8;
+    if (offset > TR.limit)
+        return false;
+    return !(readTSSByte(offset) & (1 << (isr % 8)));
+}
+
+template<typename T>
+void CPU::validateIOAccess(WORD port)
+{
+    if (!getPE())
+        return;
+    if (!getVM() && !(getCPL() > getIOPL()))
+        return;
+
+    WORD mask = (1 << sizeof(T)) - 1;
+    WORD perm;
+    if (isIOPermissionMapCurrent() || refreshIOPermissionMap()) {
+        perm = m_ioPermissionMap[port / 8] | (m_ioPermissionMap[port / 8 + 1] << 8);
+    } else {
+        // Without a shadow, read just the one or two bitmap bytes this access covers.
+        perm = 0xffff;
+        if (TR.limit >= 103) {
+            DWORD offset = currentTSS().getIOMapBase() + port / 8;
+            if (offset <= TR.limit)
+                perm = (perm & 0xff00) | readTSSByte(offset);
+            if ((port & 7) + sizeof(T) > 8 && port / 8 + 1 < 65536 / 8 && offset + 1 <= TR.limit)
+                perm = (perm & 0x00ff) | (readTSSByte(offset + 1) << 8);
+        }
+    }
+    if (perm & (mask << (port & 7)))
         throw GeneralProtectionFault(0, "I/O map disallowed access");
 }
 
@@ -128,19 +236,13 @@ void CPU::out(WORD port, T data)
 {
     validateIOAccess<T>(port);
 
-    if (options.iopeek) {
+    if (UNLIKELY(options.iopeek)) {
         if (port != 0x00E6 && port != 0x0020 && port != 0x3D4 && port != 0x03d5 && port != 0xe2 && port != 0xe0 && port != 0x92) {
             vlog(LogIO, "CPU::out<%zu>: %x --> %03x", sizeof(T) * 8, data, port);
         }
     }
 
-    if (auto* device = machine().outputDeviceForPort(port)) {
-        device->out<T>(port, data);
-        return;
-    }
-
-    if (!IODevice::shouldIgnorePort(port))
-        vlog(LogAlert, "Unhandled I/O write to port %03x, data %x", port, data);
+    machine().ioPortBus().out<T>(port, data);
 }
 
 
@@ -148,16 +250,9 @@ template<typename T> T CPU::in(WORD port)
 {
     validateIOAccess<T>(port);
 
-    T data;
-    if (auto* device = machine().inputDeviceForPort(port)) {
-        data = device->in<T>(port);
-    } else {
-        if (!IODevice::shouldIgnorePort(port))
-            vlog(LogAlert, "Unhandled I/O read from port %03x", port);
-        data = IODevice::JunkValue;
-    }
+    T data = machine().ioPortBus().in<T>(port);
 
-    if (options.iopeek) {
+    if (UNLIKELY(options.iopeek)) {
         if (port != 0xe6 && port != 0x20 && port != 0x3d4 && port != 0x03d5 && port != 0x3da && port != 0x92) {
             vlog(LogIO, "CPU::in<%zu>: %03x = %x", sizeof(T) * 8, port, data);
         }
@@ -201,3 +296,6 @@ template DWORD CPU::in<DWORD>(WORD port);
 template void CPU::out<BYTE>(WORD port, BYTE);
 template void CPU::out<WORD>(WORD port, WORD);
 template void CPU::out<DWORD>(WORD port, DWORD);
+template void CPU::validateIOAccess<BYTE>(WORD port);
+template void CPU::validateIOAccess<WORD>(WORD port);
+template void CPU::validateIOAccess<DWORD>(WORD port);
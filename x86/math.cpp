@@ -30,10 +30,6 @@ QWORD CPU::doADD(T dest, T src)
 {
     QWORD result = (QWORD)dest + (QWORD)src;
     mathFlags(result, dest, src);
-    setOF(((
-          ((result)^(dest)) &
-          ((result)^(src))
-         )>>(TypeTrivia<T>::bits - 1))&1);
     return result;
 }
 
@@ -43,10 +39,6 @@ QWORD CPU::doADC(T dest, T src)
     QWORD result = (QWORD)dest + (QWORD)src + (QWORD)getCF();
 
     mathFlags(result, dest, src);
-    setOF(((
-          ((result)^(dest)) &
-          ((result)^(src))
-         )>>(TypeTrivia<T>::bits - 1))&1);
     return result;
 }
 
@@ -183,7 +175,7 @@ void CPU::doDIV(T dividendHigh, T dividendLow, T divisor, T& quotient, T& remain
     DT dividend = weld<DT>(dividendHigh, dividendLow);
     DT result = dividend / divisor;
     if (result > std::numeric_limits<T>::max() || result < std::numeric_limits<T>::min()) {
-        throw DivideError(QString("Divide overflow (%1 / %2 = %3 { range = %4 - %5 })").arg(dividend).arg(divisor).arg(result).arg(std::numeric_limits<T>::min()).arg(std::numeric_limits<T>::max()));
+        throw DivideError("Divide overflow (%lld / %lld = %lld { range = %lld - %lld })", (long long)dividend, (long long)divisor, (long long)result, (long long)std::numeric_limits<T>::min(), (long long)std::numeric_limits<T>::max());
     }
 
     quotient = result;
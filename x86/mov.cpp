@@ -125,7 +125,7 @@ void CPU::_MOV_reg32_CR(Instruction& insn)
         // table (PDPT) and the loading of a control register causes the
         // PDPT to be loaded into the processor.
         if (getCPL() != 0) {
-            throw GeneralProtectionFault(0, QString("MOV reg32, CRx with CPL!=0(%1)").arg(getCPL()));
+            throw GeneralProtectionFault(0, "MOV reg32, CRx with CPL!=0(%u)", getCPL());
         }
     } else {
         // FIXME: GP(0) conditions:
@@ -160,7 +160,7 @@ void CPU::_MOV_CR_reg32(Instruction& insn)
         // table (PDPT) and the loading of a control register causes the
         // PDPT to be loaded into the processor.
         if (getCPL() != 0) {
-            throw GeneralProtectionFault(0, QString("MOV CRx, reg32 with CPL!=0(%1)").arg(getCPL()));
+            throw GeneralProtectionFault(0, "MOV CRx, reg32 with CPL!=0(%u)", getCPL());
         }
     } else {
         // FIXME: GP(0) conditions:
@@ -172,13 +172,17 @@ void CPU::_MOV_CR_reg32(Instruction& insn)
 
     auto value = readRegister<DWORD>(static_cast<CPU::RegisterIndex32>(insn.rm() & 7));
 
-    if (crIndex == 4) {
-        vlog(LogCPU, "CR4 written (%08x) but not supported!", value);
+    if (crIndex == 4 && (value & ~(CR4::VME | CR4::PVI | CR4::TSD))) {
+        vlog(LogCPU, "CR4 written (%08x) with unsupported bits!", value);
     }
     setControlRegister(crIndex, value);
 
-    if (crIndex == 0 || crIndex == 3)
+    if (crIndex == 0 || crIndex == 3) {
         updateCodeSegmentCache();
+        invalidateIOPermissionMap();
+        invalidateInterruptGateCache();
+        invalidateTSSDescriptorCache();
+    }
 
 #ifdef VERBOSE_DEBUG
     vlog(LogCPU, "MOV CR%u <- %08X", crIndex, getControlRegister(crIndex));
@@ -196,7 +200,7 @@ void CPU::_MOV_reg32_DR(Instruction& insn)
 
     if (getPE()) {
         if (getCPL() != 0) {
-            throw GeneralProtectionFault(0, QString("MOV reg32, DRx with CPL!=0(%1)").arg(getCPL()));
+            throw GeneralProtectionFault(0, "MOV reg32, DRx with CPL!=0(%u)", getCPL());
         }
     }
 
@@ -215,7 +219,7 @@ void CPU::_MOV_DR_reg32(Instruction& insn)
 
     if (getPE()) {
         if (getCPL() != 0) {
-            throw GeneralProtectionFault(0, QString("MOV DRx, reg32 with CPL!=0(%1)").arg(getCPL()));
+            throw GeneralProtectionFault(0, "MOV DRx, reg32 with CPL!=0(%u)", getCPL());
         }
     }
 
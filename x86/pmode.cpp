@@ -24,13 +24,15 @@
 
 #include "CPU.h"
 #include "debugger.h"
+#include <cstdarg>
+#include <cstdio>
 
 //#define DEBUG_DESCRIPTOR_TABLES
 
 void CPU::doSGDTorSIDT(Instruction& insn, DescriptorTableRegister& table)
 {
     if (insn.modrm().isRegister())
-        throw InvalidOpcode(QString("%1 with register destination").arg(insn.mnemonic()));
+        throw InvalidOpcode("S%s with register destination", table.name());
 
     snoop(insn.modrm().segment(), insn.modrm().offset(), MemoryAccessType::Write);
     snoop(insn.modrm().segment(), insn.modrm().offset() + 6, MemoryAccessType::Write);
@@ -79,6 +81,7 @@ void CPU::setLDT(WORD selector)
     m_LDTR.setSelector(selector);
     m_LDTR.setBase(base);
     m_LDTR.setLimit(limit);
+    invalidateInterruptGateCache();
 
 #ifdef DEBUG_DESCRIPTOR_TABLES
     vlog(LogAlert, "setLDT { segment: %04X => base:%08X, limit:%08X }", m_LDTR.selector(), m_LDTR.base(), m_LDTR.limit());
@@ -110,16 +113,18 @@ void CPU::dumpLDT()
 void CPU::doLGDTorLIDT(Instruction& insn, DescriptorTableRegister& table)
 {
     if (insn.modrm().isRegister())
-        throw InvalidOpcode(QString("%1 with register source").arg(insn.mnemonic()));
+        throw InvalidOpcode("L%s with register source", table.name());
 
     if (getCPL() != 0)
-        throw GeneralProtectionFault(0, QString("%1 with CPL != 0").arg(insn.mnemonic()));
+        throw GeneralProtectionFault(0, "L%s with CPL != 0", table.name());
 
     DWORD base = readMemory32(insn.modrm().segment(), insn.modrm().offset() + 2);
     WORD limit = readMemory16(insn.modrm().segment(), insn.modrm().offset());
     DWORD baseMask = o32() ? 0xffffffff : 0x00ffffff;
     table.setBase(LinearAddress(base & baseMask));
     table.setLimit(limit);
+    invalidateInterruptGateCache();
+    invalidateTSSDescriptorCache();
 }
 
 void CPU::_LGDT(Instruction& insn)
@@ -161,7 +166,7 @@ void CPU::_CLTS(Instruction&)
 {
     if (getPE()) {
         if (getCPL() != 0) {
-            throw GeneralProtectionFault(0, QString("CLTS with CPL!=0(%1)").arg(getCPL()));
+            throw GeneralProtectionFault(0, "CLTS with CPL!=0(%u)", getCPL());
         }
     }
     m_CR0 &= ~(1 << 3);
@@ -171,7 +176,7 @@ void CPU::_LMSW_RM16(Instruction& insn)
 {
     if (getPE()) {
         if (getCPL() != 0) {
-            throw GeneralProtectionFault(0, QString("LMSW with CPL!=0(%1)").arg(getCPL()));
+            throw GeneralProtectionFault(0, "LMSW with CPL!=0(%u)", getCPL());
         }
     }
 
@@ -183,6 +188,9 @@ void CPU::_LMSW_RM16(Instruction& insn)
     }
 
     m_CR0 = (m_CR0 & 0xFFFFFFF0) | (msw & 0x0F);
+    invalidateIOPermissionMap();
+    invalidateInterruptGateCache();
+    invalidateTSSDescriptorCache();
 #ifdef PMODE_DEBUG
     vlog(LogCPU, "LMSW set CR0=%08X, PE=%u", getCR0(), getPE());
 #endif
@@ -327,20 +335,38 @@ void CPU::raiseException(const Exception& e)
         } else {
             interrupt(e.num(), InterruptSource::External);
         }
-    } catch (Exception e) {
+    } catch (const Exception&) {
         ASSERT_NOT_REACHED();
     }
 }
 
-Exception CPU::GeneralProtectionFault(WORD code, const QString& reason)
+static void logException(const char* exception, const char* reasonFormat, va_list ap)
+{
+    char reason[256];
+    vsnprintf(reason, sizeof(reason), reasonFormat, ap);
+    vlog(LogCPU, "Exception: %s :: %s", exception, reason);
+}
+
+#define LOG_EXCEPTION(reason, ...) \
+    do { \
+        if (options.log_exceptions) { \
+            char exception[64]; \
+            snprintf(exception, sizeof(exception), __VA_ARGS__); \
+            va_list ap; \
+            va_start(ap, reason); \
+            logException(exception, reason, ap); \
+            va_end(ap); \
+        } \
+    } while (0)
+
+Exception CPU::GeneralProtectionFault(WORD code, const char* reason, ...)
 {
     WORD selector = code & 0xfff8;
     bool TI = code & 4;
     bool I = code & 2;
     bool EX = code & 1;
 
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #GP(%04x) selector=%04X, TI=%u, I=%u, EX=%u :: %s", code, selector, TI, I, EX, qPrintable(reason));
+    LOG_EXCEPTION(reason, "#GP(%04x) selector=%04X, TI=%u, I=%u, EX=%u", code, selector, TI, I, EX);
     if (options.crashOnGPF) {
         dumpAll();
         vlog(LogAlert, "CRASH ON GPF");
@@ -349,45 +375,39 @@ Exception CPU::GeneralProtectionFault(WORD code, const QString& reason)
     return Exception(0xd, code, reason);
 }
 
-Exception CPU::StackFault(WORD selector, const QString& reason)
+Exception CPU::StackFault(WORD selector, const char* reason, ...)
 {
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #SS(%04x) :: %s", selector, qPrintable(reason));
+    LOG_EXCEPTION(reason, "#SS(%04x)", selector);
     return Exception(0xc, selector, reason);
 }
 
-Exception CPU::NotPresent(WORD selector, const QString& reason)
+Exception CPU::NotPresent(WORD selector, const char* reason, ...)
 {
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #NP(%04x) :: %s", selector, qPrintable(reason));
+    LOG_EXCEPTION(reason, "#NP(%04x)", selector);
     return Exception(0xb, selector, reason);
 }
 
-Exception CPU::InvalidOpcode(const QString& reason)
+Exception CPU::InvalidOpcode(const char* reason, ...)
 {
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #UD :: %s", qPrintable(reason));
+    LOG_EXCEPTION(reason, "#UD");
     return Exception(0x6, reason);
 }
 
-Exception CPU::BoundRangeExceeded(const QString& reason)
+Exception CPU::BoundRangeExceeded(const char* reason, ...)
 {
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #BR :: %s", qPrintable(reason));
+    LOG_EXCEPTION(reason, "#BR");
     return Exception(0x5, reason);
 }
 
-Exception CPU::InvalidTSS(WORD selector, const QString& reason)
+Exception CPU::InvalidTSS(WORD selector, const char* reason, ...)
 {
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #TS(%04x) :: %s", selector, qPrintable(reason));
+    LOG_EXCEPTION(reason, "#TS(%04x)", selector);
     return Exception(0xa, selector, reason);
 }
 
-Exception CPU::DivideError(const QString& reason)
+Exception CPU::DivideError(const char* reason, ...)
 {
-    if (options.log_exceptions)
-        vlog(LogCPU, "Exception: #DE :: %s", qPrintable(reason));
+    LOG_EXCEPTION(reason, "#DE");
     return Exception(0x0, reason);
 }
 
@@ -407,13 +427,13 @@ void CPU::validateSegmentLoad(SegmentRegisterIndex reg, WORD selector, const Des
             throw GeneralProtectionFault(0, "ss loaded with null descriptor");
         }
         if (selectorRPL != getCPL()) {
-            throw GeneralProtectionFault(selector & 0xfffc, QString("ss selector RPL(%1) != CPL(%2)").arg(selectorRPL).arg(getCPL()));
+            throw GeneralProtectionFault(selector & 0xfffc, "ss selector RPL(%u) != CPL(%u)", selectorRPL, getCPL());
         }
         if (!descriptor.isData() || !descriptor.asDataSegmentDescriptor().writable()) {
             throw GeneralProtectionFault(selector & 0xfffc, "ss loaded with something other than a writable data segment");
         }
         if (descriptor.DPL() != getCPL()) {
-            throw GeneralProtectionFault(selector & 0xfffc, QString("ss selector leads to descriptor with DPL(%1) != CPL(%2)").arg(descriptor.DPL()).arg(getCPL()));
+            throw GeneralProtectionFault(selector & 0xfffc, "ss selector leads to descriptor with DPL(%u) != CPL(%u)", descriptor.DPL(), getCPL());
         }
         if (!descriptor.present()) {
             throw StackFault(selector & 0xfffc, "ss loaded with non-present segment");
@@ -429,24 +449,24 @@ void CPU::validateSegmentLoad(SegmentRegisterIndex reg, WORD selector, const Des
         || reg == SegmentRegisterIndex::FS
         || reg == SegmentRegisterIndex::GS) {
         if (!descriptor.isData() && (descriptor.isCode() && !descriptor.asCodeSegmentDescriptor().readable())) {
-            throw GeneralProtectionFault(selector & 0xfffc, QString("%1 loaded with non-data or non-readable code segment").arg(registerName(reg)));
+            throw GeneralProtectionFault(selector & 0xfffc, "%s loaded with non-data or non-readable code segment", registerName(reg));
         }
         if (descriptor.isData() || descriptor.isNonconformingCode()) {
             if (selectorRPL > descriptor.DPL()) {
-                throw GeneralProtectionFault(selector & 0xfffc, QString("%1 loaded with data or non-conforming code segment and RPL > DPL").arg(registerName(reg)));
+                throw GeneralProtectionFault(selector & 0xfffc, "%s loaded with data or non-conforming code segment and RPL > DPL", registerName(reg));
             }
             if (getCPL() > descriptor.DPL()) {
-                throw GeneralProtectionFault(selector & 0xfffc, QString("%1 loaded with data or non-conforming code segment and CPL > DPL").arg(registerName(reg)));
+                throw GeneralProtectionFault(selector & 0xfffc, "%s loaded with data or non-conforming code segment and CPL > DPL", registerName(reg));
             }
         }
         if (!descriptor.present()) {
-            throw NotPresent(selector & 0xfffc, QString("%1 loaded with non-present segment").arg(registerName(reg)));
+            throw NotPresent(selector & 0xfffc, "%s loaded with non-present segment", registerName(reg));
         }
     }
 
     if (!descriptor.isNull() && !descriptor.isSegmentDescriptor()) {
         dumpDescriptor(descriptor);
-        throw GeneralProtectionFault(selector & 0xfffc, QString("%1 loaded with system segment").arg(registerName(reg)));
+        throw GeneralProtectionFault(selector & 0xfffc, "%s loaded with system segment", registerName(reg));
     }
 }
 
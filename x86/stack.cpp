@@ -200,15 +200,25 @@ void CPU::_PUSH_imm32(Instruction& insn)
 
 void CPU::_PUSHF(Instruction&)
 {
-    if (getPE() && getVM() && getIOPL() < 3)
-        throw GeneralProtectionFault(0, "PUSHF in VM86 mode with IOPL < 3");
+    if (getPE() && getVM() && getIOPL() < 3) {
+        if (!getVME())
+            throw GeneralProtectionFault(0, "PUSHF in VM86 mode with IOPL < 3");
+        push16(virtualizedFlags());
+        return;
+    }
     push16(getFlags());
 }
 
 void CPU::_POPF(Instruction&)
 {
-    if (getPE() && getVM() && getIOPL() < 3)
-        throw GeneralProtectionFault(0, "POPF in VM86 mode with IOPL < 3");
+    if (getPE() && getVM() && getIOPL() < 3) {
+        if (!getVME())
+            throw GeneralProtectionFault(0, "POPF in VM86 mode with IOPL < 3");
+        TransactionalPopper popper(*this);
+        setVirtualizedFlags(popper.pop16());
+        popper.commit();
+        return;
+    }
     setEFlagsRespectfully(pop16(), getCPL());
 }
 
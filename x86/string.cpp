@@ -23,7 +23,10 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "CPU.h"
+#include "machine.h"
 #include "pic.h"
+#include "MemoryProvider.h"
+#include <algorithm>
 
 template<typename F>
 void CPU::doOnceOrRepeatedly(Instruction& insn, bool careAboutZF, F func)
@@ -57,9 +60,61 @@ void CPU::doLODS(Instruction& insn)
     });
 }
 
+// REP STOS/MOVS into a memory provider (i.e VGA memory) in real or V86 mode without paging.
+// Whole blocks are handed to the provider; anything else (offset wraparound, the end of the
+// provider, a source that isn't plain RAM) is left for the regular element-by-element loop.
+template<typename T>
+void CPU::doBulkStringWrite(bool isMOVS)
+{
+    static const DWORD chunkSize = 4096;
+    BYTE chunk[chunkSize];
+
+    if (getDF() || getPG() || (getPE() && !getVM()) || a32())
+        return;
+
+    while (getCX()) {
+        if (getIF() && PIC::hasPendingIRQ() && !PIC::isIgnoringAllIRQs())
+            throw HardwareInterruptDuringREP();
+
+        DWORD destination = cachedDescriptor(SegmentRegisterIndex::ES).linearAddress(getDI()).get();
+        auto* provider = memoryProviderForAddress(PhysicalAddress(destination));
+        if (!provider)
+            return;
+
+        DWORD length = std::min<DWORD>({ getCX() * (DWORD)sizeof(T), chunkSize, 0x10000u - getDI(), provider->baseAddress().get() + provider->size() - destination });
+        if (isMOVS)
+            length = std::min<DWORD>(length, 0x10000u - getSI());
+        length -= length % sizeof(T);
+        if (!length)
+            return;
+
+        if (isMOVS) {
+            DWORD source = cachedDescriptor(currentSegment()).linearAddress(getSI()).get();
+            // With A20 off, a source at or past 1 MiB wraps around; leave that to the element-wise loop.
+            if (!isA20Enabled() && source + length > 0x100000)
+                return;
+            if (source + length > m_memorySize || memoryProviderForAddress(PhysicalAddress(source)) || memoryProviderForAddress(PhysicalAddress(source + length - 1)))
+                return;
+            memcpy(chunk, m_memory + source, length);
+            setSI(getSI() + length);
+        } else {
+            T value = readRegister<T>(RegisterAL);
+            for (DWORD i = 0; i < length; i += sizeof(T))
+                memcpy(chunk + i, &value, sizeof(T));
+        }
+
+        provider->writeMemoryBlock(destination, chunk, length);
+        setDI(getDI() + length);
+        setCX(getCX() - length / sizeof(T));
+        m_cycle += length / sizeof(T);
+    }
+}
+
 template<typename T>
 void CPU::doSTOS(Instruction& insn)
 {
+    if (insn.hasRepPrefix())
+        doBulkStringWrite<T>(false);
     doOnceOrRepeatedly(insn, false, [this] () {
         writeMemory<T>(SegmentRegisterIndex::ES, readRegisterForAddressSize(RegisterDI), readRegister<T>(RegisterAL));
         stepRegisterForAddressSize(RegisterDI, sizeof(T));
@@ -93,6 +148,8 @@ void CPU::doSCAS(Instruction& insn)
 template<typename T>
 void CPU::doMOVS(Instruction& insn)
 {
+    if (insn.hasRepPrefix())
+        doBulkStringWrite<T>(true);
     doOnceOrRepeatedly(insn, false, [this] () {
         T tmp = readMemory<T>(currentSegment(), readRegisterForAddressSize(RegisterSI));
         writeMemory<T>(SegmentRegisterIndex::ES, readRegisterForAddressSize(RegisterDI), tmp);
@@ -101,9 +158,42 @@ void CPU::doMOVS(Instruction& insn)
     });
 }
 
+template<typename T>
+void CPU::doStreamedOUTS()
+{
+    // Same as the plain REP loop below, except that the port sees each chunk of elements in one call.
+    static const unsigned chunkSize = 256;
+    T chunk[chunkSize];
+    WORD port = getDX();
+    if (readRegisterForAddressSize(RegisterCX))
+        validateIOAccess<T>(port);
+    while (readRegisterForAddressSize(RegisterCX)) {
+        if (getIF() && PIC::hasPendingIRQ() && !PIC::isIgnoringAllIRQs())
+            throw HardwareInterruptDuringREP();
+        unsigned count = 0;
+        try {
+            while (count < chunkSize && readRegisterForAddressSize(RegisterCX)) {
+                chunk[count] = readMemory<T>(currentSegment(), readRegisterForAddressSize(RegisterSI));
+                ++count;
+                ++m_cycle;
+                stepRegisterForAddressSize(RegisterSI, sizeof(T));
+                decrementCXForAddressSize();
+            }
+        } catch (...) {
+            machine().ioPortBus().outStream<T>(port, chunk, count);
+            throw;
+        }
+        machine().ioPortBus().outStream<T>(port, chunk, count);
+    }
+}
+
 template<typename T>
 void CPU::doOUTS(Instruction& insn)
 {
+    if (insn.hasRepPrefix() && !options.iopeek && machine().ioPortBus().hasOutputStream(getDX())) {
+        doStreamedOUTS<T>();
+        return;
+    }
     doOnceOrRepeatedly(insn, false, [this] () {
         T data = readMemory<T>(currentSegment(), readRegisterForAddressSize(RegisterSI));
         out<T>(getDX(), data);